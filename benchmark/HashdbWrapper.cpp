@@ -84,15 +84,43 @@ namespace benchmark {
 		}
 	}
 
+	namespace {
+
+		// Compares the value in the database page with the expected value, so that no copy is made.
+		class ComparingValueVisitor : public IValueVisitor {
+		public:
+			ComparingValueVisitor(const std::string& expectedValue)
+				: expectedValue_(expectedValue)
+				, equal_(true)
+			{ }
+
+			virtual bool visit(const boost::string_ref& valuePart, size_t offset, size_t valueSize)
+			{
+				equal_ = equal_ && valueSize == expectedValue_.size() && boost::string_ref(expectedValue_).substr(offset, valuePart.size()) == valuePart;
+				return equal_;
+			}
+
+			bool equal() const
+			{
+				return equal_;
+			}
+
+		private:
+			const std::string& expectedValue_;
+			bool equal_;
+		};
+
+	};
+
 	void HashdbWapper::checkedFetch(size_type number, const std::string& key, const std::string& expectedValue)
 	{
-		std::string actualValue;
+		ComparingValueVisitor visitor(expectedValue);
 
-		if (! database_->fetch(key, 0, actualValue)) {
+		if (! database_->fetch(key, 0, visitor)) {
 			RAISE_BENCHMARK_EXCEPTION("unable to fetch value for key number %u", number);
 		}
 
-		if (expectedValue != actualValue) {
+		if (! visitor.equal()) {
 			RAISE_BENCHMARK_EXCEPTION("unexpected value for key number %u", number);
 		}
 	}
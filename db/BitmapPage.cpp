@@ -129,6 +129,32 @@ namespace hashdb {
 		return allocatedPageOffset;
 	}
 
+	uint32_t BitmapPage::acquirePageBelow(uint32_t endPageOffset)
+	{
+		const uint32_t seekStart = getSeekStart();
+		RAISE_INTERNAL_ERROR_IF_ARG(seekStart > numberOfManagedPages() || endPageOffset > numberOfManagedPages());
+
+		const uint32_t* const mapBegin = constData32() + (HEADER_DATA_END_OFFSET >> 2);
+		const uint32_t* const mapEnd   = mapBegin + ((endPageOffset + 31) / 32);
+		uint32_t allocatedPageOffset = NO_SPACE;
+
+		for (const uint32_t* ii = mapBegin + (seekStart / 32); ii < mapEnd; ++ii) {
+			if (*ii != 0xffffffff) {
+				// Pages are acquired in ascending order, so no free page below the offset remains.
+				const uint32_t freePageOffset = static_cast<uint32_t>((ii - mapBegin) * 32 + firstZeroInWord(*ii));
+
+				if (freePageOffset < endPageOffset) {
+					allocatedPageOffset = acquireAllocationBit(mapBegin, ii);
+					setSeekStart(allocatedPageOffset + 1);
+				}
+
+				break;
+			}
+		}
+
+		return allocatedPageOffset;
+	}
+
 	void BitmapPage::releasePage(uint32_t pageOffset)
 	{
 		RAISE_INTERNAL_ERROR_IF_ARG(pageOffset >= numberOfManagedPages());
@@ -146,5 +172,44 @@ namespace hashdb {
 		}
 	}
 
+	//----------------------------------------------------------------------------
+	// Acquired pages.
+
+	size_type BitmapPage::numberOfAcquiredPages() const
+	{
+		const uint32_t* const mapBegin = constData32() + (HEADER_DATA_END_OFFSET >> 2);
+		const uint32_t* const mapEnd   = constData32() + (size() >> 2);
+		size_type acquiredPages = 0;
+
+		for (const uint32_t* ii = mapBegin; ii != mapEnd; ++ii) {
+			for (uint32_t word = *ii; word != 0; word &= word - 1) {
+				++acquiredPages;
+			}
+		}
+
+		return acquiredPages;
+	}
+
+	uint32_t BitmapPage::highestAcquiredPage() const
+	{
+		const uint32_t* const mapBegin = constData32() + (HEADER_DATA_END_OFFSET >> 2);
+		const uint32_t* const mapEnd   = constData32() + (size() >> 2);
+
+		for (const uint32_t* ii = mapEnd; ii != mapBegin; ) {
+			const uint32_t word = *--ii;
+
+			if (word != 0) {
+				uint32_t bitNumber = 31;
+				while ((word & (1U << bitNumber)) == 0) {
+					--bitNumber;
+				}
+
+				return (static_cast<uint32_t>(ii - mapBegin) * 32) + bitNumber;
+			}
+		}
+
+		return NO_SPACE;
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
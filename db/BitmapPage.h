@@ -83,8 +83,14 @@ namespace hashdb {
 		size_type numberOfManagedPages() const;
 
 		uint32_t acquirePage(uint32_t nearPageOffset = 0);
+		uint32_t acquirePageBelow(uint32_t endPageOffset); // lowest free page below the offset
 		void releasePage(uint32_t pageOffset);
 
+		// Acquired pages.
+	public:
+		size_type numberOfAcquiredPages() const;
+		uint32_t highestAcquiredPage() const;
+
 	private:
 		size_type firstZeroInWord(uint32_t word) const;
 		uint32_t acquireAllocationBit(const uint32_t* const mapBegin, const uint32_t* freeAreaPtr);
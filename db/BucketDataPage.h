@@ -41,7 +41,23 @@ namespace hashdb {
 
 		}
 
+		BucketDataPage(const IPageAllocator::PageMemoryPtr& memory, size_type size) 
+			: DataPage(memory, size)
+		{
+
+		}
+
 		virtual uint32_t magic() const
+		{
+			return HASHED_BUCKET_DATA_MAGIC;
+		}
+
+		virtual uint32_t taggedMagic() const
+		{
+			return TAGGED_BUCKET_DATA_MAGIC;
+		}
+
+		virtual uint32_t untaggedMagic() const
 		{
 			return BUCKET_DATA_MAGIC;
 		}
@@ -47,6 +47,29 @@ namespace hashdb {
 		const uint64_t numberOfRecords = getDatabaseNumberOfRecords();
 		const uint64_t dataSize = getDataSize();
 		RAISE_DATABASE_CORRUPTED_IF(numberOfRecords * 5 > dataSize, "data size %u too small for %u records on %s", dataSize, numberOfRecords, getId().toString());
+
+		// Bucket 0 is never created by a split.
+		RAISE_DATABASE_CORRUPTED_IF(getSplitPosition() != 0 && (highestBucketNumber == 0 || highestBucketNumber == static_cast<uint32_t>(-1)), "split in progress with highest bucket number %u on %s", highestBucketNumber, getId().toString());
+	}
+
+	uint32_t BucketHeaderPage::getSplitPosition() const
+	{
+		return get32unchecked(SPLIT_POSITION_OFFSET);
+	}
+
+	void BucketHeaderPage::setSplitPosition(uint32_t splitPosition)
+	{
+		put32unchecked(SPLIT_POSITION_OFFSET, splitPosition);
+	}
+
+	uint32_t BucketHeaderPage::getHashFunction() const
+	{
+		return get32unchecked(HASH_FUNCTION_OFFSET);
+	}
+
+	void BucketHeaderPage::setHashFunction(uint32_t hashFunction)
+	{
+		put32unchecked(HASH_FUNCTION_OFFSET, hashFunction);
 	}
 
 }; // namespace hashdb
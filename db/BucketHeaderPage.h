@@ -33,6 +33,20 @@ namespace kerio {
 namespace hashdb {
 
 	class BucketHeaderPage : public HeaderPage { // intentionally copyable
+		// Bucket file header page extends the common header with the state of an incremental split:
+		// offset size accessors field
+		// 56     4    SplitPosition: 0 if no split is in progress, otherwise 1 + index of the page in the chain of the bucket being split
+		//             where moving of records to the highest bucket continues
+		//
+		// 60     4    HashFunction: Options::HashFunction_t of the built-in hash function which created the database,
+		//             0 if the function is not built-in
+		//
+		// Pages created by older versions have the fields cleared, so no split is in progress and the hash function
+		// is checked only by the test hash.
+
+		static const uint16_t SPLIT_POSITION_OFFSET = HEADER_DATA_END;
+		static const uint16_t HASH_FUNCTION_OFFSET = HEADER_DATA_END + 4;
+
 	public:
 		BucketHeaderPage(IPageAllocator* allocator, size_type size) 
 			: HeaderPage(allocator, size)
@@ -51,6 +65,13 @@ namespace hashdb {
 		}
 
 		virtual void validate() const;
+
+		// Field accessors.
+		uint32_t getSplitPosition() const;
+		void setSplitPosition(uint32_t splitPosition);
+
+		uint32_t getHashFunction() const;
+		void setHashFunction(uint32_t hashFunction);
 	};
 
 }; // namespace hashdb
@@ -0,0 +1,360 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// BulkLoadRuns.cpp - records of a bulk load sorted by bucket in memory and in temporary run files.
+#include "stdafx.h"
+#include <algorithm>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "utils/ExceptionCreator.h"
+#include "DataPageCursor.h"
+#include "OpenFiles.h"
+#include "BulkLoadRuns.h"
+
+namespace kerio {
+namespace hashdb {
+
+	namespace {
+
+		// Run file record: bucket (4), sequence (4), key hash (4), inline record size (2), inline record.
+		const size_type RUN_RECORD_HEADER_SIZE = 14;
+
+		uint32_t getLittleEndian(const char* data, size_type size)
+		{
+			uint32_t value = 0;
+
+			for (size_type i = size; i != 0; --i) {
+				value = (value << 8) | static_cast<uint8_t>(data[i - 1]);
+			}
+
+			return value;
+		}
+
+		void putLittleEndian(char* data, size_type size, uint32_t value)
+		{
+			for (size_type i = 0; i < size; ++i) {
+				data[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+			}
+		}
+
+	};
+
+	//----------------------------------------------------------------------------
+	// Record of a bulk load.
+
+	BulkLoadRecord::BulkLoadRecord()
+		: sequence_(0)
+		, keyHash_(0)
+	{
+
+	}
+
+	BulkLoadRecord::BulkLoadRecord(uint32_t sequence, uint32_t keyHash, const boost::string_ref& inlineRecord)
+		: sequence_(sequence)
+		, keyHash_(keyHash)
+		, inlineRecord_(inlineRecord.data(), inlineRecord.size())
+	{
+
+	}
+
+	uint32_t BulkLoadRecord::sequence() const
+	{
+		return sequence_;
+	}
+
+	uint32_t BulkLoadRecord::keyHash() const
+	{
+		return keyHash_;
+	}
+
+	boost::string_ref BulkLoadRecord::inlineRecord() const
+	{
+		return inlineRecord_;
+	}
+
+	boost::string_ref BulkLoadRecord::recordIdValue() const
+	{
+		const size_type recordIdSize = static_cast<uint8_t>(inlineRecord_[0]) + 2; // key size (1) + key + part number (1)
+		return boost::string_ref(inlineRecord_.data(), recordIdSize);
+	}
+
+	boost::string_ref BulkLoadRecord::key() const
+	{
+		return boost::string_ref(inlineRecord_.data() + 1, static_cast<uint8_t>(inlineRecord_[0]));
+	}
+
+	bool BulkLoadRecord::isLargeValue() const
+	{
+		const size_type valueSizeOffset = static_cast<size_type>(recordIdValue().size());
+		return getLittleEndian(inlineRecord_.data() + valueSizeOffset, 2) == DataPageCursor::INVALID_INLINE_VALUE_SIZE;
+	}
+
+	size_type BulkLoadRecord::largeValueSize() const
+	{
+		const size_type infoOffset = static_cast<size_type>(recordIdValue().size()) + 2;
+		return getLittleEndian(inlineRecord_.data() + infoOffset, 4);
+	}
+
+	PageId BulkLoadRecord::firstLargeValuePageId() const
+	{
+		const size_type infoOffset = static_cast<size_type>(recordIdValue().size()) + 2;
+		return overflowFilePage(getLittleEndian(inlineRecord_.data() + infoOffset + 4, 4));
+	}
+
+	bool BulkLoadRecord::operator<(const BulkLoadRecord& right) const
+	{
+		const int compared = recordIdValue().compare(right.recordIdValue());
+		return (compared != 0)? (compared < 0) : (sequence_ < right.sequence_);
+	}
+
+	//----------------------------------------------------------------------------
+	// Reader of a run file.
+
+	class BulkLoadRunReader : boost::noncopyable {
+	public:
+		BulkLoadRunReader(const boost::filesystem::path& fileName)
+			: fileName_(fileName)
+			, file_(fileName.string().c_str(), std::ios::binary)
+			, isValid_(false)
+			, bucket_(0)
+		{
+			RAISE_IO_ERROR_IF(! file_, "unable to open bulk load run file \"%s\"", fileName_.string());
+			next();
+		}
+
+		bool isValid() const
+		{
+			return isValid_;
+		}
+
+		uint32_t bucket() const
+		{
+			return bucket_;
+		}
+
+		const BulkLoadRecord& record() const
+		{
+			return record_;
+		}
+
+		void next()
+		{
+			char header[RUN_RECORD_HEADER_SIZE];
+			isValid_ = file_.read(header, sizeof(header)).good();
+
+			if (isValid_) {
+				const size_type size = getLittleEndian(header + 12, 2);
+				inlineRecord_.resize(size);
+				RAISE_IO_ERROR_IF(size == 0 || ! file_.read(&inlineRecord_[0], size), "unable to read bulk load run file \"%s\"", fileName_.string());
+
+				bucket_ = getLittleEndian(header, 4);
+				record_ = BulkLoadRecord(getLittleEndian(header + 4, 4), getLittleEndian(header + 8, 4), inlineRecord_);
+			}
+			else {
+				RAISE_IO_ERROR_IF(! file_.eof() || file_.gcount() != 0, "unable to read bulk load run file \"%s\"", fileName_.string());
+			}
+		}
+
+	private:
+		const boost::filesystem::path fileName_;
+		std::ifstream file_;
+
+		bool isValid_;
+		uint32_t bucket_;
+		std::string inlineRecord_;
+		BulkLoadRecord record_;
+	};
+
+	//----------------------------------------------------------------------------
+	// Ctor and dtor.
+
+	BulkLoadRuns::BulkLoadRuns(const boost::filesystem::path& database, const MetaData& metaData, size_type bufferBytes)
+		: database_(database)
+		, metaData_(metaData)
+		, bufferBytes_(bufferBytes)
+		, nextBufferedRecord_(0)
+		, nextSequence_(0)
+		, numberOfRecords_(0)
+		, dataInlineSize_(0)
+	{
+
+	}
+
+	BulkLoadRuns::~BulkLoadRuns()
+	{
+		try {
+			removeRunFiles();
+		} catch (std::exception&) {
+			// Ignore.
+		}
+	}
+
+	void BulkLoadRuns::removeRunFiles()
+	{
+		runReaders_.clear();
+
+		for (std::vector<boost::filesystem::path>::const_iterator ii = runFileNames_.begin(); ii != runFileNames_.end(); ++ii) {
+			boost::system::error_code removeError;
+			boost::filesystem::remove(*ii, removeError);
+		}
+
+		runFileNames_.clear();
+	}
+
+	//----------------------------------------------------------------------------
+	// Adding records.
+
+	void BulkLoadRuns::add(const RecordId& recordId, uint32_t keyHash, const DataPage::AddedValueRef& valueRef)
+	{
+		RAISE_INTERNAL_ERROR_IF(! runReaders_.empty(), "unable to add a bulk loaded record after reading has started");
+
+		const boost::string_ref value = valueRef.value();
+		const size_type recordInlineSize = recordId.recordOverheadSize() + static_cast<size_type>(value.size());
+		const uint32_t sequence = nextSequence_++;
+		RAISE_INVALID_ARGUMENT_IF(nextSequence_ == 0, "bulk load is full: record numbers exhausted");
+
+		BufferedRecord bufferedRecord;
+		bufferedRecord.bucket_ = 0; // Assigned when the buffer is sorted.
+		bufferedRecord.sequence_ = sequence;
+		bufferedRecord.keyHash_ = keyHash;
+		bufferedRecord.offset_ = static_cast<size_type>(buffer_.size());
+		bufferedRecord.size_ = static_cast<uint16_t>(recordInlineSize);
+
+		char valueSizeOrTag[2];
+		putLittleEndian(valueSizeOrTag, sizeof(valueSizeOrTag), valueRef.valueSizeOrTag());
+
+		buffer_.append(reinterpret_cast<const char*>(recordId.data()), recordId.size());
+		buffer_.append(valueSizeOrTag, sizeof(valueSizeOrTag));
+		buffer_.append(value.data(), value.size());
+		bufferedRecords_.push_back(bufferedRecord);
+
+		++numberOfRecords_;
+		dataInlineSize_ += recordInlineSize;
+	}
+
+	bool BulkLoadRuns::isBufferFull() const
+	{
+		return buffer_.size() >= bufferBytes_;
+	}
+
+	void BulkLoadRuns::writeRun()
+	{
+		sortBuffer();
+
+		const boost::filesystem::path fileName = OpenFiles::databaseNameToBulkLoadRunFileName(database_, static_cast<size_type>(runFileNames_.size()));
+		runFileNames_.push_back(fileName);
+
+		std::ofstream file(fileName.string().c_str(), std::ios::binary | std::ios::trunc);
+		RAISE_IO_ERROR_IF(! file, "unable to create bulk load run file \"%s\"", fileName.string());
+
+		for (std::vector<BufferedRecord>::const_iterator ii = bufferedRecords_.begin(); ii != bufferedRecords_.end(); ++ii) {
+			char header[RUN_RECORD_HEADER_SIZE];
+			putLittleEndian(header, 4, ii->bucket_);
+			putLittleEndian(header + 4, 4, ii->sequence_);
+			putLittleEndian(header + 8, 4, ii->keyHash_);
+			putLittleEndian(header + 12, 2, ii->size_);
+
+			const boost::string_ref recordData = bufferedRecordData(*ii);
+			file.write(header, sizeof(header));
+			file.write(recordData.data(), recordData.size());
+		}
+
+		file.close();
+		RAISE_IO_ERROR_IF(! file, "unable to write bulk load run file \"%s\"", fileName.string());
+
+		buffer_.clear();
+		bufferedRecords_.clear();
+	}
+
+	bool BulkLoadRuns::hasRuns() const
+	{
+		return ! runFileNames_.empty();
+	}
+
+	uint64_t BulkLoadRuns::numberOfRecords() const
+	{
+		return numberOfRecords_;
+	}
+
+	uint64_t BulkLoadRuns::dataInlineSize() const
+	{
+		return dataInlineSize_;
+	}
+
+	void BulkLoadRuns::sortBuffer()
+	{
+		for (std::vector<BufferedRecord>::iterator ii = bufferedRecords_.begin(); ii != bufferedRecords_.end(); ++ii) {
+			ii->bucket_ = metaData_.bucketForHash(ii->keyHash_);
+		}
+
+		std::sort(bufferedRecords_.begin(), bufferedRecords_.end());
+	}
+
+	boost::string_ref BulkLoadRuns::bufferedRecordData(const BufferedRecord& record) const
+	{
+		return boost::string_ref(buffer_.data() + record.offset_, record.size_);
+	}
+
+	//----------------------------------------------------------------------------
+	// Reading records by bucket.
+
+	void BulkLoadRuns::startReading()
+	{
+		RAISE_INTERNAL_ERROR_IF(! runReaders_.empty(), "reading of bulk loaded records has already started");
+
+		sortBuffer();
+		nextBufferedRecord_ = 0;
+
+		for (std::vector<boost::filesystem::path>::const_iterator ii = runFileNames_.begin(); ii != runFileNames_.end(); ++ii) {
+			runReaders_.push_back(boost::shared_ptr<BulkLoadRunReader>(new BulkLoadRunReader(*ii)));
+		}
+	}
+
+	void BulkLoadRuns::readBucket(uint32_t bucketNumber, BulkLoadRecords_t& records)
+	{
+		records.clear();
+
+		for (std::vector<boost::shared_ptr<BulkLoadRunReader> >::iterator ii = runReaders_.begin(); ii != runReaders_.end(); ++ii) {
+			BulkLoadRunReader& reader = **ii;
+			RAISE_INTERNAL_ERROR_IF(reader.isValid() && reader.bucket() < bucketNumber, "bulk loaded records of bucket %u were skipped", reader.bucket());
+
+			while (reader.isValid() && reader.bucket() == bucketNumber) {
+				records.push_back(reader.record());
+				reader.next();
+			}
+		}
+
+		while (nextBufferedRecord_ < bufferedRecords_.size() && bufferedRecords_[nextBufferedRecord_].bucket_ == bucketNumber) {
+			const BufferedRecord& bufferedRecord = bufferedRecords_[nextBufferedRecord_];
+			records.push_back(BulkLoadRecord(bufferedRecord.sequence_, bufferedRecord.keyHash_, bufferedRecordData(bufferedRecord)));
+			++nextBufferedRecord_;
+		}
+
+		RAISE_INTERNAL_ERROR_IF(nextBufferedRecord_ < bufferedRecords_.size() && bufferedRecords_[nextBufferedRecord_].bucket_ < bucketNumber, "bulk loaded records of bucket %u were skipped", bufferedRecords_[nextBufferedRecord_].bucket_);
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,120 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// BulkLoadRuns.h - records of a bulk load sorted by bucket in memory and in temporary run files.
+#pragma once
+#include <boost/filesystem/path.hpp>
+#include "DataPage.h"
+#include "MetaData.h"
+#include "RecordId.h"
+
+namespace kerio {
+namespace hashdb {
+
+	class BulkLoadRecord { // intentionally copyable
+	public:
+		BulkLoadRecord();
+		BulkLoadRecord(uint32_t sequence, uint32_t keyHash, const boost::string_ref& inlineRecord);
+
+		uint32_t sequence() const;
+		uint32_t keyHash() const;
+		boost::string_ref inlineRecord() const;
+		boost::string_ref recordIdValue() const;
+		boost::string_ref key() const;
+
+		bool isLargeValue() const;
+		size_type largeValueSize() const;
+		PageId firstLargeValuePageId() const;
+
+		bool operator<(const BulkLoadRecord& right) const;
+
+	private:
+		uint32_t sequence_;
+		uint32_t keyHash_;
+		std::string inlineRecord_;
+	};
+
+	typedef std::vector<BulkLoadRecord> BulkLoadRecords_t;
+
+	class BulkLoadRunReader;
+
+	class BulkLoadRuns : boost::noncopyable {
+		// Added records are buffered in memory. A full buffer is sorted by bucket and written to a run file,
+		// so the number of buckets must not change after the first run is written. Records of each bucket
+		// are then read from all runs and the buffer at once, in the order of buckets.
+	public:
+		BulkLoadRuns(const boost::filesystem::path& database, const MetaData& metaData, size_type bufferBytes);
+		~BulkLoadRuns();
+
+		// Adding records.
+		void add(const RecordId& recordId, uint32_t keyHash, const DataPage::AddedValueRef& valueRef);
+		bool isBufferFull() const;
+		void writeRun();
+		bool hasRuns() const;
+
+		uint64_t numberOfRecords() const;
+		uint64_t dataInlineSize() const;
+
+		// Reading records by bucket.
+		void startReading();
+		void readBucket(uint32_t bucketNumber, BulkLoadRecords_t& records);
+
+	private:
+		struct BufferedRecord { // intentionally copyable
+			uint32_t bucket_;
+			uint32_t sequence_;
+			uint32_t keyHash_;
+			size_type offset_;
+			uint16_t size_;
+
+			bool operator<(const BufferedRecord& right) const
+			{
+				return (bucket_ != right.bucket_)? (bucket_ < right.bucket_) : (sequence_ < right.sequence_);
+			}
+		};
+
+		void sortBuffer();
+		boost::string_ref bufferedRecordData(const BufferedRecord& record) const;
+		void removeRunFiles();
+
+		const boost::filesystem::path database_;
+		const MetaData& metaData_;
+		const size_type bufferBytes_;
+
+		std::string buffer_;
+		std::vector<BufferedRecord> bufferedRecords_;
+		size_t nextBufferedRecord_;
+
+		std::vector<boost::filesystem::path> runFileNames_;
+		std::vector<boost::shared_ptr<BulkLoadRunReader> > runReaders_;
+
+		uint32_t nextSequence_;
+		uint64_t numberOfRecords_;
+		uint64_t dataInlineSize_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,122 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// BulkLoaderImpl.cpp - implementation of the IBulkLoader interface.
+#include "stdafx.h"
+#include <kerio/hashdb/Constants.h>
+#include <kerio/hashdb/StringOrReference.h>
+#include "BulkLoaderImpl.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//-------------------------------------------------------------------------
+	// Construction & destruction.
+
+	BulkLoaderImpl::BulkLoaderImpl(boost::shared_ptr<OpenDatabase>& openDatabase, uint64_t expectedNumberOfRecords)
+		: expectedNumberOfRecords_(expectedNumberOfRecords)
+		, runs_(openDatabase->beginBulkLoad())
+		, finished_(false)
+		, openDatabaseWeakPtr_(openDatabase)
+	{
+
+	}
+
+	BulkLoaderImpl::~BulkLoaderImpl()
+	{
+		if (finished_) {
+			return;
+		}
+
+		try {
+			boost::shared_ptr<OpenDatabase> openDatabase(openDatabaseWeakPtr_.lock());
+
+			if (openDatabase) {
+				openDatabase->abortBulkLoad(*runs_);
+			}
+		} catch (std::exception&) {
+			// Ignore.
+		}
+	}
+
+	boost::shared_ptr<OpenDatabase> BulkLoaderImpl::lockOpenDatabase()
+	{
+		boost::shared_ptr<OpenDatabase> openDatabase(openDatabaseWeakPtr_.lock());
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase, "Referenced database is no longer open.");
+		RAISE_INVALID_ARGUMENT_IF(finished_, "bulk load is already finished");
+
+		return openDatabase;
+	}
+
+	//-------------------------------------------------------------------------
+	// Loading.
+
+	void BulkLoaderImpl::add(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value)
+	{
+		RAISE_INVALID_ARGUMENT_IF(key.size() > MAX_KEY_SIZE, "key too long");
+		RAISE_INVALID_ARGUMENT_IF(key.empty(), "empty key is not allowed");
+		RAISE_INVALID_ARGUMENT_IF(partNum > MAX_PARTNUM, "partNum is too large");
+		RAISE_INVALID_ARGUMENT_IF(partNum == ALL_PARTS, "partNum ALL_PARTS is not allowed");
+
+		boost::shared_ptr<OpenDatabase> openDatabase(lockOpenDatabase());
+		openDatabase->bulkLoadAdd(*runs_, expectedNumberOfRecords_, key, partNum, value);
+	}
+
+	void BulkLoaderImpl::add(const IWriteBatch& writeBatch)
+	{
+		const size_t batchSize = writeBatch.count();
+
+		for (size_t i = 0; i < batchSize; ++i) {
+			const size_type keySize = writeBatch.keyAt(i).size();
+			const partNum_t partNum = writeBatch.partNumAt(i);
+
+			RAISE_INVALID_ARGUMENT_IF(keySize > MAX_KEY_SIZE, "key at index %u too long", i);
+			RAISE_INVALID_ARGUMENT_IF(keySize == 0, "empty key at index %u is not allowed", i);
+			RAISE_INVALID_ARGUMENT_IF(partNum > MAX_PARTNUM, "partNum at index %u is too large", i);
+			RAISE_INVALID_ARGUMENT_IF(partNum == ALL_PARTS, "partNum ALL_PARTS at index %u is not allowed", i);
+		}
+
+		boost::shared_ptr<OpenDatabase> openDatabase(lockOpenDatabase());
+
+		for (size_t i = 0; i < batchSize; ++i) {
+			const StringOrReference keyHolder = writeBatch.keyAt(i);
+			const StringOrReference valueHolder = writeBatch.valueAt(i);
+
+			openDatabase->bulkLoadAdd(*runs_, expectedNumberOfRecords_, keyHolder.getRef(), writeBatch.partNumAt(i), valueHolder.getRef());
+		}
+	}
+
+	void BulkLoaderImpl::finish()
+	{
+		boost::shared_ptr<OpenDatabase> openDatabase(lockOpenDatabase());
+
+		finished_ = true;
+		openDatabase->finishBulkLoad(*runs_);
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
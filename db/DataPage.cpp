@@ -30,6 +30,11 @@
 #include "DataPageCursor.h"
 #include "DataPage.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASHDB_SSE2_HASH_TAG_SCAN
+#endif
+
 namespace kerio {
 namespace hashdb {
 
@@ -44,6 +49,7 @@ namespace hashdb {
 		setNextOverflowPage(0);
 		setNumberOfRecords(0);
 		setEndOfFreeArea(size());
+		deadRecords_ = 0;
 	}
 
 	void DataPage::validate() const
@@ -55,10 +61,51 @@ namespace hashdb {
 		RAISE_DATABASE_CORRUPTED_IF(endOfFreeArea < HEADER_DATA_END_OFFSET, "bad \"end of free area\" %u (page header ends at %u) on %s", endOfFreeArea, uint16_t(HEADER_DATA_END_OFFSET), getId().toString());
 
 		const uint16_t numberOfRecords = getNumberOfRecords();
-		const size_type maxRecords = (size() - HEADER_DATA_END_OFFSET) / 2;
+		const size_type maxRecords = (size() - HEADER_DATA_END_OFFSET) / slotSize();
 		RAISE_DATABASE_CORRUPTED_IF(numberOfRecords > maxRecords, "too many records (%u > %u) on %s", numberOfRecords, maxRecords, getId().toString());
 	}
 
+	bool DataPage::isKnownMagic(uint32_t pageMagic) const
+	{
+		return pageMagic == magic() || pageMagic == taggedMagic() || pageMagic == untaggedMagic();
+	}
+
+	//----------------------------------------------------------------------------
+	// Page format.
+
+	void DataPage::setUpTagged(uint32_t pageNumber)
+	{
+		setUp(pageNumber);
+		setMagic(taggedMagic());
+	}
+
+	void DataPage::setUpUntagged(uint32_t pageNumber)
+	{
+		setUp(pageNumber);
+		setMagic(untaggedMagic());
+	}
+
+	bool DataPage::hasHashTags() const
+	{
+		const uint32_t pageMagic = getMagic();
+		return pageMagic == TAGGED_BUCKET_DATA_MAGIC || pageMagic == TAGGED_OVERFLOW_DATA_MAGIC;
+	}
+
+	bool DataPage::hasKeyHashes() const
+	{
+		const uint32_t pageMagic = getMagic();
+		return pageMagic == HASHED_BUCKET_DATA_MAGIC || pageMagic == HASHED_OVERFLOW_DATA_MAGIC;
+	}
+
+	size_type DataPage::slotSize() const
+	{
+		if (hasKeyHashes()) {
+			return HASHED_SLOT_SIZE;
+		}
+
+		return (hasHashTags())? TAGGED_SLOT_SIZE : UNTAGGED_SLOT_SIZE;
+	}
+
 	//----------------------------------------------------------------------------
 	// Utilities for data access.
 
@@ -69,25 +116,135 @@ namespace hashdb {
 
 	size_type DataPage::largestPossibleInlineRecordSize() const
 	{
-		return dataSpace(size()) - sizeof(uint16_t);
+		return largestPossibleInlineRecordSize(size());
+	}
+
+	size_type DataPage::largestPossibleInlineRecordSize(size_type pageSize)
+	{
+		// Records stored by the current format fit to pages of any format. Records stored by older formats
+		// may be too large for hashed pages, see addMovedRecordToEmptyPage().
+		return dataSpace(pageSize) - HASHED_SLOT_SIZE;
 	}
 
 	size_type DataPage::freeSpace() const
 	{
-		const size_type recordPointerArraySize = getNumberOfRecords() * sizeof(uint16_t);
+		const size_type recordPointerArraySize = getNumberOfRecords() * slotSize();
 		const size_type bytesfree = getEndOfFreeArea() - (HEADER_DATA_END_OFFSET + recordPointerArraySize);
 		
 		RAISE_DATABASE_CORRUPTED_IF(bytesfree > size(), "free area %u > page size %u on %s", bytesfree, size(), getId().toString());
 		return bytesfree;
 	}
 
-	void DataPage::addRecordOffset(size_type keyOffset)
+	void DataPage::addRecordOffset(size_type keyOffset, uint32_t keyHash)
 	{
 		const uint16_t numberOfRecords = getNumberOfRecords();
 		setRecordOffsetAt(numberOfRecords, keyOffset);
+
+		if (hasKeyHashes()) {
+			setKeyHashAt(numberOfRecords, keyHash);
+		}
+		else if (hasHashTags()) {
+			setHashTagAt(numberOfRecords, RecordId::hashTagFor(keyHash));
+		}
+
 		setNumberOfRecords(numberOfRecords + 1);
 	}
 
+	uint16_t DataPage::findKeyHash(uint32_t keyHash, uint16_t fromIndex) const
+	{
+		if (hasKeyHashes()) {
+			return findHashedSlot(keyHash, fromIndex);
+		}
+
+		if (hasHashTags()) {
+			return findTaggedSlot(RecordId::hashTagFor(keyHash), fromIndex);
+		}
+
+		// Any record of an untagged page may have the key.
+		return fromIndex;
+	}
+
+	uint16_t DataPage::findHashedSlot(uint32_t keyHash, uint16_t fromIndex) const
+	{
+		const uint16_t numberOfRecords = getNumberOfRecords();
+		uint16_t index = fromIndex;
+
+#if defined(HASHDB_SSE2_HASH_TAG_SCAN)
+		// Compare upper halves of the key hashes of 8 slots (3 loads) at once, the whole key hash is compared only for matching slots.
+		// The upper half of a key hash is the 16-bit word at offset 4 of the slot.
+		static const uint16_t SLOTS_PER_SCAN = static_cast<uint16_t>((3 * sizeof(__m128i)) / HASHED_SLOT_SIZE);
+		static const uint64_t UPPER_HALF_MASK = 0x410410410410ULL; // first byte of the upper half of each slot
+
+		const value_type* slots = constData() + HEADER_DATA_END_OFFSET;
+		const __m128i searchedHalves = _mm_set1_epi16(static_cast<short>(keyHash >> 16));
+
+		for (; index + SLOTS_PER_SCAN <= numberOfRecords; index += SLOTS_PER_SCAN) {
+			const value_type* scannedSlots = slots + (index * HASHED_SLOT_SIZE);
+			uint64_t matchMask = 0;
+
+			for (int i = 0; i < 3; ++i) {
+				const __m128i slotWords = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scannedSlots + (i * sizeof(__m128i))));
+				const uint64_t matchedBytes = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(slotWords, searchedHalves)));
+				matchMask |= matchedBytes << (i * sizeof(__m128i));
+			}
+
+			matchMask &= UPPER_HALF_MASK;
+
+			for (uint16_t slot = 0; matchMask != 0; ++slot, matchMask >>= HASHED_SLOT_SIZE) {
+				if ((matchMask & (1 << 4)) != 0 && getKeyHashAt(index + slot) == keyHash) {
+					return index + slot;
+				}
+			}
+		}
+#endif
+
+		for (; index < numberOfRecords; ++index) {
+			if (getKeyHashAt(index) == keyHash) {
+				break;
+			}
+		}
+
+		return index;
+	}
+
+	uint16_t DataPage::findTaggedSlot(uint16_t hashTag, uint16_t fromIndex) const
+	{
+		const uint16_t numberOfRecords = getNumberOfRecords();
+		uint16_t index = fromIndex;
+
+#if defined(HASHDB_SSE2_HASH_TAG_SCAN)
+		// Compare tags of 4 slots at once. A slot read as little endian 32-bit word has the tag in the upper half.
+		static const uint16_t SLOTS_PER_SCAN = static_cast<uint16_t>(sizeof(__m128i) / TAGGED_SLOT_SIZE);
+
+		const value_type* slots = constData() + HEADER_DATA_END_OFFSET;
+		const __m128i searchedTags = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(hashTag) << 16));
+		const __m128i tagMask = _mm_set1_epi32(static_cast<int>(0xffff0000));
+
+		for (; index + SLOTS_PER_SCAN <= numberOfRecords; index += SLOTS_PER_SCAN) {
+			const __m128i slotWords = _mm_loadu_si128(reinterpret_cast<const __m128i*>(slots + (index * TAGGED_SLOT_SIZE)));
+			const __m128i matches = _mm_cmpeq_epi32(_mm_and_si128(slotWords, tagMask), searchedTags);
+			const int matchMask = _mm_movemask_ps(_mm_castsi128_ps(matches));
+
+			if (matchMask != 0) {
+				uint16_t slot = 0;
+				while ((matchMask & (1 << slot)) == 0) {
+					++slot;
+				}
+
+				return index + slot;
+			}
+		}
+#endif
+
+		for (; index < numberOfRecords; ++index) {
+			if (get16unchecked(HEADER_DATA_END_OFFSET + (index * TAGGED_SLOT_SIZE) + sizeof(uint16_t)) == hashTag) {
+				break;
+			}
+		}
+
+		return index;
+	}
+
 	//----------------------------------------------------------------------------
 	// Adding data.
 
@@ -113,32 +270,19 @@ namespace hashdb {
 		return valueReference_;
 	}
 
-	size_type DataPage::addSingleRecord(const RecordId& recordId, const AddedValueRef& valueRef)
+	size_type DataPage::addSingleRecord(const RecordId& recordId, uint32_t keyHash, const AddedValueRef& valueRef)
 	{
 		const size_type valueInlineSize = static_cast<size_type>(valueRef.value().size());
 		const size_type recordInlineSize = recordId.recordOverheadSize() + valueInlineSize; // record overhead (record id size + inline value size (2)) + value or large value reference.
-		const bool canAdd = freeSpace() >= sizeof(uint16_t) + recordId.recordOverheadSize() + valueInlineSize; // record pointer (2) + record.
+		const bool canAdd = makeFreeSpace(slotSize() + recordId.recordOverheadSize() + valueInlineSize); // record slot (2, 4 or 6) + record.
 
 		if (canAdd) {
-			// Compute offsets.
-			const size_type endOfFreeArea = getEndOfFreeArea();
-
-			const size_type keyOffset = endOfFreeArea - recordInlineSize;
-			const size_type valueOffset = endOfFreeArea - valueInlineSize;
-			const size_type valueSizeOffset = valueOffset - sizeof(uint16_t);
-
 			// Copy the key, value size and value.
-			putBytes(keyOffset, recordId.value());
-
-			const uint16_t valueSizeOrTag = valueRef.valueSizeOrTag();
-			this->operator[](valueSizeOffset)     = (valueSizeOrTag & 0xff);
-			this->operator[](valueSizeOffset + 1) = ((valueSizeOrTag >> 8) & 0xff);
-
-			const boost::string_ref value = valueRef.value();
-			putBytes(valueOffset, value);
+			const size_type keyOffset = getEndOfFreeArea() - recordInlineSize;
+			putRecord(keyOffset, recordId, valueRef);
 
 			// Add new pointer to the start of the key.
-			addRecordOffset(keyOffset);
+			addRecordOffset(keyOffset, keyHash);
 
 			// Set new "end of free area".
 			setEndOfFreeArea(keyOffset);
@@ -147,10 +291,34 @@ namespace hashdb {
 		return (canAdd)? recordInlineSize : 0;
 	}
 
-	size_type DataPage::addSingleRecord(const boost::string_ref& recordInlineData)
+	void DataPage::putRecord(size_type recordOffset, const RecordId& recordId, const AddedValueRef& valueRef)
+	{
+		const size_type valueSizeOffset = recordOffset + recordId.size();
+		const size_type valueOffset = valueSizeOffset + sizeof(uint16_t);
+
+		putBytes(recordOffset, recordId.value());
+
+		const uint16_t valueSizeOrTag = valueRef.valueSizeOrTag();
+		this->operator[](valueSizeOffset)     = (valueSizeOrTag & 0xff);
+		this->operator[](valueSizeOffset + 1) = ((valueSizeOrTag >> 8) & 0xff);
+
+		putBytes(valueOffset, valueRef.value());
+	}
+
+	bool DataPage::makeFreeSpace(size_type requiredSpace)
+	{
+		// Space of dead records is reclaimed only when it is actually needed.
+		if (freeSpace() < requiredSpace && hasDeadRecords()) {
+			compactRecords();
+		}
+
+		return freeSpace() >= requiredSpace;
+	}
+
+	size_type DataPage::addSingleRecord(const boost::string_ref& recordInlineData, uint32_t keyHash)
 	{
 		const size_type recordInlineSize = static_cast<size_type>(recordInlineData.size());
-		const bool canAdd = freeSpace() >= sizeof(uint16_t) + recordInlineSize;
+		const bool canAdd = makeFreeSpace(slotSize() + recordInlineSize);
 
 		if (canAdd) {
 			// Compute offsets.
@@ -159,13 +327,33 @@ namespace hashdb {
 
 			// Copy the record, add pointer to its start and adjust "end of free area".
 			putBytes(recordOffset, recordInlineData);
-			addRecordOffset(recordOffset);
+			addRecordOffset(recordOffset, keyHash);
 			setEndOfFreeArea(recordOffset);
 		}
 
 		return (canAdd)? recordInlineSize : 0;
 	}
 
+	size_type DataPage::addMovedRecordToEmptyPage(const boost::string_ref& recordInlineData, uint32_t keyHash)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(getNumberOfRecords() != 0);
+
+		size_type addedSize = addSingleRecord(recordInlineData, keyHash);
+
+		// Record written by an older format may be too large for the slot of the current format.
+		if (addedSize == 0) {
+			setUpTagged(getPageNumber());
+			addedSize = addSingleRecord(recordInlineData, keyHash);
+		}
+
+		if (addedSize == 0) {
+			setUpUntagged(getPageNumber());
+			addedSize = addSingleRecord(recordInlineData, keyHash);
+		}
+
+		return addedSize;
+	}
+
 	//----------------------------------------------------------------------------
 	// Deleting data.
 
@@ -175,9 +363,7 @@ namespace hashdb {
 		RAISE_INTERNAL_ERROR_IF_ARG(numberOfRecords == 0);
 		RAISE_INTERNAL_ERROR_IF_ARG(! cursor.isValid());
 
-		const size_type recordInlineSize = (cursor.isInlineValue())? 
-			  cursor.recordOverheadSize() + static_cast<size_type>(cursor.inlineValue().size())	// inline value - overhead + value size
-			: cursor.recordOverheadSize() + (2 * sizeof(uint32_t));								// big value - overhead + data size (4) + page pointer (4)
+		const size_type recordInlineSize = DataPage::recordInlineSize(cursor);
 
 		if (cursor.index() < numberOfRecords - 1) {
 			// Generic case: existing records and record pointers must be moved.
@@ -190,16 +376,31 @@ namespace hashdb {
 			moveBytes(newEndOfFreeArea, endOfFreeArea, movedBytes);
 
 			// Adjust record pointers.
+			const bool hashTags = hasHashTags();
+			const bool keyHashes = hasKeyHashes();
+
 			for (uint16_t i = cursor.index() + 1; i < numberOfRecords; ++i) {
-				const size_type newOffset = getRecordOffsetAt(i) + recordInlineSize;
+				const size_type newOffset = (isDeadRecordAt(i))? DEAD_RECORD_OFFSET : getRecordOffsetAt(i) + recordInlineSize;
 				setRecordOffsetAt(i - 1, newOffset);
+
+				if (keyHashes) {
+					setKeyHashAt(i - 1, getKeyHashAt(i));
+				}
+				else if (hashTags) {
+					setHashTagAt(i - 1, getHashTagAt(i));
+				}
 			}
 
 			setEndOfFreeArea(newEndOfFreeArea);
 		}
 		else {
-			// Special case: adjust the end of free area when deleting the last item.
-			const uint32_t newEndOfFreeArea = (numberOfRecords == 1)? size() : getRecordOffsetAt(cursor.index() - 1);
+			// Special case: adjust the end of free area when deleting the last item. Space of dead records below the previous live one is freed as well.
+			uint16_t previousIndex = cursor.index();
+			while (previousIndex > 0 && isDeadRecordAt(previousIndex - 1)) {
+				--previousIndex;
+			}
+
+			const uint32_t newEndOfFreeArea = (previousIndex == 0)? size() : getRecordOffsetAt(previousIndex - 1);
 			setEndOfFreeArea(newEndOfFreeArea);
 		}
 		setNumberOfRecords(numberOfRecords - 1);
@@ -207,6 +408,135 @@ namespace hashdb {
 		return recordInlineSize;
 	}
 
+	size_type DataPage::markRecordDead(const DataPageCursor& cursor)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(! cursor.isValid());
+
+		// Nothing is moved, so removing many records from the page is linear.
+		const size_type recordInlineSize = DataPage::recordInlineSize(cursor);
+		setRecordOffsetAt(cursor.index(), DEAD_RECORD_OFFSET);
+		++deadRecords_;
+
+		return recordInlineSize;
+	}
+
+	bool DataPage::isDeadRecordAt(size_type index) const
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(index >= getNumberOfRecords());
+
+		return get16unchecked(HEADER_DATA_END_OFFSET + (index * slotSize())) == DEAD_RECORD_OFFSET;
+	}
+
+	bool DataPage::hasDeadRecords() const
+	{
+		return deadRecords_ != 0;
+	}
+
+	void DataPage::compactRecords()
+	{
+		if (! hasDeadRecords()) {
+			return;
+		}
+
+		const uint16_t numberOfRecords = getNumberOfRecords();
+		const bool hashTags = hasHashTags();
+		const bool keyHashes = hasKeyHashes();
+		size_type endOfFreeArea = size();
+		uint16_t liveRecords = 0;
+
+		// Records with lower indexes are stored at higher offsets, so each live record is moved up past the holes above it.
+		for (uint16_t i = 0; i < numberOfRecords; ++i) {
+			if (isDeadRecordAt(i)) {
+				continue;
+			}
+
+			const DataPageCursor cursor(this, i);
+			const size_type recordOffset = getRecordOffsetAt(i);
+			const size_type recordInlineSize = DataPage::recordInlineSize(cursor);
+			RAISE_INTERNAL_ERROR_IF(recordOffset + recordInlineSize > endOfFreeArea, "record %u at offset %u overlaps compacted records on %s", i, recordOffset, getId().toString());
+
+			endOfFreeArea -= recordInlineSize;
+			if (endOfFreeArea != recordOffset) {
+				moveBytes(endOfFreeArea, recordOffset, recordInlineSize);
+			}
+
+			setRecordOffsetAt(liveRecords, endOfFreeArea);
+
+			if (keyHashes) {
+				setKeyHashAt(liveRecords, getKeyHashAt(i));
+			}
+			else if (hashTags) {
+				setHashTagAt(liveRecords, getHashTagAt(i));
+			}
+
+			++liveRecords;
+		}
+
+		setNumberOfRecords(liveRecords);
+		setEndOfFreeArea(endOfFreeArea);
+		deadRecords_ = 0;
+	}
+
+	size_type DataPage::recordInlineSize(const DataPageCursor& cursor)
+	{
+		return (cursor.isInlineValue())? 
+			  cursor.recordOverheadSize() + static_cast<size_type>(cursor.inlineValue().size())	// inline value - overhead + value size
+			: cursor.recordOverheadSize() + (2 * sizeof(uint32_t));								// big value - overhead + data size (4) + page pointer (4)
+	}
+
+	//----------------------------------------------------------------------------
+	// Updating data.
+
+	size_type DataPage::replaceSingleRecord(const DataPageCursor& cursor, const RecordId& recordId, const AddedValueRef& valueRef)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(! cursor.isValid());
+
+		const size_type oldRecordInlineSize = recordInlineSize(cursor);
+		const size_type newRecordInlineSize = recordId.recordOverheadSize() + static_cast<size_type>(valueRef.value().size());
+		const bool canReplace = newRecordInlineSize <= oldRecordInlineSize || freeSpace() >= newRecordInlineSize - oldRecordInlineSize;
+
+		if (canReplace) {
+			// The end of the record stays in place. Records stored below it are moved by the size difference,
+			// so a value of the same size is simply overwritten.
+			const size_type recordOffset = getRecordOffsetAt(cursor.index());
+			const size_type newRecordOffset = recordOffset + oldRecordInlineSize - newRecordInlineSize;
+
+			if (newRecordOffset != recordOffset) {
+				const size_type endOfFreeArea = getEndOfFreeArea();
+				const size_type newEndOfFreeArea = endOfFreeArea + oldRecordInlineSize - newRecordInlineSize;
+				const uint16_t numberOfRecords = getNumberOfRecords();
+
+				moveBytes(newEndOfFreeArea, endOfFreeArea, recordOffset - endOfFreeArea);
+
+				for (uint16_t i = cursor.index() + 1; i < numberOfRecords; ++i) {
+					if (! isDeadRecordAt(i)) {
+						setRecordOffsetAt(i, getRecordOffsetAt(i) + oldRecordInlineSize - newRecordInlineSize);
+					}
+				}
+
+				setRecordOffsetAt(cursor.index(), newRecordOffset);
+				setEndOfFreeArea(newEndOfFreeArea);
+			}
+
+			putRecord(newRecordOffset, recordId, valueRef);
+		}
+
+		return (canReplace)? newRecordInlineSize : 0;
+	}
+
+	void DataPage::setFirstLargeValuePage(const DataPageCursor& cursor, uint32_t pageNumber)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(! cursor.isValid() || cursor.isInlineValue());
+
+		// Large value record: overhead + data size (4) + page pointer (4).
+		const size_type pageNumberOffset = getRecordOffsetAt(cursor.index()) + cursor.recordOverheadSize() + sizeof(uint32_t);
+
+		put8(pageNumberOffset, static_cast<value_type>(pageNumber));
+		put8(pageNumberOffset + 1, static_cast<value_type>(pageNumber >> 8));
+		put8(pageNumberOffset + 2, static_cast<value_type>(pageNumber >> 16));
+		put8(pageNumberOffset + 3, static_cast<value_type>(pageNumber >> 24));
+	}
+
 	//----------------------------------------------------------------------------
 	// Overflow chain traversal.
 
@@ -268,7 +598,7 @@ namespace hashdb {
 	{
 		RAISE_INTERNAL_ERROR_IF_ARG(index >= getNumberOfRecords());
 
-		const size_type keyOffsetPosition = HEADER_DATA_END_OFFSET + (index * sizeof(uint16_t));
+		const size_type keyOffsetPosition = HEADER_DATA_END_OFFSET + (index * slotSize());
 		return get16(keyOffsetPosition);
 	}
 
@@ -277,10 +607,44 @@ namespace hashdb {
 		RAISE_INTERNAL_ERROR_IF_ARG(index > getNumberOfRecords());
 		RAISE_INTERNAL_ERROR_IF_ARG(offset > size());
 
-		const size_type keyOffsetPosition = HEADER_DATA_END_OFFSET + (index * sizeof(uint16_t));
+		const size_type keyOffsetPosition = HEADER_DATA_END_OFFSET + (index * slotSize());
 		const uint16_t sixteenBitOffset = static_cast<uint16_t>(offset);
 		put16(keyOffsetPosition, sixteenBitOffset);
 	}
 
+	uint16_t DataPage::getHashTagAt(size_type index) const
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(index >= getNumberOfRecords() || ! hasHashTags());
+
+		const size_type hashTagPosition = HEADER_DATA_END_OFFSET + (index * slotSize()) + sizeof(uint16_t);
+		return get16(hashTagPosition);
+	}
+
+	void DataPage::setHashTagAt(size_type index, uint16_t hashTag)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(index > getNumberOfRecords() || ! hasHashTags());
+
+		const size_type hashTagPosition = HEADER_DATA_END_OFFSET + (index * slotSize()) + sizeof(uint16_t);
+		put16(hashTagPosition, hashTag);
+	}
+
+	uint32_t DataPage::getKeyHashAt(size_type index) const
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(index >= getNumberOfRecords() || ! hasKeyHashes());
+
+		// Key hash is aligned to 2 bytes only.
+		const size_type keyHashPosition = HEADER_DATA_END_OFFSET + (index * HASHED_SLOT_SIZE) + sizeof(uint16_t);
+		return get16(keyHashPosition) | (static_cast<uint32_t>(get16(keyHashPosition + sizeof(uint16_t))) << 16);
+	}
+
+	void DataPage::setKeyHashAt(size_type index, uint32_t keyHash)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(index > getNumberOfRecords() || ! hasKeyHashes());
+
+		const size_type keyHashPosition = HEADER_DATA_END_OFFSET + (index * HASHED_SLOT_SIZE) + sizeof(uint16_t);
+		put16(keyHashPosition, static_cast<uint16_t>(keyHash));
+		put16(keyHashPosition + sizeof(uint16_t), static_cast<uint16_t>(keyHash >> 16));
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
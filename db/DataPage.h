@@ -48,6 +48,25 @@ namespace hashdb {
 		// 22     2    record offset 1
 		// ...
 		//
+		// Tagged pages (0x6b0c3e55 for bucket page, 0x7f41a0d3 for overflow page) store a hash tag (upper 16 bits of the key hash)
+		// after each record offset, so that records with other keys can be skipped without comparing the keys:
+		// 20     2    record offset 0
+		// 22     2    hash tag of record 0
+		// 24     2    record offset 1
+		// ...
+		// Hashed pages (0x1c5e93a7 for bucket page, 0x58d2b61f for overflow page) store the key hash used to select the bucket
+		// instead of the hash tag, so that records are moved to other buckets without hashing their keys again and lookups
+		// compare whole key hashes:
+		// 20     2    record offset 0
+		// 22     4    key hash of record 0
+		// 26     2    record offset 1
+		// ...
+		// New pages are always hashed, tagged pages are created by database format versions 2 to 4 and untagged pages
+		// by database format version 1.
+		//
+		// Removed records may be marked dead by setting their offset to zero. Dead slots are skipped by cursors and exist
+		// only in memory, the page is compacted when an added record does not fit or before the page is written.
+		//
 		// Each record has following format:
 		//  offset size field
 		//	0     1    key size (1..127)
@@ -60,13 +79,26 @@ namespace hashdb {
 		static const uint16_t NUMBER_OF_RECORDS_OFFSET = 16;
 		static const uint16_t HIGHEST_FREE_BYTE_OFFSET = 18;
 
+		static const uint16_t DEAD_RECORD_OFFSET = 0;
+
 	protected:
 		static const uint16_t HEADER_DATA_END_OFFSET = 20; // end of header data
 
 	public:
+		static const size_type UNTAGGED_SLOT_SIZE = 2;
+		static const size_type TAGGED_SLOT_SIZE = 4;
+		static const size_type HASHED_SLOT_SIZE = 6; // slot size of newly written pages
 
 		DataPage(IPageAllocator* allocator, size_type size) 
 			: Page(allocator, size)
+			, deadRecords_(0)
+		{
+
+		}
+
+		DataPage(const IPageAllocator::PageMemoryPtr& memory, size_type size) 
+			: Page(memory, size)
+			, deadRecords_(0)
 		{
 
 		}
@@ -74,12 +106,24 @@ namespace hashdb {
 		// Virtual methods.
 		virtual void setUp(uint32_t pageNumber);
 		virtual void validate() const;
+		virtual bool isKnownMagic(uint32_t pageMagic) const;
+		virtual uint32_t taggedMagic() const = 0;
+		virtual uint32_t untaggedMagic() const = 0;
+
+		// Page format.
+		void setUpTagged(uint32_t pageNumber);
+		void setUpUntagged(uint32_t pageNumber);
+		bool hasHashTags() const;
+		bool hasKeyHashes() const;
+		size_type slotSize() const;
 
 		// Utilities for data access.
 		static size_type dataSpace(size_type pageSize);
 		size_type largestPossibleInlineRecordSize() const;
+		static size_type largestPossibleInlineRecordSize(size_type pageSize);
 		size_type freeSpace() const;
-		void addRecordOffset(size_type offset);
+		void addRecordOffset(size_type offset, uint32_t keyHash);
+		uint16_t findKeyHash(uint32_t keyHash, uint16_t fromIndex) const; // index of the first record which may have the key hash
 
 		class AddedValueRef { // Intentionally copyable.
 		public:
@@ -95,9 +139,25 @@ namespace hashdb {
 			const int64_t largeValueRef_;
 		};
 
-		size_type addSingleRecord(const RecordId& recordId, const AddedValueRef& valueRef);
-		size_type addSingleRecord(const boost::string_ref& recordInlineData);
+		size_type addSingleRecord(const RecordId& recordId, uint32_t keyHash, const AddedValueRef& valueRef);
+		size_type addSingleRecord(const boost::string_ref& recordInlineData, uint32_t keyHash);
+		size_type addMovedRecordToEmptyPage(const boost::string_ref& recordInlineData, uint32_t keyHash);
 		size_type deleteSingleRecord(const DataPageCursor& cursor);
+		size_type markRecordDead(const DataPageCursor& cursor);
+		bool isDeadRecordAt(size_type index) const;
+		bool hasDeadRecords() const;
+		void compactRecords();
+		size_type replaceSingleRecord(const DataPageCursor& cursor, const RecordId& recordId, const AddedValueRef& valueRef);
+		void setFirstLargeValuePage(const DataPageCursor& cursor, uint32_t pageNumber);
+		static size_type recordInlineSize(const DataPageCursor& cursor);
+
+	private:
+		uint16_t findHashedSlot(uint32_t keyHash, uint16_t fromIndex) const;
+		uint16_t findTaggedSlot(uint16_t hashTag, uint16_t fromIndex) const;
+		void putRecord(size_type recordOffset, const RecordId& recordId, const AddedValueRef& valueRef);
+		bool makeFreeSpace(size_type requiredSpace);
+
+	public:
 
 		PageId nextOverflowPageId();
 
@@ -113,6 +173,15 @@ namespace hashdb {
 
 		uint16_t getRecordOffsetAt(size_type index) const;
 		void setRecordOffsetAt(size_type index, size_type offset);
+
+		uint16_t getHashTagAt(size_type index) const;
+		void setHashTagAt(size_type index, uint16_t hashTag);
+
+		uint32_t getKeyHashAt(size_type index) const;
+		void setKeyHashAt(size_type index, uint32_t keyHash);
+
+	private:
+		uint16_t deadRecords_;	// Number of slots marked dead since the page was last compacted.
 	};
 
 
@@ -39,7 +39,7 @@ namespace hashdb {
 		: pagePtr_(pagePtr)
 		, recordIndex_(recordIndex)
 	{
-
+		skipDeadRecords();
 	}
 
 	//----------------------------------------------------------------------------
@@ -48,20 +48,32 @@ namespace hashdb {
 	void DataPageCursor::next()
 	{
 		++recordIndex_;
+		skipDeadRecords();
 	}
 
 	void DataPageCursor::reset()
 	{
 		recordIndex_ = 0;
+		skipDeadRecords();
+	}
+
+	void DataPageCursor::skipDeadRecords()
+	{
+		const uint16_t numberOfRecords = pagePtr_->getNumberOfRecords();
+
+		while (recordIndex_ < numberOfRecords && pagePtr_->isDeadRecordAt(recordIndex_)) {
+			++recordIndex_;
+		}
 	}
 
-	bool DataPageCursor::find(const RecordId& recordId)
+	bool DataPageCursor::find(const RecordId& recordId, uint32_t keyHash)
 	{
 		const uint16_t numberOfRecords = pagePtr_->getNumberOfRecords();
 		bool found = false;
 
-		for (; recordIndex_ < numberOfRecords; ++recordIndex_) {
-			found = (recordIdValue() == recordId.value());
+		// Compare record ids only for records whose key hash or tag matches.
+		for (; (recordIndex_ = pagePtr_->findKeyHash(keyHash, recordIndex_)) < numberOfRecords; ++recordIndex_) {
+			found = ! pagePtr_->isDeadRecordAt(recordIndex_) && (recordIdValue() == recordId.value());
 
 			if (found) {
 				break;
@@ -71,13 +83,13 @@ namespace hashdb {
 		return found;
 	}
 
-	bool DataPageCursor::find(const boost::string_ref& searchKey)
+	bool DataPageCursor::find(const boost::string_ref& searchKey, uint32_t keyHash)
 	{
 		const uint16_t numberOfRecords = pagePtr_->getNumberOfRecords();
 		bool found = false;
 
-		for (; recordIndex_ < numberOfRecords; ++recordIndex_) {
-			found = (key() == searchKey);
+		for (; (recordIndex_ = pagePtr_->findKeyHash(keyHash, recordIndex_)) < numberOfRecords; ++recordIndex_) {
+			found = ! pagePtr_->isDeadRecordAt(recordIndex_) && (key() == searchKey);
 
 			if (found) {
 				break;
@@ -138,6 +150,16 @@ namespace hashdb {
 		return recordIdValue().back();
 	}
 
+	bool DataPageCursor::hasKeyHash() const
+	{
+		return pagePtr_->hasKeyHashes();
+	}
+
+	uint32_t DataPageCursor::keyHash() const
+	{
+		return pagePtr_->getKeyHashAt(recordIndex_);
+	}
+
 	uint16_t DataPageCursor::inlineValueSize(uint16_t recordOffset) const
 	{
 		const size_type valueSizeOffset = recordOffset + recordIdSize(recordOffset);
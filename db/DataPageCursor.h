@@ -41,18 +41,20 @@ namespace hashdb {
 		// Traversal.
 		void next();
 		void reset();
-		bool find(const RecordId& recordId);
-		bool find(const boost::string_ref& key);
+		bool find(const RecordId& recordId, uint32_t keyHash);
+		bool find(const boost::string_ref& key, uint32_t keyHash);
 
 		// Cursor properties.
 		bool isValid() const;
 		bool isInlineValue() const;
+		bool hasKeyHash() const;
 		uint16_t index() const;
 
 		// Accessors.
 		boost::string_ref recordIdValue() const;
 		boost::string_ref key() const;
 		partNum_t partNum() const;
+		uint32_t keyHash() const;
 		boost::string_ref inlineValue() const;
 		boost::string_ref inlineRecord() const;
 
@@ -62,6 +64,7 @@ namespace hashdb {
 		size_type recordOverheadSize() const;
 
 	private:
+		void skipDeadRecords();
 		uint16_t recordOffset() const;
 		size_type recordIdSize(uint16_t recordOffset) const;
 		uint16_t inlineValueSize(uint16_t recordOffset) const;
@@ -34,6 +34,7 @@
 #include "utils/SingleWrite.h"
 #include "utils/SingleDelete.h"
 #include "IteratorImpl.h"
+#include "BulkLoaderImpl.h"
 #include "OpenFiles.h"
 #include "DatabaseImpl.h"
 
@@ -127,6 +128,13 @@ namespace hashdb {
 		return doFetch(singleRead);
 	}
 
+	bool DatabaseImpl::fetch(const boost::string_ref& key, partNum_t partNum, IValueVisitor& visitor)
+	{
+		checkSimpleArgumentFor(key, partNum);
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase_, "database is not open");
+		return openDatabase_->fetch(key, partNum, visitor);
+	}
+
 	void DatabaseImpl::store(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value)
 	{
 		checkSimpleArgumentFor(key, partNum);
@@ -163,17 +171,28 @@ namespace hashdb {
 		const size_t batchSize = batch.count();
 
 		for (size_t i = 0; i < batchSize; ++i) {
-			const size_type keySize = batch.keyAt(i).size();
-			const partNum_t partNum = batch.partNumAt(i);
-
-			RAISE_INVALID_ARGUMENT_IF(keySize > MAX_KEY_SIZE, "key at index %u too long", i);
-			RAISE_INVALID_ARGUMENT_IF(keySize == 0, "empty key at index %u is not allowed", i);
-			RAISE_INVALID_ARGUMENT_IF(partNum > MAX_PARTNUM, "partNum at index %u is too large", i);
-			RAISE_INVALID_ARGUMENT_IF(partNum == ALL_PARTS, "partNum ALL_PARTS at index %u is not allowed");
-			RAISE_INVALID_ARGUMENT_IF(partNum < 0, "negative partNum at index %u is not allowed", i);
+			checkBatchItem(i, batch.keyAt(i).size(), batch.partNumAt(i));
+		}
+	}
+
+	void DatabaseImpl::checkBatchArgumentFor(const FlatBatch& batch) const
+	{
+		const size_t batchSize = batch.count();
+
+		for (size_t i = 0; i < batchSize; ++i) {
+			checkBatchItem(i, static_cast<size_type>(batch.keyAt(i).size()), batch.partNumAt(i));
 		}
 	}
 
+	void DatabaseImpl::checkBatchItem(size_t index, size_type keySize, partNum_t partNum) const
+	{
+		RAISE_INVALID_ARGUMENT_IF(keySize > MAX_KEY_SIZE, "key at index %u too long", index);
+		RAISE_INVALID_ARGUMENT_IF(keySize == 0, "empty key at index %u is not allowed", index);
+		RAISE_INVALID_ARGUMENT_IF(partNum > MAX_PARTNUM, "partNum at index %u is too large", index);
+		RAISE_INVALID_ARGUMENT_IF(partNum == ALL_PARTS, "partNum ALL_PARTS at index %u is not allowed");
+		RAISE_INVALID_ARGUMENT_IF(partNum < 0, "negative partNum at index %u is not allowed", index);
+	}
+
 	bool DatabaseImpl::fetch(IReadBatch& readBatch)
 	{
 		checkBatchArgumentFor(readBatch);
@@ -192,6 +211,27 @@ namespace hashdb {
 		doRemove(deleteBatch);
 	}
 
+	bool DatabaseImpl::fetch(FlatBatch& flatBatch)
+	{
+		checkBatchArgumentFor(flatBatch);
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase_, "database is not open");
+		return openDatabase_->fetch(flatBatch);
+	}
+
+	void DatabaseImpl::store(const FlatBatch& flatBatch)
+	{
+		checkBatchArgumentFor(flatBatch);
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase_, "database is not open");
+		openDatabase_->store(flatBatch);
+	}
+
+	void DatabaseImpl::remove(const FlatBatch& flatBatch)
+	{
+		checkBatchArgumentFor(flatBatch);
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase_, "database is not open");
+		openDatabase_->remove(flatBatch);
+	}
+
 	//-------------------------------------------------------------------------
 	// Iterator.
 
@@ -203,6 +243,26 @@ namespace hashdb {
 		return iterator;
 	}
 
+	//-------------------------------------------------------------------------
+	// Bulk load.
+
+	BulkLoader DatabaseImpl::newBulkLoader(uint64_t expectedNumberOfRecords)
+	{
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase_, "database is not open");
+
+		BulkLoader bulkLoader(new BulkLoaderImpl(openDatabase_, expectedNumberOfRecords));
+		return bulkLoader;
+	}
+
+	//-------------------------------------------------------------------------
+	// Compaction.
+
+	bool DatabaseImpl::compact(size_t maxPages)
+	{
+		RAISE_INVALID_ARGUMENT_IF(! openDatabase_, "database is not open");
+		return openDatabase_->compact(static_cast<size_type>(maxPages));
+	}
+
 	//-------------------------------------------------------------------------
 	// Statistics.
 
@@ -221,12 +281,16 @@ namespace hashdb {
 			ManagedDatabaseFiles(const boost::filesystem::path& database)
 				: bucketFile_(OpenFiles::databaseNameToBucketFileName(database))
 				, overflowFile_(OpenFiles::databaseNameToOverflowFileName(database))
+				, logFile_(OpenFiles::databaseNameToLogFileName(database))
+				, keyFilterFile_(OpenFiles::databaseNameToKeyFilterFileName(database))
 			{
 
 			}
 
 			const boost::filesystem::path bucketFile_;
 			const boost::filesystem::path overflowFile_;
+			const boost::filesystem::path logFile_;	// Exists only if the database uses the write-ahead log.
+			const boost::filesystem::path keyFilterFile_;	// Exists only if the database uses the key filter.
 		};
 
 		bool singleFileNotFound(const boost::filesystem::file_status& fileStatus)
@@ -330,6 +394,25 @@ namespace hashdb {
 			boost::system::error_code overflowRenameError;
 			boost::filesystem::rename(sourceFiles.overflowFile_, targetFiles.overflowFile_, overflowRenameError);
 			RAISE_IO_ERROR_IF(overflowRenameError, "overflow file \"%s\" cannot be renamed to \"%s\": %s", sourceFiles.overflowFile_.string(), targetFiles.overflowFile_.string(), overflowRenameError.message());
+
+			boost::system::error_code logStatusError;
+			if (boost::filesystem::exists(sourceFiles.logFile_, logStatusError)) {
+				boost::system::error_code logRenameError;
+				boost::filesystem::rename(sourceFiles.logFile_, targetFiles.logFile_, logRenameError);
+				RAISE_IO_ERROR_IF(logRenameError, "log file \"%s\" cannot be renamed to \"%s\": %s", sourceFiles.logFile_.string(), targetFiles.logFile_.string(), logRenameError.message());
+			}
+
+			// A filter saved for another database must not be used with the renamed one.
+			boost::system::error_code keyFilterRemoveError;
+			boost::filesystem::remove(targetFiles.keyFilterFile_, keyFilterRemoveError);
+			RAISE_IO_ERROR_IF(keyFilterRemoveError, "key filter file \"%s\" cannot be deleted: %s", targetFiles.keyFilterFile_.string(), keyFilterRemoveError.message());
+
+			boost::system::error_code keyFilterStatusError;
+			if (boost::filesystem::exists(sourceFiles.keyFilterFile_, keyFilterStatusError)) {
+				boost::system::error_code keyFilterRenameError;
+				boost::filesystem::rename(sourceFiles.keyFilterFile_, targetFiles.keyFilterFile_, keyFilterRenameError);
+				RAISE_IO_ERROR_IF(keyFilterRenameError, "key filter file \"%s\" cannot be renamed to \"%s\": %s", sourceFiles.keyFilterFile_.string(), targetFiles.keyFilterFile_.string(), keyFilterRenameError.message());
+			}
 		}
 
 		return canRename;
@@ -348,8 +431,16 @@ namespace hashdb {
 		boost::system::error_code overflowRemoveError;
 		const bool overflowFileExisted = boost::filesystem::remove(databaseFiles.overflowFile_, overflowRemoveError);
 
+		boost::system::error_code logRemoveError;
+		boost::filesystem::remove(databaseFiles.logFile_, logRemoveError);
+
+		boost::system::error_code keyFilterRemoveError;
+		boost::filesystem::remove(databaseFiles.keyFilterFile_, keyFilterRemoveError);
+
 		RAISE_IO_ERROR_IF(bucketRemoveError, "bucket file \"%s\" cannot be deleted: %s", databaseFiles.bucketFile_.string(), bucketRemoveError.message());
 		RAISE_IO_ERROR_IF(overflowRemoveError, "overflow file \"%s\" cannot be deleted: %s", databaseFiles.overflowFile_.string(), overflowRemoveError.message());
+		RAISE_IO_ERROR_IF(logRemoveError, "log file \"%s\" cannot be deleted: %s", databaseFiles.logFile_.string(), logRemoveError.message());
+		RAISE_IO_ERROR_IF(keyFilterRemoveError, "key filter file \"%s\" cannot be deleted: %s", databaseFiles.keyFilterFile_.string(), keyFilterRemoveError.message());
 
 		return bucketFileExisted && overflowFileExisted;
 	}
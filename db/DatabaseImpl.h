@@ -48,18 +48,28 @@ namespace hashdb {
 
 		void checkSimpleArgumentFor(const boost::string_ref& key, partNum_t partNum) const;
 		virtual bool fetch(const boost::string_ref& key, partNum_t partNum, std::string& value);
+		virtual bool fetch(const boost::string_ref& key, partNum_t partNum, IValueVisitor& visitor);
 		virtual	void store(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value);
 		virtual void remove(const boost::string_ref& key, partNum_t partNum);
 		virtual void remove(const boost::string_ref& key);
 		virtual std::vector<partNum_t> listParts(const boost::string_ref& key);
 
 		void checkBatchArgumentFor(const IKeyProducer& batch) const;
+		void checkBatchArgumentFor(const FlatBatch& batch) const;
+		void checkBatchItem(size_t index, size_type keySize, partNum_t partNum) const;
 		virtual bool fetch(IReadBatch& readBatch);
 		virtual void store(const IWriteBatch& writeBatch);
 		virtual void remove(const IDeleteBatch& deleteBatch);
+		virtual bool fetch(FlatBatch& flatBatch);
+		virtual void store(const FlatBatch& flatBatch);
+		virtual void remove(const FlatBatch& flatBatch);
 
 		virtual Iterator newIterator();
 
+		virtual BulkLoader newBulkLoader(uint64_t expectedNumberOfRecords);
+
+		virtual bool compact(size_t maxPages);
+
 		virtual Statistics statistics();
 
 		virtual bool exists(const boost::filesystem::path& database);
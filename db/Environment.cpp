@@ -27,9 +27,11 @@
 
 // Environment.cpp - environment for accessing the database.
 #include "stdafx.h"
+#include "LockFreePageAllocator.h"
 #include "NullLockManager.h"
 #include "SimplePageAllocator.h"
 #include "SingleThreadedPageAllocator.h"
+#include "TrueLockManager.h"
 #include "utils/ExceptionCreator.h"
 #include "Environment.h"
 
@@ -45,6 +47,10 @@ namespace hashdb {
 			lockManager_.reset(new NullLockManager());
 			break;
 
+		case Options::TrueLockManagerType:
+			lockManager_.reset(new TrueLockManager());
+			break;
+
 		default:
 			RAISE_NOT_YET_IMPLEMENTED("Option lockManagerType_=%d is not yet implemented", options.lockManagerType_);
 			break;
@@ -60,6 +66,11 @@ namespace hashdb {
 			headerPageAllocator_.reset(new SimplePageAllocator());
 			break;
 
+		case Options::LockFreePageAllocatorType:
+			pageAllocator_.reset(new LockFreePageAllocator(options.memoryPoolBytes_));
+			headerPageAllocator_.reset(new SimplePageAllocator());
+			break;
+
 		default:
 			RAISE_NOT_YET_IMPLEMENTED("Option pageAllocatorType_=%d is not yet implemented", options.pageAllocatorType_);
 			break;
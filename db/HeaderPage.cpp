@@ -70,7 +70,7 @@ namespace hashdb {
 
 	uint32_t HeaderPage::computeChecksum() const
 	{
-		return xor32(HEADER_DATA_END);
+		return xor32(); // Whole page, overflow file header stores the bitmap summary after the header data.
 	}
 
 
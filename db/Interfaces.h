@@ -72,6 +72,20 @@ namespace hashdb {
 				*counterMemory = initialCount;
 			}
 
+			// Pointer to a part of the memory held by "base", sharing its reference counter.
+			PageMemoryPtr(const PageMemoryPtr& base, size_t offset)
+				: allocator_(base.allocator_)
+				, pageMemory_(base.pageMemory_ + offset)
+				, counterMemory_(base.counterMemory_)
+			{
+				HASHDB_ASSERT(allocator_ != NULL);
+				HASHDB_ASSERT(pageMemory_ != NULL);
+				HASHDB_ASSERT(counterMemory_ != NULL);
+				HASHDB_ASSERT(*counterMemory_ != 0);
+
+				++(*counterMemory_);
+			}
+
 			PageMemoryPtr(const PageMemoryPtr& ref)
 				: allocator_(ref.allocator_)
 				, pageMemory_(ref.pageMemory_)
@@ -151,6 +165,20 @@ namespace hashdb {
 	};
 
 	//----------------------------------------------------------------------------
+	// Interface of a shared buffer pool client.
+
+	class IBufferPoolClient {
+	public:
+		// Releases up to the given number of least recently used clean pages unless the client is being used.
+		// Called by the buffer pool under its mutex, so the client must not wait, write or call the pool back.
+		// The pool adjusts the client's frame count itself.
+		// Returns the number of released pages.
+		virtual size_type releaseColdPages(size_type pages) = 0;
+
+		virtual ~IBufferPoolClient() { }
+	};
+
+	//----------------------------------------------------------------------------
 
 }; // namespace hashdb
 }; // namespace kerio
@@ -0,0 +1,277 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// KeyFilter.cpp - in-memory filter of keys stored in the database.
+#include "stdafx.h"
+#include <algorithm>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "utils/ExceptionCreator.h"
+#include "KeyFilter.h"
+
+namespace kerio {
+namespace hashdb {
+
+	namespace {
+
+		const uint32_t FILTER_FILE_MAGIC = 0x46424448; // "HDBF"
+		const uint32_t FILTER_FILE_VERSION = 2; // 2 - probes are derived from the key hash
+		const size_type FILTER_FILE_HEADER_SIZE = 32;
+
+		const size_type BITS_PER_PROBE = 9; // 512 bits in a block
+
+		uint64_t getLittleEndian(const char* data, size_type size)
+		{
+			uint64_t value = 0;
+
+			for (size_type i = size; i != 0; --i) {
+				value = (value << 8) | static_cast<uint8_t>(data[i - 1]);
+			}
+
+			return value;
+		}
+
+		void putLittleEndian(char* data, size_type size, uint64_t value)
+		{
+			for (size_type i = 0; i < size; ++i) {
+				data[i] = static_cast<char>(value & 0xff);
+				value >>= 8;
+			}
+		}
+
+		// Finalizer of splitmix64. Spreads the key hash to all bits, so that neither the block nor the probes
+		// depend on the low bits selecting the bucket only.
+		uint64_t remix(uint64_t value)
+		{
+			value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+			return value ^ (value >> 31);
+		}
+
+	};
+
+	KeyFilter::KeyFilter(size_type filterBytes)
+		: numberOfBlocks_((filterBytes + BLOCK_SIZE - 1) / BLOCK_SIZE)
+		, numberOfWords_(numberOfBlocks_ * (BLOCK_SIZE / sizeof(uint64_t)))
+		, isValid_(false)
+		, isRebuilding_(false)
+		, removedKeys_(0)
+		, rejects_(0)
+	{
+		if (numberOfWords_ != 0) {
+			words_.reset(new boost::atomic<uint64_t>[numberOfWords_]);
+			clear();
+		}
+	}
+
+	bool KeyFilter::isEnabled() const
+	{
+		return numberOfBlocks_ != 0;
+	}
+
+	bool KeyFilter::isValid() const
+	{
+		return isValid_;
+	}
+
+	bool KeyFilter::isRebuilding() const
+	{
+		return isRebuilding_;
+	}
+
+	//-------------------------------------------------------------------------
+	// Maintenance of the filter.
+
+	void KeyFilter::clear()
+	{
+		for (size_type i = 0; i < numberOfWords_; ++i) {
+			words_[i].store(0, boost::memory_order_relaxed);
+		}
+
+		isValid_ = false;
+		isRebuilding_ = false;
+		removedKeys_ = 0;
+	}
+
+	void KeyFilter::beginRebuild()
+	{
+		clear();
+		isRebuilding_ = isEnabled();
+	}
+
+	void KeyFilter::setValid()
+	{
+		isRebuilding_ = false;
+		isValid_ = isEnabled();
+	}
+
+	void KeyFilter::invalidate()
+	{
+		isValid_ = false;
+		isRebuilding_ = false;
+	}
+
+	void KeyFilter::add(uint32_t keyHash)
+	{
+		if (! isValid_ && ! isRebuilding_) {
+			return;
+		}
+
+		const Probes probes = probesFor(keyHash);
+
+		for (size_type i = 0; i < BLOCK_SIZE / sizeof(uint64_t); ++i) {
+			if (probes.bits_[i] != 0) {
+				words_[probes.firstWord_ + i].fetch_or(probes.bits_[i], boost::memory_order_relaxed);
+			}
+		}
+	}
+
+	void KeyFilter::keyRemoved()
+	{
+		if (isValid_ || isRebuilding_) {
+			++removedKeys_;
+		}
+	}
+
+	bool KeyFilter::mayContain(uint32_t keyHash) const
+	{
+		if (! isValid_) {
+			return true;
+		}
+
+		const Probes probes = probesFor(keyHash);
+
+		for (size_type i = 0; i < BLOCK_SIZE / sizeof(uint64_t); ++i) {
+			if ((words_[probes.firstWord_ + i].load(boost::memory_order_relaxed) & probes.bits_[i]) != probes.bits_[i]) {
+				rejects_.fetch_add(1, boost::memory_order_relaxed);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	size_type KeyFilter::rejects() const
+	{
+		return rejects_.load(boost::memory_order_relaxed);
+	}
+
+	KeyFilter::Probes KeyFilter::probesFor(uint32_t keyHash) const
+	{
+		const uint64_t blockHash = remix(keyHash);
+
+		Probes probes;
+		probes.firstWord_ = static_cast<size_type>(blockHash % numberOfBlocks_) * (BLOCK_SIZE / sizeof(uint64_t));
+		std::fill(probes.bits_, probes.bits_ + BLOCK_SIZE / sizeof(uint64_t), 0);
+
+		uint64_t probeBits = remix(blockHash);
+
+		for (size_type i = 0; i < PROBES_PER_KEY; ++i) {
+			const size_type bit = static_cast<size_type>(probeBits & ((1 << BITS_PER_PROBE) - 1));
+			probes.bits_[bit / 64] |= static_cast<uint64_t>(1) << (bit % 64);
+			probeBits >>= BITS_PER_PROBE;
+		}
+
+		return probes;
+	}
+
+	//-------------------------------------------------------------------------
+	// Side file.
+
+	bool KeyFilter::load(const boost::filesystem::path& fileName, uint64_t numberOfRecords)
+	{
+		clear();
+
+		std::ifstream file(fileName.string().c_str(), std::ios::binary);
+		if (! file) {
+			return false;
+		}
+
+		// The filter is used only if it was saved with the same size by the last close of the database.
+		char header[FILTER_FILE_HEADER_SIZE];
+		if (! file.read(header, sizeof(header))
+				|| getLittleEndian(header, 4) != FILTER_FILE_MAGIC
+				|| getLittleEndian(header + 4, 4) != FILTER_FILE_VERSION
+				|| getLittleEndian(header + 8, 4) != numberOfBlocks_
+				|| getLittleEndian(header + 16, 8) != numberOfRecords) {
+			return false;
+		}
+
+		std::vector<char> block(BLOCK_SIZE);
+
+		for (size_type i = 0; i < numberOfWords_; i += BLOCK_SIZE / sizeof(uint64_t)) {
+			if (! file.read(&block[0], BLOCK_SIZE)) {
+				clear();
+				return false;
+			}
+
+			for (size_type j = 0; j < BLOCK_SIZE / sizeof(uint64_t); ++j) {
+				words_[i + j].store(getLittleEndian(&block[j * sizeof(uint64_t)], sizeof(uint64_t)), boost::memory_order_relaxed);
+			}
+		}
+
+		removedKeys_ = getLittleEndian(header + 24, 8);
+		isValid_ = true;
+
+		return true;
+	}
+
+	void KeyFilter::save(const boost::filesystem::path& fileName, uint64_t numberOfRecords) const
+	{
+		std::ofstream file(fileName.string().c_str(), std::ios::binary | std::ios::trunc);
+		RAISE_IO_ERROR_IF(! file, "unable to create key filter file \"%s\"", fileName.string());
+
+		char header[FILTER_FILE_HEADER_SIZE] = { 0 };
+		putLittleEndian(header, 4, FILTER_FILE_MAGIC);
+		putLittleEndian(header + 4, 4, FILTER_FILE_VERSION);
+		putLittleEndian(header + 8, 4, numberOfBlocks_);
+		putLittleEndian(header + 16, 8, numberOfRecords);
+		putLittleEndian(header + 24, 8, removedKeys_);
+		file.write(header, sizeof(header));
+
+		std::vector<char> block(BLOCK_SIZE);
+
+		for (size_type i = 0; i < numberOfWords_; i += BLOCK_SIZE / sizeof(uint64_t)) {
+			for (size_type j = 0; j < BLOCK_SIZE / sizeof(uint64_t); ++j) {
+				putLittleEndian(&block[j * sizeof(uint64_t)], sizeof(uint64_t), words_[i + j].load(boost::memory_order_relaxed));
+			}
+
+			file.write(&block[0], BLOCK_SIZE);
+		}
+
+		file.close();
+		RAISE_IO_ERROR_IF(! file, "unable to write key filter file \"%s\"", fileName.string());
+	}
+
+	bool KeyFilter::isWorthSaving(uint64_t numberOfRecords) const
+	{
+		// Bits of removed keys make the filter less selective. Rebuild it when they outnumber the stored records.
+		return isValid_ && removedKeys_ <= numberOfRecords;
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,97 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// KeyFilter.h - in-memory filter of keys stored in the database.
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/scoped_array.hpp>
+#include <kerio/hashdb/Types.h>
+
+namespace kerio {
+namespace hashdb {
+
+	// Blocked Bloom filter of stored keys. All bits of a key are set in a single 64 byte block, so a lookup
+	// touches one cache line. Blocks and bits are selected by a remix of the key hash the bucket is selected by,
+	// so keys are not hashed again and splits and merges of buckets leave the filter intact. Bits of removed keys
+	// are never cleared, the filter only loses precision and it is rebuilt after the next open when too many keys were removed.
+	//
+	// A filter being rebuilt collects the keys, but it is not used until all buckets were scanned. The database
+	// scans one bucket per request, see OpenDatabase::advanceKeyFilterRebuild().
+	//
+	// Bits are set by requests which write lock the metadata and read by concurrent fetches, hence the atomics.
+
+	class KeyFilter : boost::noncopyable
+	{
+	public:
+		static const size_type BLOCK_SIZE = 64;
+		static const size_type PROBES_PER_KEY = 6;
+
+		KeyFilter(size_type filterBytes);
+
+		bool isEnabled() const;
+		bool isValid() const;
+		bool isRebuilding() const;
+
+		// Maintenance of the filter.
+		void clear();
+		void beginRebuild();
+		void setValid();
+		void invalidate();
+		void add(uint32_t keyHash);
+		void keyRemoved();
+
+		// Returns false if the key is surely not in the database.
+		bool mayContain(uint32_t keyHash) const;
+		size_type rejects() const;
+
+		// Side file with the filter saved by the last close.
+		bool load(const boost::filesystem::path& fileName, uint64_t numberOfRecords);
+		void save(const boost::filesystem::path& fileName, uint64_t numberOfRecords) const;
+		bool isWorthSaving(uint64_t numberOfRecords) const;
+
+	private:
+		struct Probes { // intentionally copyable
+			size_type firstWord_;
+			uint64_t bits_[BLOCK_SIZE / sizeof(uint64_t)];
+		};
+
+		Probes probesFor(uint32_t keyHash) const;
+
+	private:
+		const size_type numberOfBlocks_;
+		const size_type numberOfWords_;
+		boost::scoped_array<boost::atomic<uint64_t> > words_;
+
+		boost::atomic<bool> isValid_;
+		boost::atomic<bool> isRebuilding_;
+		uint64_t removedKeys_;	// Removed keys whose bits remain set.
+		mutable boost::atomic<size_type> rejects_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -86,6 +86,11 @@ namespace hashdb {
 		return value.size() < valueSize;
 	}
 
+	boost::string_ref LargeValuePage::valuePart(size_type remainingSize) const
+	{
+		return getBytes(HEADER_DATA_END_OFFSET, partSize(remainingSize));
+	}
+
 	//----------------------------------------------------------------------------
 	// Large value chain traversal.
 
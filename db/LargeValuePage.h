@@ -72,6 +72,7 @@ namespace hashdb {
 		// Utilities for data access.
 		bool putValuePart(size_type& position, const boost::string_ref& value);
 		bool getValuePart(std::string& value, size_type valueSize) const;
+		boost::string_ref valuePart(size_type remainingSize) const;
 
 		// Large value chain traversal.
 		PageId nextLargeValuePageId();
@@ -0,0 +1,77 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// LargeValueStreamBuffer.cpp - stream buffer reading a large value page by page.
+#include "stdafx.h"
+#include "utils/ExceptionCreator.h"
+#include "LargeValueStreamBuffer.h"
+
+namespace kerio {
+namespace hashdb {
+
+	LargeValueStreamBuffer::LargeValueStreamBuffer(OpenFiles& openFiles, IPageAllocator* allocator, size_type valueSize, const PageId& firstLargeValuePageId)
+		: openFiles_(openFiles)
+		, largeValuePage_(allocator, openFiles.pageSize())
+		, valueSize_(valueSize)
+		, remainingSize_(valueSize)
+		, nextPageId_(firstLargeValuePageId)
+	{
+		setg(0, 0, 0);
+	}
+
+	size_type LargeValueStreamBuffer::remainingSize() const
+	{
+		return remainingSize_ + static_cast<size_type>(egptr() - gptr());
+	}
+
+	LargeValueStreamBuffer::int_type LargeValueStreamBuffer::underflow()
+	{
+		if (gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+
+		if (remainingSize_ == 0) {
+			return traits_type::eof();
+		}
+
+		RAISE_DATABASE_CORRUPTED_IF(! nextPageId_.isValid(), "actual large value size is smaller than %u recorded in metadata", valueSize_);
+
+		// The page buffer is reused for every part of the value.
+		openFiles_.read(largeValuePage_, nextPageId_);
+		const boost::string_ref part = largeValuePage_.valuePart(remainingSize_);
+		remainingSize_ -= static_cast<size_type>(part.size());
+		nextPageId_ = largeValuePage_.nextLargeValuePageId();
+		RAISE_DATABASE_CORRUPTED_IF(remainingSize_ == 0 && nextPageId_.isValid(), "actual large value size is greater than %u recorded in metadata", valueSize_);
+
+		char* partBegin = const_cast<char*>(part.data());
+		setg(partBegin, partBegin, partBegin + part.size());
+
+		return traits_type::to_int_type(*gptr());
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,59 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// LargeValueStreamBuffer.h - stream buffer reading a large value page by page.
+#pragma once
+#include <streambuf>
+#include "LargeValuePage.h"
+#include "OpenFiles.h"
+
+namespace kerio {
+namespace hashdb {
+
+	// Reads pages of a large value chain on demand as the stream consumer pulls the data.
+	// Only a single page buffer is held regardless of the value size.
+	// Errors are raised from underflow(), so the stream must have badbit set in its exception mask to propagate them.
+
+	class LargeValueStreamBuffer : public std::streambuf, boost::noncopyable {
+	public:
+		LargeValueStreamBuffer(OpenFiles& openFiles, IPageAllocator* allocator, size_type valueSize, const PageId& firstLargeValuePageId);
+
+		size_type remainingSize() const;
+
+	protected:
+		virtual int_type underflow();
+
+	private:
+		OpenFiles& openFiles_;
+		LargeValuePage largeValuePage_;
+		const size_type valueSize_;
+		size_type remainingSize_;
+		PageId nextPageId_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
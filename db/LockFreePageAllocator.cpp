@@ -0,0 +1,208 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// LockFreePageAllocator.cpp - a page allocator for multi-threaded use.
+#include "stdafx.h"
+#include <boost/thread/thread.hpp>
+#include <kerio/hashdb/Constants.h>
+#include "utils/ExceptionCreator.h"
+#include "utils/ConfigUtils.h"
+#include "LockFreePageAllocator.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//----------------------------------------------------------------------------
+	// Creation and destruction.
+
+	LockFreePageAllocator::Magazine::Magazine()
+		: busy_(false)
+		, entries_(0)
+	{
+
+	}
+
+	LockFreePageAllocator::LockFreePageAllocator(size_type maximumHeldBytes)
+		: maximumHeldBytes_(maximumHeldBytes)
+		, pageSize_(0)
+		, heldPages_(0)
+		, depot_(maximumHeldBytes / MIN_PAGE_SIZE) // Depot nodes are preallocated for the smallest page size.
+	{
+
+	}
+
+	LockFreePageAllocator::~LockFreePageAllocator()
+	{
+		freeSomeMemory();
+	}
+
+	//----------------------------------------------------------------------------
+	// IPageAllocator methods.
+
+	IPageAllocator::PageMemoryPtr LockFreePageAllocator::allocate(size_type size)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(! isValidPageSize(size));
+
+		// Lazy initialization, all subsequent allocations must use the same size.
+		size_type pageSize = 0;
+		if (! pageSize_.compare_exchange_strong(pageSize, size)) {
+			RAISE_INTERNAL_ERROR_IF(pageSize != size, "requested page size %u differs from page size %u of the allocator", size, pageSize);
+		}
+
+		Entry entry;
+
+		if (popEntry(entry)) {
+			--heldPages_;
+		}
+		else {
+			entry.pageMemory_ = static_cast<value_type*>(malloc(size));
+			entry.counterMemory_ = static_cast<counter_type*>(malloc(sizeof(counter_type)));
+
+			if (entry.pageMemory_ == NULL || entry.counterMemory_ == NULL) {
+				freeEntry(entry);
+				RAISE_INTERNAL_ERROR("Out of memory");
+			}
+		}
+
+		return PageMemoryPtr(this, entry.pageMemory_, entry.counterMemory_);
+	}
+
+	void LockFreePageAllocator::deallocate(value_type* pageMemory, counter_type* counterMemory)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(pageMemory == NULL || counterMemory == NULL);
+
+		const size_type pageSize = pageSize_.load();
+		RAISE_INTERNAL_ERROR_IF_ARG(pageSize == 0);
+
+		Entry entry;
+		entry.pageMemory_ = pageMemory;
+		entry.counterMemory_ = counterMemory;
+
+		const size_type maximumHeldPages = maximumHeldBytes_ / pageSize;
+
+		if (heldPages_.fetch_add(1) >= maximumHeldPages || ! pushEntry(entry)) {
+			--heldPages_;
+			freeEntry(entry);
+		}
+	}
+
+	void LockFreePageAllocator::freeSomeMemory()
+	{
+		for (size_type i = 0; i < MAGAZINES; ++i) {
+			Magazine* magazine = tryAcquireMagazine(magazines_[i]);
+
+			if (magazine != NULL) {
+				while (magazine->entries_ != 0) {
+					freeEntry(magazine->entry_[--magazine->entries_]);
+					--heldPages_;
+				}
+
+				releaseMagazine(magazine);
+			}
+		}
+
+		Entry entry;
+		while (depot_.pop(entry)) {
+			freeEntry(entry);
+			--heldPages_;
+		}
+	}
+
+	size_type LockFreePageAllocator::heldPages()
+	{
+		return heldPages_.load();
+	}
+
+	//----------------------------------------------------------------------------
+	// Magazines and the depot.
+
+	LockFreePageAllocator::Magazine* LockFreePageAllocator::acquireMagazine()
+	{
+		const size_t index = boost::hash<boost::thread::id>()(boost::this_thread::get_id()) % MAGAZINES;
+		return tryAcquireMagazine(magazines_[index]);
+	}
+
+	LockFreePageAllocator::Magazine* LockFreePageAllocator::tryAcquireMagazine(Magazine& magazine)
+	{
+		bool busy = false;
+		const bool acquired = magazine.busy_.compare_exchange_strong(busy, true, boost::memory_order_acquire);
+
+		return (acquired)? &magazine : NULL;
+	}
+
+	void LockFreePageAllocator::releaseMagazine(Magazine* magazine)
+	{
+		magazine->busy_.store(false, boost::memory_order_release);
+	}
+
+	bool LockFreePageAllocator::popEntry(Entry& entry)
+	{
+		Magazine* magazine = acquireMagazine();
+
+		if (magazine != NULL) {
+			const bool found = (magazine->entries_ != 0);
+			if (found) {
+				entry = magazine->entry_[--magazine->entries_];
+			}
+
+			releaseMagazine(magazine);
+
+			if (found) {
+				return true;
+			}
+		}
+
+		return depot_.pop(entry);
+	}
+
+	bool LockFreePageAllocator::pushEntry(const Entry& entry)
+	{
+		Magazine* magazine = acquireMagazine();
+
+		if (magazine != NULL) {
+			const bool pushed = (magazine->entries_ < MAGAZINE_SIZE);
+			if (pushed) {
+				magazine->entry_[magazine->entries_++] = entry;
+			}
+
+			releaseMagazine(magazine);
+
+			if (pushed) {
+				return true;
+			}
+		}
+
+		return depot_.bounded_push(entry);
+	}
+
+	void LockFreePageAllocator::freeEntry(const Entry& entry)
+	{
+		free(entry.pageMemory_);
+		free(entry.counterMemory_);
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,86 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// LockFreePageAllocator.h - a page allocator for multi-threaded use.
+#pragma once
+#include <boost/atomic.hpp>
+#include <boost/lockfree/stack.hpp>
+#include "Environment.h"
+
+namespace kerio {
+namespace hashdb {
+
+	// Released pages are kept in magazines and in a shared lock-free depot. Each thread uses the magazine
+	// selected by its thread id, a magazine used by another thread is bypassed rather than waited for.
+	// Pages which do not fit into the magazine or the depot are returned to malloc.
+
+	class LockFreePageAllocator : public IPageAllocator, boost::noncopyable
+	{
+	public:
+		static const size_type MAGAZINES = 16;
+		static const size_type MAGAZINE_SIZE = 8;
+
+		LockFreePageAllocator(size_type maximumHeldBytes);
+		virtual ~LockFreePageAllocator();
+
+		virtual PageMemoryPtr allocate(size_type size);
+		virtual void deallocate(value_type* pageMemory, counter_type* counterMemory);
+		virtual void freeSomeMemory();
+		virtual size_type heldPages();
+
+	private:
+		struct Entry { // intentionally copyable
+			value_type* pageMemory_;
+			counter_type* counterMemory_;
+		};
+
+		struct Magazine : boost::noncopyable {
+			Magazine();
+
+			boost::atomic<bool> busy_;
+			size_type entries_;
+			Entry entry_[MAGAZINE_SIZE];
+		};
+
+		Magazine* acquireMagazine();
+		Magazine* tryAcquireMagazine(Magazine& magazine);
+		void releaseMagazine(Magazine* magazine);
+
+		bool popEntry(Entry& entry);
+		bool pushEntry(const Entry& entry);
+		static void freeEntry(const Entry& entry);
+
+	private:
+		const size_type maximumHeldBytes_;
+		boost::atomic<size_type> pageSize_;
+		boost::atomic<size_type> heldPages_;
+
+		Magazine magazines_[MAGAZINES];
+		boost::lockfree::stack<Entry> depot_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
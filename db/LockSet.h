@@ -0,0 +1,70 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// LockSet.h - page locks held by a database request.
+#pragma once
+#include "Environment.h"
+
+namespace kerio {
+namespace hashdb {
+
+	// Owner of a lock set, all locks of the set are released on destruction.
+
+	class LockSet : boost::noncopyable {
+	public:
+		LockSet(ILockManager* lockManager)
+			: lockManager_(lockManager)
+			, lockSet_(lockManager->newLockSet())
+		{ }
+
+		~LockSet()
+		{
+			lockManager_->releaseLockSet(lockSet_);
+		}
+
+		void readLock(const PageId& pageId)
+		{
+			lockManager_->acquireReadLock(lockSet_, pageId);
+		}
+
+		void writeLock(const PageId& pageId)
+		{
+			lockManager_->acquireWriteLock(lockSet_, pageId);
+		}
+
+		// Releases all locks, the set can be used to acquire other locks.
+		void release()
+		{
+			lockManager_->releaseLockSet(lockSet_);
+		}
+
+	private:
+		ILockManager* lockManager_;
+		const ILockManager::lockSet_t lockSet_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
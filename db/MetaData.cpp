@@ -27,9 +27,12 @@
 
 // MetaData.cpp - keeps metadata for database page allocation/deallocation.
 #include "stdafx.h"
+#include <algorithm>
 #include "OpenFiles.h"
 #include "MetaData.h"
 #include "BitmapPage.h"
+#include "DataPage.h"
+#include "utils/MurmurHash3Adapter.h"
 
 namespace kerio {
 namespace hashdb {
@@ -54,6 +57,21 @@ namespace hashdb {
 			return (highestBucket + 1) & (highMask >> 1);
 		}
 
+		uint32_t computeBucketSplitTo(const uint32_t newBucket)
+		{
+			// The bucket was split to the new bucket when its number differed from the new one only in the highest bit.
+			return newBucket & (computeMaskFrom(newBucket - 1) >> 1);
+		}
+
+		size_type computeFill(uint64_t dataInlineSize, uint64_t numberOfRecords, uint32_t buckets)
+		{
+			const size_type averageDataPerPage = static_cast<size_type>(dataInlineSize / buckets);
+			const size_type averagePointersPerPage = static_cast<size_type>(numberOfRecords / buckets);
+
+			// Slots of newly written pages hold the record offset and key hash.
+			return averageDataPerPage + (averagePointersPerPage * DataPage::HASHED_SLOT_SIZE);
+		}
+
 	};
 
 
@@ -64,9 +82,11 @@ namespace hashdb {
 		: highestBucket_(openFiles.bucketHeaderPage()->getHighestBucket())
 		, highMask_(computeMaskFrom(highestBucket_))
 		, bucketToSplit_(computeBucketToSplit(highestBucket_, highMask_))
+		, splitPosition_(openFiles.bucketHeaderPage()->getSplitPosition())
 		, numberOfRecords_(openFiles.bucketHeaderPage()->getDatabaseNumberOfRecords())
 		, dataInlineSize_(openFiles.bucketHeaderPage()->getDataSize())
 		, leavePageFreeSpace_(options.leavePageFreeSpace_)
+		, mergeFillPercent_(options.mergeFillPercent_)
 		, overflowFileManager_(environment, openFiles)
 		, bucketPagesAcquired_(0)
 		, overflowPagesAcquired_(0)
@@ -75,7 +95,8 @@ namespace hashdb {
 		, overflowPagesReleased_(0)
 		, largeValuePagesReleased_(0)
 		, splitsOnOverfill_(0)
-		, hashFun_(options.hashFun_)
+		, overflowPagesRelocated_(0)
+		, hashFun_(openFiles.hashFunction())
 		, openFiles_(openFiles)
 		, unsavedChanges_(0)
 		, minFlushFrequency_(options.minFlushFrequency_)
@@ -90,10 +111,11 @@ namespace hashdb {
 	{
 		if ((forceSave && unsavedChanges_ != 0) || (unsavedChanges_ >= minFlushFrequency_)) {
 
-			HeaderPage* bucketHeaderPage = openFiles_.bucketHeaderPage();
+			BucketHeaderPage* bucketHeaderPage = openFiles_.bucketHeaderPage();
 
 			bucketHeaderPage->setHighestPageNumber(highestBucket_ + 1);
 			bucketHeaderPage->setHighestBucket(highestBucket_);
+			bucketHeaderPage->setSplitPosition(splitPosition_);
 			bucketHeaderPage->setDatabaseNumberOfRecords(numberOfRecords_);
 			bucketHeaderPage->setDataSize(dataInlineSize_);
 
@@ -129,14 +151,35 @@ namespace hashdb {
 		return newBucketNumber;
 	}
 
-	uint32_t MetaData::bucketForKey(const boost::string_ref& key) const
+	uint32_t MetaData::hashKey(const boost::string_ref& key) const
+	{
+		return hashFun_(key.data(), key.size());
+	}
+
+	void MetaData::hashKeys(const boost::string_ref* keys, size_t count, uint32_t* hashes) const
+	{
+		if (hashFun_ == murmur3Hash) {
+			murmur3HashMany(keys, count, hashes);
+		}
+		else {
+			for (size_t i = 0; i < count; ++i) {
+				hashes[i] = hashKey(keys[i]);
+			}
+		}
+	}
+
+	uint32_t MetaData::bucketForHash(uint32_t hash) const
 	{
-		const uint32_t hash = hashFun_(key.data(), key.size());
 		const uint32_t bucket = hash & highMask_;
 
 		return (bucket > highestBucket_)? (bucket & (highMask_ >> 1)) : bucket;
 	}
 
+	uint32_t MetaData::bucketForKey(const boost::string_ref& key) const
+	{
+		return bucketForHash(hashKey(key));
+	}
+
 	uint32_t MetaData::highestBucket() const
 	{
 		return highestBucket_;
@@ -146,6 +189,71 @@ namespace hashdb {
 	{
 		return bucketToSplit_;
 	}
+
+	uint32_t MetaData::beginSplit()
+	{
+		RAISE_INTERNAL_ERROR_IF(isSplitInProgress(), "split of bucket %u is already in progress", bucketBeingSplit());
+
+		const uint32_t newBucket = newBucketNumber();
+		splitPosition_ = 1;
+
+		return newBucket;
+	}
+
+	void MetaData::endSplit()
+	{
+		RAISE_INTERNAL_ERROR_IF(! isSplitInProgress(), "no split is in progress");
+
+		splitPosition_ = 0;
+		increaseSaveImportance();
+	}
+
+	bool MetaData::isSplitInProgress() const
+	{
+		return splitPosition_ != 0;
+	}
+
+	uint32_t MetaData::bucketBeingSplit() const
+	{
+		RAISE_INTERNAL_ERROR_IF(! isSplitInProgress(), "no split is in progress");
+		return computeBucketSplitTo(highestBucket_);
+	}
+
+	uint32_t MetaData::bucketToMergeTo() const
+	{
+		RAISE_INTERNAL_ERROR_IF(highestBucket_ == 0, "bucket 0 cannot be merged");
+		return computeBucketSplitTo(highestBucket_);
+	}
+
+	void MetaData::releaseHighestBucket()
+	{
+		RAISE_INTERNAL_ERROR_IF(highestBucket_ == 0, "bucket 0 cannot be released");
+		RAISE_INTERNAL_ERROR_IF(isSplitInProgress(), "bucket %u cannot be released while it is being split to", highestBucket_);
+
+		--highestBucket_;
+
+		highMask_ = computeMaskFrom(highestBucket_);
+		bucketToSplit_ = computeBucketToSplit(highestBucket_, highMask_);
+
+		++bucketPagesReleased_;
+		increaseSaveImportance();
+	}
+
+	uint32_t MetaData::splitPageIndex() const
+	{
+		RAISE_INTERNAL_ERROR_IF(! isSplitInProgress(), "no split is in progress");
+		return splitPosition_ - 1;
+	}
+
+	void MetaData::setSplitPageIndex(uint32_t pageIndex)
+	{
+		RAISE_INTERNAL_ERROR_IF(! isSplitInProgress(), "no split is in progress");
+
+		if (splitPosition_ != pageIndex + 1) {
+			splitPosition_ = pageIndex + 1;
+			increaseSaveImportance();
+		}
+	}
 	
     //----------------------------------------------------------------------------
 	// Management of the overflow file.
@@ -186,6 +294,35 @@ namespace hashdb {
 		overflowFileManager_.releaseOverflowPageNumber(pageNumber);
 	}
 
+	//----------------------------------------------------------------------------
+	// Compaction of the overflow file.
+
+	uint32_t MetaData::relocateOverflowFilePage(uint32_t pageNumber)
+	{
+		// Returns zero if there is no free page below the relocated one.
+		const uint32_t newPageNumber = overflowFileManager_.acquireOverflowPageNumberBelow(pageNumber);
+
+		if (newPageNumber != 0) {
+			overflowFileManager_.releaseOverflowPageNumber(pageNumber);
+			++overflowPagesRelocated_;
+		}
+
+		return newPageNumber;
+	}
+
+	uint32_t MetaData::compactedHighestOverflowFilePage() const
+	{
+		return overflowFileManager_.compactedHighestPage();
+	}
+
+	uint32_t MetaData::truncateOverflowFile()
+	{
+		const uint32_t highestPage = overflowFileManager_.truncate();
+		increaseSaveImportance();
+
+		return highestPage;
+	}
+
     //----------------------------------------------------------------------------
     // Statistics.
 
@@ -214,6 +351,11 @@ namespace hashdb {
 		increaseSaveImportance();
 	}
 
+	uint64_t MetaData::numberOfRecords() const
+	{
+		return numberOfRecords_;
+	}
+
 	void MetaData::incrementOverfillStatistics()
 	{
 		++splitsOnOverfill_;
@@ -221,11 +363,7 @@ namespace hashdb {
 
 	kerio::hashdb::size_type MetaData::actualFill(size_type recordInlineSize) const
 	{
-		const size_type buckets = highestBucket_ + 1;
-		const size_type averageDataPerPage = static_cast<size_type>((dataInlineSize_ + recordInlineSize) / buckets);
-		const size_type averagePointersPerPage = static_cast<size_type>((numberOfRecords_ + 1) / buckets);
-
-		return averageDataPerPage + (averagePointersPerPage * sizeof(uint16_t));
+		return computeFill(dataInlineSize_ + recordInlineSize, numberOfRecords_ + 1, highestBucket_ + 1);
 	}
 
 	kerio::hashdb::size_type MetaData::expectedFill() const
@@ -245,6 +383,29 @@ namespace hashdb {
 		return computedActualFill > computedExpectedFill;
 	}
 
+	bool MetaData::isUnderfill() const
+	{
+		// Merge is the inverse of the split. The fill after the merge must stay well below the split threshold,
+		// otherwise the next store could split the merged bucket again.
+		if (mergeFillPercent_ == 0 || highestBucket_ == 0) {
+			return false;
+		}
+
+		const uint64_t fillAfterMerge = computeFill(dataInlineSize_, numberOfRecords_, highestBucket_);
+		return (fillAfterMerge * 100) < (static_cast<uint64_t>(expectedFill()) * mergeFillPercent_);
+	}
+
+	uint32_t MetaData::bucketsForFill(uint64_t numberOfRecords, uint64_t dataInlineSize) const
+	{
+		// Smallest number of buckets whose actual fill does not exceed the expected fill.
+		const uint64_t fill = dataInlineSize + (numberOfRecords * DataPage::HASHED_SLOT_SIZE);
+		const uint64_t computedExpectedFill = std::max<uint64_t>(expectedFill(), 1);
+		const uint64_t buckets = (fill + computedExpectedFill - 1) / computedExpectedFill;
+
+		RAISE_INVALID_ARGUMENT_IF(buckets >= std::numeric_limits<uint32_t>::max(), "database is full: buckets exhausted");
+		return (buckets != 0)? static_cast<uint32_t>(buckets) : 1;
+	}
+
 	Statistics MetaData::statistics() const
 	{
 		Statistics stats;
@@ -258,8 +419,10 @@ namespace hashdb {
 		stats.overflowPagesReleased_ = overflowPagesReleased_;
 		stats.largeValuePagesReleased_ = largeValuePagesReleased_;
 		stats.bitmapPagesReleased_ = overflowFileManager_.bitmapPagesReleased();
+		stats.bitmapPagesRead_ = overflowFileManager_.bitmapPagesRead();
 
 		stats.splitsOnOverfill_ = splitsOnOverfill_;
+		stats.overflowPagesRelocated_ = overflowPagesRelocated_;
 		stats.cachedPages_ = overflowFileManager_.heldPages();
 
 		stats.pageSize_ = openFiles_.pageSize();
@@ -48,10 +48,24 @@ namespace hashdb {
 	public:
 		uint32_t newBucketNumber();
 
+		uint32_t hashKey(const boost::string_ref& key) const;
+		void hashKeys(const boost::string_ref* keys, size_t count, uint32_t* hashes) const;
+		uint32_t bucketForHash(uint32_t hash) const;
 		uint32_t bucketForKey(const boost::string_ref& key) const;
 		uint32_t highestBucket() const;
 		uint32_t bucketToSplit() const;
 
+		// Incremental split of a bucket to the highest bucket.
+		uint32_t beginSplit();
+		void endSplit();
+		bool isSplitInProgress() const;
+		uint32_t bucketBeingSplit() const;
+		uint32_t splitPageIndex() const;
+		void setSplitPageIndex(uint32_t pageIndex);
+
+		// Merge of the highest bucket to the bucket it was split from.
+		uint32_t bucketToMergeTo() const;
+		void releaseHighestBucket();
 
         // Management of the overflow file.
 	public:
@@ -61,6 +75,11 @@ namespace hashdb {
 		uint32_t acquireLargeValuePageNumber();
 		void releaseLargeValuePageNumber(uint32_t pageNumber);
 
+		// Compaction of the overflow file.
+		uint32_t relocateOverflowFilePage(uint32_t pageNumber);
+		uint32_t compactedHighestOverflowFilePage() const;
+		uint32_t truncateOverflowFile();
+
 	private:
 		uint32_t doAcquireOverflowFilePageNumber();
 		void doReleaseOverflowFilePageNumber(uint32_t pageNumber);
@@ -69,10 +88,13 @@ namespace hashdb {
 	public:
 		void recordAdded(size_type recordInlineSize);
 		void recordRemoved(size_type recordInlineSize);
+		uint64_t numberOfRecords() const;
 		void incrementOverfillStatistics();
 		size_type actualFill(size_type recordInlineSize) const;
 		size_type expectedFill() const;
 		bool isOverfill(size_type recordInlineSize) const;
+		bool isUnderfill() const;
+		uint32_t bucketsForFill(uint64_t numberOfRecords, uint64_t dataInlineSize) const;
 
 		Statistics statistics() const;
 
@@ -83,9 +105,11 @@ namespace hashdb {
 		uint32_t highestBucket_; 
 		uint32_t highMask_;			// Must be declared after highestBucket_, see the ctor.
 		uint32_t bucketToSplit_;	// Must be declared after highMask_, see the ctor.
+		uint32_t splitPosition_;	// 0 or 1 + index of the page where the incremental split continues.
 		uint64_t numberOfRecords_;
 		uint64_t dataInlineSize_;
 		int32_t leavePageFreeSpace_;
+		size_type mergeFillPercent_;
 
 		OverflowFilePageAllocator overflowFileManager_;
 
@@ -99,6 +123,7 @@ namespace hashdb {
 		size_type largeValuePagesReleased_;
 
 		size_type splitsOnOverfill_;
+		size_type overflowPagesRelocated_;
 
 		Options::hashFun_t hashFun_;
 		OpenFiles& openFiles_;
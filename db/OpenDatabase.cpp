@@ -28,174 +28,307 @@
 // OpenDatabase.cpp - represents an open database.
 #include "stdafx.h"
 #include <limits>
+#include <algorithm>
 #include <iostream>
-#include <boost/iostreams/device/array.hpp>
-#include <boost/iostreams/stream.hpp>
+#include <boost/filesystem.hpp>
 #include <kerio/hashdb/StringOrReference.h>
 #include "BucketDataPage.h"
 #include "OverflowDataPage.h"
 #include "LargeValuePage.h"
+#include "LargeValueStreamBuffer.h"
 #include "DataPageCursor.h"
+#include "LockSet.h"
 #include "OpenDatabase.h"
 
 namespace kerio {
 namespace hashdb {
 
 	//-------------------------------------------------------------------------
-	// Utilities.
+	// Page locks.
+	//
+	// Requests acquire locks in this order: metadata, bucket table, bucket chains.
+	// Requests which modify the database write lock the metadata, so they are serialized with each other,
+	// but they run concurrently with readers of other bucket chains. The bucket table is write locked
+	// only by a split, a bucket chain lock covers the overflow pages and large values of the bucket.
+	// While a bucket is split incrementally, requests for keys of the new bucket lock both chains in ascending order.
 
-	template<typename T>
-	class PageLoader
-	{
-	public:
-		PageLoader(Environment& environment, OpenFiles& openFiles)
-			: openFiles_(openFiles)
-			, page_(environment.pageAllocator(), openFiles.pageSize())
-		{
+	namespace {
 
+		PageId metaDataLock()
+		{
+			return overflowFilePage(0);
 		}
 
-		~PageLoader()
+		PageId bucketTableLock()
 		{
-			openFiles_.write(page_);
+			return bucketFilePage(0);
 		}
 
-		T& page(const PageId& pageId)
+		PageId bucketChainLock(uint32_t bucketNumber)
 		{
-			if (page_.getId() != pageId) {
-				save();
-				load(pageId);
-				page_.validate();
-			}
-
-			return page_;
+			return bucketFilePage(bucketNumber + 1);
 		}
 
-		T& newPage(const uint32_t pageNumber)
+	} // anonymous namespace
+
+	//-------------------------------------------------------------------------
+	// Access order for read/write/delete batches.
+
+	class BatchReorderItem {
+	public:
+
+		BatchReorderItem()
+			: index_(0)
+			, keyHash_(0)
+			, bucketNumber_(0)
+		{ }
+
+		explicit BatchReorderItem(size_t index)
+			: index_(index)
+			, keyHash_(0)
+			, bucketNumber_(0)
+		{ }
+
+		size_t index() const
 		{
-			if (page_.getId().pageNumber() != pageNumber) {
-				save();
-			}
+			return index_;
+		}
 
-			page_.setUp(pageNumber);
-			return page_;
+		uint32_t keyHash() const
+		{
+			return keyHash_;
 		}
 
-		void invalidate()
+		uint32_t bucketNumber() const
 		{
-			page_.disown();
+			return bucketNumber_;
 		}
 
-		void save()
+		void setKeyHash(uint32_t keyHash, uint32_t bucketNumber)
 		{
-			if (page_.getId().isValid()) {
-				openFiles_.write(page_);
-			}
+			keyHash_ = keyHash;
+			bucketNumber_ = bucketNumber;
 		}
 
-	private:
-		void load(const PageId& pageId)
+		bool operator<(const BatchReorderItem& right) const
 		{
-			openFiles_.read(page_, pageId);
+			return bucketNumber_ < right.bucketNumber_;
 		}
 
-		OpenFiles& openFiles_;
-		T page_;
+	private:
+		size_t index_;
+		uint32_t keyHash_;
+		uint32_t bucketNumber_;
 	};
 
-	// This initial implementation of SingleRequestCache holds only a single instance of bucket page and a single instance of overflow page.
-	// A reference to the instance is valid only until the next call to the cache.
-	class SingleRequestCache {
-	public:
-		SingleRequestCache(Environment& environment, OpenFiles& openFiles)
-			: bucketPageLoader_(environment, openFiles)
-			, overflowPageLoader_(environment, openFiles)
-		{ }
+	typedef Vector<BatchReorderItem, OpenDatabase::ASSUMED_BATCH_SIZE_MAX_SIZE> batchAccessVector_t;
 
-		DataPage& dataPage(const PageId& pageId)
-		{
-			if (pageId.fileType() == PageId::BucketFileType) {
-				return bucketPageLoader_.page(pageId);
+	// Keys are hashed in small groups, so that several of them are hashed in parallel.
+	// The hash is kept in the item and reused for the lookup, so each key is hashed only once per batch.
+	const size_t KEYS_HASHED_AT_ONCE = 8;
+
+	void setKeyHashes(batchAccessVector_t& accessOrder, size_t first, const MetaData& metaData, const boost::string_ref* keys, size_t count)
+	{
+		uint32_t hashes[KEYS_HASHED_AT_ONCE];
+		metaData.hashKeys(keys, count, hashes);
+
+		for (size_t j = 0; j < count; ++j) {
+			accessOrder[first + j].setKeyHash(hashes[j], metaData.bucketForHash(hashes[j]));
+		}
+	}
+
+	void hashAccessOrderKeys(batchAccessVector_t& accessOrder, const MetaData& metaData, const IKeyProducer& batch)
+	{
+		std::vector<StringOrReference> keyHolders;
+		keyHolders.reserve(KEYS_HASHED_AT_ONCE);
+		boost::string_ref keys[KEYS_HASHED_AT_ONCE];
+
+		for (size_t first = 0; first < accessOrder.size(); first += KEYS_HASHED_AT_ONCE) {
+			const size_t count = std::min(KEYS_HASHED_AT_ONCE, accessOrder.size() - first);
+
+			keyHolders.clear();
+			for (size_t j = 0; j < count; ++j) {
+				keyHolders.push_back(batch.keyAt(accessOrder[first + j].index()));
 			}
-			else {
-				return overflowPageLoader_.page(pageId);
+
+			for (size_t j = 0; j < count; ++j) {
+				keys[j] = keyHolders[j].getRef();
 			}
+
+			setKeyHashes(accessOrder, first, metaData, keys, count);
 		}
+	}
 
-		OverflowDataPage& newOverflowPage(uint32_t newPageNumber)
-		{
-			OverflowDataPage& newPage = overflowPageLoader_.newPage(newPageNumber);
-			return newPage;
+	void hashAccessOrderKeys(batchAccessVector_t& accessOrder, const MetaData& metaData, const FlatBatch& batch)
+	{
+		boost::string_ref keys[KEYS_HASHED_AT_ONCE];
+
+		for (size_t first = 0; first < accessOrder.size(); first += KEYS_HASHED_AT_ONCE) {
+			const size_t count = std::min(KEYS_HASHED_AT_ONCE, accessOrder.size() - first);
+
+			for (size_t j = 0; j < count; ++j) {
+				keys[j] = batch.keyAt(accessOrder[first + j].index());
+			}
+
+			setKeyHashes(accessOrder, first, metaData, keys, count);
 		}
+	}
 
-		void save()
-		{
-			bucketPageLoader_.save();
-			overflowPageLoader_.save();
+	void removeKeysRejectedByFilter(batchAccessVector_t& accessOrder, const KeyFilter& keyFilter)
+	{
+		size_t keptItems = 0;
+
+		for (size_t i = 0; i < accessOrder.size(); ++i) {
+			if (keyFilter.mayContain(accessOrder[i].keyHash())) {
+				accessOrder[keptItems++] = accessOrder[i];
+			}
+		}
+
+		accessOrder.resize(keptItems);
+	}
+
+	template <class Batch>
+	void createBatchAccessOrder(batchAccessVector_t& accessOrder, const MetaData& metaData, const Batch& batch)
+	{
+		const size_type batchSize = static_cast<size_type>(batch.count());
+		accessOrder.reserve(batchSize);
+
+		for (size_type i = 0; i < batchSize; ++i) {
+			accessOrder.push_back(BatchReorderItem(i));
+		}
+
+		hashAccessOrderKeys(accessOrder, metaData, batch);
+		accessOrder.sort();
+	}
+
+	bool isPageOfLowerBucket(const std::pair<uint32_t, PageCache::DataPagePtr>& left, const std::pair<uint32_t, PageCache::DataPagePtr>& right)
+	{
+		return left.first < right.first;
+	}
+
+	void prefetchBucketPages(PageCache& pageCache, const batchAccessVector_t& accessOrder)
+	{
+		std::vector<uint32_t> pageNumbers;
+		pageNumbers.reserve(accessOrder.size());
+
+		for (batchAccessVector_t::const_iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
+			const uint32_t pageNumber = ii->bucketNumber() + 1;
+
+			if (pageNumbers.empty() || pageNumbers.back() != pageNumber) {
+				pageNumbers.push_back(pageNumber);
+			}
 		}
 
-		void invalidate()
+		pageCache.prefetch(PageId::BucketFileType, pageNumbers);
+	}
+
+	// Appends visited values to the results of a flat batch.
+	class FlatBatchResultVisitor : public IValueVisitor {
+	public:
+		FlatBatchResultVisitor(FlatBatch& batch, size_t index)
+			: batch_(batch)
+			, index_(index)
+		{ }
+
+		virtual bool visit(const boost::string_ref& valuePart, size_t /* offset */, size_t /* valueSize */)
 		{
-			bucketPageLoader_.invalidate();
-			overflowPageLoader_.invalidate();
+			batch_.appendResultAt(index_, valuePart);
+			return true;
 		}
 
 	private:
-		PageLoader<BucketDataPage> bucketPageLoader_;
-		PageLoader<OverflowDataPage> overflowPageLoader_;
+		FlatBatch& batch_;
+		const size_t index_;
 	};
 
-	//-------------------------------------------------------------------------
-	// Access order for read/write/delete batches.
-
-	class BatchReorderItem {
+	// Receives the value of the record found by OpenDatabase::visitSingleValue() while the chain is read locked.
+	// Returns true if the value was consumed.
+	class RecordValueVisitor {
 	public:
+		virtual bool visitInlineValue(const boost::string_ref& value) = 0;
+		virtual bool visitLargeValue(size_type valueSize, const PageId& firstLargeValuePageId) = 0;
 
-		BatchReorderItem(size_t index, uint32_t bucketNumber)
-			: index_(index)
-			, bucketNumber_(bucketNumber)
+		virtual ~RecordValueVisitor() { }
+	};
+
+	// Passes the value to a visitor of the public API, a large value in page-sized parts.
+	class ValueVisitorAdapter : public RecordValueVisitor {
+	public:
+		ValueVisitorAdapter(OpenDatabase& database, IValueVisitor& visitor)
+			: database_(database)
+			, visitor_(visitor)
 		{ }
 
-		size_t index() const
+		virtual bool visitInlineValue(const boost::string_ref& value)
 		{
-			return index_;
+			visitor_.visit(value, 0, value.size());
+			return true;
 		}
 
-		bool operator<(const BatchReorderItem& right) const
+		virtual bool visitLargeValue(size_type valueSize, const PageId& firstLargeValuePageId)
 		{
-			return bucketNumber_ < right.bucketNumber_;
+			database_.visitLargeValue(visitor_, valueSize, firstLargeValuePageId);
+			return true;
 		}
 
 	private:
-		size_t index_;
-		uint32_t bucketNumber_;
+		OpenDatabase& database_;
+		IValueVisitor& visitor_;
 	};
 
-	typedef Vector<BatchReorderItem, OpenDatabase::ASSUMED_BATCH_SIZE_MAX_SIZE> batchAccessVector_t;
+	// Sets the value to a read batch, a large value is read as the consumer pulls the data.
+	class ReadBatchConsumerAdapter : public RecordValueVisitor {
+	public:
+		ReadBatchConsumerAdapter(OpenFiles& openFiles, IPageAllocator* allocator, IReadBatch& readBatch, size_t index)
+			: openFiles_(openFiles)
+			, allocator_(allocator)
+			, readBatch_(readBatch)
+			, index_(index)
+		{ }
 
-	void createBatchAccessOrder(batchAccessVector_t& accessOrder, const MetaData& metaData, const IKeyProducer& batch)
-	{
-		const size_type batchSize = static_cast<size_type>(batch.count());
-		accessOrder.reserve(batchSize);
+		virtual bool visitInlineValue(const boost::string_ref& value)
+		{
+			return readBatch_.setValueAt(index_, value);
+		}
 
-		for (size_type i = 0; i < batchSize; ++i) {
-			const StringOrReference	keyHolder = batch.keyAt(i);
-			const uint32_t bucket = metaData.bucketForKey(keyHolder.getRef());
-			accessOrder.emplace_back(i, bucket);
+		virtual bool visitLargeValue(size_type valueSize, const PageId& firstLargeValuePageId)
+		{
+			LargeValueStreamBuffer streamBuffer(openFiles_, allocator_, valueSize, firstLargeValuePageId);
+			std::istream stream(&streamBuffer);
+			stream.exceptions(std::ios_base::badbit); // Rethrow errors raised when reading the pages.
+
+			return readBatch_.setLargeValueAt(index_, stream, valueSize);
 		}
 
-		accessOrder.sort();
-	}
+	private:
+		OpenFiles& openFiles_;
+		IPageAllocator* allocator_;
+		IReadBatch& readBatch_;
+		const size_t index_;
+	};
 
 	//-------------------------------------------------------------------------
 	// Creation and destruction.
 
 	OpenDatabase::OpenDatabase(const boost::filesystem::path& database, const Options& options)
-		: environment_(options)
+		: database_(database)
+		, environment_(options)
 		, openFiles_(database, options, environment_)
 		, metaData_(environment_, openFiles_, options)
+		, pageCache_(environment_, openFiles_, options)
+		, keyFilter_(options.keyFilterBytes_)
+		, keyFilterRebuildBucket_(0)
+		, recordCache_(options.recordCacheBytes_)
 		, storeThrowIfLargerThan_(options.storeThrowIfLargerThan_)
 		, fetchIgnoreIfLargerThan_(options.fetchIgnoreIfLargerThan_)
+		, splitPagesPerStore_(options.splitPagesPerStore_)
+		, readOnly_(options.readOnly_)
+		, bulkLoadBufferBytes_(options.bulkLoadBufferBytes_)
+		, bulkLoadInProgress_(false)
+		, compactionInProgress_(false)
+		, compactionLimit_(0)
+		, compactionBucket_(0)
+		, bucketFileTruncationPending_(false)
 	{
 		if (openFiles_.isNew()) {
 			size_type bucketsToCreate = options.initialBuckets_;
@@ -206,6 +339,75 @@ namespace hashdb {
 		else {
 			HASHDB_LOG_DEBUG("Number of buckets in database is %u", metaData_.highestBucket() + 1);
 		}
+
+		openKeyFilter();
+	}
+
+	void OpenDatabase::openKeyFilter()
+	{
+		const boost::filesystem::path fileName = OpenFiles::databaseNameToKeyFilterFileName(database_);
+
+		if (keyFilter_.isEnabled()) {
+			if (openFiles_.isNew()) {
+				keyFilter_.setValid();
+			}
+			else if (keyFilter_.load(fileName, metaData_.numberOfRecords())) {
+				HASHDB_LOG_DEBUG("Loaded key filter from %s", fileName.string());
+			}
+			else {
+				// Open does not scan the database. Fetches scan the buckets one by one until the filter can be used.
+				keyFilter_.beginRebuild();
+				HASHDB_LOG_DEBUG("Key filter will be rebuilt from %u buckets", metaData_.highestBucket() + 1);
+			}
+		}
+
+		// The saved filter becomes stale with the first change. It is saved again when the database is closed,
+		// so a filter left behind by a crash is never used.
+		if (! readOnly_) {
+			boost::system::error_code removeError;
+			boost::filesystem::remove(fileName, removeError);
+			RAISE_IO_ERROR_IF(removeError, "key filter file \"%s\" cannot be deleted: %s", fileName.string(), removeError.message());
+		}
+	}
+
+	void OpenDatabase::advanceKeyFilterRebuild()
+	{
+		if (! keyFilter_.isRebuilding()) {
+			return;
+		}
+
+		// Each request scans a single bucket chain before taking its own locks. Concurrent requests do not wait for the one scanning.
+		boost::mutex::scoped_lock rebuildLock(keyFilterRebuildMutex_, boost::try_to_lock);
+		if (! rebuildLock.owns_lock() || ! keyFilter_.isRebuilding()) {
+			return;
+		}
+
+		LockSet bucketLocks(environment_.lockManager());
+		bucketLocks.readLock(bucketTableLock());
+
+		// Stores add their keys meanwhile. Splits move records to buckets not scanned yet, merges add the moved keys.
+		if (keyFilterRebuildBucket_ > metaData_.highestBucket()) {
+			keyFilter_.setValid();
+			HASHDB_LOG_DEBUG("Rebuilt key filter from %u records", static_cast<size_type>(metaData_.numberOfRecords()));
+			return;
+		}
+
+		const uint32_t bucketNumber = keyFilterRebuildBucket_++;
+		PageId pageId(bucketFilePage(bucketNumber + 1));
+		size_type numberOfTraversedPages = 0;
+
+		bucketLocks.readLock(bucketChainLock(bucketNumber));
+
+		while (pageId.isValid()) {
+			const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+
+			for (DataPageCursor cursor(page.get()); cursor.isValid(); cursor.next()) {
+				keyFilter_.add(recordKeyHash(cursor));
+			}
+
+			pageId = page->nextOverflowPageId();
+			incrementTraversedPages(numberOfTraversedPages, pageId);
+		}
 	}
 
 	void OpenDatabase::createInitialBucketPages(const size_type initialBuckets)
@@ -219,13 +421,27 @@ namespace hashdb {
 			openFiles_.write(bucketPage);
 		}
 
-		flush();
+		saveBuffers();
 	}
 
 	void OpenDatabase::close()
 	{
-		flush();
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+		compactDeadRecords();
+		locks.writeLock(bucketTableLock());
+
+		saveBuffers();
+		pageCache_.clear();
+
+		truncateBucketFile();
+		openFiles_.checkpoint();
 		openFiles_.close();
+
+		if (! readOnly_ && keyFilter_.isWorthSaving(metaData_.numberOfRecords())) {
+			keyFilter_.save(OpenFiles::databaseNameToKeyFilterFileName(database_), metaData_.numberOfRecords());
+		}
 	}
 
 	bool OpenDatabase::isClosed() const
@@ -251,20 +467,72 @@ namespace hashdb {
 
 	void OpenDatabase::flush()
 	{
-		metaData_.save(true);
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+		compactDeadRecords();
+
+		// Finish the incremental split, if any.
+		if (! readOnly_ && metaData_.isSplitInProgress()) {
+			locks.writeLock(bucketTableLock());
+			advanceSplit(0);
+		}
+
+		saveBuffers();
+		truncateBucketFile();
+	}
+
+	void OpenDatabase::truncateBucketFile()
+	{
+		// Drops pages of merged buckets. The header page is followed by a page of each bucket.
+		if (bucketFileTruncationPending_) {
+			openFiles_.truncate(PageId::BucketFileType, metaData_.highestBucket() + 2);
+			bucketFileTruncationPending_ = false;
+		}
 	}
 
 	void OpenDatabase::sync()
 	{
-		flush();
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		saveBuffers();
 		openFiles_.sync();
 	}
 
+	void OpenDatabase::saveBuffers()
+	{
+		pageCache_.save();
+		metaData_.save(true);
+		openFiles_.commit();
+	}
+
+	void OpenDatabase::saveRequestChanges()
+	{
+		// Each write request is committed to the write-ahead log as a whole.
+		if (openFiles_.logsWrites()) {
+			saveBuffers();
+		}
+		else {
+			metaData_.save();
+		}
+	}
+
 	//-------------------------------------------------------------------------
 	// Releasing unnecessary resources.
 
 	void OpenDatabase::releaseSomeResources()
 	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+		compactDeadRecords();
+		locks.writeLock(bucketTableLock());
+
+		pageCache_.clear();
 		environment_.pageAllocator()->freeSomeMemory();
 	}
 
@@ -281,24 +549,40 @@ namespace hashdb {
 
 	std::vector<partNum_t> OpenDatabase::listParts(const boost::string_ref& key)
 	{
-		const uint32_t bucketNumber = metaData_.bucketForKey(key);
-		PageId pageId(bucketFilePage(bucketNumber + 1));
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.readLock(bucketTableLock());
 
-		SingleRequestCache cache(environment_, openFiles_);
 		std::vector<partNum_t> rv;
-		size_type numberOfTraversedPages = 0;
+		const uint32_t keyHash = metaData_.hashKey(key);
 
-		while (pageId.isValid()) {
-			DataPage& page = cache.dataPage(pageId);
+		if (! keyFilter_.mayContain(keyHash)) {
+			return rv;
+		}
 
-			DataPageCursor cursor(&page);
-			while (cursor.find(key)) {
-				rv.push_back(cursor.partNum());
-				cursor.next();
-			}
+		uint32_t buckets[MAX_BUCKETS_FOR_KEY];
+		const size_type numberOfBuckets = bucketsForHash(keyHash, buckets);
 
-			pageId = page.nextOverflowPageId();
-			incrementTraversedPages(numberOfTraversedPages, pageId);
+		for (size_type i = 0; i < numberOfBuckets; ++i) {
+			PageId pageId(bucketFilePage(buckets[i] + 1));
+			locks.readLock(bucketChainLock(buckets[i]));
+
+			size_type numberOfTraversedPages = 0;
+
+			while (pageId.isValid()) {
+				const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+
+				DataPageCursor cursor(page.get());
+				while (cursor.find(key, keyHash)) {
+					rv.push_back(cursor.partNum());
+					cursor.next();
+				}
+
+				pageId = page->nextOverflowPageId();
+				incrementTraversedPages(numberOfTraversedPages, pageId);
+			}
 		}
 
 		std::sort(rv.begin(), rv.end());
@@ -333,56 +617,61 @@ namespace hashdb {
 		RAISE_DATABASE_CORRUPTED_IF(largeValuePageId.isValid(), "actual large value size is greater than %u recorded in metadata", valueSize);
 	}
 
-	bool OpenDatabase::fetchSingleValueAt(SingleRequestCache& cache, IReadBatch& readBatch, size_t index)
+	void OpenDatabase::visitLargeValue(IValueVisitor& visitor, const size_type valueSize, const PageId& firstLargeValuePageId)
 	{
-		const StringOrReference keyHolder = readBatch.keyAt(index);
-		const boost::string_ref key = keyHolder.getRef();
-		
-		const partNum_t partNum = readBatch.partNumAt(index);
-		const RecordId recordId(key, partNum);
+		LargeValuePage largeValuePage(environment_.pageAllocator(), openFiles_.pageSize());
+		PageId largeValuePageId = firstLargeValuePageId;
+		size_type offset = 0;
 
-		const uint32_t bucketNumber = metaData_.bucketForKey(key);
-		PageId pageId(bucketFilePage(bucketNumber + 1));
+		while (offset < valueSize) {
+			RAISE_DATABASE_CORRUPTED_IF(! largeValuePageId.isValid(), "actual large value size is smaller than %u recorded in metadata", valueSize);
 
-		bool success = false;
-		while (! success && pageId.isValid()) {
-			DataPage& page = cache.dataPage(pageId);
+			openFiles_.read(largeValuePage, largeValuePageId);
+			const boost::string_ref valuePart = largeValuePage.valuePart(valueSize - offset);
 
-			DataPageCursor cursor(&page);
-			if (cursor.find(recordId)) {
-				
-				if (cursor.isInlineValue()) {
-					success = readBatch.setValueAt(index, cursor.inlineValue());
-					break;
-				}
-				else {
-					std::string fetchedValue;
-					const size_type valueSize = cursor.largeValueSize();
+			if (! visitor.visit(valuePart, offset, valueSize)) {
+				return;
+			}
 
-					if (fetchIgnoreIfLargerThan_ != 0 && valueSize > fetchIgnoreIfLargerThan_) {
-						break;
-					}
+			offset += static_cast<size_type>(valuePart.size());
+			largeValuePageId = largeValuePage.nextLargeValuePageId();
+		}
 
-					// TODO: fetch the value on demand rather than at once.
-					fetchLargeValue(fetchedValue, valueSize, cursor.firstLargeValuePageId());
+		RAISE_DATABASE_CORRUPTED_IF(largeValuePageId.isValid(), "actual large value size is greater than %u recorded in metadata", valueSize);
+	}
 
-					typedef boost::iostreams::basic_array_source<char> Device;
-					boost::iostreams::stream<Device> stream(fetchedValue.data(), fetchedValue.size());
+	bool OpenDatabase::fetchCachedValueAt(IReadBatch& readBatch, size_t index, bool& success)
+	{
+		if (! recordCache_.isEnabled()) {
+			return false;
+		}
 
-					success = readBatch.setLargeValueAt(index, stream, valueSize);
-					break;
-				}
-			}
+		const StringOrReference keyHolder = readBatch.keyAt(index);
+		std::string value;
 
-			pageId = page.nextOverflowPageId();
+		if (! recordCache_.fetch(keyHolder.getRef(), readBatch.partNumAt(index), value)) {
+			return false;
 		}
 
-		return success;
+		success = readBatch.setValueAt(index, value);
+		return true;
+	}
+
+	bool OpenDatabase::fetchSingleValueAt(IReadBatch& readBatch, size_t index, uint32_t keyHash)
+	{
+		const StringOrReference keyHolder = readBatch.keyAt(index);
+		ReadBatchConsumerAdapter consumer(openFiles_, environment_.pageAllocator(), readBatch, index);
+
+		return visitSingleValue(keyHolder.getRef(), keyHash, readBatch.partNumAt(index), consumer, true);
 	}
 
 	bool OpenDatabase::fetch(IReadBatch& readBatchRef)
 	{
-		SingleRequestCache cache(environment_, openFiles_);
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.readLock(bucketTableLock());
 
 		const size_type batchSize = static_cast<size_type>(readBatchRef.count());
 		size_type valuesFoundAndSet = 0;
@@ -390,7 +679,14 @@ namespace hashdb {
 		if (batchSize < MIN_BATCH_SIZE_TO_REORDER) {
 
 			for (size_type i = 0; i < batchSize; ++i) {
-				if (fetchSingleValueAt(cache, readBatchRef, i)) {
+				bool success = false;
+
+				if (! fetchCachedValueAt(readBatchRef, i, success)) {
+					const StringOrReference keyHolder = readBatchRef.keyAt(i);
+					success = fetchSingleValueAt(readBatchRef, i, metaData_.hashKey(keyHolder.getRef()));
+				}
+
+				if (success) {
 					++valuesFoundAndSet;
 				}
 			}
@@ -398,12 +694,29 @@ namespace hashdb {
 		}
 		else {
 			batchAccessVector_t accessOrder;
-			createBatchAccessOrder(accessOrder, metaData_, readBatchRef);
+			accessOrder.reserve(batchSize);
 
-			for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
-				const size_t accessIndex = ii->index();
+			// Keys found in the record cache or rejected by the key filter are left out, so their bucket pages are not even prefetched.
+			for (size_type i = 0; i < batchSize; ++i) {
+				bool success = false;
+
+				if (fetchCachedValueAt(readBatchRef, i, success)) {
+					if (success) {
+						++valuesFoundAndSet;
+					}
+				}
+				else {
+					accessOrder.push_back(BatchReorderItem(i));
+				}
+			}
 
-				if (fetchSingleValueAt(cache, readBatchRef, accessIndex)) {
+			hashAccessOrderKeys(accessOrder, metaData_, readBatchRef);
+			removeKeysRejectedByFilter(accessOrder, keyFilter_);
+			accessOrder.sort();
+			prefetchBucketPages(pageCache_, accessOrder);
+
+			for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
+				if (fetchSingleValueAt(readBatchRef, ii->index(), ii->keyHash())) {
 					++valuesFoundAndSet;
 				}
 			}
@@ -412,22 +725,143 @@ namespace hashdb {
 		return batchSize == valuesFoundAndSet;
 	}
 
-	//-------------------------------------------------------------------------
-	// Deleting from the database.
+	bool OpenDatabase::fetch(const boost::string_ref& key, partNum_t partNum, IValueVisitor& visitor)
+	{
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
 
-	void OpenDatabase::freeLargeValuePages(const PageId& firstLargeValuePageId, const size_type valueSize)
+		LockSet locks(environment_.lockManager());
+		locks.readLock(bucketTableLock());
+
+		// The value is visited in the page memory, so neither the record cache nor a copy of the value is involved.
+		ValueVisitorAdapter adapter(*this, visitor);
+		return visitSingleValue(key, metaData_.hashKey(key), partNum, adapter, false);
+	}
+
+	bool OpenDatabase::visitSingleValue(const boost::string_ref& key, uint32_t keyHash, partNum_t partNum, RecordValueVisitor& visitor, bool cacheInlineValue)
 	{
-		size_type remainingValueSize = valueSize;
+		if (! keyFilter_.mayContain(keyHash)) {
+			return false;
+		}
 
-		LargeValuePage largeValuePage(environment_.pageAllocator(), openFiles_.pageSize());
-		PageId largeValuePageId = firstLargeValuePageId;
+		const RecordId recordId(key, partNum);
 
-		while (remainingValueSize != 0) {
-			RAISE_DATABASE_CORRUPTED_IF(! largeValuePageId.isValid(), "actual large value size is smaller than %u recorded in metadata", valueSize);
+		uint32_t buckets[MAX_BUCKETS_FOR_KEY];
+		const size_type numberOfBuckets = bucketsForHash(keyHash, buckets);
 
-			openFiles_.read(largeValuePage, largeValuePageId);
-			RAISE_DATABASE_CORRUPTED_IF(largeValuePage.getMagic() != largeValuePage.magic(), "bad large page value magic number %08x on %s", largeValuePage.getMagic(), largeValuePageId.toString());
-			metaData_.releaseLargeValuePageNumber(largeValuePageId.pageNumber());
+		LockSet chainLocks(environment_.lockManager());
+		bool found = false;
+		bool success = false;
+
+		for (size_type i = 0; ! found && i < numberOfBuckets; ++i) {
+			PageId pageId(bucketFilePage(buckets[i] + 1));
+			size_type numberOfTraversedPages = 0;
+
+			chainLocks.readLock(bucketChainLock(buckets[i]));
+
+			while (! found && pageId.isValid()) {
+				const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+
+				DataPageCursor cursor(page.get());
+				found = cursor.find(recordId, keyHash);
+
+				if (found) {
+
+					if (cursor.isInlineValue()) {
+						const boost::string_ref value = cursor.inlineValue();
+
+						if (cacheInlineValue) {
+							recordCache_.insert(key, partNum, value);
+						}
+
+						success = visitor.visitInlineValue(value);
+					}
+					else {
+						const size_type valueSize = cursor.largeValueSize();
+
+						if (fetchIgnoreIfLargerThan_ != 0 && valueSize > fetchIgnoreIfLargerThan_) {
+							return false;
+						}
+
+						success = visitor.visitLargeValue(valueSize, cursor.firstLargeValuePageId());
+					}
+				}
+
+				pageId = page->nextOverflowPageId();
+				incrementTraversedPages(numberOfTraversedPages, pageId);
+			}
+		}
+
+		return success;
+	}
+
+	bool OpenDatabase::fetch(FlatBatch& flatBatch)
+	{
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.readLock(bucketTableLock());
+
+		flatBatch.clearResults();
+
+		const size_type batchSize = static_cast<size_type>(flatBatch.count());
+		size_type valuesFound = 0;
+		std::string cachedValue;
+
+		batchAccessVector_t accessOrder;
+		accessOrder.reserve(batchSize);
+
+		// Keys found in the record cache or rejected by the key filter are left out of the access order.
+		for (size_type i = 0; i < batchSize; ++i) {
+			const boost::string_ref key = flatBatch.keyAt(i);
+
+			if (recordCache_.isEnabled() && recordCache_.fetch(key, flatBatch.partNumAt(i), cachedValue)) {
+				flatBatch.appendResultAt(i, cachedValue);
+				++valuesFound;
+			}
+			else {
+				accessOrder.push_back(BatchReorderItem(i));
+			}
+		}
+
+		hashAccessOrderKeys(accessOrder, metaData_, flatBatch);
+		removeKeysRejectedByFilter(accessOrder, keyFilter_);
+
+		if (accessOrder.size() >= MIN_BATCH_SIZE_TO_REORDER) {
+			accessOrder.sort();
+			prefetchBucketPages(pageCache_, accessOrder);
+		}
+
+		for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
+			const size_t accessIndex = ii->index();
+			FlatBatchResultVisitor visitor(flatBatch, accessIndex);
+			ValueVisitorAdapter adapter(*this, visitor);
+
+			if (visitSingleValue(flatBatch.keyAt(accessIndex), ii->keyHash(), flatBatch.partNumAt(accessIndex), adapter, true)) {
+				++valuesFound;
+			}
+		}
+
+		return batchSize == valuesFound;
+	}
+
+	//-------------------------------------------------------------------------
+	// Deleting from the database.
+
+	void OpenDatabase::freeLargeValuePages(const PageId& firstLargeValuePageId, const size_type valueSize)
+	{
+		size_type remainingValueSize = valueSize;
+
+		LargeValuePage largeValuePage(environment_.pageAllocator(), openFiles_.pageSize());
+		PageId largeValuePageId = firstLargeValuePageId;
+
+		while (remainingValueSize != 0) {
+			RAISE_DATABASE_CORRUPTED_IF(! largeValuePageId.isValid(), "actual large value size is smaller than %u recorded in metadata", valueSize);
+
+			openFiles_.read(largeValuePage, largeValuePageId);
+			RAISE_DATABASE_CORRUPTED_IF(largeValuePage.getMagic() != largeValuePage.magic(), "bad large page value magic number %08x on %s", largeValuePage.getMagic(), largeValuePageId.toString());
+			metaData_.releaseLargeValuePageNumber(largeValuePageId.pageNumber());
 
 			remainingValueSize -= largeValuePage.partSize(remainingValueSize);
 			largeValuePageId = largeValuePage.nextLargeValuePageId();
@@ -436,61 +870,139 @@ namespace hashdb {
 		RAISE_DATABASE_CORRUPTED_IF(largeValuePageId.isValid(), "actual large value size is greater than %u recorded in metadata", valueSize);
 	}
 
-	void OpenDatabase::removeRecord(DataPage& page, DataPageCursor cursor)
+	void OpenDatabase::releaseRecord(const DataPageCursor& cursor)
 	{
 		if (! cursor.isInlineValue()) {
 			freeLargeValuePages(cursor.firstLargeValuePageId(), cursor.largeValueSize());
 		}
 
+		// Callers hold a write lock of the chain, so the value cannot be cached again by a concurrent fetch.
+		recordCache_.erase(cursor.key(), cursor.partNum());
+	}
+
+	void OpenDatabase::removeRecord(DataPage& page, DataPageCursor cursor)
+	{
+		releaseRecord(cursor);
+
 		const size_type removedRecordInlineSize = page.deleteSingleRecord(cursor);
 		metaData_.recordRemoved(removedRecordInlineSize);
 	}
 
-	void OpenDatabase::removeSingleValue(SingleRequestCache& cache, const boost::string_ref& key, partNum_t partNum)
+	void OpenDatabase::removeRecordLazily(uint32_t bucketNumber, const PageCache::DataPagePtr& page, const DataPageCursor& cursor)
+	{
+		releaseRecord(cursor);
+
+		// The record is only marked dead, the page is compacted once at the end of the request.
+		if (! page->hasDeadRecords()) {
+			pagesWithDeadRecords_.push_back(std::make_pair(bucketNumber, page));
+		}
+
+		const size_type removedRecordInlineSize = page->markRecordDead(cursor);
+		metaData_.recordRemoved(removedRecordInlineSize);
+	}
+
+	void OpenDatabase::compactDeadRecords()
+	{
+		// Dead records never reach the disk, so the page format is unchanged.
+		if (pagesWithDeadRecords_.empty()) {
+			return;
+		}
+
+		LockSet bucketLocks(environment_.lockManager());
+		bucketLocks.readLock(bucketTableLock());
+
+		// Pages were added in the order of removals. Readers lock two chains of a bucket being split in ascending order,
+		// so holding a chain while waiting for another one could deadlock. Each chain is compacted under its own lock.
+		std::stable_sort(pagesWithDeadRecords_.begin(), pagesWithDeadRecords_.end(), isPageOfLowerBucket);
+
+		pagesWithDeadRecords_t::iterator ii = pagesWithDeadRecords_.begin();
+		while (ii != pagesWithDeadRecords_.end()) {
+			const uint32_t bucketNumber = ii->first;
+
+			LockSet chainLock(environment_.lockManager());
+			chainLock.writeLock(bucketChainLock(bucketNumber));
+
+			for (; ii != pagesWithDeadRecords_.end() && ii->first == bucketNumber; ++ii) {
+				ii->second->compactRecords();
+			}
+		}
+
+		pagesWithDeadRecords_.clear();
+	}
+
+	void OpenDatabase::removeSingleValue(const boost::string_ref& key, uint32_t keyHash, partNum_t partNum)
 	{
 		const RecordId recordId(key, partNum);
+
+		LockSet bucketLocks(environment_.lockManager());
+		bucketLocks.readLock(bucketTableLock());
 		
-		const uint32_t bucketNumber = metaData_.bucketForKey(key);
-		PageId currentPageId(bucketFilePage(bucketNumber + 1));
-		size_type numberOfTraversedPages = 0;
+		uint32_t buckets[MAX_BUCKETS_FOR_KEY];
+		const size_type numberOfBuckets = bucketsForHash(keyHash, buckets);
+		bool removed = false;
 
-		while (currentPageId.isValid()) {
-			DataPage& page = cache.dataPage(currentPageId);
+		for (size_type i = 0; ! removed && i < numberOfBuckets; ++i) {
+			PageId currentPageId(bucketFilePage(buckets[i] + 1));
+			size_type numberOfTraversedPages = 0;
 
-			DataPageCursor cursor(&page);
-			if (cursor.find(recordId)) {
-				removeRecord(page, cursor);
-				break;
-			}
+			bucketLocks.writeLock(bucketChainLock(buckets[i]));
+
+			while (currentPageId.isValid()) {
+				const PageCache::DataPagePtr page = pageCache_.dataPage(currentPageId);
+
+				DataPageCursor cursor(page.get());
+				if (cursor.find(recordId, keyHash)) {
+					removeRecordLazily(buckets[i], page, cursor);
+					keyFilter_.keyRemoved();
+					removed = true;
+					break;
+				}
 
-			currentPageId = page.nextOverflowPageId();
-			incrementTraversedPages(numberOfTraversedPages, currentPageId);
+				currentPageId = page->nextOverflowPageId();
+				incrementTraversedPages(numberOfTraversedPages, currentPageId);
+			}
 		}
 	}
 
-	void OpenDatabase::removeAllParts(SingleRequestCache& cache, const boost::string_ref& key)
+	void OpenDatabase::removeAllParts(const boost::string_ref& key, uint32_t keyHash)
 	{
-		const uint32_t bucketNumber = metaData_.bucketForKey(key);
-		PageId pageId(bucketFilePage(bucketNumber + 1));
-		size_type numberOfTraversedPages = 0;
+		LockSet bucketLocks(environment_.lockManager());
+		bucketLocks.readLock(bucketTableLock());
 
-		while (pageId.isValid()) {
-			DataPage& page = cache.dataPage(pageId);
+		uint32_t buckets[MAX_BUCKETS_FOR_KEY];
+		const size_type numberOfBuckets = bucketsForHash(keyHash, buckets);
 
-			DataPageCursor cursor(&page);
-			while (cursor.find(key)) {
-				removeRecord(page, cursor);
-				cursor.reset();
-			}
+		for (size_type i = 0; i < numberOfBuckets; ++i) {
+			PageId pageId(bucketFilePage(buckets[i] + 1));
+			size_type numberOfTraversedPages = 0;
 
-			pageId = page.nextOverflowPageId();
-			incrementTraversedPages(numberOfTraversedPages, pageId);
+			bucketLocks.writeLock(bucketChainLock(buckets[i]));
+
+			while (pageId.isValid()) {
+				const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+
+				DataPageCursor cursor(page.get());
+				while (cursor.find(key, keyHash)) {
+					removeRecordLazily(buckets[i], page, cursor);
+					keyFilter_.keyRemoved();
+					cursor.next();
+				}
+
+				pageId = page->nextOverflowPageId();
+				incrementTraversedPages(numberOfTraversedPages, pageId);
+			}
 		}
 	}
 
 	void OpenDatabase::remove(const IDeleteBatch& deleteBatch)
 	{
-		SingleRequestCache cache(environment_, openFiles_);
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadInProgress_, "unable to remove records during a bulk load");
 
 		const size_type batchSize = static_cast<size_type>(deleteBatch.count());
 
@@ -498,13 +1010,14 @@ namespace hashdb {
 
 			for (size_t i = 0; i < batchSize; ++i) {
 				const StringOrReference keyHolder = deleteBatch.keyAt(i);
+				const uint32_t keyHash = metaData_.hashKey(keyHolder.getRef());
 				const partNum_t partNum = deleteBatch.partNumAt(i);
 
 				if (partNum == ALL_PARTS) {
-					removeAllParts(cache, keyHolder.getRef());
+					removeAllParts(keyHolder.getRef(), keyHash);
 				}
 				else {
-					removeSingleValue(cache, keyHolder.getRef(), partNum);
+					removeSingleValue(keyHolder.getRef(), keyHash, partNum);
 				}
 			}
 
@@ -512,6 +1025,7 @@ namespace hashdb {
 		else {
 			batchAccessVector_t accessOrder;
 			createBatchAccessOrder(accessOrder, metaData_, deleteBatch);
+			prefetchBucketPages(pageCache_, accessOrder);
 
 			for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
 				const size_t accessIndex = ii->index();
@@ -520,21 +1034,163 @@ namespace hashdb {
 				const partNum_t partNum = deleteBatch.partNumAt(accessIndex);
 
 				if (partNum == ALL_PARTS) {
-					removeAllParts(cache, keyHolder.getRef());
+					removeAllParts(keyHolder.getRef(), ii->keyHash());
 				}
 				else {
-					removeSingleValue(cache, keyHolder.getRef(), partNum);
+					removeSingleValue(keyHolder.getRef(), ii->keyHash(), partNum);
+				}
+			}
+
+		}
+
+		finishRemove(batchSize);
+	}
+
+	void OpenDatabase::remove(const FlatBatch& flatBatch)
+	{
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadInProgress_, "unable to remove records during a bulk load");
+
+		const size_type batchSize = static_cast<size_type>(flatBatch.count());
+
+		if (batchSize < MIN_BATCH_SIZE_TO_REORDER) {
+
+			for (size_type i = 0; i < batchSize; ++i) {
+				removeSingleValue(flatBatch, i, metaData_.hashKey(flatBatch.keyAt(i)));
+			}
+
+		}
+		else {
+			batchAccessVector_t accessOrder;
+			createBatchAccessOrder(accessOrder, metaData_, flatBatch);
+			prefetchBucketPages(pageCache_, accessOrder);
+
+			for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
+				removeSingleValue(flatBatch, ii->index(), ii->keyHash());
+			}
+
+		}
+
+		finishRemove(batchSize);
+	}
+
+	void OpenDatabase::removeSingleValue(const FlatBatch& flatBatch, size_t index, uint32_t keyHash)
+	{
+		const partNum_t partNum = flatBatch.partNumAt(index);
+
+		if (partNum == ALL_PARTS) {
+			removeAllParts(flatBatch.keyAt(index), keyHash);
+		}
+		else {
+			removeSingleValue(flatBatch.keyAt(index), keyHash, partNum);
+		}
+	}
+
+	void OpenDatabase::finishRemove(size_type batchSize)
+	{
+		compactDeadRecords();
+		mergeOnUnderfill(batchSize);
+		saveRequestChanges();
+	}
+
+	void OpenDatabase::mergeOnUnderfill(size_type maxMerges)
+	{
+		// Each removal can merge a single bucket, like each store can split one.
+		if (! metaData_.isUnderfill() || metaData_.isSplitInProgress()) {
+			return;
+		}
+
+		LockSet bucketLocks(environment_.lockManager());
+		bucketLocks.writeLock(bucketTableLock());
+
+		for (size_type i = 0; i < maxMerges && metaData_.isUnderfill(); ++i) {
+			mergeHighestBucket();
+		}
+	}
+
+	void OpenDatabase::mergeHighestBucket()
+	{
+		const uint32_t highestBucket = metaData_.highestBucket();
+		const uint32_t bucketToMergeTo = metaData_.bucketToMergeTo();
+
+		// Records of the highest bucket are moved back to the bucket it was split from and its pages are released.
+		PageId pageId(bucketFilePage(highestBucket + 1));
+		size_type numberOfTraversedPages = 0;
+		size_type movedRecords = 0;
+		size_type releasedOverflowPages = 0;
+
+		while (pageId.isValid()) {
+			const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+
+			for (DataPageCursor cursor(page.get()); cursor.isValid(); cursor.next()) {
+				// The key filter rebuild may have scanned the lower bucket already.
+				if (keyFilter_.isRebuilding()) {
+					keyFilter_.add(recordKeyHash(cursor));
 				}
+
+				moveRecordToBucket(cursor, bucketToMergeTo);
+				++movedRecords;
+			}
+
+			const PageId nextPageId = page->nextOverflowPageId();
+			pageCache_.discard(pageId);
+
+			if (pageId.fileType() == PageId::OverflowFileType) {
+				metaData_.releaseOverflowPageNumber(pageId.pageNumber());
+				++releasedOverflowPages;
 			}
 
+			pageId = nextPageId;
+			incrementTraversedPages(numberOfTraversedPages, pageId);
 		}
 
-		metaData_.save();
+		metaData_.releaseHighestBucket();
+		bucketFileTruncationPending_ = true;
+
+		HASHDB_LOG_DEBUG("Merged bucket %u with %u overflow pages and %u records to bucket %u", highestBucket, releasedOverflowPages, movedRecords, bucketToMergeTo);
 	}
 
 	//-------------------------------------------------------------------------
 	// Writing to the database.
 
+	class SplitPageNumbers {
+		// With the write-ahead log, page numbers of the original overflow chain are reused in ascending order by the chains
+		// written by a split and new overflow pages are acquired only for pages above their count. The log commits the split
+		// as a whole. Without the log, pages are written in place, so the split writes new pages only and the original chain
+		// stays readable until the bucket page is overwritten.
+	public:
+
+		SplitPageNumbers(MetaData& metaData, const OpenDatabase::OriginalOverflowPageNumbers_t& originalPageNumbers, bool reuseOriginalPages)
+			: metaData_(metaData)
+			, originalPageNumbers_(originalPageNumbers)
+			, reusablePages_(reuseOriginalPages? originalPageNumbers.size() : 0)
+			, reused_(0)
+		{ }
+
+		uint32_t acquire()
+		{
+			return (reused_ < reusablePages_)? originalPageNumbers_[reused_++] : metaData_.acquireOverflowPageNumber();
+		}
+
+		void releaseUnused()
+		{
+			while (reused_ < originalPageNumbers_.size()) {
+				metaData_.releaseOverflowPageNumber(originalPageNumbers_[reused_++]);
+			}
+		}
+
+	private:
+		MetaData& metaData_;
+		const OpenDatabase::OriginalOverflowPageNumbers_t& originalPageNumbers_;
+		const size_type reusablePages_;
+		size_type reused_;
+	};
+
 	class SplitPages {
 	public:
 
@@ -553,13 +1209,17 @@ namespace hashdb {
 			return bucketNumber_;
 		}
 
-		size_type addRecord(const DataPageCursor& cursor)
+		size_type addRecord(const DataPageCursor& cursor, uint32_t keyHash)
+		{
+			return addRecord(cursor.inlineRecord(), keyHash);
+		}
+
+		size_type addRecord(const boost::string_ref& recordInlineData, uint32_t keyHash)
 		{
-			const boost::string_ref recordInlineData = cursor.inlineRecord();
-			size_type addedSize = lastPage().addSingleRecord(recordInlineData);
+			size_type addedSize = lastPage().addSingleRecord(recordInlineData, keyHash);
 
 			if (addedSize == 0) {
-				addedSize = newPage().addSingleRecord(recordInlineData);
+				addedSize = newPage().addMovedRecordToEmptyPage(recordInlineData, keyHash);
 				RAISE_INTERNAL_ERROR_IF(addedSize == 0, "unable to add overflow record on page split");
 			}
 
@@ -567,12 +1227,12 @@ namespace hashdb {
 			return addedSize;
 		}
 
-		size_type addRecord(const RecordId& recordId, const DataPage::AddedValueRef& valueRef)
+		size_type addRecord(const RecordId& recordId, uint32_t keyHash, const DataPage::AddedValueRef& valueRef)
 		{
-			size_type addedSize = lastPage().addSingleRecord(recordId, valueRef);
+			size_type addedSize = lastPage().addSingleRecord(recordId, keyHash, valueRef);
 
 			if (addedSize == 0) {
-				addedSize = newPage().addSingleRecord(recordId, valueRef);
+				addedSize = newPage().addSingleRecord(recordId, keyHash, valueRef);
 				RAISE_INTERNAL_ERROR_IF(addedSize == 0, "unable to add new record on page split");
 			}
 
@@ -580,12 +1240,12 @@ namespace hashdb {
 			return addedSize;
 		}
 
-		void write(MetaData& metaData, OpenFiles& openFiles)
+		void write(SplitPageNumbers& pageNumbers, OpenFiles& openFiles)
 		{
 			if (! overflowChain_.empty()) {
 				const size_type chainSize = overflowChain_.size();
 
-				uint32_t overflowPageNumber = metaData.acquireOverflowPageNumber();
+				uint32_t overflowPageNumber = pageNumbers.acquire();
 				bucketPage_.setNextOverflowPage(overflowPageNumber);
 
 				for (size_type i = 0; i < chainSize; ++i) {
@@ -594,7 +1254,7 @@ namespace hashdb {
 					page.setId(overflowFilePage(overflowPageNumber));
 
 					if (i + 1 < chainSize) {
-						overflowPageNumber = metaData.acquireOverflowPageNumber();
+						overflowPageNumber = pageNumbers.acquire();
 						page.setNextOverflowPage(overflowPageNumber);
 					}
 
@@ -637,7 +1297,7 @@ namespace hashdb {
 		size_type records_;
 	};
 
-	void OpenDatabase::splitToChains(SingleRequestCache& cache, OriginalOverflowPageNumbers_t& originalOverflowPageNumbers, SplitPages& chainBeingSplit, SplitPages& newChain)
+	void OpenDatabase::splitToChains(OriginalOverflowPageNumbers_t& originalOverflowPageNumbers, SplitPages& chainBeingSplit, SplitPages& newChain)
 	{
 		// Read the original chain and split it to two chains.
 		PageId pageId(bucketFilePage(chainBeingSplit.bucket() + 1));
@@ -648,20 +1308,20 @@ namespace hashdb {
 				RAISE_DATABASE_CORRUPTED_IF(originalOverflowPageNumbers.size() > ALLOWED_OVERFLOW_CHAIN_MAX_SIZE, "cycle in overflow page chain (done %u page traversals) on %s", originalOverflowPageNumbers.size(), pageId.toString());
 			}
 
-			DataPage& page = cache.dataPage(pageId);
-			DataPageCursor cursor(&page);
+			const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+			DataPageCursor cursor(page.get());
 
 			while (cursor.isValid()) {
-				const boost::string_ref key = cursor.key();
-				const uint32_t bucket = metaData_.bucketForKey(key);
+				const uint32_t keyHash = recordKeyHash(cursor);
+				const uint32_t bucket = metaData_.bucketForHash(keyHash);
 				
 				HASHDB_LOG_DEBUG_DETAIL("Split of bucket %u: record key=\"%s\" (%s) moved to bucket %u", chainBeingSplit.bucket(), cursor.key(), pageId.toString(), bucket);
 
 				if (bucket == chainBeingSplit.bucket()) {
-					chainBeingSplit.addRecord(cursor);
+					chainBeingSplit.addRecord(cursor, keyHash);
 				}
 				else if (bucket == newChain.bucket()) {
-					newChain.addRecord(cursor);
+					newChain.addRecord(cursor, keyHash);
 				}
 				else {
 					RAISE_INTERNAL_ERROR("invalid bucket number %u, expected %u or %u when splitting on %s", bucket, chainBeingSplit.bucket(), newChain.bucket(), pageId.toString());
@@ -670,17 +1330,21 @@ namespace hashdb {
 				cursor.next();
 			}
 
-			pageId = page.nextOverflowPageId();
+			pageId = page->nextOverflowPageId();
 		}
 
-		// Get rid of the cache.
-		cache.save();
-		cache.invalidate();
+		// Cached pages of both chains are superseded by the split pages.
+		pageCache_.discard(bucketFilePage(chainBeingSplit.bucket() + 1));
+		pageCache_.discard(bucketFilePage(newChain.bucket() + 1));
+
+		for (OriginalOverflowPageNumbers_t::iterator ii = originalOverflowPageNumbers.begin(); ii != originalOverflowPageNumbers.end(); ++ii) {
+			pageCache_.discard(overflowFilePage(*ii));
+		}
 
 		originalOverflowPageNumbers.sort();
 	}
 
-	void OpenDatabase::splitOnOverfill(SingleRequestCache& cache)
+	void OpenDatabase::splitOnOverfill()
 	{
 		const uint32_t bucketToSplitNumber = metaData_.bucketToSplit();
 		const uint32_t newBucketNumber = metaData_.newBucketNumber();
@@ -689,23 +1353,22 @@ namespace hashdb {
 		SplitPages newChain(newBucketNumber, environment_.pageAllocator(), openFiles_.pageSize());
 		OriginalOverflowPageNumbers_t originalOverflowPageNumbers;
 
-		splitToChains(cache, originalOverflowPageNumbers, chainBeingSplit, newChain);
+		splitToChains(originalOverflowPageNumbers, chainBeingSplit, newChain);
 
-		// Write the changes.
-		chainBeingSplit.write(metaData_, openFiles_);
-		newChain.write(metaData_, openFiles_);
+		// Write the changes, the chain being split takes over its original overflow pages first if they can be reused.
+		SplitPageNumbers pageNumbers(metaData_, originalOverflowPageNumbers, openFiles_.logsWrites());
+		chainBeingSplit.write(pageNumbers, openFiles_);
+		newChain.write(pageNumbers, openFiles_);
 
-		// Release original overflow pages.
-		for (OriginalOverflowPageNumbers_t::iterator ii = originalOverflowPageNumbers.begin(); ii != originalOverflowPageNumbers.end(); ++ii) {
-			metaData_.releaseOverflowPageNumber(*ii);
-		}
+		// Release original overflow pages which were not reused.
+		pageNumbers.releaseUnused();
 
 		HASHDB_LOG_DEBUG("Split bucket %u with %u overflow pages and %u records: %u records remained in bucket %u, %u records moved to new bucket %u",
 			bucketToSplitNumber, originalOverflowPageNumbers.size(), chainBeingSplit.records() + newChain.records(),
 			chainBeingSplit.records(), chainBeingSplit.bucket(), newChain.records(), newChain.bucket());
 	}
 
-	size_type OpenDatabase::splitAddRecordOnOverflow(SingleRequestCache& cache, const RecordId& recordId, const DataPage::AddedValueRef& valueRef)
+	size_type OpenDatabase::splitAddRecordOnOverflow(const RecordId& recordId, uint32_t keyHash, const DataPage::AddedValueRef& valueRef)
 	{
 		const uint32_t bucketToSplitNumber = metaData_.bucketToSplit();
 		const uint32_t newBucketNumber = metaData_.newBucketNumber();
@@ -714,31 +1377,30 @@ namespace hashdb {
 		SplitPages newChain(newBucketNumber, environment_.pageAllocator(), openFiles_.pageSize());
 		OriginalOverflowPageNumbers_t originalOverflowPageNumbers;
 
-		splitToChains(cache, originalOverflowPageNumbers, chainBeingSplit, newChain);
+		splitToChains(originalOverflowPageNumbers, chainBeingSplit, newChain);
 
 		// Add new record to the end of the appropriate chain.
-		const uint32_t newRecordBucket = metaData_.bucketForKey(recordId.key());
+		const uint32_t newRecordBucket = metaData_.bucketForHash(keyHash);
 		HASHDB_LOG_DEBUG_DETAIL("Split of bucket %u: new record key=\"%s\" added to bucket %u", bucketToSplitNumber, recordId.key().to_string(), newRecordBucket);
 
 		size_type addedSize = 0;
 		if (newRecordBucket == bucketToSplitNumber) {
-			addedSize = chainBeingSplit.addRecord(recordId, valueRef);
+			addedSize = chainBeingSplit.addRecord(recordId, keyHash, valueRef);
 		}
 		else if (newRecordBucket == newBucketNumber) {
-			addedSize = newChain.addRecord(recordId, valueRef);
+			addedSize = newChain.addRecord(recordId, keyHash, valueRef);
 		}
 		else {
 			RAISE_INTERNAL_ERROR("invalid bucket number %u, expected %u or %u when adding new record after split", newRecordBucket, bucketToSplitNumber, newBucketNumber);
 		}
 
-		// Write the changes.
-		chainBeingSplit.write(metaData_, openFiles_);
-		newChain.write(metaData_, openFiles_);
+		// Write the changes, the chain being split takes over its original overflow pages first if they can be reused.
+		SplitPageNumbers pageNumbers(metaData_, originalOverflowPageNumbers, openFiles_.logsWrites());
+		chainBeingSplit.write(pageNumbers, openFiles_);
+		newChain.write(pageNumbers, openFiles_);
 
-		// Release original overflow pages.
-		for (OriginalOverflowPageNumbers_t::iterator ii = originalOverflowPageNumbers.begin(); ii != originalOverflowPageNumbers.end(); ++ii) {
-			metaData_.releaseOverflowPageNumber(*ii);
-		}
+		// Release original overflow pages which were not reused.
+		pageNumbers.releaseUnused();
 
 		HASHDB_LOG_DEBUG("Split bucket %u with %u overflow pages and %u records: %u records remained in bucket %u, %u records moved to new bucket %u, 1 new record added to bucket %u",
 			bucketToSplitNumber, originalOverflowPageNumbers.size(), chainBeingSplit.records() + newChain.records(),
@@ -747,65 +1409,235 @@ namespace hashdb {
 		return addedSize;
 	}
 
-	void OpenDatabase::storeSingleValue(SingleRequestCache& cache, const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value)
+	PageId OpenDatabase::storeLargeValue(const boost::string_ref& value)
+	{
+		LargeValuePage largeValuePage(environment_.pageAllocator(), openFiles_.pageSize());
+
+		size_type putPosition = 0;
+		bool valuePartRemains;
+
+		uint32_t newLargeValuePageNumber = metaData_.acquireLargeValuePageNumber();
+		const PageId firstLargeValuePageId(overflowFilePage(newLargeValuePageNumber));
+
+		do {
+			largeValuePage.setUp(newLargeValuePageNumber);
+			valuePartRemains = largeValuePage.putValuePart(putPosition, value);
+
+			if (valuePartRemains) {
+				newLargeValuePageNumber = metaData_.acquireLargeValuePageNumber();
+				largeValuePage.setNextLargeValuePage(newLargeValuePageNumber);
+			}
+
+			openFiles_.write(largeValuePage);
+		} while (valuePartRemains);
+
+		return firstLargeValuePageId;
+	}
+
+	void OpenDatabase::beginSplit()
+	{
+		const uint32_t bucketToSplitNumber = metaData_.bucketToSplit();
+		const uint32_t newBucketNumber = metaData_.beginSplit();
+
+		// Records are moved to the empty bucket page by subsequent requests.
+		BucketDataPage bucketPage(environment_.pageAllocator(), openFiles_.pageSize());
+		bucketPage.setUp(newBucketNumber + 1);
+
+		pageCache_.discard(bucketFilePage(newBucketNumber + 1));
+		openFiles_.write(bucketPage);
+
+		HASHDB_LOG_DEBUG("Started incremental split of bucket %u to new bucket %u", bucketToSplitNumber, newBucketNumber);
+	}
+
+	void OpenDatabase::advanceSplit(size_type maxPages)
+	{
+		const uint32_t bucketBeingSplit = metaData_.bucketBeingSplit();
+		const uint32_t newBucketNumber = metaData_.highestBucket();
+		uint32_t pageIndex = metaData_.splitPageIndex();
+
+		// Skip the pages which were already split. Records of the new bucket are never added to them.
+		PageId pageId(bucketFilePage(bucketBeingSplit + 1));
+		size_type numberOfTraversedPages = 0;
+
+		for (uint32_t i = 0; i < pageIndex && pageId.isValid(); ++i) {
+			pageId = pageCache_.dataPage(pageId)->nextOverflowPageId();
+			incrementTraversedPages(numberOfTraversedPages, pageId);
+		}
+
+		size_type splitPages = 0;
+		size_type movedRecords = 0;
+
+		while (pageId.isValid() && (maxPages == 0 || splitPages < maxPages)) {
+			const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+			DataPageCursor cursor(page.get());
+
+			while (cursor.isValid()) {
+				const uint32_t bucket = metaData_.bucketForHash(recordKeyHash(cursor));
+
+				if (bucket == newBucketNumber) {
+					HASHDB_LOG_DEBUG_DETAIL("Split of bucket %u: record key=\"%s\" (%s) moved to bucket %u", bucketBeingSplit, cursor.key(), pageId.toString(), bucket);
+
+					moveRecordToBucket(cursor, newBucketNumber);
+					page->markRecordDead(cursor);
+					cursor.next();
+					++movedRecords;
+				}
+				else {
+					RAISE_INTERNAL_ERROR_IF(bucket != bucketBeingSplit, "invalid bucket number %u, expected %u or %u when splitting on %s", bucket, bucketBeingSplit, newBucketNumber, pageId.toString());
+					cursor.next();
+				}
+			}
+
+			// The split holds the bucket table exclusively, moved records are dropped from the page at once.
+			page->compactRecords();
+
+			++splitPages;
+			++pageIndex;
+
+			pageId = page->nextOverflowPageId();
+			incrementTraversedPages(numberOfTraversedPages, pageId);
+		}
+
+		if (pageId.isValid()) {
+			metaData_.setSplitPageIndex(pageIndex);
+		}
+		else {
+			releaseEmptyOverflowPages(bucketBeingSplit);
+			metaData_.endSplit();
+		}
+
+		HASHDB_LOG_DEBUG("Split %u pages of bucket %u: %u records moved to new bucket %u, %s", splitPages, bucketBeingSplit, movedRecords, newBucketNumber, (pageId.isValid())? "split continues" : "split finished");
+	}
+
+	void OpenDatabase::moveRecordToBucket(const DataPageCursor& cursor, uint32_t bucketNumber)
+	{
+		const boost::string_ref recordInlineData = cursor.inlineRecord();
+		const uint32_t keyHash = recordKeyHash(cursor);
+
+		// Add to the first page of the chain with enough free space.
+		PageId pageId(bucketFilePage(bucketNumber + 1));
+		PageId parentPageId;
+		size_type numberOfTraversedPages = 0;
+
+		while (pageId.isValid()) {
+			parentPageId = pageId;
+			const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+
+			if (page->addSingleRecord(recordInlineData, keyHash) != 0) {
+				return;
+			}
+
+			pageId = page->nextOverflowPageId();
+			incrementTraversedPages(numberOfTraversedPages, pageId);
+		}
+
+		const uint32_t newOverflowPageNumber = metaData_.acquireOverflowPageNumber();
+		const PageCache::DataPagePtr newOverflowPage = pageCache_.newOverflowPage(newOverflowPageNumber);
+		const size_type addedSize = newOverflowPage->addMovedRecordToEmptyPage(recordInlineData, keyHash);
+		RAISE_INTERNAL_ERROR_IF(addedSize == 0, "unable to add overflow record on page split");
+
+		pageCache_.dataPage(parentPageId)->setNextOverflowPage(newOverflowPageNumber);
+	}
+
+	uint32_t OpenDatabase::recordKeyHash(const DataPageCursor& cursor) const
+	{
+		// Pages written by format versions 1 to 4 do not store key hashes.
+		return (cursor.hasKeyHash())? cursor.keyHash() : metaData_.hashKey(cursor.key());
+	}
+
+	void OpenDatabase::releaseEmptyOverflowPages(uint32_t bucketNumber)
+	{
+		PageCache::DataPagePtr parentPage = pageCache_.dataPage(bucketFilePage(bucketNumber + 1));
+		PageId pageId = parentPage->nextOverflowPageId();
+		size_type numberOfTraversedPages = 0;
+
+		while (pageId.isValid()) {
+			const PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+			const PageId nextPageId = page->nextOverflowPageId();
+
+			if (page->getNumberOfRecords() == 0) {
+				parentPage->setNextOverflowPage(page->getNextOverflowPage());
+				pageCache_.discard(pageId);
+				metaData_.releaseOverflowPageNumber(pageId.pageNumber());
+			}
+			else {
+				parentPage = page;
+			}
+
+			pageId = nextPageId;
+			incrementTraversedPages(numberOfTraversedPages, pageId);
+		}
+	}
+
+	void OpenDatabase::storeSingleValue(const boost::string_ref& key, uint32_t keyHash, partNum_t partNum, const boost::string_ref& value)
 	{
 		const RecordId recordId(key, partNum);
 
-		const uint32_t bucketNumberForKey = metaData_.bucketForKey(key);
+		// The key is added before the record becomes visible to concurrent fetches.
+		keyFilter_.add(keyHash);
+
+		LockSet bucketLocks(environment_.lockManager());
+
+		// Each store moves a part of the bucket being split (or all of it, if stores do not split incrementally).
+		if (metaData_.isSplitInProgress()) {
+			bucketLocks.writeLock(bucketTableLock());
+			advanceSplit(splitPagesPerStore_);
+			bucketLocks.release();
+		}
+
+		bucketLocks.readLock(bucketTableLock());
+
+		uint32_t buckets[MAX_BUCKETS_FOR_KEY];
+		const size_type numberOfBuckets = bucketsForHash(keyHash, buckets);
+
+		const uint32_t bucketNumberForKey = buckets[numberOfBuckets - 1];
 		const PageId bucketPageId(bucketFilePage(bucketNumberForKey + 1));
 		bool skipInsert = false;
+		bool found = false;
 
-		PageId currentPageId(bucketPageId);
+		PageId currentPageId;
 
-		// Delete existing record if any.
-		size_type pagesTraversersedWhenDeleting = 0;
-		while (currentPageId.isValid()) {
-			DataPage& delDataPage = cache.dataPage(currentPageId);
+		// Replace existing record if any. If it does not fit to its page, it is deleted and added as a new record.
+		for (size_type i = 0; ! found && i < numberOfBuckets; ++i) {
+			currentPageId = bucketFilePage(buckets[i] + 1);
+			bucketLocks.writeLock(bucketChainLock(buckets[i]));
 
-			DataPageCursor cursor(&delDataPage);
-			if (cursor.find(recordId)) {
-				if (cursor.isInlineValue() && value == cursor.inlineValue()) {
+			size_type pagesTraversersedWhenDeleting = 0;
+			while (currentPageId.isValid()) {
+				const PageCache::DataPagePtr delDataPage = pageCache_.dataPage(currentPageId);
+
+				DataPageCursor cursor(delDataPage.get());
+				if (cursor.find(recordId, keyHash)) {
+					if (cursor.isInlineValue() && value == cursor.inlineValue()) {
+							skipInsert = true;
+					}
+					else if (replaceRecord(*delDataPage, cursor, recordId, value)) {
 						skipInsert = true;
-				}
-				else {
-					removeRecord(delDataPage, cursor);
-					HASHDB_LOG_DEBUG_DETAIL("Removed old record key=\"%s\" from bucket %u (%s)", key.to_string(), bucketNumberForKey, currentPageId.toString());
+						HASHDB_LOG_DEBUG_DETAIL("Replaced record key=\"%s\" in bucket %u (%s)", key.to_string(), buckets[i], currentPageId.toString());
+					}
+					else {
+						removeRecord(*delDataPage, cursor);
+						HASHDB_LOG_DEBUG_DETAIL("Removed old record key=\"%s\" from bucket %u (%s)", key.to_string(), buckets[i], currentPageId.toString());
+					}
+
+					found = true;
+					break;
 				}
 
-				break;
+				currentPageId = delDataPage->nextOverflowPageId();
+				incrementTraversedPages(pagesTraversersedWhenDeleting, currentPageId);
 			}
-
-			currentPageId = delDataPage.nextOverflowPageId();
-			incrementTraversedPages(pagesTraversersedWhenDeleting, currentPageId);
 		}
 
 		// Add new value.
 		if (! skipInsert) {
 			const size_type recordOverheadSize = recordId.recordOverheadSize();
-			const bool isInlineRecord = (recordOverheadSize + value.size()) <= cache.dataPage(bucketPageId).largestPossibleInlineRecordSize();
+			const bool isInlineRecord = (recordOverheadSize + value.size()) <= pageCache_.dataPage(bucketPageId)->largestPossibleInlineRecordSize();
 
 			// If value is a large value, split it to large value pages.
 			PageId firstLargeValuePageId;
 			if (! isInlineRecord) {
-				LargeValuePage largeValuePage(environment_.pageAllocator(), openFiles_.pageSize());
-
-				size_type putPosition = 0;
-				bool valuePartRemains;
-
-				uint32_t newLargeValuePageNumber = metaData_.acquireLargeValuePageNumber();
-				firstLargeValuePageId = PageId(overflowFilePage(newLargeValuePageNumber));
-
-				do {
-					largeValuePage.setUp(newLargeValuePageNumber);
-					valuePartRemains = largeValuePage.putValuePart(putPosition, value);
-
-					if (valuePartRemains) {
-						newLargeValuePageNumber = metaData_.acquireLargeValuePageNumber();
-						largeValuePage.setNextLargeValuePage(newLargeValuePageNumber);
-					}
-
-					openFiles_.write(largeValuePage);
-				} while (valuePartRemains);
+				firstLargeValuePageId = storeLargeValue(value);
 			}
 
 			// Create reference to value (for inline value) or to value size + id of first large value page (for a large value).
@@ -820,43 +1652,56 @@ namespace hashdb {
 
 			while (currentPageId.isValid()) {
 				parentPageId = currentPageId;
-				DataPage& addDataPage = cache.dataPage(currentPageId);
+				const PageCache::DataPagePtr addDataPage = pageCache_.dataPage(currentPageId);
 				
-				addedInlineRecordSize = addDataPage.addSingleRecord(recordId, addedValueRef);
+				addedInlineRecordSize = addDataPage->addSingleRecord(recordId, keyHash, addedValueRef);
 				if (addedInlineRecordSize != 0) {
 					HASHDB_LOG_DEBUG_DETAIL("Added new %s record key=\"%s\" to bucket %u (%s)", (isInlineRecord)? "inline" : "large", key.to_string(), bucketNumberForKey, currentPageId.toString());
 					break;
 				}
 
-				currentPageId = addDataPage.nextOverflowPageId();
+				currentPageId = addDataPage->nextOverflowPageId();
 				incrementTraversedPages(pagesTraversersedWhenInserting, currentPageId);
 			}
 
 			// Record could not be added to an existing page.
 			if (addedInlineRecordSize == 0) {
 
-				// Split on overflow? (Aka "uncontrolled split".)
-				if (bucketNumberForKey == metaData_.bucketToSplit()) {
+				// Split on overflow? (Aka "uncontrolled split".) Incremental splits are started only on overfill.
+				if (bucketNumberForKey == metaData_.bucketToSplit() && splitPagesPerStore_ == 0) {
 					HASHDB_LOG_DEBUG_DETAIL("Overflow detected in bucket %u, traversed %u pages", bucketNumberForKey, pagesTraversersedWhenInserting);
-					addedInlineRecordSize = splitAddRecordOnOverflow(cache, recordId, addedValueRef);
+
+					bucketLocks.release();
+					bucketLocks.writeLock(bucketTableLock());
+					addedInlineRecordSize = splitAddRecordOnOverflow(recordId, keyHash, addedValueRef);
 				}
 				else {
 					const uint32_t newOverflowPageNumber = metaData_.acquireOverflowPageNumber();
-					OverflowDataPage& newOverflowPage = cache.newOverflowPage(newOverflowPageNumber);
+					const PageCache::DataPagePtr newOverflowPage = pageCache_.newOverflowPage(newOverflowPageNumber);
 
-					addedInlineRecordSize = newOverflowPage.addSingleRecord(recordId, addedValueRef);
-					RAISE_INTERNAL_ERROR_IF(addedInlineRecordSize == 0, "unable to add record to %s", newOverflowPage.getId().toString());
+					addedInlineRecordSize = newOverflowPage->addSingleRecord(recordId, keyHash, addedValueRef);
+					RAISE_INTERNAL_ERROR_IF(addedInlineRecordSize == 0, "unable to add record to %s", newOverflowPage->getId().toString());
 
-					DataPage& parentPage = cache.dataPage(parentPageId);
-					parentPage.setNextOverflowPage(newOverflowPageNumber);
+					const PageCache::DataPagePtr parentPage = pageCache_.dataPage(parentPageId);
+					parentPage->setNextOverflowPage(newOverflowPageNumber);
 
-					HASHDB_LOG_DEBUG_DETAIL("Added new %s record key=\"%s\" to bucket %u (new %s)", (isInlineRecord)? "inline" : "large", key.to_string(), bucketNumberForKey, newOverflowPage.getId().toString());
+					HASHDB_LOG_DEBUG_DETAIL("Added new %s record key=\"%s\" to bucket %u (new %s)", (isInlineRecord)? "inline" : "large", key.to_string(), bucketNumberForKey, newOverflowPage->getId().toString());
 
 					// Split on overfill? (Aka "controlled split".)
 					const bool overfill = metaData_.isOverfill(addedInlineRecordSize);
-					if (overfill) {
+					if (overfill && ! metaData_.isSplitInProgress()) {
 						HASHDB_LOG_DEBUG_DETAIL("Overfill detected, actual fill=%u, expected fill=%u", metaData_.actualFill(addedInlineRecordSize), metaData_.expectedFill());
-						splitOnOverfill(cache);
+
+						bucketLocks.release();
+						bucketLocks.writeLock(bucketTableLock());
+
+						if (splitPagesPerStore_ == 0) {
+							splitOnOverfill();
+						}
+						else {
+							beginSplit();
+						}
+
 						metaData_.incrementOverfillStatistics();
 					}
 				}
@@ -866,7 +1711,47 @@ namespace hashdb {
 		}
 	}
 
-	size_type OpenDatabase::storeSingleValue(SingleRequestCache& cache, const IWriteBatch& writeBatch, size_t index)
+	bool OpenDatabase::replaceRecord(DataPage& page, const DataPageCursor& cursor, const RecordId& recordId, const boost::string_ref& value)
+	{
+		const bool isInlineRecord = (recordId.recordOverheadSize() + value.size()) <= page.largestPossibleInlineRecordSize();
+		const size_type oldRecordInlineSize = DataPage::recordInlineSize(cursor);
+		const size_type newRecordInlineSize = recordId.recordOverheadSize() + (isInlineRecord? static_cast<size_type>(value.size()) : 2 * sizeof(uint32_t));
+
+		if (newRecordInlineSize > oldRecordInlineSize && page.freeSpace() < newRecordInlineSize - oldRecordInlineSize) {
+			return false;
+		}
+
+		// The new large value is stored before the record is replaced and the old value is released only after that,
+		// so that the record never refers to released pages if storing fails.
+		PageId firstLargeValuePageId;
+		if (! isInlineRecord) {
+			firstLargeValuePageId = storeLargeValue(value);
+		}
+
+		const bool oldValueIsLarge = ! cursor.isInlineValue();
+		const PageId oldFirstLargeValuePageId = oldValueIsLarge? cursor.firstLargeValuePageId() : PageId();
+		const size_type oldLargeValueSize = oldValueIsLarge? cursor.largeValueSize() : 0;
+
+		// Callers hold a write lock of the chain, like for removeRecord().
+		recordCache_.erase(cursor.key(), cursor.partNum());
+
+		const DataPage::AddedValueRef addedValueRef = isInlineRecord?
+			DataPage::AddedValueRef(value) : DataPage::AddedValueRef(static_cast<size_type>(value.size()), firstLargeValuePageId);
+
+		const size_type replacedRecordInlineSize = page.replaceSingleRecord(cursor, recordId, addedValueRef);
+		RAISE_INTERNAL_ERROR_IF(replacedRecordInlineSize != newRecordInlineSize, "unable to replace record on %s", page.getId().toString());
+
+		if (oldValueIsLarge) {
+			freeLargeValuePages(oldFirstLargeValuePageId, oldLargeValueSize);
+		}
+
+		metaData_.recordRemoved(oldRecordInlineSize);
+		metaData_.recordAdded(replacedRecordInlineSize);
+
+		return true;
+	}
+
+	size_type OpenDatabase::storeSingleValue(const IWriteBatch& writeBatch, size_t index, uint32_t keyHash)
 	{
 		const StringOrReference keyHolder = writeBatch.keyAt(index);
 		const partNum_t partNum = writeBatch.partNumAt(index);
@@ -875,7 +1760,7 @@ namespace hashdb {
 		const bool tooLarge = (storeThrowIfLargerThan_ != 0 && valueHolder.size() > storeThrowIfLargerThan_);
 
 		if (! tooLarge) {
-			storeSingleValue(cache, keyHolder.getRef(), partNum, valueHolder.getRef());
+			storeSingleValue(keyHolder.getRef(), keyHash, partNum, valueHolder.getRef());
 		}
 
 		return (tooLarge)? 1 : 0;
@@ -883,7 +1768,13 @@ namespace hashdb {
 
 	void OpenDatabase::store(const IWriteBatch& writeBatch)
 	{
-		SingleRequestCache cache(environment_, openFiles_);
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadInProgress_, "unable to store records during a bulk load");
 
 		const size_type batchSize = static_cast<size_type>(writeBatch.count());
 		size_type numberOfTooLargeValues = 0;
@@ -892,36 +1783,418 @@ namespace hashdb {
 
 			batchAccessVector_t accessOrder;
 			createBatchAccessOrder(accessOrder, metaData_, writeBatch);
+			prefetchBucketPages(pageCache_, accessOrder);
+
+			for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
+				numberOfTooLargeValues += storeSingleValue(writeBatch, ii->index(), ii->keyHash());
+			}
+
+		}
+		else {
+
+			for (size_type i = 0; i < batchSize; ++i) {
+				const StringOrReference keyHolder = writeBatch.keyAt(i);
+				numberOfTooLargeValues += storeSingleValue(writeBatch, i, metaData_.hashKey(keyHolder.getRef()));
+			}
+
+		}
+
+		finishStore(numberOfTooLargeValues);
+	}
+
+	size_type OpenDatabase::storeSingleValue(const FlatBatch& flatBatch, size_t index, uint32_t keyHash)
+	{
+		const boost::string_ref value = flatBatch.valueAt(index);
+		const bool tooLarge = (storeThrowIfLargerThan_ != 0 && value.size() > storeThrowIfLargerThan_);
+
+		if (! tooLarge) {
+			storeSingleValue(flatBatch.keyAt(index), keyHash, flatBatch.partNumAt(index), value);
+		}
+
+		return (tooLarge)? 1 : 0;
+	}
+
+	void OpenDatabase::store(const FlatBatch& flatBatch)
+	{
+		PageCache::Request request(pageCache_);
+		advanceKeyFilterRebuild();
+
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadInProgress_, "unable to store records during a bulk load");
+
+		const size_type batchSize = static_cast<size_type>(flatBatch.count());
+		size_type numberOfTooLargeValues = 0;
+
+		if (batchSize >= MIN_BATCH_SIZE_TO_REORDER && ! metaData_.isOverfill(MIN_FREE_SPACE_TO_REORDER)) {
+
+			batchAccessVector_t accessOrder;
+			createBatchAccessOrder(accessOrder, metaData_, flatBatch);
+			prefetchBucketPages(pageCache_, accessOrder);
 
 			for (batchAccessVector_t::iterator ii = accessOrder.begin(); ii != accessOrder.end(); ++ii) {
-				numberOfTooLargeValues += storeSingleValue(cache, writeBatch, ii->index());
+				numberOfTooLargeValues += storeSingleValue(flatBatch, ii->index(), ii->keyHash());
 			}
 
 		}
 		else {
 
 			for (size_type i = 0; i < batchSize; ++i) {
-				numberOfTooLargeValues += storeSingleValue(cache, writeBatch, i);
+				numberOfTooLargeValues += storeSingleValue(flatBatch, i, metaData_.hashKey(flatBatch.keyAt(i)));
 			}
 
 		}
 
-		metaData_.save();
+		finishStore(numberOfTooLargeValues);
+	}
+
+	void OpenDatabase::finishStore(size_type numberOfTooLargeValues)
+	{
+		compactDeadRecords();
+		saveRequestChanges();
 
 		RAISE_VALUE_TOO_LARGE_IF(numberOfTooLargeValues == 1, "unable to store value larger than store limit (%u bytes)", storeThrowIfLargerThan_);
 		RAISE_VALUE_TOO_LARGE_IF(numberOfTooLargeValues > 1, "unable to store %u values larger than store limit (%u bytes)", numberOfTooLargeValues, storeThrowIfLargerThan_);
 	}
 
+	//-------------------------------------------------------------------------
+	// Bulk load.
+
+	boost::shared_ptr<BulkLoadRuns> OpenDatabase::beginBulkLoad()
+	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(readOnly_, "unable to bulk load a read-only database");
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadInProgress_, "bulk load is already in progress");
+
+		const Statistics stats = metaData_.statistics();
+		RAISE_INVALID_ARGUMENT_IF(stats.numberOfRecords_ != 0 || stats.overflowFileDataPages_ != 0 || metaData_.isSplitInProgress(), "unable to bulk load a database which is not empty");
+
+		boost::shared_ptr<BulkLoadRuns> runs(new BulkLoadRuns(database_, metaData_, bulkLoadBufferBytes_));
+		bulkLoadInProgress_ = true;
+
+		return runs;
+	}
+
+	void OpenDatabase::bulkLoadAdd(BulkLoadRuns& runs, uint64_t expectedNumberOfRecords, const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value)
+	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(! bulkLoadInProgress_, "bulk load is not in progress");
+		RAISE_VALUE_TOO_LARGE_IF(storeThrowIfLargerThan_ != 0 && value.size() > storeThrowIfLargerThan_, "unable to store value larger than store limit (%u bytes)", storeThrowIfLargerThan_);
+
+		const RecordId recordId(key, partNum);
+		const uint32_t keyHash = metaData_.hashKey(key);
+		const bool isInlineRecord = (recordId.recordOverheadSize() + value.size()) <= DataPage::largestPossibleInlineRecordSize(openFiles_.pageSize());
+		keyFilter_.add(keyHash);
+
+		// Large values are written to the overflow file right away, runs keep only the references.
+		if (isInlineRecord) {
+			runs.add(recordId, keyHash, DataPage::AddedValueRef(value));
+		}
+		else {
+			const PageId firstLargeValuePageId = storeLargeValue(value);
+			runs.add(recordId, keyHash, DataPage::AddedValueRef(static_cast<size_type>(value.size()), firstLargeValuePageId));
+		}
+
+		if (runs.isBufferFull()) {
+			// Records in runs are sorted by bucket, so the final number of buckets is estimated from the buffered records.
+			if (! runs.hasRuns()) {
+				const uint64_t numberOfRecords = std::max(expectedNumberOfRecords, runs.numberOfRecords());
+				const uint64_t dataInlineSize = (runs.dataInlineSize() / runs.numberOfRecords()) * numberOfRecords;
+				createBulkLoadBuckets(numberOfRecords, dataInlineSize);
+			}
+
+			runs.writeRun();
+		}
+	}
+
+	void OpenDatabase::finishBulkLoad(BulkLoadRuns& runs)
+	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+		locks.writeLock(bucketTableLock());
+
+		RAISE_INVALID_ARGUMENT_IF(! bulkLoadInProgress_, "bulk load is not in progress");
+
+		// Without runs, all records are known and the number of buckets is exact.
+		if (! runs.hasRuns()) {
+			createBulkLoadBuckets(runs.numberOfRecords(), runs.dataInlineSize());
+		}
+
+		runs.startReading();
+		bulkLoadInProgress_ = false;
+
+		// Buckets are written in a single pass in the order of bucket pages.
+		const OriginalOverflowPageNumbers_t noOverflowPageNumbers;
+		SplitPageNumbers pageNumbers(metaData_, noOverflowPageNumbers, false);
+		BulkLoadRecords_t records;
+
+		for (uint32_t bucketNumber = 0; bucketNumber <= metaData_.highestBucket(); ++bucketNumber) {
+			runs.readBucket(bucketNumber, records);
+			removeReplacedBulkLoadRecords(records);
+
+			SplitPages chain(bucketNumber, environment_.pageAllocator(), openFiles_.pageSize());
+
+			for (BulkLoadRecords_t::const_iterator ii = records.begin(); ii != records.end(); ++ii) {
+				const size_type addedSize = chain.addRecord(ii->inlineRecord(), ii->keyHash());
+				metaData_.recordAdded(addedSize);
+			}
+
+			pageCache_.discard(bucketFilePage(bucketNumber + 1));
+			chain.write(pageNumbers, openFiles_);
+		}
+
+		HASHDB_LOG_DEBUG("Bulk load wrote %u records to %u buckets", static_cast<size_type>(runs.numberOfRecords()), metaData_.highestBucket() + 1);
+		saveBuffers();
+	}
+
+	void OpenDatabase::abortBulkLoad(BulkLoadRuns& runs)
+	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
+		RAISE_INVALID_ARGUMENT_IF(! bulkLoadInProgress_, "bulk load is not in progress");
+
+		runs.startReading();
+		bulkLoadInProgress_ = false;
+
+		// Only large values were written so far.
+		BulkLoadRecords_t records;
+
+		for (uint32_t bucketNumber = 0; bucketNumber <= metaData_.highestBucket(); ++bucketNumber) {
+			runs.readBucket(bucketNumber, records);
+
+			for (BulkLoadRecords_t::const_iterator ii = records.begin(); ii != records.end(); ++ii) {
+				if (ii->isLargeValue()) {
+					freeLargeValuePages(ii->firstLargeValuePageId(), ii->largeValueSize());
+				}
+			}
+		}
+
+		saveBuffers();
+	}
+
+	void OpenDatabase::createBulkLoadBuckets(uint64_t numberOfRecords, uint64_t dataInlineSize)
+	{
+		const uint32_t buckets = metaData_.bucketsForFill(numberOfRecords, dataInlineSize);
+		const uint32_t existingBuckets = metaData_.highestBucket() + 1;
+
+		// Empty pages keep the database consistent until the bulk load finishes and rewrites them.
+		if (buckets > existingBuckets) {
+			createInitialBucketPages(buckets - existingBuckets);
+		}
+
+		HASHDB_LOG_DEBUG("Bulk load of %u records uses %u buckets", static_cast<size_type>(numberOfRecords), metaData_.highestBucket() + 1);
+	}
+
+	void OpenDatabase::removeReplacedBulkLoadRecords(BulkLoadRecords_t& records)
+	{
+		// The last added record of the same key and part number replaces the previous ones.
+		std::sort(records.begin(), records.end());
+
+		BulkLoadRecords_t::iterator kept = records.begin();
+
+		for (BulkLoadRecords_t::iterator ii = records.begin(); ii != records.end(); ++ii) {
+			BulkLoadRecords_t::iterator next = ii + 1;
+
+			if (next != records.end() && next->recordIdValue() == ii->recordIdValue()) {
+				if (ii->isLargeValue()) {
+					freeLargeValuePages(ii->firstLargeValuePageId(), ii->largeValueSize());
+				}
+			}
+			else {
+				if (kept != ii) {
+					*kept = *ii;
+				}
+
+				++kept;
+			}
+		}
+
+		records.erase(kept, records.end());
+	}
+
+	//-------------------------------------------------------------------------
+	// Compaction of the overflow file.
+
+	bool OpenDatabase::compact(size_type maxPages)
+	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+		locks.writeLock(bucketTableLock());
+
+		RAISE_INVALID_ARGUMENT_IF(readOnly_, "unable to compact a read-only database");
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadInProgress_, "unable to compact a database during a bulk load");
+
+		// A pass relocates pages above the highest page number the acquired pages would have in a compact file.
+		if (! compactionInProgress_) {
+			compactionLimit_ = metaData_.compactedHighestOverflowFilePage();
+			compactionBucket_ = 0;
+			compactionInProgress_ = true;
+
+			HASHDB_LOG_DEBUG("Compaction relocates overflow file pages above page %u", compactionLimit_);
+		}
+
+		size_type visitedPages = 0;
+
+		while (compactionBucket_ <= metaData_.highestBucket() && (maxPages == 0 || visitedPages < maxPages)) {
+			visitedPages += compactBucket(compactionBucket_);
+			++compactionBucket_;
+		}
+
+		const bool finished = (compactionBucket_ > metaData_.highestBucket());
+
+		if (finished) {
+			compactionInProgress_ = false;
+			truncateOverflowFile();
+		}
+		else {
+			saveRequestChanges();
+		}
+
+		return finished;
+	}
+
+	size_type OpenDatabase::compactBucket(uint32_t bucketNumber)
+	{
+		PageCache::DataPagePtr parentPage = pageCache_.dataPage(bucketFilePage(bucketNumber + 1));
+		PageId pageId = parentPage->nextOverflowPageId();
+		size_type visitedPages = 1;
+		size_type numberOfTraversedPages = 0;
+
+		for (DataPageCursor cursor(parentPage.get()); cursor.isValid(); cursor.next()) {
+			if (! cursor.isInlineValue()) {
+				visitedPages += compactLargeValue(*parentPage, cursor);
+			}
+		}
+
+		while (pageId.isValid()) {
+			PageCache::DataPagePtr page = pageCache_.dataPage(pageId);
+			++visitedPages;
+
+			if (pageId.pageNumber() > compactionLimit_) {
+				const uint32_t newPageNumber = metaData_.relocateOverflowFilePage(pageId.pageNumber());
+
+				if (newPageNumber != 0) {
+					HASHDB_LOG_DEBUG_DETAIL("Compaction of bucket %u: overflow page %u relocated to page %u", bucketNumber, pageId.pageNumber(), newPageNumber);
+
+					const PageCache::DataPagePtr newPage = pageCache_.newOverflowPage(newPageNumber);
+					newPage->putBytes(0, page->getBytes(0, page->size()));
+					newPage->setPageNumber(newPageNumber);
+
+					pageCache_.discard(pageId);
+					parentPage->setNextOverflowPage(newPageNumber);
+					page = newPage;
+				}
+			}
+
+			for (DataPageCursor cursor(page.get()); cursor.isValid(); cursor.next()) {
+				if (! cursor.isInlineValue()) {
+					visitedPages += compactLargeValue(*page, cursor);
+				}
+			}
+
+			parentPage = page;
+			pageId = page->nextOverflowPageId();
+			incrementTraversedPages(numberOfTraversedPages, pageId);
+		}
+
+		return visitedPages;
+	}
+
+	size_type OpenDatabase::compactLargeValue(DataPage& page, const DataPageCursor& cursor)
+	{
+		const size_type valueSize = cursor.largeValueSize();
+		size_type remainingValueSize = valueSize;
+
+		// A relocated page is written at its new number before the previous page or the record is changed to point to it.
+		boost::scoped_ptr<LargeValuePage> previousPage(new LargeValuePage(environment_.pageAllocator(), openFiles_.pageSize()));
+		boost::scoped_ptr<LargeValuePage> currentPage(new LargeValuePage(environment_.pageAllocator(), openFiles_.pageSize()));
+		bool hasPreviousPage = false;
+
+		PageId largeValuePageId = cursor.firstLargeValuePageId();
+		size_type visitedPages = 0;
+
+		while (remainingValueSize != 0) {
+			RAISE_DATABASE_CORRUPTED_IF(! largeValuePageId.isValid(), "actual large value size is smaller than %u recorded in metadata", valueSize);
+
+			openFiles_.read(*currentPage, largeValuePageId);
+			RAISE_DATABASE_CORRUPTED_IF(currentPage->getMagic() != currentPage->magic(), "bad large page value magic number %08x on %s", currentPage->getMagic(), largeValuePageId.toString());
+			++visitedPages;
+
+			if (largeValuePageId.pageNumber() > compactionLimit_) {
+				const uint32_t newPageNumber = metaData_.relocateOverflowFilePage(largeValuePageId.pageNumber());
+
+				if (newPageNumber != 0) {
+					currentPage->setId(overflowFilePage(newPageNumber));
+					currentPage->setPageNumber(newPageNumber);
+					openFiles_.write(*currentPage);
+
+					if (hasPreviousPage) {
+						previousPage->setNextLargeValuePage(newPageNumber);
+						openFiles_.write(*previousPage);
+					}
+					else {
+						page.setFirstLargeValuePage(cursor, newPageNumber);
+					}
+				}
+			}
+
+			remainingValueSize -= currentPage->partSize(remainingValueSize);
+			largeValuePageId = currentPage->nextLargeValuePageId();
+
+			previousPage.swap(currentPage);
+			hasPreviousPage = true;
+		}
+
+		RAISE_DATABASE_CORRUPTED_IF(largeValuePageId.isValid(), "actual large value size is greater than %u recorded in metadata", valueSize);
+		return visitedPages;
+	}
+
+	void OpenDatabase::truncateOverflowFile()
+	{
+		const Statistics stats = metaData_.statistics();
+		const uint32_t highestPage = metaData_.truncateOverflowFile();
+
+		// Header pages are saved with the new highest page before the file is truncated.
+		saveBuffers();
+		pageCache_.discardOverflowPagesFrom(highestPage + 1);
+		openFiles_.truncate(PageId::OverflowFileType, highestPage + 1);
+
+		HASHDB_LOG_DEBUG("Compaction truncated the overflow file from %u to %u data pages", stats.overflowFileDataPages_, metaData_.statistics().overflowFileDataPages_);
+	}
+
 	//-------------------------------------------------------------------------
 	// Statistics.
 
 	kerio::hashdb::Statistics OpenDatabase::statistics()
 	{
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.writeLock(metaDataLock());
+
 		Statistics stats = metaData_.statistics();
 		
 		stats.cachedPages_ += environment_.pageAllocator()->heldPages();
+		stats.cachedPages_ += pageCache_.cachedPages();
 		stats.cachedPages_ += 2; // Header pages.
 
+		stats.pageCacheHits_ = pageCache_.hits();
+		stats.pageCacheMisses_ = pageCache_.misses();
+		stats.pageCacheEvictions_ = pageCache_.evictions();
+		stats.keyFilterRejects_ = keyFilter_.rejects();
+		stats.recordCacheHits_ = recordCache_.hits();
+		stats.recordCacheMisses_ = recordCache_.misses();
+
 		return stats;
 	}
 
@@ -930,14 +2203,18 @@ namespace hashdb {
 
 	bool OpenDatabase::iteratorFetch(IteratorPosition& position, std::string& key, partNum_t& partNum, std::string& value)
 	{
-		SingleRequestCache cache(environment_, openFiles_);
+		PageCache::Request request(pageCache_);
+		LockSet locks(environment_.lockManager());
+		locks.readLock(bucketTableLock());
+
 		bool success = false;
 
 		while (! success && position.bucketNumber_ <= metaData_.highestBucket()) {
+			locks.readLock(bucketChainLock(position.bucketNumber_));
 
 			while (! success && position.currentPageId_.isValid()) {
-				DataPage& page = cache.dataPage(position.currentPageId_);
-				DataPageCursor cursor(&page, position.recordIndex_);
+				const PageCache::DataPagePtr page = pageCache_.dataPage(position.currentPageId_);
+				DataPageCursor cursor(page.get(), position.recordIndex_);
 
 				if (cursor.isValid()) {
 
@@ -957,7 +2234,7 @@ namespace hashdb {
 
 				}
 				else {
-					position.currentPageId_ = page.nextOverflowPageId();
+					position.currentPageId_ = page->nextOverflowPageId();
 					position.recordIndex_ = 0;
 					incrementTraversedPages(position.pagesTraversedInOverflowChain_, position.currentPageId_);
 				}
@@ -978,5 +2255,20 @@ namespace hashdb {
 		RAISE_DATABASE_CORRUPTED_IF(id.isValid() && numberOfTraversedPages > ALLOWED_OVERFLOW_CHAIN_MAX_SIZE, "cycle in overflow page chain (done %u page traversals) on %s", numberOfTraversedPages, id.toString());
 	}
 
+	size_type OpenDatabase::bucketsForHash(uint32_t keyHash, uint32_t (&buckets)[MAX_BUCKETS_FOR_KEY]) const
+	{
+		// Records of a key moved to the new bucket may still remain in the bucket being split.
+		// Buckets are returned in ascending order, in which their chain locks must be acquired.
+		const uint32_t bucketNumber = metaData_.bucketForHash(keyHash);
+		size_type numberOfBuckets = 0;
+
+		if (metaData_.isSplitInProgress() && bucketNumber == metaData_.highestBucket()) {
+			buckets[numberOfBuckets++] = metaData_.bucketBeingSplit();
+		}
+
+		buckets[numberOfBuckets++] = bucketNumber;
+		return numberOfBuckets;
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
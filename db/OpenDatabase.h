@@ -31,8 +31,12 @@
 #include "Environment.h"
 #include "OpenFiles.h"
 #include "MetaData.h"
+#include "PageCache.h"
+#include "KeyFilter.h"
+#include "RecordCache.h"
 #include "Vector.h"
 #include "BucketDataPage.h"
+#include "BulkLoadRuns.h"
 #include "IteratorPosition.h"
 
 namespace kerio {
@@ -40,8 +44,8 @@ namespace hashdb {
 
 	class DataPage;
 	class DataPageCursor;
-	class SingleRequestCache;
 	class SplitPages;
+	class RecordValueVisitor;
 
 	class OpenDatabase : boost::noncopyable
 	{
@@ -51,6 +55,7 @@ namespace hashdb {
 		static const size_type MIN_BATCH_SIZE_TO_REORDER = 5;
 		static const size_type MIN_FREE_SPACE_TO_REORDER = 512 * MIN_BATCH_SIZE_TO_REORDER;
 		static const size_type ASSUMED_BATCH_SIZE_MAX_SIZE = 1000;
+		static const size_type MAX_BUCKETS_FOR_KEY = 2;
 
 	public:
 		OpenDatabase(const boost::filesystem::path& database, const Options& options);
@@ -65,49 +70,128 @@ namespace hashdb {
 
 		void createInitialBucketPages(size_type initialBuckets);
 
+	private:
+		void openKeyFilter();
+		void advanceKeyFilterRebuild();
+
+	public:
+
 		// Reading from the database.
 		void fetchLargeValue(std::string& outValue, const size_type valueSize, const PageId& firstLargeValuePageId);
-		bool fetchSingleValueAt(SingleRequestCache& cache, IReadBatch& readBatch, size_t index);
+		bool fetchCachedValueAt(IReadBatch& readBatch, size_t index, bool& success);
+		bool fetchSingleValueAt(IReadBatch& readBatch, size_t index, uint32_t keyHash);
+		bool visitSingleValue(const boost::string_ref& key, uint32_t keyHash, partNum_t partNum, RecordValueVisitor& visitor, bool cacheInlineValue);
+		void visitLargeValue(IValueVisitor& visitor, const size_type valueSize, const PageId& firstLargeValuePageId);
 
 		// Deleting from the database.
 		void freeLargeValuePages(const PageId& firstLargeValuePageId, size_type valueSize);
+		void releaseRecord(const DataPageCursor& cursor);
 		void removeRecord(DataPage& page, DataPageCursor cursor);
-		void removeSingleValue(SingleRequestCache& cache, const boost::string_ref& key, partNum_t partNum);
-		void removeAllParts(SingleRequestCache& cache, const boost::string_ref& key);
+		void removeRecordLazily(uint32_t bucketNumber, const PageCache::DataPagePtr& page, const DataPageCursor& cursor);
+		void removeSingleValue(const boost::string_ref& key, uint32_t keyHash, partNum_t partNum);
+		void removeSingleValue(const FlatBatch& flatBatch, size_t index, uint32_t keyHash);
+		void removeAllParts(const boost::string_ref& key, uint32_t keyHash);
 
-		// Writing to the database.
 	private:
+		void finishRemove(size_type batchSize);
+		void compactDeadRecords();
+		void mergeOnUnderfill(size_type maxMerges);
+		void mergeHighestBucket();
+		void truncateBucketFile();
+
+		// Writing to the database.
+	public:
 		typedef Vector<uint32_t, ASSUMED_OVERFLOW_CHAIN_MAX_SIZE> OriginalOverflowPageNumbers_t;
 
-		void splitToChains(SingleRequestCache& cache, OriginalOverflowPageNumbers_t& originalOverflowPageNumbers, SplitPages& chainBeingSplit, SplitPages& newChain);
-		void splitOnOverfill(SingleRequestCache& cache);
-		size_type splitAddRecordOnOverflow(SingleRequestCache& cache, const RecordId& recordId, const DataPage::AddedValueRef& valueRef);
+	private:
+		void splitToChains(OriginalOverflowPageNumbers_t& originalOverflowPageNumbers, SplitPages& chainBeingSplit, SplitPages& newChain);
+		void splitOnOverfill();
+		size_type splitAddRecordOnOverflow(const RecordId& recordId, uint32_t keyHash, const DataPage::AddedValueRef& valueRef);
+
+		PageId storeLargeValue(const boost::string_ref& value);
+		bool replaceRecord(DataPage& page, const DataPageCursor& cursor, const RecordId& recordId, const boost::string_ref& value);
+		void beginSplit();
+		void advanceSplit(size_type maxPages);
+		void moveRecordToBucket(const DataPageCursor& cursor, uint32_t bucketNumber);
+		uint32_t recordKeyHash(const DataPageCursor& cursor) const;
+		void releaseEmptyOverflowPages(uint32_t bucketNumber);
+
+	public:
+		void storeSingleValue(const boost::string_ref& key, uint32_t keyHash, partNum_t partNum, const boost::string_ref& value);
+		size_type storeSingleValue(const IWriteBatch& writeBatch, size_t index, uint32_t keyHash);
+		size_type storeSingleValue(const FlatBatch& flatBatch, size_t index, uint32_t keyHash);
+
+	private:
+		void finishStore(size_type numberOfTooLargeValues);
 
 	public:
-		void storeSingleValue(SingleRequestCache& cache, const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value);
-		size_type storeSingleValue(SingleRequestCache& cache, const IWriteBatch& writeBatch, size_t index);
 
 		// API methods.
 		std::vector<partNum_t> listParts(const boost::string_ref& key);
 
 		bool fetch(IReadBatch& readBatch);
+		bool fetch(const boost::string_ref& key, partNum_t partNum, IValueVisitor& visitor);
 		void remove(const IDeleteBatch& deleteBatch);
 		void store(const IWriteBatch& writeBatch);
+		bool fetch(FlatBatch& flatBatch);
+		void remove(const FlatBatch& flatBatch);
+		void store(const FlatBatch& flatBatch);
 
 		Statistics statistics();
 
 		// Support for iterators.
 		bool iteratorFetch(IteratorPosition& position, std::string& key, partNum_t& partNum, std::string& value);
 
+		// Bulk load.
+		boost::shared_ptr<BulkLoadRuns> beginBulkLoad();
+		void bulkLoadAdd(BulkLoadRuns& runs, uint64_t expectedNumberOfRecords, const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value);
+		void finishBulkLoad(BulkLoadRuns& runs);
+		void abortBulkLoad(BulkLoadRuns& runs);
+
+	private:
+		void createBulkLoadBuckets(uint64_t numberOfRecords, uint64_t dataInlineSize);
+		void removeReplacedBulkLoadRecords(BulkLoadRecords_t& records);
+
+		// Compaction of the overflow file.
+	public:
+		bool compact(size_type maxPages);
+
 	private:
+		size_type compactBucket(uint32_t bucketNumber);
+		size_type compactLargeValue(DataPage& page, const DataPageCursor& cursor);
+		void truncateOverflowFile();
+
+	private:
+		void saveBuffers();
+		void saveRequestChanges();
 		void incrementTraversedPages(size_type& numberOfTraversedPages, const PageId& id);
+		size_type bucketsForHash(uint32_t keyHash, uint32_t (&buckets)[MAX_BUCKETS_FOR_KEY]) const;
 
+		const boost::filesystem::path database_;
 		Environment environment_;
 		OpenFiles openFiles_;
 		MetaData metaData_;
+		PageCache pageCache_;
+		KeyFilter keyFilter_;
+		boost::mutex keyFilterRebuildMutex_;
+		uint32_t keyFilterRebuildBucket_;	// Next bucket to be scanned by the key filter rebuild.
+		RecordCache recordCache_;
 
 		size_type storeThrowIfLargerThan_;
 		size_type fetchIgnoreIfLargerThan_;
+		size_type splitPagesPerStore_;
+		bool readOnly_;
+		size_type bulkLoadBufferBytes_;
+		bool bulkLoadInProgress_;
+
+		bool compactionInProgress_;
+		uint32_t compactionLimit_;	// Pages with higher numbers are relocated by the compaction pass.
+		uint32_t compactionBucket_;	// Next bucket to be processed by the compaction pass.
+
+		bool bucketFileTruncationPending_;	// Buckets were merged since the bucket file was last truncated.
+
+		typedef std::vector<std::pair<uint32_t, PageCache::DataPagePtr> > pagesWithDeadRecords_t;
+		pagesWithDeadRecords_t pagesWithDeadRecords_;	// Pages and their buckets with records removed by the current request.
 	};
 
 }; // namespace hashdb
@@ -27,10 +27,13 @@
 
 // OpenFiles.cpp - simple holder of the open database files.
 #include "stdafx.h"
+#include <sstream>
+#include <boost/filesystem.hpp>
 #include <kerio/hashdb/Constants.h>
 #include "utils/ExceptionCreator.h"
 #include "BucketHeaderPage.h"
 #include "OverflowHeaderPage.h"
+#include "Version.h"
 #include "OpenFiles.h"
 
 namespace kerio {
@@ -50,6 +53,15 @@ namespace hashdb {
 			return file;
 		}
 
+		bool fileExists(const boost::filesystem::path& fileName)
+		{
+			boost::system::error_code statusError;
+			const boost::filesystem::file_status fileStatus = boost::filesystem::status(fileName, statusError);
+
+			RAISE_IO_ERROR_IF(statusError && fileStatus.type() != boost::filesystem::file_not_found, "existence of the file \"%s\" cannot be determined: %s", fileName.string(), statusError.message());
+			return fileStatus.type() == boost::filesystem::regular_file;
+		}
+
 	};
 
 	boost::filesystem::path OpenFiles::databaseNameToBucketFileName(const boost::filesystem::path& database)
@@ -62,19 +74,46 @@ namespace hashdb {
 		return createFileName(database, ".dbo");
 	}
 
+	boost::filesystem::path OpenFiles::databaseNameToLogFileName(const boost::filesystem::path& database)
+	{
+		return createFileName(database, ".dbl");
+	}
+
+	boost::filesystem::path OpenFiles::databaseNameToBulkLoadRunFileName(const boost::filesystem::path& database, size_type runNumber)
+	{
+		std::ostringstream suffix;
+		suffix << ".dbr" << runNumber;
+		return createFileName(database, suffix.str());
+	}
+
+	boost::filesystem::path OpenFiles::databaseNameToKeyFilterFileName(const boost::filesystem::path& database)
+	{
+		return createFileName(database, ".dbf");
+	}
+
 	OpenFiles::OpenFiles(const boost::filesystem::path& database, const Options& options, Environment& environment)
-		: environment_(environment)
+		: hashFun_(options.hashFun_)
+		, logFileName_(databaseNameToLogFileName(database))
+		, logWrites_(false)
+		, checkpointBytes_(options.writeAheadLogCheckpointBytes_)
+		, environment_(environment)
 	{
 		HASHDB_LOG_DEBUG("Opening database %s", database.string());
 
 		try {
-			
+			// Pages pending in the log are read from the log, so the files cannot be mapped.
+			Options fileOptions = options;
+			fileOptions.mapFiles_ = options.mapFiles_ && ! fileExists(logFileName_);
+
 			boost::filesystem::path bucketFileName = databaseNameToBucketFileName(database);
-			bucketFile_.reset(new PagedFile(bucketFileName, PageId::BucketFileType, options, environment));
-			const PagedFile::fileSize_t bucketFileSize = bucketFile_->size();
+			bucketFile_.reset(new PagedFile(bucketFileName, PageId::BucketFileType, fileOptions, environment));
 
 			boost::filesystem::path overflowFileName = databaseNameToOverflowFileName(database);
-			overflowFile_.reset(new PagedFile(overflowFileName, PageId::OverflowFileType, options, environment));
+			overflowFile_.reset(new PagedFile(overflowFileName, PageId::OverflowFileType, fileOptions, environment));
+
+			openLog(options);
+
+			const PagedFile::fileSize_t bucketFileSize = bucketFile_->size();
 			const PagedFile::fileSize_t overflowFileSize = overflowFile_->size(); 
 
 			isNew_ = (bucketFileSize == 0) && (overflowFileSize == 0);
@@ -91,7 +130,12 @@ namespace hashdb {
 			}
 			else {
 				readHeaderPages();
-				validate(options);
+				selectHashFunction(options);
+				validate();
+
+				if (! options.readOnly_) {
+					upgradeFormatVersion(options);
+				}
 			}
 		} catch (const std::exception& ex) {
 			HASHDB_LOG_DEBUG("Error when opening database %s: %s", database.string(), ex.what());
@@ -101,6 +145,29 @@ namespace hashdb {
 		}
 	}
 
+	void OpenFiles::openLog(const Options& options)
+	{
+		const bool logExists = fileExists(logFileName_);
+		logWrites_ = options.writeAheadLog_ && ! options.readOnly_;
+
+		if (logExists || logWrites_) {
+			log_.reset(new WriteAheadLog(logFileName_, options, environment_));
+
+			// Write pages committed before the database was closed or crashed to the database files.
+			if (! options.readOnly_) {
+				writeLoggedPages();
+			}
+
+			if (! options.readOnly_ && ! logWrites_) {
+				log_->close();
+				log_.reset();
+
+				boost::system::error_code removeError;
+				boost::filesystem::remove(logFileName_, removeError);
+			}
+		}
+	}
+
 	void OpenFiles::close()
 	{
 		HASHDB_LOG_DEBUG("Closing database files");
@@ -120,14 +187,25 @@ namespace hashdb {
 			
 			overflowFile_->close();
 		}
+
+		if (log_ && ! log_->isClosed()) {
+			const bool removeLog = logWrites_ && log_->size() == 0 && log_->loggedImages().empty();
+			log_->close();
+
+			if (removeLog) {
+				boost::system::error_code removeError;
+				boost::filesystem::remove(logFileName_, removeError);
+			}
+		}
 	}
 
 	bool OpenFiles::isClosed() const
 	{
 		const bool bucketFileClosed = ! bucketFile_ || bucketFile_->isClosed();
 		const bool overflowFileClosed = ! overflowFile_ || overflowFile_->isClosed();
+		const bool logClosed = ! log_ || log_->isClosed();
 
-		return bucketFileClosed && overflowFileClosed;
+		return bucketFileClosed && overflowFileClosed && logClosed;
 	}
 
 	OpenFiles::~OpenFiles()
@@ -167,16 +245,47 @@ namespace hashdb {
 
 	void OpenFiles::write(Page& page)
 	{
-		file(page.getId().fileType())->write(page);
+		if (! logWrites_) {
+			file(page.getId().fileType())->write(page);
+		}
+		else if (page.dirty()) {
+			RAISE_INTERNAL_ERROR_IF(page.size() != pageSize_, "Logged page size %d differs from the page size %d of the database", page.size(), pageSize_);
+
+			boost::mutex::scoped_lock lock(logMutex_);
+			log_->append(page);
+			page.clearDirtyFlag();
+		}
 	}
 
 	void OpenFiles::read(Page& page, const PageId& pageId)
 	{
+		if (log_) {
+			boost::mutex::scoped_lock lock(logMutex_);
+
+			if (log_->hasPage(pageId)) {
+				uint8_t* pageData = page.mutableData();
+				page.clearDirtyFlag();
+
+				const size_type imageSize = log_->readPage(pageId, pageData, page.size());
+				RAISE_DATABASE_CORRUPTED_IF(imageSize < page.size(), "logged image of %s is smaller than page size %u", pageId.toString(), page.size());
+
+				page.setId(pageId);
+				return;
+			}
+		}
+
+		// A page missing in the log is not logged meanwhile, the page cache does not read a page being written back.
+		// A checkpoint writes logged pages to the files before it truncates the log.
 		file(pageId.fileType())->read(page, pageId);
 	}
 
 	void OpenFiles::sync()
 	{
+		if (logWrites_) {
+			boost::mutex::scoped_lock lock(logMutex_);
+			log_->sync();
+		}
+
 		bucketFile_->sync();
 		overflowFile_->sync();
 	}
@@ -187,15 +296,84 @@ namespace hashdb {
 		overflowFile_->prefetch();
 	}
 
+	//----------------------------------------------------------------------------
+	// Write-ahead log.
+
+	bool OpenFiles::logsWrites() const
+	{
+		return logWrites_;
+	}
+
+	void OpenFiles::truncate(PageId::DatabaseFile_t fileType, uint32_t numberOfPages)
+	{
+		// Logged images of truncated pages must not be written back behind the end of the file by a later checkpoint.
+		if (logWrites_) {
+			boost::mutex::scoped_lock lock(logMutex_);
+			writeLoggedPages();
+		}
+
+		PagedFile* truncatedFile = file(fileType);
+		const PagedFile::fileSize_t newSize = numberOfPages * static_cast<PagedFile::fileSize_t>(pageSize_);
+
+		if (truncatedFile->size() > newSize) {
+			truncatedFile->truncate(newSize);
+		}
+	}
+
+	void OpenFiles::commit()
+	{
+		boost::mutex::scoped_lock lock(logMutex_);
+
+		if (logWrites_) {
+			log_->commit();
+
+			if (log_->size() >= checkpointBytes_) {
+				writeLoggedPages();
+			}
+		}
+	}
+
+	void OpenFiles::checkpoint()
+	{
+		boost::mutex::scoped_lock lock(logMutex_);
+
+		if (logWrites_) {
+			writeLoggedPages();
+		}
+	}
+
+	void OpenFiles::writeLoggedPages()
+	{
+		if (log_->size() != 0 || ! log_->loggedImages().empty()) {
+			log_->commit();
+			log_->sync();
+
+			// Database files are written only after the log is on the disk and the log is truncated only after the files are.
+			const WriteAheadLog::loggedImages_t& loggedImages = log_->loggedImages();
+			std::string image;
+
+			for (WriteAheadLog::loggedImages_t::const_iterator ii = loggedImages.begin(); ii != loggedImages.end(); ++ii) {
+				log_->readImage(ii->second, image);
+				file(ii->first.fileType())->writeImage(ii->first.pageNumber(), image);
+			}
+
+			bucketFile_->sync();
+			overflowFile_->sync();
+
+			HASHDB_LOG_DEBUG("Checkpoint wrote %u logged pages to database files", loggedImages.size());
+			log_->truncate();
+		}
+	}
+
 	//----------------------------------------------------------------------------
 	// Header page accessors and utilities.
 	
-	HeaderPage* OpenFiles::bucketHeaderPage()
+	BucketHeaderPage* OpenFiles::bucketHeaderPage()
 	{
 		return bucketFileHeader_.get();
 	}
 
-	HeaderPage* OpenFiles::overflowHeaderPage()
+	OverflowHeaderPage* OpenFiles::overflowHeaderPage()
 	{
 		return overflowFileHeader_.get();
 	}
@@ -205,7 +383,7 @@ namespace hashdb {
 		if (bucketFileHeader_->dirty()) {
 			HASHDB_LOG_DEBUG("Saving dirty bucket file header page");
 			bucketFileHeader_->updateChecksum();
-			bucketFile_->write(*bucketFileHeader_);
+			write(*bucketFileHeader_);
 		}
 	}
 
@@ -214,7 +392,7 @@ namespace hashdb {
 		if (overflowFileHeader_->dirty()) {
 			HASHDB_LOG_DEBUG("Saving dirty overflow file header page");
 			overflowFileHeader_->updateChecksum();
-			overflowFile_->write(*overflowFileHeader_);
+			write(*overflowFileHeader_);
 		}
 	}
 
@@ -242,6 +420,7 @@ namespace hashdb {
 		const uint32_t testHash = options.computeTestHash();
 		bucketFileHeader_->setTestHash(testHash);
 		overflowFileHeader_->setTestHash(testHash);
+		bucketFileHeader_->setHashFunction(options.hashFunctionType());
 
 		// Creation timestamp and creation tag should be the same for both bucket and overflow file.
 		const uint32_t creationTimestamp = static_cast<uint32_t>(time(NULL));
@@ -262,7 +441,7 @@ namespace hashdb {
 		bucketFileHeader_.reset(new BucketHeaderPage(environment_.headerPageAllocator(), MIN_PAGE_SIZE));
 
 		bucketFile_->setPageSize(MIN_PAGE_SIZE);
-		bucketFile_->read(*bucketFileHeader_, bucketHeaderId);
+		read(*bucketFileHeader_, bucketHeaderId);
 		bucketFileHeader_->validate();
 
 		// Re-read the bucket file header page if it is bigger.
@@ -272,7 +451,7 @@ namespace hashdb {
 			bucketFileHeader_.reset(new BucketHeaderPage(environment_.headerPageAllocator(), pageSize_));
 
 			bucketFile_->setPageSize(pageSize_);
-			bucketFile_->read(*bucketFileHeader_, bucketHeaderId);
+			read(*bucketFileHeader_, bucketHeaderId);
 			bucketFileHeader_->validate();
 		}
 
@@ -281,7 +460,7 @@ namespace hashdb {
 		overflowFileHeader_.reset(new OverflowHeaderPage(environment_.headerPageAllocator(), pageSize_));
 
 		overflowFile_->setPageSize(pageSize_);
-		overflowFile_->read(*overflowFileHeader_, overflowHeaderId);
+		read(*overflowFileHeader_, overflowHeaderId);
 		overflowFileHeader_->validate();
 
 		// Check that the page size matches.
@@ -300,23 +479,62 @@ namespace hashdb {
 		HASHDB_LOG_DEBUG("Read header pages, page size is %u", pageSize_);
 	}
 
-	void OpenFiles::validate(const Options& options) const
+	void OpenFiles::selectHashFunction(const Options& options)
 	{
+		// A built-in hash function recorded in the header is used regardless of the options.
+		const uint32_t hashFunctionType = bucketFileHeader_->getHashFunction();
+		Options hashOptions = options;
+
+		if (hashFunctionType != Options::CustomHashFunctionType) {
+			hashOptions.hashFun_ = Options::builtInHashFunction(static_cast<Options::HashFunction_t>(hashFunctionType));
+
+			if (hashOptions.hashFun_ == NULL) {
+				RAISE_INCOMPATIBLE_DATABASE("unknown hash function %u on %s", hashFunctionType, bucketFileHeader_->getId().toString());
+			}
+		}
+
 		// Check that the hash function used to create the database matches.
-		const uint32_t testHash = options.computeTestHash();
+		const uint32_t testHash = hashOptions.computeTestHash();
 		RAISE_INVALID_ARGUMENT_IF(bucketFileHeader_->getTestHash() != testHash, "Hash function does not match on %s", bucketFileHeader_->getId().toString());
 		RAISE_INVALID_ARGUMENT_IF(overflowFileHeader_->getTestHash() != testHash, "Hash function does not match on %s", overflowFileHeader_->getId().toString());
 
-		// Check that file is not smaller than the maximum number of pages.
+		hashFun_ = hashOptions.hashFun_;
+	}
+
+	void OpenFiles::validate() const
+	{
+		// Check that file is not smaller than the maximum number of pages. Pages pending in the log are not written yet.
+		if (log_ && ! log_->loggedImages().empty()) {
+			return;
+		}
+
 		const PagedFile::fileSize_t bucketFileSize = bucketFile_->size();
-		const uint32_t bucketFilePages = bucketFileHeader_->getHighestPageNumber() + 1;
+		const PagedFile::fileSize_t bucketFilePages = static_cast<PagedFile::fileSize_t>(bucketFileHeader_->getHighestPageNumber()) + 1;
 		RAISE_DATABASE_CORRUPTED_IF(bucketFileSize < (bucketFilePages * pageSize()), "missing pages in bucket file");
 
 		const PagedFile::fileSize_t overflowFileSize = overflowFile_->size(); 
-		const uint32_t overflowFilePages = overflowFileHeader_->getHighestPageNumber() + 1;
+		const PagedFile::fileSize_t overflowFilePages = static_cast<PagedFile::fileSize_t>(overflowFileHeader_->getHighestPageNumber()) + 1;
 		RAISE_DATABASE_CORRUPTED_IF(overflowFileSize < (overflowFilePages * pageSize()), "missing pages in overflow file");
 	}
 
+	void OpenFiles::upgradeFormatVersion(const Options& options)
+	{
+		// Older formats remain readable, the version only prevents older code from opening the database after new pages were written.
+		if (bucketFileHeader_->getDatabaseVersion() < DATABASE_CURRENT_FORMAT_VERSION || overflowFileHeader_->getDatabaseVersion() < DATABASE_CURRENT_FORMAT_VERSION) {
+			HASHDB_LOG_DEBUG("Upgrading database format version from %u to %u", bucketFileHeader_->getDatabaseVersion(), DATABASE_CURRENT_FORMAT_VERSION);
+
+			bucketFileHeader_->setDatabaseVersion(DATABASE_CURRENT_FORMAT_VERSION);
+			overflowFileHeader_->setDatabaseVersion(DATABASE_CURRENT_FORMAT_VERSION);
+
+			// Older headers do not record the hash function. The test hash matched, so the one in the options is recorded if it is built-in.
+			if (bucketFileHeader_->getHashFunction() == Options::CustomHashFunctionType) {
+				bucketFileHeader_->setHashFunction(options.hashFunctionType());
+			}
+
+			saveHeaderPages();
+		}
+	}
+
 	//----------------------------------------------------------------------------
 	// State.
 
@@ -330,5 +548,10 @@ namespace hashdb {
 		return pageSize_;
 	}
 
+	Options::hashFun_t OpenFiles::hashFunction() const
+	{
+		return hashFun_;
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
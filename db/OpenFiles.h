@@ -27,9 +27,11 @@
 
 // OpenFiles.h - simple holder of the open database files.
 #pragma once
+#include <boost/thread/mutex.hpp>
 #include "BucketHeaderPage.h"
 #include "OverflowHeaderPage.h"
 #include "PagedFile.h"
+#include "WriteAheadLog.h"
 
 namespace kerio {
 namespace hashdb {
@@ -48,8 +50,8 @@ namespace hashdb {
 		PagedFile* file(PageId::DatabaseFile_t fileType);
 
 		// Header page accessors and utilities.
-		HeaderPage* bucketHeaderPage();
-		HeaderPage* overflowHeaderPage();
+		BucketHeaderPage* bucketHeaderPage();
+		OverflowHeaderPage* overflowHeaderPage();
 		void saveBucketHeaderPage();
 		void saveOverflowHeaderPage();
 		void saveHeaderPages();
@@ -59,24 +61,41 @@ namespace hashdb {
 		void read(Page& page, const PageId& pageId);
 		void sync();
 		void prefetch();
+		void truncate(PageId::DatabaseFile_t fileType, uint32_t numberOfPages);
+
+		// Write-ahead log.
+		bool logsWrites() const;
+		void commit();
+		void checkpoint();
 
 		// State.
 		bool isNew() const;
 		size_type pageSize() const;
+		Options::hashFun_t hashFunction() const;
 
 		// Utilities
 		static boost::filesystem::path databaseNameToBucketFileName(const boost::filesystem::path& database);
 		static boost::filesystem::path databaseNameToOverflowFileName(const boost::filesystem::path& database);
+		static boost::filesystem::path databaseNameToLogFileName(const boost::filesystem::path& database);
+		static boost::filesystem::path databaseNameToBulkLoadRunFileName(const boost::filesystem::path& database, size_type runNumber);
+		static boost::filesystem::path databaseNameToKeyFilterFileName(const boost::filesystem::path& database);
 
 	private:
 		// Creating/processing header pages.
 		void createHeaderPages(const Options& options, uint32_t creationTag);
 		void readHeaderPages();
-		void validate(const Options& options) const;
+		void selectHashFunction(const Options& options);
+		void validate() const;
+		void upgradeFormatVersion(const Options& options);
+
+		// Opening the write-ahead log.
+		void openLog(const Options& options);
+		void writeLoggedPages();
 
 	private:
 		bool isNew_;
 		size_type pageSize_;
+		Options::hashFun_t hashFun_;
 
 		boost::scoped_ptr<PagedFile> bucketFile_;
 		boost::scoped_ptr<BucketHeaderPage> bucketFileHeader_;
@@ -84,6 +103,15 @@ namespace hashdb {
 		boost::scoped_ptr<PagedFile> overflowFile_;
 		boost::scoped_ptr<OverflowHeaderPage> overflowFileHeader_;
 
+		const boost::filesystem::path logFileName_;
+		boost::scoped_ptr<WriteAheadLog> log_;
+		bool logWrites_;
+		const WriteAheadLog::fileSize_t checkpointBytes_;
+
+		// Guards the write-ahead log. Pages of the database files are read and written at explicit offsets,
+		// so the file I/O of concurrent requests needs no lock.
+		boost::mutex logMutex_;
+
 		Environment& environment_;
 	};
 
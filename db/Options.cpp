@@ -30,6 +30,7 @@
 #include "utils/ExceptionCreator.h"
 #include "utils/ConfigUtils.h"
 #include "utils/MurmurHash3Adapter.h"
+#include "utils/WyHash.h"
 #include "utils/NullLogger.h"
 #include <kerio/hashdb/Constants.h>
 #include <kerio/hashdb/Options.h>
@@ -43,13 +44,25 @@ namespace hashdb {
 	Options::Options() 
 		: createIfMissing_(true)
 		, readOnly_(false)
+		, mapFiles_(false)
 		, pageSize_(defaultPageSize())
 		, memoryPoolBytes_(defaultCacheBytes())
+		, pageCacheBytes_(defaultPageCacheBytes())
+		, keyFilterBytes_(0)
+		, recordCacheBytes_(0)
+		, bufferPoolSoftQuota_(16 * 1024)
+		, bufferPoolHardQuota_(0)
 		, initialBuckets_(1)
 		, hashFun_(murmur3Hash)
 		, leavePageFreeSpace_(0)
 		, largeValuesPerKey_(1)
 		, minFlushFrequency_(20)
+		, splitPagesPerStore_(0)
+		, mergeFillPercent_(0)
+		, bulkLoadBufferBytes_(32 * 1024 * 1024)
+		, writeAheadLog_(false)
+		, writeAheadLogGroupSize_(1)
+		, writeAheadLogCheckpointBytes_(4 * 1024 * 1024)
 		, storeThrowIfLargerThan_(20 * 1024 * 1024)
 		, fetchIgnoreIfLargerThan_(50 * 1024 * 1024)
 		, lockManagerType_(NullLockManagerType)
@@ -63,6 +76,7 @@ namespace hashdb {
 		Options options;
 		options.createIfMissing_ = false;
 		options.readOnly_ = true;
+		options.mapFiles_ = true;
 		options.logger_ = logger;
 		return options;
 	}
@@ -86,9 +100,27 @@ namespace hashdb {
 		return readWriteSingleThreaded(logger);
 	}
 
+	kerio::hashdb::Options Options::readWriteMultiThreaded(boost::shared_ptr<ILogger> logger)
+	{
+		Options options;
+		options.lockManagerType_ = TrueLockManagerType;
+		options.pageAllocatorType_ = LockFreePageAllocatorType;
+		options.logger_ = logger;
+		return options;
+	}
+
+	Options Options::readWriteMultiThreaded()
+	{
+		boost::shared_ptr<ILogger> logger(new NullLogger());
+		return readWriteMultiThreaded(logger);
+	}
+
 	void Options::validate() const
 	{
 		RAISE_INVALID_ARGUMENT_IF(createIfMissing_ && readOnly_, "Options: createIfMissing_ and readOnly_ cannot be both true");
+		RAISE_INVALID_ARGUMENT_IF(mapFiles_ && ! readOnly_,      "Options: mapFiles_ can be true only if readOnly_ is true");
+		RAISE_INVALID_ARGUMENT_IF(mapFiles_ && lockManagerType_ == TrueLockManagerType,
+																 "Options: mapFiles_ cannot be used in multithreaded environments");
 		RAISE_INVALID_ARGUMENT_IF(! isValidPageSize(pageSize_),  "Options: page size pageSize_ is invalid (%u)", pageSize_);
 		RAISE_INVALID_ARGUMENT_IF(initialBuckets_ == 0,          "Options: initial number of buckets initialBuckets_ must be greater than 0");
 		RAISE_INVALID_ARGUMENT_IF(hashFun_ == NULL,              "Options: hash function pointer hashFun_ must not be null");
@@ -98,6 +130,13 @@ namespace hashdb {
 																 "Options: storeThrowIfLargerThan_ must be either 0 or it must be larger than maximum page size");
 		RAISE_INVALID_ARGUMENT_IF(fetchIgnoreIfLargerThan_ != 0 && fetchIgnoreIfLargerThan_ <= MAX_PAGE_SIZE,  
 																 "Options: fetchIgnoreIfLargerThan_ must be either 0 or it must be larger than maximum page size");
+		RAISE_INVALID_ARGUMENT_IF(mergeFillPercent_ > 50,        "Options: mergeFillPercent_ must not be greater than 50");
+		RAISE_INVALID_ARGUMENT_IF(bulkLoadBufferBytes_ == 0,     "Options: bulkLoadBufferBytes_ must be greater than 0");
+		RAISE_INVALID_ARGUMENT_IF(writeAheadLogGroupSize_ == 0,  "Options: writeAheadLogGroupSize_ must be greater than 0");
+		RAISE_INVALID_ARGUMENT_IF(writeAheadLogCheckpointBytes_ == 0,
+																 "Options: writeAheadLogCheckpointBytes_ must be greater than 0");
+		RAISE_INVALID_ARGUMENT_IF(bufferPoolHardQuota_ != 0 && bufferPoolHardQuota_ < bufferPoolSoftQuota_,
+																 "Options: bufferPoolHardQuota_ must be either 0 or it must not be smaller than bufferPoolSoftQuota_");
 
 		switch (lockManagerType_) {
 		case NullLockManagerType:
@@ -136,5 +175,35 @@ namespace hashdb {
 		return hash;
 	}
 
+	//-------------------------------------------------------------------------
+	// Built-in hash functions.
+
+	Options::hashFun_t Options::builtInHashFunction(HashFunction_t hashFunctionType)
+	{
+		switch (hashFunctionType) {
+		case Murmur3HashFunctionType:
+			return murmur3Hash;
+
+		case WyHashFunctionType:
+			return wyHash;
+
+		default:
+			return NULL;
+		}
+	}
+
+	Options::HashFunction_t Options::hashFunctionType() const
+	{
+		if (hashFun_ == murmur3Hash) {
+			return Murmur3HashFunctionType;
+		}
+
+		if (hashFun_ == wyHash) {
+			return WyHashFunctionType;
+		}
+
+		return CustomHashFunctionType;
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
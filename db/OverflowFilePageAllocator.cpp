@@ -35,6 +35,8 @@ namespace hashdb {
 	OverflowFilePageAllocator::OverflowFilePageAllocator(Environment& environment, OpenFiles& openFiles) 
 		: highestOverflowFilePage_(openFiles.overflowHeaderPage()->getHighestPageNumber())
 		, bitmapPagesAcquired_(0)
+		, bitmapPagesReleased_(0)
+		, bitmapPagesRead_(0)
 		, bitmapPageDistance_(BitmapPage::numberOfManagedPages(openFiles.pageSize()) + 1)
 		, environment_(environment)
 		, openFiles_(openFiles)
@@ -64,6 +66,7 @@ namespace hashdb {
 			bitmapPageMap_t::value_type loadedPage(bitmapPageNumber, BitmapPage(environment_.pageAllocator(), openFiles_.pageSize()));
 			openFiles_.read(loadedPage.second, overflowFilePage(bitmapPageNumber));
 			loadedPage.second.validate();
+			++bitmapPagesRead_;
 
 			std::pair<bitmapPageMap_t::iterator, bool> insertResult = loadedBitmaps_.insert(loadedPage);
 			RAISE_INTERNAL_ERROR_IF_ARG(! insertResult.second);
@@ -74,10 +77,15 @@ namespace hashdb {
 		return pageIt;
 	}
 
-	uint32_t OverflowFilePageAllocator::acquireOffsetFromExistingBitmapPage(uint32_t bitmapPageNumber)
+	uint32_t OverflowFilePageAllocator::acquireOffsetFromExistingBitmapPage(uint32_t bitmapPageNumber, uint32_t endPageOffset)
 	{
 		OverflowFilePageAllocator::bitmapPageMap_t::iterator pageIt = existingBitmapPage(bitmapPageNumber);
-		return pageIt->second.acquirePage();
+		return pageIt->second.acquirePageBelow(endPageOffset);
+	}
+
+	uint32_t OverflowFilePageAllocator::bitmapPageIndex(uint32_t bitmapPageNumber) const
+	{
+		return (bitmapPageNumber - 1) / bitmapPageDistance_;
 	}
 
 	uint32_t OverflowFilePageAllocator::acquireOverflowPageNumber()
@@ -85,15 +93,7 @@ namespace hashdb {
 		const uint32_t eventuallyCreatedPageNumber = highestOverflowFilePage_ + 1;
 		RAISE_INVALID_ARGUMENT_IF(eventuallyCreatedPageNumber == 0, "database is full: overflow pages exhausted");
 
-		uint32_t acquiredPageNumber = BitmapPage::NO_SPACE;
-		for (size_type bitmapPageNumber = 1; bitmapPageNumber < eventuallyCreatedPageNumber; bitmapPageNumber += bitmapPageDistance_) {
-			const uint32_t pageNumberOffset = acquireOffsetFromExistingBitmapPage(bitmapPageNumber);
-
-			if (pageNumberOffset != BitmapPage::NO_SPACE) {
-				acquiredPageNumber = bitmapPageNumber + 1 + pageNumberOffset; // 0 -> next page after bitmap page
-				break;
-			}
-		}
+		uint32_t acquiredPageNumber = acquireFromExistingBitmapPages(eventuallyCreatedPageNumber, false);
 
 		if (acquiredPageNumber == BitmapPage::NO_SPACE) {
 			const uint32_t pageNumberOffset = acquireOffsetFromNewBitmapPage(eventuallyCreatedPageNumber);
@@ -108,6 +108,44 @@ namespace hashdb {
 		return acquiredPageNumber;
 	}
 
+	uint32_t OverflowFilePageAllocator::acquireFromExistingBitmapPages(uint32_t belowPageNumber, bool onlyPagesBelow)
+	{
+		// Bitmap pages are searched in ascending order and each returns its lowest free page. The last bitmap page
+		// may manage pages behind the end of the file, they are skipped if only pages below the limit are acquired.
+		const uint32_t managedPages = static_cast<uint32_t>(bitmapPageDistance_ - 1);
+		OverflowHeaderPage* headerPage = openFiles_.overflowHeaderPage();
+		const uint32_t summarizedBitmapPages = headerPage->summarizedBitmapPages();
+
+		uint32_t acquiredPageNumber = BitmapPage::NO_SPACE;
+		for (uint32_t bitmapIndex = 0; ; ++bitmapIndex) {
+			// Skip bitmap pages which are known to be full.
+			if (bitmapIndex < summarizedBitmapPages) {
+				bitmapIndex = headerPage->nextBitmapPageWithFreeSpace(bitmapIndex);
+			}
+
+			const uint64_t bitmapPageNumber = 1 + (static_cast<uint64_t>(bitmapIndex) * bitmapPageDistance_);
+			if (bitmapPageNumber >= belowPageNumber) {
+				break;
+			}
+
+			const uint64_t pagesBelow = belowPageNumber - bitmapPageNumber - 1;
+			const uint32_t endPageOffset = (onlyPagesBelow && pagesBelow < managedPages)? static_cast<uint32_t>(pagesBelow) : managedPages;
+			const uint32_t pageNumberOffset = acquireOffsetFromExistingBitmapPage(static_cast<uint32_t>(bitmapPageNumber), endPageOffset);
+
+			if (pageNumberOffset != BitmapPage::NO_SPACE) {
+				acquiredPageNumber = static_cast<uint32_t>(bitmapPageNumber) + 1 + pageNumberOffset; // 0 -> next page after bitmap page
+				break;
+			}
+
+			// A bitmap page searched only partially may have free pages above the limit.
+			if (bitmapIndex < summarizedBitmapPages && endPageOffset == managedPages) {
+				headerPage->setBitmapPageFull(bitmapIndex, true);
+			}
+		}
+
+		return acquiredPageNumber;
+	}
+
 	void OverflowFilePageAllocator::releaseOverflowPageNumber(uint32_t pageNumber)
 	{
 		RAISE_INTERNAL_ERROR_IF_ARG(pageNumber == 0 || pageNumber > highestOverflowFilePage_);
@@ -117,6 +155,13 @@ namespace hashdb {
 
 		bitmapPageMap_t::iterator pageIt = existingBitmapPage(bitmapPageNumber);
 		pageIt->second.releasePage(pageNumberOffset);
+
+		OverflowHeaderPage* headerPage = openFiles_.overflowHeaderPage();
+		const uint32_t bitmapIndex = bitmapPageIndex(bitmapPageNumber);
+
+		if (bitmapIndex < headerPage->summarizedBitmapPages()) {
+			headerPage->setBitmapPageFull(bitmapIndex, false);
+		}
 	}
 
 	void OverflowFilePageAllocator::save()
@@ -124,6 +169,112 @@ namespace hashdb {
 		for (OverflowFilePageAllocator::bitmapPageMap_t::iterator ii = loadedBitmaps_.begin(); ii != loadedBitmaps_.end(); ++ii) {
 			openFiles_.write(ii->second);
 		}
+
+		evictLoadedBitmapPages();
+	}
+
+	//----------------------------------------------------------------------------
+	// Compaction.
+
+	uint32_t OverflowFilePageAllocator::acquireOverflowPageNumberBelow(uint32_t pageNumber)
+	{
+		const uint32_t acquiredPageNumber = acquireFromExistingBitmapPages(pageNumber, true);
+		return (acquiredPageNumber == BitmapPage::NO_SPACE)? 0 : acquiredPageNumber;
+	}
+
+	BitmapPage OverflowFilePageAllocator::bitmapPageToInspect(uint32_t bitmapPageNumber) const
+	{
+		// Bitmap pages which are not loaded are read without loading them, so that a scan of the whole file
+		// does not fill the loaded bitmap pages with unmodified pages.
+		bitmapPageMap_t::const_iterator pageIt = loadedBitmaps_.find(bitmapPageNumber);
+		if (pageIt != loadedBitmaps_.end()) {
+			BitmapPage loadedPage(pageIt->second);
+			loadedPage.clearDirtyFlag(); // The loaded page itself remains dirty.
+			return loadedPage;
+		}
+
+		BitmapPage page(environment_.pageAllocator(), openFiles_.pageSize());
+		openFiles_.read(page, overflowFilePage(bitmapPageNumber));
+		page.validate();
+
+		return page;
+	}
+
+	uint32_t OverflowFilePageAllocator::compactedHighestPage() const
+	{
+		// Counts acquired pages and returns the highest page number they would occupy if there were no free pages between them.
+		uint64_t acquiredPages = 0;
+
+		for (uint64_t bitmapPageNumber = 1; bitmapPageNumber < highestOverflowFilePage_; bitmapPageNumber += bitmapPageDistance_) {
+			acquiredPages += bitmapPageToInspect(static_cast<uint32_t>(bitmapPageNumber)).numberOfAcquiredPages();
+		}
+
+		if (acquiredPages == 0) {
+			return 0;
+		}
+
+		const uint64_t managedPages = bitmapPageDistance_ - 1;
+		const uint64_t lastBitmapIndex = (acquiredPages - 1) / managedPages;
+		const uint64_t lastPageOffset = (acquiredPages - 1) % managedPages;
+
+		return static_cast<uint32_t>(1 + (lastBitmapIndex * bitmapPageDistance_) + 1 + lastPageOffset);
+	}
+
+	uint32_t OverflowFilePageAllocator::truncate()
+	{
+		// Free pages after the highest acquired page are dropped from the file, including bitmap pages managing only them.
+		const size_type bitmapPages = overflowFileBitmapPages();
+		uint32_t newHighestPage = 0;
+
+		for (uint32_t bitmapIndex = static_cast<uint32_t>(bitmapPages); bitmapIndex > 0 && newHighestPage == 0; --bitmapIndex) {
+			const uint32_t bitmapPageNumber = 1 + ((bitmapIndex - 1) * bitmapPageDistance_);
+			const uint32_t highestAcquiredOffset = bitmapPageToInspect(bitmapPageNumber).highestAcquiredPage();
+
+			if (highestAcquiredOffset != BitmapPage::NO_SPACE) {
+				newHighestPage = bitmapPageNumber + 1 + highestAcquiredOffset;
+			}
+		}
+
+		for (bitmapPageMap_t::iterator ii = loadedBitmaps_.begin(); ii != loadedBitmaps_.end(); ) {
+			if (ii->first > newHighestPage) {
+				ii->second.clearDirtyFlag();
+				ii = loadedBitmaps_.erase(ii);
+			}
+			else {
+				++ii;
+			}
+		}
+
+		highestOverflowFilePage_ = newHighestPage;
+		bitmapPagesReleased_ += bitmapPages - overflowFileBitmapPages();
+
+		return newHighestPage;
+	}
+
+	void OverflowFilePageAllocator::evictLoadedBitmapPages()
+	{
+		if (loadedBitmaps_.size() <= MAX_LOADED_BITMAP_PAGES) {
+			return;
+		}
+
+		// Saved bitmap pages are clean. Full pages are dropped first, they are not read again while the summary marks them full.
+		const OverflowHeaderPage* headerPage = openFiles_.overflowHeaderPage();
+		const uint32_t summarizedBitmapPages = headerPage->summarizedBitmapPages();
+
+		for (bitmapPageMap_t::iterator ii = loadedBitmaps_.begin(); ii != loadedBitmaps_.end(); ) {
+			const uint32_t bitmapIndex = bitmapPageIndex(ii->first);
+
+			if (bitmapIndex < summarizedBitmapPages && headerPage->isBitmapPageFull(bitmapIndex)) {
+				ii = loadedBitmaps_.erase(ii);
+			}
+			else {
+				++ii;
+			}
+		}
+
+		if (loadedBitmaps_.size() > MAX_LOADED_BITMAP_PAGES) {
+			loadedBitmaps_.clear();
+		}
 	}
 
 	uint32_t OverflowFilePageAllocator::highestOverflowFilePage() const
@@ -138,7 +289,7 @@ namespace hashdb {
 
 	size_type OverflowFilePageAllocator::bitmapPagesReleased() const
 	{
-		return 0;
+		return bitmapPagesReleased_;
 	}
 
 	size_type OverflowFilePageAllocator::overflowFileDataPages() const
@@ -157,5 +308,10 @@ namespace hashdb {
 		return static_cast<size_type>(loadedBitmaps_.size());
 	}
 
+	size_type OverflowFilePageAllocator::bitmapPagesRead() const
+	{
+		return bitmapPagesRead_;
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
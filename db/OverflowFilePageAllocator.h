@@ -36,11 +36,18 @@ namespace hashdb {
 
 	class OverflowFilePageAllocator {
 	public:
+		static const size_type MAX_LOADED_BITMAP_PAGES = 16;
+
 		OverflowFilePageAllocator(Environment& environment, OpenFiles& openFiles);
 		uint32_t acquireOverflowPageNumber();
 		void releaseOverflowPageNumber(uint32_t pageNumber);
 		void save();
 
+		// Compaction.
+		uint32_t acquireOverflowPageNumberBelow(uint32_t pageNumber);
+		uint32_t compactedHighestPage() const;
+		uint32_t truncate();
+
 		uint32_t highestOverflowFilePage() const;
 		size_type bitmapPagesAcquired() const;
 		size_type bitmapPagesReleased() const;
@@ -48,19 +55,26 @@ namespace hashdb {
 		size_type overflowFileBitmapPages() const;
 
 		size_type heldPages() const;
+		size_type bitmapPagesRead() const;
 
 	private:
 		typedef boost::unordered_map<uint32_t, BitmapPage> bitmapPageMap_t;
 
 		bitmapPageMap_t::iterator existingBitmapPage(uint32_t bitmapPageNumber);
 		uint32_t acquireOffsetFromNewBitmapPage(uint32_t bitmapPageNumber);
-		uint32_t acquireOffsetFromExistingBitmapPage(uint32_t bitmapPageNumber);
+		uint32_t acquireOffsetFromExistingBitmapPage(uint32_t bitmapPageNumber, uint32_t endPageOffset);
+		uint32_t acquireFromExistingBitmapPages(uint32_t belowPageNumber, bool onlyPagesBelow);
+		BitmapPage bitmapPageToInspect(uint32_t bitmapPageNumber) const;
+		uint32_t bitmapPageIndex(uint32_t bitmapPageNumber) const;
+		void evictLoadedBitmapPages();
 
 	private:
 		bitmapPageMap_t loadedBitmaps_;
 
 		uint32_t highestOverflowFilePage_;
 		size_type bitmapPagesAcquired_;
+		size_type bitmapPagesReleased_;
+		size_type bitmapPagesRead_;
 
 		const size_type bitmapPageDistance_;
 
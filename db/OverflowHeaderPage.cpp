@@ -0,0 +1,87 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// OverflowHeaderPage.cpp - overflow file header page.
+#include "stdafx.h"
+#include "OverflowHeaderPage.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//----------------------------------------------------------------------------
+	// Bitmap page summary.
+
+	uint32_t OverflowHeaderPage::summarizedBitmapPages() const
+	{
+		return (size() - BITMAP_SUMMARY_OFFSET) * 8;
+	}
+
+	bool OverflowHeaderPage::isBitmapPageFull(uint32_t bitmapIndex) const
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(bitmapIndex >= summarizedBitmapPages());
+
+		return (get8(BITMAP_SUMMARY_OFFSET + (bitmapIndex / 8)) & (1 << (bitmapIndex % 8))) != 0;
+	}
+
+	void OverflowHeaderPage::setBitmapPageFull(uint32_t bitmapIndex, bool full)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(bitmapIndex >= summarizedBitmapPages());
+
+		const size_type byteOffset = BITMAP_SUMMARY_OFFSET + (bitmapIndex / 8);
+		const value_type mask = static_cast<value_type>(1 << (bitmapIndex % 8));
+		const value_type summaryByte = get8(byteOffset);
+		const value_type newSummaryByte = (full)? (summaryByte | mask) : (summaryByte & ~mask);
+
+		if (newSummaryByte != summaryByte) {
+			put8(byteOffset, newSummaryByte);
+		}
+	}
+
+	uint32_t OverflowHeaderPage::nextBitmapPageWithFreeSpace(uint32_t fromIndex) const
+	{
+		const uint32_t summarizedPages = summarizedBitmapPages();
+		uint32_t bitmapIndex = fromIndex;
+
+		while (bitmapIndex < summarizedPages) {
+			const value_type summaryByte = get8(BITMAP_SUMMARY_OFFSET + (bitmapIndex / 8));
+
+			if (summaryByte == 0xff && (bitmapIndex % 8) == 0) {
+				bitmapIndex += 8; // Skip 8 full bitmap pages at once.
+			}
+			else if ((summaryByte & (1 << (bitmapIndex % 8))) == 0) {
+				break;
+			}
+			else {
+				++bitmapIndex;
+			}
+		}
+
+		return bitmapIndex;
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
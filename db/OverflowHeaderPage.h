@@ -33,6 +33,15 @@ namespace kerio {
 namespace hashdb {
 
 	class OverflowHeaderPage : public HeaderPage { // intentionally copyable
+		// Overflow file header page extends the common header with a summary of bitmap pages:
+		// offset size accessors field
+		// 56     n    BitmapSummary: bit i is set if the i-th bitmap page of the overflow file has no free page
+		//
+		// Bitmap pages beyond the summary capacity are not summarized. Pages created by older versions
+		// have the summary cleared, so all their bitmap pages are assumed to have free pages.
+
+		static const uint16_t BITMAP_SUMMARY_OFFSET = HEADER_DATA_END;
+
 	public:
 		OverflowHeaderPage(IPageAllocator* allocator, size_type size) 
 			: HeaderPage(allocator, size)
@@ -50,6 +59,12 @@ namespace hashdb {
 			return PageId::OverflowFileType;
 		}
 
+		// Bitmap page summary.
+		uint32_t summarizedBitmapPages() const;
+		bool isBitmapPageFull(uint32_t bitmapIndex) const;
+		void setBitmapPageFull(uint32_t bitmapIndex, bool full);
+		uint32_t nextBitmapPageWithFreeSpace(uint32_t fromIndex) const;
+
 	};
 
 }; // namespace hashdb
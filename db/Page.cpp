@@ -47,7 +47,7 @@ namespace hashdb {
 		RAISE_INTERNAL_ERROR_IF_ARG(fileType() != getId().fileType());
 
 		const uint32_t pageMagicNumber = getMagic();
-		RAISE_DATABASE_CORRUPTED_IF(pageMagicNumber != magic(), "bad magic number %08x on %s", pageMagicNumber, getId().toString());
+		RAISE_DATABASE_CORRUPTED_IF(! isKnownMagic(pageMagicNumber), "bad magic number %08x on %s", pageMagicNumber, getId().toString());
 
 		const uint32_t checksum = getChecksum();
 		if (checksum != 0xffffffff) {
@@ -60,6 +60,11 @@ namespace hashdb {
 		RAISE_DATABASE_CORRUPTED_IF(idPageNumber != actualPageNumber, "bad page number %u on %s", actualPageNumber, getId().toString());
 	}
 
+	bool Page::isKnownMagic(uint32_t pageMagic) const
+	{
+		return pageMagic == magic();
+	}
+
 	void Page::setId(const PageId& pageId)
 	{
 		RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType());
@@ -77,6 +82,12 @@ namespace hashdb {
 		clearDirtyFlag();
 	}
 
+	void Page::setMemory(const IPageAllocator::PageMemoryPtr& memory)
+	{
+		RAISE_INTERNAL_ERROR_IF(dirty(), "unable to replace memory of modified %s", getId().toString());
+		memory_ = memory;
+	}
+
 	void Page::putBytes(size_type index, boost::string_ref value)
 	{
 		RAISE_INTERNAL_ERROR_IF_ARG(index + value.size() > size_);
@@ -55,8 +55,12 @@ namespace hashdb {
 		static const uint32_t OVERFLOW_HEADER_MAGIC = 0x154fe1b7;
 
 		static const uint32_t BUCKET_DATA_MAGIC     = 0x2e19d943;
+		static const uint32_t TAGGED_BUCKET_DATA_MAGIC = 0x6b0c3e55;
+		static const uint32_t HASHED_BUCKET_DATA_MAGIC = 0x1c5e93a7;
 
 		static const uint32_t OVERFLOW_DATA_MAGIC   = 0x35e2f297;
+		static const uint32_t TAGGED_OVERFLOW_DATA_MAGIC = 0x7f41a0d3;
+		static const uint32_t HASHED_OVERFLOW_DATA_MAGIC = 0x58d2b61f;
 		static const uint32_t LARGE_VALUE_MAGIC     = 0x4dcf7a68;
 		static const uint32_t BITMAP_MAGIC			= 0x51496e2b;
 
@@ -71,6 +75,15 @@ namespace hashdb {
 			
 		}
 
+		// Page residing in memory which is not owned by the page (e.g. in a mapped file).
+		Page(const IPageAllocator::PageMemoryPtr& memory, size_type size) 
+			: memory_(memory)
+			, size_(size)
+			, dirty_(false)
+		{
+			
+		}
+
 		virtual ~Page()
 		{
 			HASHDB_ASSERT(! dirty());
@@ -78,6 +91,7 @@ namespace hashdb {
 
 		// Virtual methods.
 		virtual uint32_t magic() const = 0;
+		virtual bool isKnownMagic(uint32_t pageMagic) const;
 		virtual PageId::DatabaseFile_t fileType() const = 0;
 
 		virtual void setUp(uint32_t pageNumber);
@@ -88,6 +102,9 @@ namespace hashdb {
 		const PageId& getId() const;
 		void disown();
 
+		// Memory.
+		void setMemory(const IPageAllocator::PageMemoryPtr& memory);
+
 		// Size.
 		size_type size() const
 		{ 
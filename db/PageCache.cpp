@@ -0,0 +1,460 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// PageCache.cpp - cache of data pages kept by an open database across requests.
+#include "stdafx.h"
+#include <boost/thread/reverse_lock.hpp>
+#include "BucketDataPage.h"
+#include "OverflowDataPage.h"
+#include "SharedBufferPool.h"
+#include "PageCache.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//-------------------------------------------------------------------------
+	// Creation and destruction.
+
+	namespace {
+
+		size_type maximumCachedPages(size_type maximumBytes, size_type pageSize)
+		{
+			const size_type pages = maximumBytes / pageSize;
+			const size_type minimumPages = PageCache::MIN_CACHED_PAGES;
+
+			return (pages < minimumPages)? minimumPages : pages;
+		}
+
+	} // anonymous namespace
+
+	PageCache::PageCache(Environment& environment, OpenFiles& openFiles, const Options& options)
+		: serializesRequests_(options.lockManagerType_ == Options::NullLockManagerType)
+		, maximumPages_(maximumCachedPages(options.pageCacheBytes_, openFiles.pageSize()))
+		, hits_(0)
+		, misses_(0)
+		, evictions_(0)
+		, pendingWriteBacks_(0)
+		, environment_(environment)
+		, openFiles_(openFiles)
+	{
+		if (options.bufferPool_) {
+			bufferPool_ = boost::dynamic_pointer_cast<SharedBufferPool>(options.bufferPool_);
+			RAISE_INVALID_ARGUMENT_IF(! bufferPool_, "Options: bufferPool_ must be created by BufferPoolFactory()");
+
+			bufferPool_->attach(this, openFiles.pageSize(), options.bufferPoolSoftQuota_, options.bufferPoolHardQuota_);
+		}
+	}
+
+	PageCache::~PageCache()
+	{
+		if (bufferPool_) {
+			bufferPool_->detach(this);
+		}
+
+		// Pages should have been saved on close. Pages not saved due to an error are dropped.
+		dropAll();
+	}
+
+	//-------------------------------------------------------------------------
+	// Page access.
+
+	PageCache::DataPagePtr PageCache::dataPage(const PageId& pageId)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(! pageId.isValid());
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		waitForPageIo(lock, pageId);
+
+		pageMap_t::iterator found = pages_.find(pageId);
+		if (found != pages_.end()) {
+			++hits_;
+			lruList_.splice(lruList_.begin(), lruList_, found->second);
+			return lruList_.front();
+		}
+
+		++misses_;
+
+		// The page is read without holding the cache, so requests for other pages do not wait for the disk.
+		// Requests for the same page wait until it is inserted.
+		pendingPages_.insert(pageId);
+		DataPagePtr page;
+
+		try {
+			{
+				boost::reverse_lock<boost::mutex::scoped_lock> unlocked(lock);
+				page = loadDataPage(pageId);
+				page->validate();
+			}
+
+			makeRoom(lock);
+		} catch (std::exception&) {
+			finishPageIo(pageId);
+			throw;
+		}
+
+		insert(page);
+		finishPageIo(pageId);
+		return page;
+	}
+
+	PageCache::DataPagePtr PageCache::newOverflowPage(uint32_t newPageNumber)
+	{
+		const PageId pageId = overflowFilePage(newPageNumber);
+
+		// Stale copy of a released page may be still cached.
+		discard(pageId);
+
+		DataPagePtr page = newDataPage(PageId::OverflowFileType);
+		page->setUp(newPageNumber);
+
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		makeRoom(lock);
+		insert(page);
+		return page;
+	}
+
+	void PageCache::discard(const PageId& pageId)
+	{
+		// A stale copy being written back must not overwrite the page later.
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		waitForPageIo(lock, pageId);
+
+		pageMap_t::iterator found = pages_.find(pageId);
+
+		if (found != pages_.end()) {
+			lruList_t::iterator entry = found->second;
+			(*entry)->disown();
+
+			pages_.erase(found);
+			lruList_.erase(entry);
+
+			if (bufferPool_) {
+				bufferPool_->releaseFrames(this, 1);
+			}
+		}
+	}
+
+	void PageCache::discardOverflowPagesFrom(uint32_t firstPageNumber)
+	{
+		// Used when the overflow file is truncated. Cached pages are not written to the truncated part of the file.
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		waitForWriteBacks(lock);
+		size_type discardedPages = 0;
+
+		for (lruList_t::iterator ii = lruList_.begin(); ii != lruList_.end(); ) {
+			const PageId pageId = (*ii)->getId();
+
+			if (pageId.fileType() == PageId::OverflowFileType && pageId.pageNumber() >= firstPageNumber) {
+				(*ii)->disown();
+				pages_.erase(pageId);
+				ii = lruList_.erase(ii);
+				++discardedPages;
+			}
+			else {
+				++ii;
+			}
+		}
+
+		if (bufferPool_ && discardedPages != 0) {
+			bufferPool_->releaseFrames(this, discardedPages);
+		}
+	}
+
+	void PageCache::prefetch(PageId::DatabaseFile_t fileType, const std::vector<uint32_t>& sortedPageNumbers)
+	{
+		std::vector<uint32_t> missingPageNumbers;
+		missingPageNumbers.reserve(sortedPageNumbers.size());
+
+		boost::mutex::scoped_lock lock(cacheMutex_);
+
+		for (std::vector<uint32_t>::const_iterator ii = sortedPageNumbers.begin(); ii != sortedPageNumbers.end(); ++ii) {
+			const PageId pageId(fileType, *ii);
+
+			if (pages_.find(pageId) == pages_.end()) {
+				missingPageNumbers.push_back(*ii);
+			}
+		}
+
+		// Pages of all files are read using the file system cache, so the missing pages are read ahead by the OS
+		// in parallel and the following synchronous reads do not wait for the disk one by one.
+		if (missingPageNumbers.size() >= MIN_PAGES_TO_PREFETCH) {
+			openFiles_.file(fileType)->prefetchPages(missingPageNumbers);
+		}
+	}
+
+	PageCache::DataPagePtr PageCache::newDataPage(PageId::DatabaseFile_t fileType)
+	{
+		DataPagePtr page;
+
+		if (fileType == PageId::BucketFileType) {
+			page.reset(new BucketDataPage(environment_.pageAllocator(), openFiles_.pageSize()));
+		}
+		else {
+			page.reset(new OverflowDataPage(environment_.pageAllocator(), openFiles_.pageSize()));
+		}
+
+		return page;
+	}
+
+	PageCache::DataPagePtr PageCache::loadDataPage(const PageId& pageId)
+	{
+		PagedFile* file = openFiles_.file(pageId.fileType());
+		DataPagePtr page;
+
+		if (file->isMapped()) {
+			// View of the mapped file, no page memory is allocated and nothing is copied.
+			const IPageAllocator::PageMemoryPtr memory = file->pageView(pageId);
+
+			if (pageId.fileType() == PageId::BucketFileType) {
+				page.reset(new BucketDataPage(memory, openFiles_.pageSize()));
+			}
+			else {
+				page.reset(new OverflowDataPage(memory, openFiles_.pageSize()));
+			}
+
+			page->setId(pageId);
+		}
+		else {
+			page = newDataPage(pageId.fileType());
+			openFiles_.read(*page, pageId);
+		}
+
+		return page;
+	}
+
+	void PageCache::insert(const DataPagePtr& page)
+	{
+		lruList_.push_front(page);
+		pages_[page->getId()] = lruList_.begin();
+	}
+
+	void PageCache::makeRoom(boost::mutex::scoped_lock& lock)
+	{
+		if (bufferPool_) {
+			// The frame of an evicted page is reused if the pool does not grant a new one.
+			const bool force = pages_.size() < MIN_CACHED_PAGES;
+
+			if (! bufferPool_->acquireFrame(this, force) && ! evictLeastRecentlyUsed(lock)) {
+				bufferPool_->acquireFrame(this, true);
+			}
+		}
+		else {
+			while (pages_.size() >= maximumPages_ && evictLeastRecentlyUsed(lock)) {
+				// Evict until there is room or all remaining pages are pinned.
+			}
+		}
+	}
+
+	bool PageCache::evictLeastRecentlyUsed(boost::mutex::scoped_lock& lock)
+	{
+		for (lruList_t::iterator ii = lruList_.end(); ii != lruList_.begin(); ) {
+			--ii;
+
+			// The page is pinned if a request holds a pointer to it besides the LRU list.
+			if (ii->use_count() == 1) {
+				const DataPagePtr leastRecentlyUsed = *ii;
+				const PageId pageId = leastRecentlyUsed->getId();
+
+				pages_.erase(pageId);
+				lruList_.erase(ii);
+
+				if (leastRecentlyUsed->dirty()) {
+					writeBack(lock, leastRecentlyUsed);
+				}
+
+				++evictions_;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool PageCache::evictCleanLeastRecentlyUsed()
+	{
+		for (lruList_t::iterator ii = lruList_.end(); ii != lruList_.begin(); ) {
+			--ii;
+
+			if (ii->use_count() == 1 && ! (*ii)->dirty()) {
+				pages_.erase((*ii)->getId());
+				lruList_.erase(ii);
+
+				++evictions_;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void PageCache::writeBack(boost::mutex::scoped_lock& lock, const DataPagePtr& page)
+	{
+		// The evicted page is written without holding the cache. Requests for the page wait until
+		// it is written, so they do not read a stale image.
+		const PageId pageId = page->getId();
+		pendingPages_.insert(pageId);
+		++pendingWriteBacks_;
+
+		try {
+			boost::reverse_lock<boost::mutex::scoped_lock> unlocked(lock);
+			openFiles_.write(*page);
+		} catch (std::exception&) {
+			// The unsaved page is kept in the cache.
+			lruList_.push_back(page);
+			pages_[pageId] = --lruList_.end();
+
+			--pendingWriteBacks_;
+			finishPageIo(pageId);
+			throw;
+		}
+
+		--pendingWriteBacks_;
+		finishPageIo(pageId);
+	}
+
+	void PageCache::finishPageIo(const PageId& pageId)
+	{
+		pendingPages_.erase(pageId);
+		pageIoFinished_.notify_all();
+	}
+
+	void PageCache::waitForPageIo(boost::mutex::scoped_lock& lock, const PageId& pageId)
+	{
+		while (pendingPages_.find(pageId) != pendingPages_.end()) {
+			pageIoFinished_.wait(lock);
+		}
+	}
+
+	void PageCache::waitForWriteBacks(boost::mutex::scoped_lock& lock)
+	{
+		while (pendingWriteBacks_ != 0) {
+			pageIoFinished_.wait(lock);
+		}
+	}
+
+	void PageCache::dropAll()
+	{
+		for (lruList_t::iterator ii = lruList_.begin(); ii != lruList_.end(); ++ii) {
+			(*ii)->disown();
+		}
+
+		pages_.clear();
+		lruList_.clear();
+	}
+
+	//-------------------------------------------------------------------------
+	// Writing back and releasing cached pages.
+
+	void PageCache::save()
+	{
+		// Pages are pinned and written without holding the cache. Only the modifying request dirties pages,
+		// so no page becomes dirty meanwhile.
+		std::vector<DataPagePtr> dirtyPages;
+
+		{
+			boost::mutex::scoped_lock lock(cacheMutex_);
+
+			for (lruList_t::iterator ii = lruList_.begin(); ii != lruList_.end(); ++ii) {
+				if ((*ii)->dirty()) {
+					dirtyPages.push_back(*ii);
+				}
+			}
+		}
+
+		for (std::vector<DataPagePtr>::iterator ii = dirtyPages.begin(); ii != dirtyPages.end(); ++ii) {
+			openFiles_.write(**ii);
+		}
+
+		// Pages evicted by concurrent requests must be written before the changes are committed.
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		waitForWriteBacks(lock);
+	}
+
+	void PageCache::clear()
+	{
+		save();
+
+		boost::mutex::scoped_lock lock(cacheMutex_);
+
+		const size_type releasedPages = static_cast<size_type>(pages_.size());
+		dropAll();
+
+		if (bufferPool_) {
+			bufferPool_->releaseFrames(this, releasedPages);
+		}
+	}
+
+	//-------------------------------------------------------------------------
+	// IBufferPoolClient methods.
+
+	size_type PageCache::releaseColdPages(size_type pages)
+	{
+		boost::mutex::scoped_lock requestLock(requestMutex_, boost::defer_lock);
+		boost::mutex::scoped_lock cacheLock(cacheMutex_, boost::defer_lock);
+		size_type releasedPages = 0;
+
+		// The pool must not wait for a client, the client may be waiting for the pool.
+		const bool idle = ! serializesRequests_ || requestLock.try_lock();
+
+		if (idle && cacheLock.try_lock()) {
+			// Dirty pages are kept, the pool holds its mutex and must not wait for their write back.
+			while (releasedPages < pages && evictCleanLeastRecentlyUsed()) {
+				++releasedPages;
+			}
+		}
+
+		return releasedPages;
+	}
+
+	//-------------------------------------------------------------------------
+	// Statistics.
+
+	size_type PageCache::cachedPages() const
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		return static_cast<size_type>(pages_.size());
+	}
+
+	size_type PageCache::hits() const
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		return hits_;
+	}
+
+	size_type PageCache::misses() const
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		return misses_;
+	}
+
+	size_type PageCache::evictions() const
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		return evictions_;
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,145 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// PageCache.h - cache of data pages kept by an open database across requests.
+#pragma once
+#include <list>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "OpenFiles.h"
+#include "DataPage.h"
+
+namespace kerio {
+namespace hashdb {
+
+	class OverflowDataPage;
+	class SharedBufferPool;
+
+	// Page cache holds the most recently used bucket and overflow data pages in LRU order.
+	// Its size is limited either by a private byte budget or by quotas in a shared buffer pool, 
+	// but it can always hold at least MIN_CACHED_PAGES pages.
+	// Dirty pages are written back when they are evicted or when save() is called.
+	//
+	// A page returned by the cache is pinned while the caller holds the pointer. Pinned pages are never evicted,
+	// so the cache can temporarily hold more pages than its limit.
+	//
+	// Pages are read and written back without holding the cache, so concurrent requests wait only for
+	// the I/O of pages they need.
+	//
+	// The cache can be used by concurrent requests. Requests to single-threaded instances must hold
+	// a PageCache::Request while they use the cache, the shared buffer pool takes pages back only from
+	// caches of single-threaded instances which are not used by a request.
+
+	class PageCache : public IBufferPoolClient, boost::noncopyable
+	{
+	public:
+		static const size_type MIN_CACHED_PAGES = 4;
+		static const size_type MIN_PAGES_TO_PREFETCH = 2;
+
+		typedef boost::shared_ptr<DataPage> DataPagePtr;
+
+		class Request : boost::noncopyable {
+		public:
+			Request(PageCache& cache)
+				: lock_(cache.requestMutex_, boost::defer_lock)
+			{
+				if (cache.serializesRequests_) {
+					lock_.lock();
+				}
+			}
+
+		private:
+			boost::mutex::scoped_lock lock_;
+		};
+
+		PageCache(Environment& environment, OpenFiles& openFiles, const Options& options);
+		virtual ~PageCache();
+
+		// Page access.
+		DataPagePtr dataPage(const PageId& pageId);
+		DataPagePtr newOverflowPage(uint32_t newPageNumber);
+		void discard(const PageId& pageId);
+		void discardOverflowPagesFrom(uint32_t firstPageNumber);
+		void prefetch(PageId::DatabaseFile_t fileType, const std::vector<uint32_t>& sortedPageNumbers);
+
+		// Writing back and releasing cached pages.
+		void save();
+		void clear();
+
+		// IBufferPoolClient methods.
+		virtual size_type releaseColdPages(size_type pages);
+
+		// Statistics.
+		size_type cachedPages() const;
+		size_type hits() const;
+		size_type misses() const;
+		size_type evictions() const;
+
+	private:
+		typedef std::list<DataPagePtr> lruList_t;
+		typedef boost::unordered_map<PageId, lruList_t::iterator> pageMap_t;
+		typedef boost::unordered_set<PageId> pageSet_t;
+
+		DataPagePtr newDataPage(PageId::DatabaseFile_t fileType);
+		DataPagePtr loadDataPage(const PageId& pageId);
+		void insert(const DataPagePtr& page);
+		void makeRoom(boost::mutex::scoped_lock& lock);
+		bool evictLeastRecentlyUsed(boost::mutex::scoped_lock& lock);
+		bool evictCleanLeastRecentlyUsed();
+		void writeBack(boost::mutex::scoped_lock& lock, const DataPagePtr& page);
+		void finishPageIo(const PageId& pageId);
+		void waitForPageIo(boost::mutex::scoped_lock& lock, const PageId& pageId);
+		void waitForWriteBacks(boost::mutex::scoped_lock& lock);
+		void dropAll();
+
+	private:
+		boost::mutex requestMutex_;
+		mutable boost::mutex cacheMutex_;
+		const bool serializesRequests_;
+
+		lruList_t lruList_; // The most recently used page is at the front.
+		pageMap_t pages_;
+		const size_type maximumPages_;
+		boost::shared_ptr<SharedBufferPool> bufferPool_;
+
+		size_type hits_;
+		size_type misses_;
+		size_type evictions_;
+
+		// Pages being read or written back while the cache is not held.
+		pageSet_t pendingPages_;
+		size_type pendingWriteBacks_;
+		boost::condition_variable pageIoFinished_;
+
+		Environment& environment_;
+		OpenFiles& openFiles_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
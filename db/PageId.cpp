@@ -77,5 +77,10 @@ namespace hashdb {
 		return PageId(PageId::OverflowFileType, pageNumber);
 	}
 
+	std::size_t hash_value(const PageId& pageId)
+	{
+		return (static_cast<std::size_t>(pageId.pageNumber()) << 2) | pageId.fileType();
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
@@ -99,5 +99,8 @@ namespace hashdb {
 	PageId bucketFilePage(uint32_t pageNumber);
 	PageId overflowFilePage(uint32_t pageNumber);
 
+	// Hash for use of PageId as a key in boost::unordered containers.
+	std::size_t hash_value(const PageId& pageId);
+
 }; // namespace hashdb
 }; // namespace kerio
@@ -27,6 +27,8 @@
 
 // PagedFile.cpp - database page.
 #include "stdafx.h"
+#include <limits>
+#include <boost/static_assert.hpp>
 
 #if defined(_WIN32)
 #include <Windows.h>
@@ -36,6 +38,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h>
 #endif
 
 #include "utils/ExceptionCreator.h"
@@ -62,11 +65,152 @@ namespace hashdb {
 	void PagedFile::write(Page& page)
 	{
 		if (page.dirty()) {
-			doWrite(page);
+			// Guard clauses.
+			const PageId& pageId = page.getId();
+			RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType_);
+			RAISE_INTERNAL_ERROR_IF(page.size() != pageSize_, "Written page size %d differs from the page size %d of database file \"%s\"", page.size(), pageSize_, fileName_);
+
+			doWrite(pageId.pageNumber(), page.constData(), pageSize_);
 			page.clearDirtyFlag();
 		}
 	}
 
+	void PagedFile::writeImage(uint32_t pageNumber, boost::string_ref image)
+	{
+		const size_type imageSize = static_cast<size_type>(image.size());
+		RAISE_INTERNAL_ERROR_IF(! isValidPageSize(imageSize), "Written page image size %u is invalid", imageSize);
+
+		doWrite(pageNumber, image.data(), imageSize);
+	}
+
+	void PagedFile::prefetchPages(const std::vector<uint32_t>& sortedPageNumbers)
+	{
+		// Adjacent pages are prefetched in a single range.
+		std::vector<uint32_t>::const_iterator ii = sortedPageNumbers.begin();
+		size_type prefetchedRanges = 0;
+
+		while (ii != sortedPageNumbers.end()) {
+			const uint32_t firstPageNumber = *ii;
+			uint32_t lastPageNumber = firstPageNumber;
+
+			for (++ii; ii != sortedPageNumbers.end() && *ii <= lastPageNumber + 1; ++ii) {
+				lastPageNumber = *ii;
+			}
+
+			const fileSize_t position = firstPageNumber * static_cast<fileSize_t>(pageSize_);
+			const fileSize_t length = (lastPageNumber - firstPageNumber + 1) * static_cast<fileSize_t>(pageSize_);
+
+			if (! prefetchRange(position, length)) {
+				break;
+			}
+
+			++prefetchedRanges;
+		}
+
+		if (prefetchedRanges != 0) {
+			HASHDB_LOG_DEBUG("Started asynchronous prefetch of %u pages in %u ranges of file \"%s\"", sortedPageNumbers.size(), prefetchedRanges, fileName_);
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	// Memory mapped access.
+
+	// Private (copy-on-write) mapping of the beginning of a database file. Pages view parts of the mapping
+	// and share its reference counter. The mapping is unmapped and deleted when the last reference is released.
+
+	class FileMapping : public IPageAllocator, boost::noncopyable {
+	public:
+		FileMapping(value_type* base, PagedFile::fileSize_t size)
+			: base_(base)
+			, size_(size)
+			, counter_(0)
+		{
+
+		}
+
+		PageMemoryPtr memory()
+		{
+			return PageMemoryPtr(this, base_, &counter_);
+		}
+
+		PagedFile::fileSize_t size() const
+		{
+			return size_;
+		}
+
+		bool growInPlace(PagedFile::fileSize_t newSize);
+
+		// IPageAllocator methods.
+		virtual PageMemoryPtr allocate(size_type /* size */)
+		{
+			RAISE_INTERNAL_ERROR("page memory cannot be allocated from a file mapping");
+			return memory();
+		}
+
+		virtual void deallocate(value_type* /* pageMemory */, counter_type* counterMemory)
+		{
+			HASHDB_ASSERT(counterMemory == &counter_);
+
+			unmap();
+			delete this;
+		}
+
+		virtual void freeSomeMemory()
+		{
+
+		}
+
+		virtual size_type heldPages()
+		{
+			return 0;
+		}
+
+	private:
+		void unmap();
+
+	private:
+		value_type* base_;
+		PagedFile::fileSize_t size_;
+		counter_type counter_;
+	};
+
+	bool PagedFile::isMapped() const
+	{
+		return mapped_;
+	}
+
+	IPageAllocator::PageMemoryPtr PagedFile::pageView(const PageId& pageId)
+	{
+		// Guard clauses.
+		RAISE_INTERNAL_ERROR_IF(! mapped_, "Database file \"%s\" is not mapped", fileName_);
+		RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType_);
+
+		const fileSize_t position = pageId.pageNumber() * static_cast<fileSize_t>(pageSize_);
+		const fileSize_t requiredSize = position + pageSize_;
+
+		// Extend the mapping if the file has grown.
+		if (mapping_ == NULL || mapping_->size() < requiredSize) {
+			const fileSize_t fileSize = size();
+			RAISE_IO_ERROR_IF(fileSize < requiredSize, "Unable to read page %u from database file \"%s\": page is beyond the end of file", pageId.pageNumber(), fileName_);
+			RAISE_IO_ERROR_IF(fileSize > std::numeric_limits<size_t>::max(), "Unable to map database file \"%s\": file is too large for the address space", fileName_);
+
+			if (mapping_ == NULL || ! mapping_->growInPlace(fileSize)) {
+				mapFile(fileSize);
+			}
+		}
+
+		return IPageAllocator::PageMemoryPtr(*mappingMemory_, static_cast<size_t>(position));
+	}
+
+	void PagedFile::unmapFile()
+	{
+		mappingMemory_.reset();
+		mapping_ = NULL;
+	}
+
+	//----------------------------------------------------------------------------
+	// Destruction.
+
 	PagedFile::~PagedFile()
 	{
 		HASHDB_ASSERT(isClosed());
@@ -108,6 +252,8 @@ namespace hashdb {
 		, fileType_(fileType)
 		, pageSize_(options.pageSize_)
 		, environment_(environment)
+		, mapped_(options.readOnly_ && options.mapFiles_)
+		, mapping_(NULL)
 		, file_(INVALID_HANDLE_VALUE)
 	{
 		// Guard clauses.
@@ -144,6 +290,8 @@ namespace hashdb {
 
 	void PagedFile::close()
 	{
+		unmapFile();
+
 		const BOOL closeSucceeded = ::CloseHandle(file_);
 		RAISE_IO_ERROR_IF(! closeSucceeded, "unable to close database file \"%s\": %s", fileName_, describeIoError());
 
@@ -166,15 +314,10 @@ namespace hashdb {
 		return fileSize.QuadPart;
 	}
 
-	void PagedFile::doWrite(const Page& page)
+	void PagedFile::doWrite(uint32_t pageNumber, const void* data, size_type size)
 	{
-		// Guard clauses.
-		const PageId& pageId = page.getId();
-		RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType_);
-		RAISE_INTERNAL_ERROR_IF(page.size() != pageSize_, "Written page size %d differs from the page size %d of database file \"%s\"", page.size(), pageSize_, fileName_);
-
 		// Compute the offset.
-		const fileSize_t position = pageId.pageNumber() * static_cast<fileSize_t>(pageSize_);
+		const fileSize_t position = pageNumber * static_cast<fileSize_t>(size);
 
 		// Write.
 		OVERLAPPED overlapped;
@@ -183,11 +326,11 @@ namespace hashdb {
 		overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
 
 		DWORD bytesWritten = 0;
-		const BOOL writeSucceeded = ::WriteFile(file_, page.constData(), pageSize_, &bytesWritten, &overlapped);
+		const BOOL writeSucceeded = ::WriteFile(file_, data, size, &bytesWritten, &overlapped);
 
 		// Fail on write error.
-		RAISE_IO_ERROR_IF(! writeSucceeded, "Unable to write page %u to database file \"%s\": %s", pageId.pageNumber(), fileName_, describeIoError());
-		RAISE_IO_ERROR_IF(bytesWritten != pageSize_, "Unable to write page %u to database file \"%s\": only %u of %u bytes written", pageId.pageNumber(), fileName_, bytesWritten, pageSize_);
+		RAISE_IO_ERROR_IF(! writeSucceeded, "Unable to write page %u to database file \"%s\": %s", pageNumber, fileName_, describeIoError());
+		RAISE_IO_ERROR_IF(bytesWritten != size, "Unable to write page %u to database file \"%s\": only %u of %u bytes written", pageNumber, fileName_, bytesWritten, size);
 	}
 
 	void PagedFile::read(Page& page, const PageId& pageId)
@@ -196,6 +339,14 @@ namespace hashdb {
 		RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType_);
 		RAISE_INTERNAL_ERROR_IF(page.size() != pageSize_, "Read page size %d differs from the page size %d of database file \"%s\"", page.size(), pageSize_, fileName_);
 
+		// Mapped file: make the page a view of the mapping.
+		if (mapped_) {
+			page.setMemory(pageView(pageId));
+			page.setId(pageId);
+			page.clearDirtyFlag();
+			return;
+		}
+
 		// Compute the offset.
 		const fileSize_t position = pageId.pageNumber() * static_cast<fileSize_t>(pageSize_);
 
@@ -227,8 +378,54 @@ namespace hashdb {
 		}
 	}
 
+	void PagedFile::truncate(fileSize_t newSize)
+	{
+		LARGE_INTEGER position;
+		position.QuadPart = newSize;
+
+		const BOOL seekSucceeded = ::SetFilePointerEx(file_, position, NULL, FILE_BEGIN);
+		RAISE_IO_ERROR_IF(! seekSucceeded, "Unable to truncate database file \"%s\": %s", fileName_, describeIoError());
+
+		const BOOL truncateSucceeded = ::SetEndOfFile(file_);
+		RAISE_IO_ERROR_IF(! truncateSucceeded, "Unable to truncate database file \"%s\": %s", fileName_, describeIoError());
+	}
+
+	void PagedFile::mapFile(fileSize_t fileSize)
+	{
+		const DWORD sizeHigh = static_cast<DWORD>(fileSize >> 32);
+		const DWORD sizeLow = static_cast<DWORD>(fileSize);
+
+		HANDLE mappingHandle = ::CreateFileMappingW(file_, NULL, PAGE_WRITECOPY, sizeHigh, sizeLow, NULL);
+		RAISE_IO_ERROR_IF(mappingHandle == NULL, "Unable to map database file \"%s\": %s", fileName_, describeIoError());
+
+		// The view keeps the mapping object open.
+		void* base = ::MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, static_cast<SIZE_T>(fileSize));
+		const std::string mapError = (base == NULL)? describeIoError() : std::string();
+		::CloseHandle(mappingHandle);
+
+		RAISE_IO_ERROR_IF(base == NULL, "Unable to map database file \"%s\": %s", fileName_, mapError);
+
+		mapping_ = new FileMapping(static_cast<IPageAllocator::value_type*>(base), fileSize);
+		mappingMemory_.reset(new IPageAllocator::PageMemoryPtr(mapping_->memory()));
+
+		HASHDB_LOG_DEBUG("Mapped %u bytes of database file \"%s\"", fileSize, fileName_);
+	}
+
+	bool FileMapping::growInPlace(PagedFile::fileSize_t /* newSize */)
+	{
+		return false;
+	}
+
+	void FileMapping::unmap()
+	{
+		::UnmapViewOfFile(base_);
+	}
+
 #else
 
+	// Offsets of pages beyond 4 GB do not fit to 32-bit off_t, build with _FILE_OFFSET_BITS=64 on 32-bit platforms.
+	BOOST_STATIC_ASSERT(sizeof(off_t) >= sizeof(PagedFile::fileSize_t));
+
 	std::string describeIoError()
 	{
 		char* description = strerror(errno);
@@ -246,6 +443,8 @@ namespace hashdb {
 		, fileType_(fileType)
 		, pageSize_(options.pageSize_)
 		, environment_(environment)
+		, mapped_(options.readOnly_ && options.mapFiles_)
+		, mapping_(NULL)
 		, fd_(-1)
 	{
 		// Guard clauses.
@@ -275,6 +474,8 @@ namespace hashdb {
 
 	void PagedFile::close()
 	{
+		unmapFile();
+
 		const int closeResult = ::close(fd_);
 		RAISE_IO_ERROR_IF(closeResult != 0, "unable to close database file \"%s\": %s", fileName_, describeIoError());
 
@@ -297,22 +498,17 @@ namespace hashdb {
 		return statbuf.st_size;
 	}
 
-	void PagedFile::doWrite(const Page& page)
+	void PagedFile::doWrite(uint32_t pageNumber, const void* data, size_type size)
 	{
-		// Guard clauses.
-		const PageId& pageId = page.getId();
-		RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType_);
-		RAISE_INTERNAL_ERROR_IF(page.size() != pageSize_, "Written page size %d differs from the page size %d of database file \"%s\"", page.size(), pageSize_, fileName_);
-
 		// Compute the offset.
-		const off_t offset = pageId.pageNumber() * pageSize_;
+		const off_t offset = static_cast<off_t>(pageNumber * static_cast<fileSize_t>(size));
 
 		// Write.
-		ssize_t writeResult = ::pwrite(fd_, page.constData(), pageSize_, offset);
+		ssize_t writeResult = ::pwrite(fd_, data, size, offset);
 
 		// Fail on write error.
-		RAISE_IO_ERROR_IF(writeResult == -1, "Unable to write page %u to database file \"%s\": %s", pageId.pageNumber(), fileName_, describeIoError());
-		RAISE_IO_ERROR_IF(static_cast<size_type>(writeResult) != pageSize_, "Unable to write page %u to database file \"%s\": only %u of %u bytes written", pageId.pageNumber(), fileName_, writeResult, pageSize_);
+		RAISE_IO_ERROR_IF(writeResult == -1, "Unable to write page %u to database file \"%s\": %s", pageNumber, fileName_, describeIoError());
+		RAISE_IO_ERROR_IF(static_cast<size_type>(writeResult) != size, "Unable to write page %u to database file \"%s\": only %u of %u bytes written", pageNumber, fileName_, writeResult, size);
 	}
 
 	void PagedFile::read(Page& page, const PageId& pageId)
@@ -321,8 +517,16 @@ namespace hashdb {
 		RAISE_INTERNAL_ERROR_IF_ARG(pageId.fileType() != fileType_);
 		RAISE_INTERNAL_ERROR_IF(page.size() != pageSize_, "Read page size %d differs from the page size %d of database file \"%s\"", page.size(), pageSize_, fileName_);
 
+		// Mapped file: make the page a view of the mapping.
+		if (mapped_) {
+			page.setMemory(pageView(pageId));
+			page.setId(pageId);
+			page.clearDirtyFlag();
+			return;
+		}
+
 		// Compute the offset.
-		const off_t offset = pageId.pageNumber() * pageSize_;
+		const off_t offset = static_cast<off_t>(pageId.pageNumber() * static_cast<fileSize_t>(pageSize_));
 
 		// Read.
 		ssize_t readResult = ::pread(fd_, page.mutableData(), pageSize_, offset);
@@ -346,6 +550,51 @@ namespace hashdb {
 		}
 	}
 
+	void PagedFile::truncate(fileSize_t newSize)
+	{
+		const int truncateResult = ::ftruncate(fd_, static_cast<off_t>(newSize));
+		RAISE_IO_ERROR_IF(truncateResult != 0, "Unable to truncate database file \"%s\": %s", fileName_, describeIoError());
+	}
+
+	void PagedFile::mapFile(fileSize_t fileSize)
+	{
+		void* base = ::mmap(NULL, static_cast<size_t>(fileSize), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+		RAISE_IO_ERROR_IF(base == MAP_FAILED, "Unable to map database file \"%s\": %s", fileName_, describeIoError());
+
+		mapping_ = new FileMapping(static_cast<IPageAllocator::value_type*>(base), fileSize);
+		mappingMemory_.reset(new IPageAllocator::PageMemoryPtr(mapping_->memory()));
+
+		HASHDB_LOG_DEBUG("Mapped %u bytes of database file \"%s\"", fileSize, fileName_);
+	}
+
+#if defined _LINUX
+
+	bool FileMapping::growInPlace(PagedFile::fileSize_t newSize)
+	{
+		// Pages view the current mapping, so it must not move.
+		const bool grown = (::mremap(base_, static_cast<size_t>(size_), static_cast<size_t>(newSize), 0) != MAP_FAILED);
+
+		if (grown) {
+			size_ = newSize;
+		}
+
+		return grown;
+	}
+
+#else
+
+	bool FileMapping::growInPlace(PagedFile::fileSize_t /* newSize */)
+	{
+		return false;
+	}
+
+#endif
+
+	void FileMapping::unmap()
+	{
+		::munmap(base_, static_cast<size_t>(size_));
+	}
+
 #endif
 
 #if defined _WIN32
@@ -382,6 +631,12 @@ namespace hashdb {
 		}
 	}
 
+	bool PagedFile::prefetchRange(fileSize_t /* position */, fileSize_t /* length */)
+	{
+		// Windows does not have public API for asynchronous prefetch of a file range, pages are read on demand.
+		return false;
+	}
+
 #elif defined _LINUX
 
 	void PagedFile::prefetch()
@@ -394,6 +649,17 @@ namespace hashdb {
 		}
 	}
 
+	bool PagedFile::prefetchRange(fileSize_t position, fileSize_t length)
+	{
+		const int adviseResult = posix_fadvise(fd_, static_cast<off_t>(position), static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+
+		if (adviseResult != 0) {
+			HASHDB_LOG_DEBUG("Unable to prefetch %u bytes at %u of file \"%s\": %s", length, position, fileName_, strerror(adviseResult));
+		}
+
+		return adviseResult == 0;
+	}
+
 #elif defined _MACOS
 
 	void PagedFile::prefetch()
@@ -410,6 +676,21 @@ namespace hashdb {
 		}
 	}
 
+	bool PagedFile::prefetchRange(fileSize_t position, fileSize_t length)
+	{
+		struct radvisory prefetch;
+		prefetch.ra_offset = static_cast<off_t>(position);
+		prefetch.ra_count = static_cast<int>(length);
+
+		const bool adviseSucceeded = (fcntl(fd_, F_RDADVISE, &prefetch) != -1);
+
+		if (! adviseSucceeded) {
+			HASHDB_LOG_DEBUG("Unable to prefetch %u bytes at %u of file \"%s\": %s", length, position, fileName_, describeIoError());
+		}
+
+		return adviseSucceeded;
+	}
+
 #endif
 
 }; // namespace hashdb
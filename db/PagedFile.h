@@ -32,6 +32,11 @@
 namespace kerio {
 namespace hashdb {
 
+	class FileMapping;
+
+	// Returns description of the last I/O error.
+	std::string describeIoError();
+
 	class PagedFile : boost::noncopyable {
 	public:
 		typedef uint64_t fileSize_t;
@@ -45,12 +50,22 @@ namespace hashdb {
 		size_type pageSize();
 		fileSize_t size();
 		void write(Page& page);
+		void writeImage(uint32_t pageNumber, boost::string_ref image);
 		void read(Page& page, const PageId& pageId);
 		void sync();
+		void truncate(fileSize_t newSize);
 		void prefetch();
+		void prefetchPages(const std::vector<uint32_t>& sortedPageNumbers);
+
+		// Memory mapped access (read-only files only).
+		bool isMapped() const;
+		IPageAllocator::PageMemoryPtr pageView(const PageId& pageId);
 
 	private:
-		void doWrite(const Page& page);
+		void doWrite(uint32_t pageNumber, const void* data, size_type size);
+		bool prefetchRange(fileSize_t position, fileSize_t length);
+		void mapFile(fileSize_t fileSize);
+		void unmapFile();
 
 	private:
 		static const size_type PREFETCH_SIZE = 1 * 1024 * 1024; // Max prefetch size.
@@ -61,6 +76,11 @@ namespace hashdb {
 		size_type pageSize_;
 		Environment& environment_;
 
+		// Current mapping of the file. Pages viewing an older mapping keep it alive.
+		const bool mapped_;
+		FileMapping* mapping_;
+		boost::scoped_ptr<IPageAllocator::PageMemoryPtr> mappingMemory_;
+
 #if defined _WIN32
 		HANDLE file_;
 #else
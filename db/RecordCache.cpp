@@ -0,0 +1,165 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// RecordCache.cpp - cache of inline values of recently fetched records.
+#include "stdafx.h"
+#include "RecordCache.h"
+
+namespace kerio {
+namespace hashdb {
+
+	RecordCache::RecordCache(size_type maximumBytes)
+		: maximumBytes_(maximumBytes)
+		, cachedBytes_(0)
+		, hits_(0)
+		, misses_(0)
+	{
+
+	}
+
+	bool RecordCache::isEnabled() const
+	{
+		return maximumBytes_ != 0;
+	}
+
+	//-------------------------------------------------------------------------
+	// Record access.
+
+	bool RecordCache::fetch(const boost::string_ref& key, partNum_t partNum, std::string& value)
+	{
+		const std::string recordKey = recordKeyFor(key, partNum);
+		boost::mutex::scoped_lock lock(cacheMutex_);
+
+		recordMap_t::iterator found = records_.find(recordKey);
+		if (found == records_.end()) {
+			++misses_;
+			return false;
+		}
+
+		++hits_;
+		lruList_.splice(lruList_.begin(), lruList_, found->second);
+		value = found->second->value_;
+
+		return true;
+	}
+
+	void RecordCache::insert(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value)
+	{
+		if (! isEnabled()) {
+			return;
+		}
+
+		Entry entry;
+		entry.recordKey_ = recordKeyFor(key, partNum);
+		entry.value_.assign(value.data(), value.size());
+
+		const size_type addedBytes = entrySize(entry);
+		if (addedBytes > maximumBytes_) {
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(cacheMutex_);
+
+		recordMap_t::iterator found = records_.find(entry.recordKey_);
+		if (found != records_.end()) {
+			evict(found);
+		}
+
+		while (cachedBytes_ + addedBytes > maximumBytes_) {
+			evict(records_.find(lruList_.back().recordKey_));
+		}
+
+		lruList_.push_front(entry);
+		records_.insert(recordMap_t::value_type(entry.recordKey_, lruList_.begin()));
+		cachedBytes_ += addedBytes;
+	}
+
+	void RecordCache::erase(const boost::string_ref& key, partNum_t partNum)
+	{
+		if (! isEnabled()) {
+			return;
+		}
+
+		const std::string recordKey = recordKeyFor(key, partNum);
+		boost::mutex::scoped_lock lock(cacheMutex_);
+
+		recordMap_t::iterator found = records_.find(recordKey);
+		if (found != records_.end()) {
+			evict(found);
+		}
+	}
+
+	void RecordCache::clear()
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+
+		records_.clear();
+		lruList_.clear();
+		cachedBytes_ = 0;
+	}
+
+	std::string RecordCache::recordKeyFor(const boost::string_ref& key, partNum_t partNum)
+	{
+		// Part numbers fit into a single byte.
+		std::string recordKey;
+		recordKey.reserve(key.size() + 1);
+		recordKey.assign(key.data(), key.size());
+		recordKey.push_back(static_cast<char>(partNum));
+
+		return recordKey;
+	}
+
+	size_type RecordCache::entrySize(const Entry& entry)
+	{
+		return static_cast<size_type>(2 * entry.recordKey_.size() + entry.value_.size()) + ENTRY_OVERHEAD;
+	}
+
+	void RecordCache::evict(const recordMap_t::iterator& found)
+	{
+		cachedBytes_ -= entrySize(*found->second);
+
+		lruList_.erase(found->second);
+		records_.erase(found);
+	}
+
+	//-------------------------------------------------------------------------
+	// Statistics.
+
+	size_type RecordCache::hits() const
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		return hits_;
+	}
+
+	size_type RecordCache::misses() const
+	{
+		boost::mutex::scoped_lock lock(cacheMutex_);
+		return misses_;
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,90 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// RecordCache.h - cache of inline values of recently fetched records.
+#pragma once
+#include <list>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <kerio/hashdb/Types.h>
+
+namespace kerio {
+namespace hashdb {
+
+	// Record cache holds inline values of the most recently fetched records in LRU order, so hot records
+	// are fetched without hashing the key and searching the bucket chain. Its size is limited by a byte budget.
+	//
+	// Values are inserted by fetches holding a read lock of the bucket chain and erased by requests which
+	// remove the record (or replace its value) holding a write lock of the chain, so the cache never
+	// returns a value which is no longer stored. The cache can be used by concurrent requests.
+
+	class RecordCache : boost::noncopyable
+	{
+	public:
+		static const size_type ENTRY_OVERHEAD = 64; // Approximate size of the list node, map node and strings.
+
+		RecordCache(size_type maximumBytes);
+
+		bool isEnabled() const;
+
+		// Record access.
+		bool fetch(const boost::string_ref& key, partNum_t partNum, std::string& value);
+		void insert(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value);
+		void erase(const boost::string_ref& key, partNum_t partNum);
+		void clear();
+
+		// Statistics.
+		size_type hits() const;
+		size_type misses() const;
+
+	private:
+		struct Entry { // intentionally copyable
+			std::string recordKey_;
+			std::string value_;
+		};
+
+		typedef std::list<Entry> lruList_t;
+		typedef boost::unordered_map<std::string, lruList_t::iterator> recordMap_t;
+
+		static std::string recordKeyFor(const boost::string_ref& key, partNum_t partNum);
+		static size_type entrySize(const Entry& entry);
+		void evict(const recordMap_t::iterator& found);
+
+	private:
+		mutable boost::mutex cacheMutex_;
+
+		lruList_t lruList_; // The most recently used record is at the front.
+		recordMap_t records_;
+		const size_type maximumBytes_;
+		size_type cachedBytes_;
+
+		size_type hits_;
+		size_type misses_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
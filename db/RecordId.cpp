@@ -73,5 +73,11 @@ namespace hashdb {
 		return size() + sizeof(uint16_t); // Record id size + inline value size (2)
 	}
 
+	uint16_t RecordId::hashTagFor(uint32_t keyHash)
+	{
+		// Bucket number is selected by the low bits of the key hash, the high bits differ among records of the same bucket.
+		return static_cast<uint16_t>(keyHash >> 16);
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
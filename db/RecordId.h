@@ -44,6 +44,9 @@ namespace hashdb {
 
 		size_type recordOverheadSize() const;
 
+		// Short key hash stored in record slots of tagged data pages.
+		static uint16_t hashTagFor(uint32_t keyHash);
+
 	private:
 		static const size_type BUFFER_SIZE = MAX_KEY_SIZE + 2; // len (1) + key (1..127) + part (1)
 		uint8_t buffer_[BUFFER_SIZE];
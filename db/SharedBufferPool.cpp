@@ -0,0 +1,240 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// SharedBufferPool.cpp - buffer pool shared by database instances in a process.
+#include "stdafx.h"
+#include <algorithm>
+#include "utils/ExceptionCreator.h"
+#include "SharedBufferPool.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//----------------------------------------------------------------------------
+	// Factory.
+
+	BufferPool BufferPoolFactory(size_type maximumBytes)
+	{
+		RAISE_INVALID_ARGUMENT_IF(maximumBytes == 0, "buffer pool size must be greater than 0");
+
+		BufferPool pool(new SharedBufferPool(maximumBytes));
+		return pool;
+	}
+
+	//----------------------------------------------------------------------------
+	// Client.
+
+	SharedBufferPool::Client::Client()
+		: client_(NULL)
+		, frameSize_(0)
+		, softQuota_(0)
+		, hardQuota_(0)
+		, heldFrames_(0)
+		, lastAcquired_(0)
+	{
+
+	}
+
+	size_type SharedBufferPool::Client::heldBytes() const
+	{
+		return heldFrames_ * frameSize_;
+	}
+
+	bool SharedBufferPool::Client::isAboveSoftQuota() const
+	{
+		return heldBytes() > softQuota_;
+	}
+
+	//----------------------------------------------------------------------------
+	// Creation and destruction.
+
+	SharedBufferPool::SharedBufferPool(size_type maximumBytes)
+		: maximumBytes_(maximumBytes)
+		, heldBytes_(0)
+		, acquisitions_(0)
+	{
+
+	}
+
+	SharedBufferPool::~SharedBufferPool()
+	{
+		HASHDB_ASSERT(clients_.empty());
+	}
+
+	//----------------------------------------------------------------------------
+	// IBufferPool methods.
+
+	size_type SharedBufferPool::maximumBytes()
+	{
+		return maximumBytes_;
+	}
+
+	size_type SharedBufferPool::heldBytes()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return heldBytes_;
+	}
+
+	//----------------------------------------------------------------------------
+	// Client registration.
+
+	void SharedBufferPool::attach(IBufferPoolClient* client, size_type frameSize, size_type softQuota, size_type hardQuota)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(client == NULL);
+		RAISE_INTERNAL_ERROR_IF_ARG(frameSize == 0);
+
+		boost::mutex::scoped_lock lock(mutex_);
+		RAISE_INTERNAL_ERROR_IF(findClient(client) != clients_.end(), "buffer pool client is already attached");
+
+		Client newClient;
+		newClient.client_ = client;
+		newClient.frameSize_ = frameSize;
+		newClient.softQuota_ = softQuota;
+		newClient.hardQuota_ = hardQuota;
+		newClient.lastAcquired_ = acquisitions_;
+
+		clients_.push_back(newClient);
+	}
+
+	void SharedBufferPool::detach(IBufferPoolClient* client)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		clients_t::iterator found = findClient(client);
+		RAISE_INTERNAL_ERROR_IF(found == clients_.end(), "buffer pool client is not attached");
+
+		heldBytes_ -= found->heldBytes();
+		clients_.erase(found);
+	}
+
+	SharedBufferPool::clients_t::iterator SharedBufferPool::findClient(IBufferPoolClient* client)
+	{
+		clients_t::iterator ii = clients_.begin();
+
+		while (ii != clients_.end() && ii->client_ != client) {
+			++ii;
+		}
+
+		return ii;
+	}
+
+	//----------------------------------------------------------------------------
+	// Frame accounting.
+
+	bool SharedBufferPool::acquireFrame(IBufferPoolClient* client, bool force)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		clients_t::iterator found = findClient(client);
+		RAISE_INTERNAL_ERROR_IF(found == clients_.end(), "buffer pool client is not attached");
+
+		const size_type requestedBytes = found->heldBytes() + found->frameSize_;
+		bool granted;
+
+		if (force || requestedBytes <= found->softQuota_) {
+			granted = true;
+		}
+		else if (found->hardQuota_ != 0 && requestedBytes > found->hardQuota_) {
+			granted = false;
+		}
+		else if (heldBytes_ + found->frameSize_ <= maximumBytes_) {
+			granted = true;
+		}
+		else {
+			granted = reclaimFrom(*found);
+		}
+
+		if (granted) {
+			++found->heldFrames_;
+			found->lastAcquired_ = ++acquisitions_;
+			heldBytes_ += found->frameSize_;
+		}
+
+		return granted;
+	}
+
+	void SharedBufferPool::releaseFrames(IBufferPoolClient* client, size_type frames)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		clients_t::iterator found = findClient(client);
+		RAISE_INTERNAL_ERROR_IF(found == clients_.end(), "buffer pool client is not attached");
+		RAISE_INTERNAL_ERROR_IF_ARG(frames > found->heldFrames_);
+
+		found->heldFrames_ -= frames;
+		heldBytes_ -= frames * found->frameSize_;
+	}
+
+	//----------------------------------------------------------------------------
+	// Taking frames back from idle clients.
+
+	namespace {
+
+		template<typename T>
+		bool lessRecentlyAcquired(const T* left, const T* right)
+		{
+			return left->lastAcquired_ < right->lastAcquired_;
+		}
+
+	} // anonymous namespace
+
+	bool SharedBufferPool::reclaimFrom(const Client& requestingClient)
+	{
+		// Candidates are clients above their soft quota, the least recently acquiring client first.
+		std::vector<Client*> candidates;
+
+		for (clients_t::iterator ii = clients_.begin(); ii != clients_.end(); ++ii) {
+			if (ii->client_ != requestingClient.client_ && ii->isAboveSoftQuota()) {
+				candidates.push_back(&(*ii));
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), lessRecentlyAcquired<Client>);
+
+		bool reclaimed = false;
+		for (std::vector<Client*>::iterator ii = candidates.begin(); ! reclaimed && ii != candidates.end(); ++ii) {
+			Client& candidate = **ii;
+
+			const size_type framesAboveSoftQuota = (candidate.heldBytes() - candidate.softQuota_ + candidate.frameSize_ - 1) / candidate.frameSize_;
+			const size_type maximumFramesToRelease = RECLAIMED_FRAMES_MAX;
+			const size_type framesToRelease = std::min(framesAboveSoftQuota, maximumFramesToRelease);
+
+			// Returns 0 if the candidate is being used.
+			const size_type releasedFrames = candidate.client_->releaseColdPages(framesToRelease);
+			HASHDB_ASSERT(releasedFrames <= candidate.heldFrames_);
+
+			candidate.heldFrames_ -= releasedFrames;
+			heldBytes_ -= releasedFrames * candidate.frameSize_;
+
+			reclaimed = (heldBytes_ + requestingClient.frameSize_ <= maximumBytes_);
+		}
+
+		return reclaimed;
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,89 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// SharedBufferPool.h - buffer pool shared by database instances in a process.
+#pragma once
+#include <boost/thread/mutex.hpp>
+#include "Interfaces.h"
+
+namespace kerio {
+namespace hashdb {
+
+	// The buffer pool does not hold any memory itself. It accounts for page frames held by the page caches
+	// of its clients and decides whether a client may hold another frame.
+
+	class SharedBufferPool : public IBufferPool, boost::noncopyable
+	{
+	public:
+		static const size_type RECLAIMED_FRAMES_MAX = 8;
+
+		SharedBufferPool(size_type maximumBytes);
+		virtual ~SharedBufferPool();
+
+		// IBufferPool methods.
+		virtual size_type maximumBytes();
+		virtual size_type heldBytes();
+
+		// Client registration.
+		void attach(IBufferPoolClient* client, size_type frameSize, size_type softQuota, size_type hardQuota);
+		void detach(IBufferPoolClient* client);
+
+		// Frame accounting.
+		bool acquireFrame(IBufferPoolClient* client, bool force);
+		void releaseFrames(IBufferPoolClient* client, size_type frames);
+
+	private:
+		struct Client { // intentionally copyable
+			Client();
+
+			IBufferPoolClient* client_;
+			size_type frameSize_;
+			size_type softQuota_;
+			size_type hardQuota_;
+			size_type heldFrames_;
+			uint64_t lastAcquired_;
+
+			size_type heldBytes() const;
+			bool isAboveSoftQuota() const;
+		};
+
+		typedef std::vector<Client> clients_t;
+
+		clients_t::iterator findClient(IBufferPoolClient* client);
+		bool reclaimFrom(const Client& requestingClient);
+
+	private:
+		boost::mutex mutex_;
+		clients_t clients_;
+
+		const size_type maximumBytes_;
+		size_type heldBytes_;
+		uint64_t acquisitions_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -42,8 +42,16 @@ namespace hashdb {
 		, overflowPagesReleased_(0)
 		, largeValuePagesReleased_(0)
 		, bitmapPagesReleased_(0)
+		, bitmapPagesRead_(0)
 		, splitsOnOverfill_(0)
+		, overflowPagesRelocated_(0)
 		, cachedPages_(0)
+		, pageCacheHits_(0)
+		, pageCacheMisses_(0)
+		, pageCacheEvictions_(0)
+		, keyFilterRejects_(0)
+		, recordCacheHits_(0)
+		, recordCacheMisses_(0)
 		, pageSize_(0)
 		, numberOfBuckets_(0)
 		, overflowFileDataPages_(0)
@@ -65,9 +73,17 @@ namespace hashdb {
 		os << "Overflow pages released: " << overflowPagesReleased_ << std::endl;
 		os << "Overflow pages released: " << overflowPagesReleased_ << std::endl;
 		os << "Bitmap pages released: " << bitmapPagesReleased_ << std::endl;
+		os << "Bitmap pages read: " << bitmapPagesRead_ << std::endl;
 
 		os << "Splits on overfill: " << splitsOnOverfill_ << std::endl;
+		os << "Overflow pages relocated: " << overflowPagesRelocated_ << std::endl;
 		os << "Cached pages: " << cachedPages_ << std::endl;
+		os << "Page cache hits: " << pageCacheHits_ << std::endl;
+		os << "Page cache misses: " << pageCacheMisses_ << std::endl;
+		os << "Page cache evictions: " << pageCacheEvictions_ << std::endl;
+		os << "Key filter rejects: " << keyFilterRejects_ << std::endl;
+		os << "Record cache hits: " << recordCacheHits_ << std::endl;
+		os << "Record cache misses: " << recordCacheMisses_ << std::endl;
 	}
 
 	void Statistics::printDatabaseStats(std::ostream& os)
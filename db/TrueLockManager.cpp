@@ -0,0 +1,182 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// TrueLockManager.cpp - reader/writer locks on database pages.
+#include "stdafx.h"
+#include "utils/ExceptionCreator.h"
+#include "TrueLockManager.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//----------------------------------------------------------------------------
+	// Lock records.
+
+	TrueLockManager::PageLock::PageLock()
+		: readers_(0)
+		, waitingWriters_(0)
+		, writer_(0)
+	{
+
+	}
+
+	TrueLockManager::HeldLock::HeldLock(const PageId& pageId, bool write)
+		: pageId_(pageId)
+		, write_(write)
+	{
+
+	}
+
+	//----------------------------------------------------------------------------
+	// Creation and destruction.
+
+	TrueLockManager::TrueLockManager()
+		: lastLockSet_(0)
+	{
+
+	}
+
+	TrueLockManager::~TrueLockManager()
+	{
+		HASHDB_ASSERT(lockSets_.empty());
+	}
+
+	//----------------------------------------------------------------------------
+	// ILockManager methods.
+
+	ILockManager::lockSet_t TrueLockManager::newLockSet()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		// Lock set 0 is never used, it marks a page without a writer.
+		++lastLockSet_;
+		if (lastLockSet_ == 0) {
+			++lastLockSet_;
+		}
+
+		return lastLockSet_;
+	}
+
+	void TrueLockManager::acquireReadLock(lockSet_t lockSet, const PageId& pageId)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(lockSet == 0 || ! pageId.isValid());
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (findHeldLock(lockSet, pageId) != NULL) {
+			return;
+		}
+
+		// The page lock is looked up again after each wait, an unused record may have been removed meanwhile.
+		while (pageLocks_[pageId].writer_ != 0 || pageLocks_[pageId].waitingWriters_ != 0) {
+			lockReleased_.wait(lock);
+		}
+
+		++pageLocks_[pageId].readers_;
+		lockSets_[lockSet].push_back(HeldLock(pageId, false));
+	}
+
+	void TrueLockManager::acquireWriteLock(lockSet_t lockSet, const PageId& pageId)
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(lockSet == 0 || ! pageId.isValid());
+		boost::mutex::scoped_lock lock(mutex_);
+
+		const HeldLock* heldLock = findHeldLock(lockSet, pageId);
+		if (heldLock != NULL) {
+			RAISE_INTERNAL_ERROR_IF(! heldLock->write_, "unable to upgrade read lock of %s", pageId.toString());
+			return;
+		}
+
+		// A record with a waiting writer is never removed.
+		PageLock& pageLock = pageLocks_[pageId];
+		++pageLock.waitingWriters_;
+
+		while (pageLock.readers_ != 0 || pageLock.writer_ != 0) {
+			lockReleased_.wait(lock);
+		}
+
+		--pageLock.waitingWriters_;
+		pageLock.writer_ = lockSet;
+		lockSets_[lockSet].push_back(HeldLock(pageId, true));
+	}
+
+	void TrueLockManager::releaseLockSet(lockSet_t lockSet)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		lockSets_t::iterator found = lockSets_.find(lockSet);
+		if (found == lockSets_.end()) {
+			return;
+		}
+
+		const heldLocks_t& heldLocks = found->second;
+		for (heldLocks_t::const_iterator ii = heldLocks.begin(); ii != heldLocks.end(); ++ii) {
+			pageLocks_t::iterator pageLock = pageLocks_.find(ii->pageId_);
+			HASHDB_ASSERT(pageLock != pageLocks_.end());
+
+			if (ii->write_) {
+				pageLock->second.writer_ = 0;
+			}
+			else {
+				--pageLock->second.readers_;
+			}
+
+			if (pageLock->second.readers_ == 0 && pageLock->second.writer_ == 0 && pageLock->second.waitingWriters_ == 0) {
+				pageLocks_.erase(pageLock);
+			}
+		}
+
+		lockSets_.erase(found);
+		lockReleased_.notify_all();
+	}
+
+	const TrueLockManager::HeldLock* TrueLockManager::findHeldLock(lockSet_t lockSet, const PageId& pageId)
+	{
+		lockSets_t::const_iterator found = lockSets_.find(lockSet);
+
+		if (found != lockSets_.end()) {
+			const heldLocks_t& heldLocks = found->second;
+
+			for (heldLocks_t::const_iterator ii = heldLocks.begin(); ii != heldLocks.end(); ++ii) {
+				if (ii->pageId_ == pageId) {
+					return &*ii;
+				}
+			}
+		}
+
+		return NULL;
+	}
+
+	//----------------------------------------------------------------------------
+	// Statistics.
+
+	size_type TrueLockManager::lockedPages()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return static_cast<size_type>(pageLocks_.size());
+	}
+
+}; // namespace hashdb
+}; // namespace kerio
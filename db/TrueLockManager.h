@@ -0,0 +1,90 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// TrueLockManager.h - reader/writer locks on database pages.
+#pragma once
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "Environment.h"
+
+namespace kerio {
+namespace hashdb {
+
+	// Each page can be locked either by any number of readers or by a single writer.
+	// A lock set holds the locks acquired by one request until it is released as a whole.
+	// Acquiring a lock already held by the same lock set does nothing, a read lock cannot be upgraded to a write lock.
+	// A waiting writer blocks new readers of the page, so that writers are not starved.
+	//
+	// Locks should be acquired in a fixed order by all requests to avoid deadlocks.
+
+	class TrueLockManager : public ILockManager, boost::noncopyable {
+	public:
+		TrueLockManager();
+
+		virtual lockSet_t newLockSet();
+		virtual void acquireReadLock(lockSet_t lockSet, const PageId& pageId);
+		virtual void acquireWriteLock(lockSet_t lockSet, const PageId& pageId);
+		virtual void releaseLockSet(lockSet_t lockSet);
+
+		virtual ~TrueLockManager();
+
+		// Statistics.
+		size_type lockedPages();
+
+	private:
+		struct PageLock { // intentionally copyable
+			PageLock();
+
+			size_type readers_;
+			size_type waitingWriters_;
+			lockSet_t writer_;
+		};
+
+		struct HeldLock { // intentionally copyable
+			HeldLock(const PageId& pageId, bool write);
+
+			PageId pageId_;
+			bool write_;
+		};
+
+		typedef boost::unordered_map<PageId, PageLock> pageLocks_t;
+		typedef std::vector<HeldLock> heldLocks_t;
+		typedef boost::unordered_map<lockSet_t, heldLocks_t> lockSets_t;
+
+		const HeldLock* findHeldLock(lockSet_t lockSet, const PageId& pageId);
+
+	private:
+		boost::mutex mutex_;
+		boost::condition_variable lockReleased_;
+
+		pageLocks_t pageLocks_;
+		lockSets_t lockSets_;
+		lockSet_t lastLockSet_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
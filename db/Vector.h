@@ -334,7 +334,7 @@ namespace hashdb {
 			return iterator(this, 0);
 		}
 
-		iterator end() const
+		const_iterator end() const
 		{	
 			return const_iterator(this, size());
 		}
@@ -32,7 +32,15 @@
 namespace kerio {
 namespace hashdb {
 
-	static const uint32_t DATABASE_CURRENT_FORMAT_VERSION = 1;	// Current on-disk format for new databases.
+	// Format versions:
+	// 1 - initial format
+	// 2 - new data pages store a hash tag of the key next to each record offset (older data pages remain readable)
+	//     overflow file header summarizes full bitmap pages (cleared summary of older headers is valid)
+	// 3 - bucket file header records the position of an incremental bucket split in progress
+	// 4 - bucket file header records the built-in hash function (cleared field of older headers means a hash function checked by the test hash)
+	// 5 - new data pages store the key hash instead of the hash tag next to each record offset (older data pages remain readable)
+
+	static const uint32_t DATABASE_CURRENT_FORMAT_VERSION = 5;	// Current on-disk format for new databases.
 	static const uint32_t DATABASE_MINIMUM_FORMAT_VERSION = 1;	// Oldest database version which can be opened current code.
 
 }; // namespace hashdb
@@ -0,0 +1,473 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// WriteAheadLog.cpp - redo log of database page images.
+#include "stdafx.h"
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "utils/ExceptionCreator.h"
+#include "utils/ConfigUtils.h"
+#include "utils/MurmurHash3.h"
+#include "PagedFile.h"
+#include "WriteAheadLog.h"
+
+namespace kerio {
+namespace hashdb {
+
+	//----------------------------------------------------------------------------
+	// Opening and closing the log.
+
+	WriteAheadLog::WriteAheadLog(const boost::filesystem::path& fileName, const Options& options, Environment& environment)
+		: fileName_(fileName.string())
+		, groupSize_(options.writeAheadLogGroupSize_)
+		, uncommittedPages_(0)
+		, unsyncedCommits_(0)
+		, commitSequence_(0)
+		, size_(0)
+		, environment_(environment)
+#if defined _WIN32
+		, file_(INVALID_HANDLE_VALUE)
+#else
+		, fd_(-1)
+#endif
+	{
+		RAISE_INTERNAL_ERROR_IF_ARG(fileName_.empty());
+		options.validate();
+
+		openFile(fileName, options.readOnly_);
+
+		try {
+			recover();
+
+			// Incomplete commits are overwritten by the next commit, remove them now so that they cannot be mistaken for it.
+			if (! options.readOnly_ && fileSize() != size_) {
+				truncateFile(size_);
+			}
+		} catch (std::exception&) {
+			closeFile();
+			throw;
+		}
+	}
+
+	void WriteAheadLog::close()
+	{
+		if (uncommittedPages_ != 0) {
+			HASHDB_LOG_DEBUG("Dropping %u uncommitted page images from log \"%s\"", uncommittedPages_, fileName_);
+		}
+
+		sync();
+		closeFile();
+	}
+
+	WriteAheadLog::~WriteAheadLog()
+	{
+		HASHDB_ASSERT(isClosed());
+
+		if (! isClosed()) {
+			try {
+				close();
+			} catch (std::exception&) {
+				// Ignore.
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	// Logging.
+
+	void WriteAheadLog::appendRecordHeader(uint32_t magic, uint32_t field1, uint32_t field2, uint32_t field3)
+	{
+		const uint32_t header[] = { magic, field1, field2, field3 };
+		uncommittedRecords_.append(reinterpret_cast<const char*>(header), sizeof(header));
+	}
+
+	void WriteAheadLog::append(const Page& page)
+	{
+		const PageId& pageId = page.getId();
+		RAISE_INTERNAL_ERROR_IF_ARG(! pageId.isValid());
+
+		const char* image = reinterpret_cast<const char*>(page.constData());
+
+		appendRecordHeader(PAGE_RECORD_MAGIC, pageId.fileType(), pageId.pageNumber(), page.size());
+
+		LoggedImage& loggedImage = loggedImages_[pageId];
+		loggedImage.position_ = size_ + uncommittedRecords_.size();
+		loggedImage.size_ = page.size();
+
+		uncommittedRecords_.append(image, page.size());
+		++uncommittedPages_;
+	}
+
+	void WriteAheadLog::commit()
+	{
+		if (uncommittedPages_ != 0) {
+			++commitSequence_;
+
+			uint32_t checksum = 0;
+			MurmurHash3_x86_32(uncommittedRecords_.data(), static_cast<int>(uncommittedRecords_.size()), commitSequence_, &checksum);
+			appendRecordHeader(COMMIT_RECORD_MAGIC, static_cast<uint32_t>(uncommittedPages_), checksum, commitSequence_);
+
+			writeFile(size_, uncommittedRecords_);
+			size_ += uncommittedRecords_.size();
+
+			uncommittedRecords_.clear();
+			uncommittedPages_ = 0;
+
+			// Group commit.
+			if (++unsyncedCommits_ >= groupSize_) {
+				sync();
+			}
+		}
+	}
+
+	void WriteAheadLog::sync()
+	{
+		if (unsyncedCommits_ != 0) {
+			syncFile();
+			unsyncedCommits_ = 0;
+		}
+	}
+
+	void WriteAheadLog::truncate()
+	{
+		RAISE_INTERNAL_ERROR_IF(uncommittedPages_ != 0, "unable to truncate log \"%s\" with %u uncommitted page images", fileName_, uncommittedPages_);
+
+		truncateFile(0);
+		syncFile();
+
+		loggedImages_.clear();
+		unsyncedCommits_ = 0;
+		size_ = 0;
+	}
+
+	WriteAheadLog::fileSize_t WriteAheadLog::size() const
+	{
+		return size_;
+	}
+
+	//----------------------------------------------------------------------------
+	// Logged page images.
+
+	bool WriteAheadLog::hasPage(const PageId& pageId) const
+	{
+		return loggedImages_.find(pageId) != loggedImages_.end();
+	}
+
+	size_type WriteAheadLog::readPage(const PageId& pageId, uint8_t* buffer, size_type bufferSize)
+	{
+		loggedImages_t::const_iterator found = loggedImages_.find(pageId);
+		RAISE_INTERNAL_ERROR_IF(found == loggedImages_.end(), "%s is not in log \"%s\"", pageId.toString(), fileName_);
+
+		const LoggedImage& image = found->second;
+		const size_type readSize = std::min(image.size_, bufferSize);
+		char* const destination = reinterpret_cast<char*>(buffer);
+
+		if (image.position_ >= size_) {
+			const size_t uncommittedPosition = static_cast<size_t>(image.position_ - size_);
+			memcpy(destination, uncommittedRecords_.data() + uncommittedPosition, readSize);
+		}
+		else {
+			readFile(image.position_, destination, readSize);
+		}
+
+		return image.size_;
+	}
+
+	void WriteAheadLog::readImage(const LoggedImage& image, std::string& outImage)
+	{
+		outImage.resize(image.size_);
+		RAISE_INTERNAL_ERROR_IF(image.position_ + image.size_ > size_, "uncommitted image cannot be read from log \"%s\"", fileName_);
+
+		readFile(image.position_, &outImage[0], image.size_);
+	}
+
+	const WriteAheadLog::loggedImages_t& WriteAheadLog::loggedImages() const
+	{
+		return loggedImages_;
+	}
+
+	//----------------------------------------------------------------------------
+	// Recovery.
+
+	void WriteAheadLog::recover()
+	{
+		std::string contents;
+		readFile(contents, fileSize());
+
+		loggedImages_t commitImages;
+		size_type commitPages = 0;
+		size_t commitStart = 0;
+		size_t position = 0;
+
+		// Read records until the first invalid or incomplete one.
+		while (position + RECORD_HEADER_SIZE <= contents.size()) {
+			uint32_t header[4];
+			memcpy(header, contents.data() + position, sizeof(header));
+
+			if (header[0] == PAGE_RECORD_MAGIC) {
+				const uint32_t fileType = header[1];
+				const uint32_t pageNumber = header[2];
+				const size_type pageSize = header[3];
+
+				const bool validPage = (fileType == PageId::BucketFileType || fileType == PageId::OverflowFileType) && isValidPageSize(pageSize);
+				if (! validPage || position + RECORD_HEADER_SIZE + pageSize > contents.size()) {
+					break;
+				}
+
+				const PageId pageId(static_cast<PageId::DatabaseFile_t>(fileType), pageNumber);
+				LoggedImage& loggedImage = commitImages[pageId];
+				loggedImage.position_ = position + RECORD_HEADER_SIZE;
+				loggedImage.size_ = pageSize;
+
+				++commitPages;
+				position += RECORD_HEADER_SIZE + pageSize;
+			}
+			else if (header[0] == COMMIT_RECORD_MAGIC) {
+				uint32_t checksum = 0;
+				MurmurHash3_x86_32(contents.data() + commitStart, static_cast<int>(position - commitStart), header[3], &checksum);
+
+				if (header[1] != commitPages || header[2] != checksum) {
+					break;
+				}
+
+				for (loggedImages_t::iterator ii = commitImages.begin(); ii != commitImages.end(); ++ii) {
+					loggedImages_[ii->first] = ii->second;
+				}
+
+				commitImages.clear();
+				commitPages = 0;
+				commitSequence_ = header[3];
+
+				position += RECORD_HEADER_SIZE;
+				commitStart = position;
+			}
+			else {
+				break;
+			}
+		}
+
+		size_ = commitStart;
+
+		if (! loggedImages_.empty()) {
+			HASHDB_LOG_DEBUG("Recovered %u page images from log \"%s\"", loggedImages_.size(), fileName_);
+		}
+
+		if (size_ != contents.size()) {
+			HASHDB_LOG_DEBUG("Ignoring %u bytes of incomplete commits at the end of log \"%s\"", contents.size() - size_, fileName_);
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	// Platform dependent file access.
+
+#if defined _WIN32
+
+	void WriteAheadLog::openFile(const boost::filesystem::path& fileName, bool readOnly)
+	{
+		std::wstring path(fileName.native());
+
+		const DWORD accessFlags = (readOnly)? (GENERIC_READ) : (GENERIC_READ | GENERIC_WRITE);
+		const DWORD shareFlags = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+		const DWORD creationFlags = (readOnly)? OPEN_EXISTING : OPEN_ALWAYS;
+
+		file_ = ::CreateFileW(path.c_str(), accessFlags, shareFlags, NULL, creationFlags, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		RAISE_IO_ERROR_IF(file_ == INVALID_HANDLE_VALUE, "Unable to open log file \"%s\"%s: %s", fileName_, (readOnly)? " read-only" : "", describeIoError());
+
+		HASHDB_LOG_DEBUG("Opened log file \"%s\"%s", fileName_, (readOnly)? " read-only" : "");
+	}
+
+	void WriteAheadLog::closeFile()
+	{
+		const BOOL closeSucceeded = ::CloseHandle(file_);
+		file_ = INVALID_HANDLE_VALUE;
+
+		RAISE_IO_ERROR_IF(! closeSucceeded, "unable to close log file \"%s\": %s", fileName_, describeIoError());
+		HASHDB_LOG_DEBUG("Closed log file \"%s\"", fileName_);
+	}
+
+	bool WriteAheadLog::isClosed() const
+	{
+		return file_ == INVALID_HANDLE_VALUE;
+	}
+
+	WriteAheadLog::fileSize_t WriteAheadLog::fileSize()
+	{
+		LARGE_INTEGER fileSize;
+
+		const BOOL getSizeSucceeded = GetFileSizeEx(file_, &fileSize);
+		RAISE_IO_ERROR_IF(! getSizeSucceeded, "Unable to get size of log file \"%s\": %s", fileName_, describeIoError());
+
+		return fileSize.QuadPart;
+	}
+
+	void WriteAheadLog::readFile(std::string& outContents, fileSize_t size)
+	{
+		outContents.resize(static_cast<size_t>(size));
+
+		if (size != 0) {
+			OVERLAPPED overlapped;
+			memset(&overlapped, 0, sizeof(overlapped));
+
+			DWORD bytesRead = 0;
+			const BOOL readSucceeded = ::ReadFile(file_, &outContents[0], static_cast<DWORD>(size), &bytesRead, &overlapped);
+
+			RAISE_IO_ERROR_IF(! readSucceeded, "Unable to read log file \"%s\": %s", fileName_, describeIoError());
+			outContents.resize(bytesRead);
+		}
+	}
+
+	void WriteAheadLog::readFile(fileSize_t position, char* buffer, size_type size)
+	{
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = static_cast<DWORD>(position);
+		overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+		DWORD bytesRead = 0;
+		const BOOL readSucceeded = ::ReadFile(file_, buffer, static_cast<DWORD>(size), &bytesRead, &overlapped);
+
+		RAISE_IO_ERROR_IF(! readSucceeded, "Unable to read log file \"%s\": %s", fileName_, describeIoError());
+		RAISE_DATABASE_CORRUPTED_IF(bytesRead != size, "log file \"%s\" is truncated: only %u of %u bytes read", fileName_, bytesRead, size);
+	}
+
+	void WriteAheadLog::writeFile(fileSize_t position, const std::string& data)
+	{
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = static_cast<DWORD>(position);
+		overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+		DWORD bytesWritten = 0;
+		const BOOL writeSucceeded = ::WriteFile(file_, data.data(), static_cast<DWORD>(data.size()), &bytesWritten, &overlapped);
+
+		RAISE_IO_ERROR_IF(! writeSucceeded, "Unable to write to log file \"%s\": %s", fileName_, describeIoError());
+		RAISE_IO_ERROR_IF(bytesWritten != data.size(), "Unable to write to log file \"%s\": only %u of %u bytes written", fileName_, bytesWritten, data.size());
+	}
+
+	void WriteAheadLog::truncateFile(fileSize_t size)
+	{
+		LARGE_INTEGER distance;
+		distance.QuadPart = size;
+
+		const BOOL truncateSucceeded = ::SetFilePointerEx(file_, distance, NULL, FILE_BEGIN) && ::SetEndOfFile(file_);
+		RAISE_IO_ERROR_IF(! truncateSucceeded, "Unable to truncate log file \"%s\": %s", fileName_, describeIoError());
+	}
+
+	void WriteAheadLog::syncFile()
+	{
+		const BOOL flushSucceeded = ::FlushFileBuffers(file_);
+		RAISE_IO_ERROR_IF(! flushSucceeded, "Unable to flush log file \"%s\": %s", fileName_, describeIoError());
+	}
+
+#else
+
+	void WriteAheadLog::openFile(const boost::filesystem::path& fileName, bool readOnly)
+	{
+		const int openFlags = (readOnly)? O_RDONLY : (O_RDWR | O_CREAT);
+		fd_ = ::open(fileName.c_str(), openFlags, 0600);
+
+		RAISE_IO_ERROR_IF(fd_ == -1, "Unable to open log file \"%s\"%s: %s", fileName_, (readOnly)? " read-only" : "", describeIoError());
+		HASHDB_LOG_DEBUG("Opened log file \"%s\"%s", fileName_, (readOnly)? " read-only" : "");
+	}
+
+	void WriteAheadLog::closeFile()
+	{
+		const int closeResult = ::close(fd_);
+		fd_ = -1;
+
+		RAISE_IO_ERROR_IF(closeResult != 0, "unable to close log file \"%s\": %s", fileName_, describeIoError());
+		HASHDB_LOG_DEBUG("Closed log file \"%s\"", fileName_);
+	}
+
+	bool WriteAheadLog::isClosed() const
+	{
+		return fd_ == -1;
+	}
+
+	WriteAheadLog::fileSize_t WriteAheadLog::fileSize()
+	{
+		struct stat statbuf;
+
+		const int statResult = ::fstat(fd_, &statbuf);
+		RAISE_IO_ERROR_IF(statResult != 0, "Unable to get size of log file \"%s\": %s", fileName_, describeIoError());
+
+		return statbuf.st_size;
+	}
+
+	void WriteAheadLog::readFile(std::string& outContents, fileSize_t size)
+	{
+		outContents.resize(static_cast<size_t>(size));
+
+		if (size != 0) {
+			const ssize_t readResult = ::pread(fd_, &outContents[0], outContents.size(), 0);
+
+			RAISE_IO_ERROR_IF(readResult == -1, "Unable to read log file \"%s\": %s", fileName_, describeIoError());
+			outContents.resize(readResult);
+		}
+	}
+
+	void WriteAheadLog::readFile(fileSize_t position, char* buffer, size_type size)
+	{
+		const ssize_t readResult = ::pread(fd_, buffer, size, static_cast<off_t>(position));
+
+		RAISE_IO_ERROR_IF(readResult == -1, "Unable to read log file \"%s\": %s", fileName_, describeIoError());
+		RAISE_DATABASE_CORRUPTED_IF(static_cast<size_t>(readResult) != size, "log file \"%s\" is truncated: only %u of %u bytes read", fileName_, readResult, size);
+	}
+
+	void WriteAheadLog::writeFile(fileSize_t position, const std::string& data)
+	{
+		const ssize_t writeResult = ::pwrite(fd_, data.data(), data.size(), static_cast<off_t>(position));
+
+		RAISE_IO_ERROR_IF(writeResult == -1, "Unable to write to log file \"%s\": %s", fileName_, describeIoError());
+		RAISE_IO_ERROR_IF(static_cast<size_t>(writeResult) != data.size(), "Unable to write to log file \"%s\": only %u of %u bytes written", fileName_, writeResult, data.size());
+	}
+
+	void WriteAheadLog::truncateFile(fileSize_t size)
+	{
+		const int truncateResult = ::ftruncate(fd_, static_cast<off_t>(size));
+		RAISE_IO_ERROR_IF(truncateResult != 0, "Unable to truncate log file \"%s\": %s", fileName_, describeIoError());
+	}
+
+	void WriteAheadLog::syncFile()
+	{
+		const int syncResult = ::fsync(fd_);
+		RAISE_IO_ERROR_IF(syncResult != 0, "Unable to flush log file \"%s\": %s", fileName_, describeIoError());
+	}
+
+#endif
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -0,0 +1,119 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// WriteAheadLog.h - redo log of database page images.
+#pragma once
+#include <boost/unordered_map.hpp>
+#include "Page.h"
+
+namespace kerio {
+namespace hashdb {
+
+	// Write-ahead log keeps images of all pages written since the last checkpoint. Pages are appended
+	// to the log instead of being written to database files. Only positions of the latest images are kept
+	// in memory, logged pages are read back from the log file. A commit appends a commit record for the pages
+	// appended since the previous commit and writes them to the log file sequentially. The log file is synced 
+	// once per a group of commits. Database files are written only at a checkpoint, after which the log is
+	// truncated. When a database is opened, pages of all completely written commits are recovered from the log.
+	//
+	// Log record format (all fields are 32-bit):
+	//
+	// offset size field
+	//	0     4    magic number of the record (page image or commit)
+	//	4     4    page: database file type, commit: number of page images in the commit
+	//	8     4    page: page number, commit: MurmurHash3 of the records in the commit
+	//	12    4    page: page size, commit: commit sequence number
+	//	16    n    page: page image
+
+	class WriteAheadLog : boost::noncopyable {
+	public:
+		typedef uint64_t fileSize_t;
+
+		struct LoggedImage { // intentionally copyable
+			fileSize_t position_;	// Position of the image in the log, uncommitted images follow the committed size.
+			size_type size_;
+		};
+
+		typedef boost::unordered_map<PageId, LoggedImage> loggedImages_t;
+
+		static const uint32_t PAGE_RECORD_MAGIC   = 0x6c2a90d1;
+		static const uint32_t COMMIT_RECORD_MAGIC = 0x7b1de54c;
+		static const size_type RECORD_HEADER_SIZE = 16;
+
+		WriteAheadLog(const boost::filesystem::path& fileName, const Options& options, Environment& environment);
+		void close();
+		bool isClosed() const;
+		~WriteAheadLog();
+
+		// Logging.
+		void append(const Page& page);
+		void commit();
+		void sync();
+		void truncate();
+		fileSize_t size() const;
+
+		// Logged page images.
+		bool hasPage(const PageId& pageId) const;
+		size_type readPage(const PageId& pageId, uint8_t* buffer, size_type bufferSize);
+		void readImage(const LoggedImage& image, std::string& outImage);
+		const loggedImages_t& loggedImages() const;
+
+	private:
+		void recover();
+		void appendRecordHeader(uint32_t magic, uint32_t field1, uint32_t field2, uint32_t field3);
+
+		// Platform dependent file access.
+		void openFile(const boost::filesystem::path& fileName, bool readOnly);
+		void closeFile();
+		fileSize_t fileSize();
+		void readFile(std::string& outContents, fileSize_t size);
+		void readFile(fileSize_t position, char* buffer, size_type size);
+		void writeFile(fileSize_t position, const std::string& data);
+		void truncateFile(fileSize_t size);
+		void syncFile();
+
+	private:
+		const std::string fileName_;
+		const size_type groupSize_;
+
+		loggedImages_t loggedImages_;	// Latest images of logged pages, both committed and uncommitted.
+		std::string uncommittedRecords_;
+		size_type uncommittedPages_;
+		size_type unsyncedCommits_;
+		uint32_t commitSequence_;
+		fileSize_t size_;
+
+		Environment& environment_;
+
+#if defined _WIN32
+		HANDLE file_;
+#else
+		int fd_;
+#endif
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
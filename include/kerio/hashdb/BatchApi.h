@@ -79,6 +79,18 @@ namespace hashdb {
 		virtual ~IValueConsumer() { }
 	};
 
+	class IValueVisitor {
+	public:
+		// Visits a part of the fetched value. The part references database page memory which is valid only during the call,
+		// so that the value can be parsed in place without copying it. A value stored on a single database page is visited 
+		// at once, a large value is visited in page-sized parts in ascending order of their offsets. Returns true to continue
+		// with the next part, returns false to skip the rest of the value.
+		// The visitor is called with database locks held and it must not call the database.
+		virtual bool visit(const boost::string_ref& valuePart, size_t offset, size_t valueSize) = 0;
+
+		virtual ~IValueVisitor() { }
+	};
+
 	//------------------------------------------------------------------------
 	// Interface for the ReadBatch. It lets hashdb to read individual keys/part numbers 
 	// from the class and to write back individual values retrieved from the database.
@@ -0,0 +1,58 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+// BulkLoader.h -- fills an empty hashdb database with records in a single pass.
+#pragma once
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <kerio/hashdb/Types.h>
+#include <kerio/hashdb/BatchApi.h>
+
+namespace kerio {
+namespace hashdb {
+
+	class IBulkLoader
+	{
+	public:
+		// Adds a record containing the given key, partNum, and value. Records can be added in any order.
+		// If a key and partNum pair is added several times, the last added value is stored.
+		virtual void add(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value) = 0;
+
+		// Adds all records of the write batch.
+		virtual void add(const IWriteBatch& writeBatch) = 0;
+
+		// Writes all added records to the database. The loader cannot be used afterwards.
+		// Raises InvalidArgumentException if the database instance is no longer valid.
+		virtual void finish() = 0;
+
+		// Destroying an unfinished loader discards the added records.
+		virtual ~IBulkLoader() { }
+	};
+
+	typedef boost::shared_ptr<IBulkLoader> BulkLoader;
+
+}; // namespace hashdb
+}; // namespace kerio
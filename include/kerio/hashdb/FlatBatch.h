@@ -0,0 +1,167 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// FlatBatch.h -- batch of keys, part numbers and values stored in contiguous buffers.
+//
+// The flat batch can be passed to the db->fetch(flatBatch), db->store(flatBatch) and db->remove(flatBatch) methods
+// as an alternative to user-defined batch classes (see BatchApi.h). The database walks its arrays directly, so that
+// no virtual call and no copy of a key or a value is made for each item of the batch. Values fetched by the batch are
+// appended to a single result buffer.
+
+#pragma once
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include <kerio/hashdb/Types.h>
+
+namespace kerio {
+namespace hashdb {
+
+	class FlatBatch { // intentionally copyable
+	public:
+		static const size_type NOT_FOUND = 0xffffffff;
+
+		void reserve(size_t elements, size_t keyBytes = 0, size_t valueBytes = 0)
+		{
+			keyOffsets_.reserve(elements);
+			keySizes_.reserve(elements);
+			partNums_.reserve(elements);
+			valueOffsets_.reserve(elements);
+			valueSizes_.reserve(elements);
+			keys_.reserve(keyBytes);
+			values_.reserve(valueBytes);
+		}
+
+		// Adds a key and a part number to be fetched or removed.
+		void add(const boost::string_ref& key, partNum_t partNum)
+		{
+			add(key, partNum, boost::string_ref());
+		}
+
+		// Adds a key, a part number and a value to be stored.
+		void add(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value)
+		{
+			keyOffsets_.push_back(static_cast<size_type>(keys_.size()));
+			keySizes_.push_back(static_cast<size_type>(key.size()));
+			keys_.append(key.data(), key.size());
+
+			partNums_.push_back(partNum);
+
+			valueOffsets_.push_back(static_cast<size_type>(values_.size()));
+			valueSizes_.push_back(static_cast<size_type>(value.size()));
+			values_.append(value.data(), value.size());
+		}
+
+		void clear()
+		{
+			keys_.clear();
+			keyOffsets_.clear();
+			keySizes_.clear();
+			partNums_.clear();
+			values_.clear();
+			valueOffsets_.clear();
+			valueSizes_.clear();
+			clearResults();
+		}
+
+		size_t count() const
+		{
+			return partNums_.size();
+		}
+
+		bool empty() const
+		{
+			return partNums_.empty();
+		}
+
+		boost::string_ref keyAt(size_t index) const
+		{
+			return boost::string_ref(keys_.data() + keyOffsets_[index], keySizes_[index]);
+		}
+
+		partNum_t partNumAt(size_t index) const
+		{
+			return partNums_[index];
+		}
+
+		boost::string_ref valueAt(size_t index) const
+		{
+			return boost::string_ref(values_.data() + valueOffsets_[index], valueSizes_[index]);
+		}
+
+		//------------------------------------------------------------------------
+		// Results of the fetch.
+
+		// Returns true if the value at the given index was fetched.
+		bool isFound(size_t index) const
+		{
+			return index < resultOffsets_.size() && resultOffsets_[index] != NOT_FOUND;
+		}
+
+		// Returns the fetched value at the given index. The reference is valid until the batch is modified.
+		boost::string_ref resultAt(size_t index) const
+		{
+			return (isFound(index))? boost::string_ref(results_.data() + resultOffsets_[index], resultSizes_[index]) : boost::string_ref();
+		}
+
+		// Called by the database before the fetch.
+		void clearResults()
+		{
+			results_.clear();
+			resultOffsets_.assign(count(), static_cast<size_type>(NOT_FOUND));
+			resultSizes_.assign(count(), 0);
+		}
+
+		// Called by the database for each part of the fetched value at the given index. Parts of a single value are appended
+		// one after another.
+		void appendResultAt(size_t index, const boost::string_ref& valuePart)
+		{
+			if (resultOffsets_[index] == NOT_FOUND) {
+				resultOffsets_[index] = static_cast<size_type>(results_.size());
+			}
+
+			results_.append(valuePart.data(), valuePart.size());
+			resultSizes_[index] += static_cast<size_type>(valuePart.size());
+		}
+
+	private:
+		std::string keys_;
+		std::vector<size_type> keyOffsets_;
+		std::vector<size_type> keySizes_;
+		std::vector<partNum_t> partNums_;
+
+		std::string values_;
+		std::vector<size_type> valueOffsets_;
+		std::vector<size_type> valueSizes_;
+
+		std::string results_;
+		std::vector<size_type> resultOffsets_;
+		std::vector<size_type> resultSizes_;
+	};
+
+}; // namespace hashdb
+}; // namespace kerio
@@ -49,7 +49,9 @@
 #include <kerio/hashdb/Options.h>
 #include <kerio/hashdb/Types.h>
 #include <kerio/hashdb/BatchApi.h>
+#include <kerio/hashdb/FlatBatch.h>
 #include <kerio/hashdb/Iterator.h>
+#include <kerio/hashdb/BulkLoader.h>
 #include <kerio/hashdb/Statistics.h>
 
 namespace kerio {
@@ -96,6 +98,10 @@ namespace hashdb {
 		// Otherwise the method returns false.
 		virtual bool fetch(const boost::string_ref& key, partNum_t partNum, std::string& value) = 0;
 
+		// Fetches the value associated with the given key and partNum from the database and passes it to the visitor
+		// without copying it (see IValueVisitor). Returns true if the value is found, returns false otherwise.
+		virtual bool fetch(const boost::string_ref& key, partNum_t partNum, IValueVisitor& visitor) = 0;
+
 		// Stores a record containing the given key, partNum, and value into the database.
 		virtual	void store(const boost::string_ref& key, partNum_t partNum, const boost::string_ref& value) = 0;
 		
@@ -122,6 +128,16 @@ namespace hashdb {
 		// Performs a batch delete.
 		virtual void remove(const IDeleteBatch& deleteBatch) = 0;
 
+		// Performs a batch read of a flat batch. Fetched values are stored to the batch (see FlatBatch::resultAt()). 
+		// Returns true if all values were found.
+		virtual bool fetch(FlatBatch& flatBatch) = 0;
+
+		// Performs a batch write of a flat batch.
+		virtual void store(const FlatBatch& flatBatch) = 0;
+
+		// Performs a batch delete of a flat batch.
+		virtual void remove(const FlatBatch& flatBatch) = 0;
+
 		//------------------------------------------------------------------------
 		// Iterator API.
 	public:
@@ -129,6 +145,24 @@ namespace hashdb {
 		// iterator at a time.
 		virtual Iterator newIterator() = 0;
 
+		//------------------------------------------------------------------------
+		// Bulk load API.
+	public:
+		// Creates a new bulk loader which fills the empty database open for writing. The expected
+		// number of records is used to choose the number of buckets before the records are sorted 
+		// to buckets. The database cannot be modified by other methods until the loader is finished
+		// or destroyed.
+		virtual BulkLoader newBulkLoader(uint64_t expectedNumberOfRecords) = 0;
+
+		//------------------------------------------------------------------------
+		// Compaction.
+	public:
+		// Moves pages from the end of the overflow file to free pages before them and truncates the file.
+		// Each call visits approximately maxPages pages (0 means no limit), so that the compaction can be 
+		// interleaved with other requests. Returns true when the compaction pass is finished and the file
+		// was truncated. Another call starts a new pass.
+		virtual bool compact(size_t maxPages) = 0;
+
 		//------------------------------------------------------------------------
 		// Statistics.
 	public:
@@ -48,6 +48,30 @@ namespace hashdb {
 		virtual ~ILogger() { }
 	};
 
+	//-------------------------------------------------------------------------
+	// Buffer pool shared by database instances in a process.
+	//
+	// Instances opened with the same buffer pool share its memory budget for cached pages.
+	// Each instance can always cache up to its soft quota and never more than its hard quota.
+	// When the pool is exhausted, an instance needing a page takes back the least recently used
+	// pages from another idle instance which holds more than its soft quota.
+
+	class IBufferPool
+	{
+	public:
+		// Returns the maximum number of bytes held by all instances using the pool.
+		virtual size_type maximumBytes() = 0;
+
+		// Returns the number of bytes currently held by all instances using the pool.
+		virtual size_type heldBytes() = 0;
+
+		virtual ~IBufferPool() { }
+	};
+
+	typedef boost::shared_ptr<IBufferPool> BufferPool;
+
+	BufferPool BufferPoolFactory(size_type maximumBytes);
+
 	//-------------------------------------------------------------------------
 	// Options for database open.
 
@@ -61,20 +85,56 @@ namespace hashdb {
 		static Options readWriteSingleThreaded(boost::shared_ptr<ILogger> logger);
 		static Options readWriteSingleThreaded();	
 
+		// Open database read-write for concurrent requests from multiple threads.
+		static Options readWriteMultiThreaded(boost::shared_ptr<ILogger> logger);
+		static Options readWriteMultiThreaded();
+
 		void validate() const;
 		uint32_t computeTestHash() const;
 
 		typedef uint32_t (*hashFun_t)(const char* key, size_t len);
 
+		// Built-in hash functions. The identifier of the function is recorded in a new database,
+		// which is then always opened with that function regardless of hashFun_.
+		enum HashFunction_t
+		{
+			CustomHashFunctionType = 0,		// Hash function which is not built-in. The database must be opened with the same hashFun_.
+			Murmur3HashFunctionType = 1,	// MurmurHash3_x86_32 (murmur3Hash).
+			WyHashFunctionType = 2			// 64-bit wyhash folded to 32 bits, several times faster than MurmurHash3 on short keys.
+		};
+
+		// Returns the built-in hash function of the given type, or NULL for CustomHashFunctionType and unknown types.
+		static hashFun_t builtInHashFunction(HashFunction_t hashFunctionType);
+
+		// Returns the type of hashFun_, or CustomHashFunctionType if it is not built-in.
+		HashFunction_t hashFunctionType() const;
+
 		bool createIfMissing_;				// Database is created if not found. The default for R/W instances is "true".
 		bool readOnly_;						// Database files are opened read only. The default for R/W instances is  "false".
+		bool mapFiles_;						// Database files opened read only are accessed through a memory mapping instead of reads, only by single-threaded instances. The default for R/O instances is "true".
 		size_type pageSize_;				// Page size, must be a power of 2 between MIN_PAGE_SIZE and MAX_PAGE_SIZE. Default is 4K (sector size of 1st gen Advanced Format HDD's).
 		size_type memoryPoolBytes_;			// Private memory pool bytes to be kept by the instance's page allocator. Default is 16K.
+		size_type pageCacheBytes_;			// Bytes of bucket and overflow pages cached by the instance across requests. Default is 64K.
+		size_type keyFilterBytes_;			// Bytes of the in-memory filter of stored keys, which answers most fetches of missing keys without reading pages (0 means no filter). The filter is saved to a side file (.dbf) on close. Without a valid side file, open does not scan the database, each fetch scans one bucket until the filter is complete. Default is 0.
+		size_type recordCacheBytes_;		// Bytes of inline values of recently fetched records cached by the instance, so hot records are fetched without searching the pages (0 means no cache). Default is 0.
+
+		// Shared buffer pool.
+		BufferPool bufferPool_;				// Buffer pool shared with other instances. If set, it limits the page cache instead of pageCacheBytes_. Default is none.
+		size_type bufferPoolSoftQuota_;		// Bytes of the shared buffer pool that the instance can always use. Default is 16K.
+		size_type bufferPoolHardQuota_;		// Maximum bytes of the shared buffer pool used by the instance (0 means no limit). Default is 0.
 		size_type initialBuckets_;			// Initial number of buckets when a new database is created. Default is 1.
-		hashFun_t hashFun_;					// Hash function. Default is murmur3Hash (adapter for MurmurHash3).
+		hashFun_t hashFun_;					// Hash function of new databases (see builtInHashFunction()). Default is murmur3Hash (adapter for MurmurHash3).
 		int32_t leavePageFreeSpace_;		// Positive or negative correction to the computed fill factor used for performance testing. Default is 0.
 		size_type largeValuesPerKey_;		// Number of large value parts expected to be stored for a single key. Default is 1.
 		size_type minFlushFrequency_;		// Minimum number of write requests after which the metadata is flushed. Default is 20.
+		size_type splitPagesPerStore_;		// Pages of the bucket being split whose records are moved to the new bucket by a single store (0 means that a bucket is split at once). Default is 0.
+		size_type mergeFillPercent_;		// The highest bucket is merged when the fill after the merge would be below the percentage of the split threshold, at most 50 (0 means that buckets are never merged). Default is 0.
+		size_type bulkLoadBufferBytes_;		// Bytes of records kept in memory by a bulk loader before they are sorted to a temporary run file (.dbr). Default is 32 MB.
+
+		// Write-ahead log.
+		bool writeAheadLog_;				// Written pages are logged to a redo log (.dbl) and written to database files only at checkpoints. Default is "false".
+		size_type writeAheadLogGroupSize_;	// Number of store/remove requests committed to the log by a single log file sync. Default is 1.
+		size_type writeAheadLogCheckpointBytes_; // Log size after which logged pages are written to database files and the log is truncated. Default is 4 MB.
 
 		// Store and fetch limits.
 		size_type storeThrowIfLargerThan_;	// Attempt to store a value larger than the limit causes exception ValueTooLarge (0 means no limit). The default limit is 20 MB.
@@ -85,7 +145,7 @@ namespace hashdb {
 			NullLockManagerType,			// "Null" lock manager that does nothing.
 			TrueLockManagerType				// Actual implementation of the lock manager interface.
 		};
-		LockManager_t lockManagerType_;		// Lock manager type. The default for single-threaded instances is NullLockManagerType.
+		LockManager_t lockManagerType_;		// Lock manager type. The default for single-threaded instances is NullLockManagerType, for multi-threaded ones TrueLockManagerType.
 
 		enum PageAllocator_t
 		{
@@ -93,7 +153,7 @@ namespace hashdb {
 			SingleThreadedPageAllocatorType,// Efficient single-threaded page allocator.
 			LockFreePageAllocatorType		// Lock-free page allocator for multi-threaded environments.
 		};
-		PageAllocator_t pageAllocatorType_; // Page allocator type. The default for single-threaded instances is SingleThreadedPageAllocatorType.
+		PageAllocator_t pageAllocatorType_; // Page allocator type. The default for single-threaded instances is SingleThreadedPageAllocatorType, for multi-threaded ones LockFreePageAllocatorType.
 
 		boost::shared_ptr<ILogger> logger_; // Logger. Default is NullLogger.
 
@@ -48,9 +48,17 @@ namespace hashdb {
 		size_type overflowPagesReleased_;
 		size_type largeValuePagesReleased_;
 		size_type bitmapPagesReleased_;
+		size_type bitmapPagesRead_;
 
 		size_type splitsOnOverfill_;
+		size_type overflowPagesRelocated_;
 		size_type cachedPages_;
+		size_type pageCacheHits_;
+		size_type pageCacheMisses_;
+		size_type pageCacheEvictions_;
+		size_type keyFilterRejects_;
+		size_type recordCacheHits_;
+		size_type recordCacheMisses_;
 
 		// Database statistics.
 		size_type pageSize_;
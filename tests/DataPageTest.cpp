@@ -27,6 +27,7 @@
 #include "stdafx.h"
 #include <kerio/hashdb/Constants.h>
 #include "utils/ConfigUtils.h"
+#include "utils/MurmurHash3Adapter.h"
 #include "testUtils/TestPageAllocator.h"
 #include "testUtils/StringUtils.h"
 #include "db/BucketDataPage.h"
@@ -100,24 +101,30 @@ void DataPageTest::testMaxRecordId()
 
 namespace {
 
+	uint32_t keyHashFor(const boost::string_ref& key)
+	{
+		return murmur3Hash(key.data(), key.size());
+	}
+
 	void initializeAndValidateBucketPage(BucketDataPage& bucketPage)
 	{
 		bucketPage.setUp(122345689);
 		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
 
-		const size_type currentMaxValueSize = bucketPage.freeSpace() - sizeof(uint16_t); // free space - record pointer (2)
+		const size_type currentMaxValueSize = bucketPage.freeSpace() - 6; // free space - record offset (2) and key hash (4)
 		const size_type largestPossibleValue = bucketPage.largestPossibleInlineRecordSize();
 		TS_ASSERT_EQUALS(currentMaxValueSize, largestPossibleValue);
-		TS_ASSERT_EQUALS(currentMaxValueSize, (bucketPage.size() - 22));
+		TS_ASSERT_EQUALS(currentMaxValueSize, (bucketPage.size() - 26));
 
 		uint8_t expectedEmptyPageHeader[] = {
-			0x43, 0xd9, 0x19, 0x2e, // 0: page type magic number - 0x2e19d943 = bucket data page
+			0xa7, 0x93, 0x5e, 0x1c, // 0: page type magic number - 0x1c5e93a7 = hashed bucket data page
 			0xff, 0xff, 0xff, 0xff, // 4: checksum - 0xffffffff = not implemented
 			0xd9, 0xd8, 0x4a, 0x07,	// 8: page number = 0x074ad8d9
 			0, 0, 0, 0,				// 12: next overflow page number = 0
 			0, 0,					// 16: number of records on the page = 0
 			0, 0,					// 18: end of free area
-			0, 0					// 20: key/value offset 0
+			0, 0,					// 20: key/value offset 0
+			0, 0, 0, 0				// 22: key hash 0
 		};
 
 		// Fill end of free area.
@@ -142,7 +149,7 @@ namespace {
 
 		DataPageCursor cursor(&bucketPage);
 		TS_ASSERT(! cursor.isValid());
-		TS_ASSERT(! cursor.find(RecordId("x", 0)));
+		TS_ASSERT(! cursor.find(RecordId("x", 0), keyHashFor("x")));
 
 		bucketPage.clearDirtyFlag();
 	}
@@ -175,20 +182,22 @@ namespace {
 
 		RecordId recordId(recordKey, recordPart);
 		DataPage::AddedValueRef valueRef("");
-		const size_type addedSize = bucketPage.addSingleRecord(recordId, valueRef);
+		const size_type addedSize = bucketPage.addSingleRecord(recordId, keyHashFor(recordId.key()), valueRef);
 		TS_ASSERT_EQUALS(recordId.recordOverheadSize(), addedSize);
 		TS_ASSERT(cursor.isValid());
 
 		const size_type RECORD_SIZE = 5; // len (1) + key (1) + part number (1) + value size (2) + value (0)
 		const size_type KEY_INDEX = pageSize - RECORD_SIZE;
+		const uint32_t keyHash = keyHashFor(recordKey);
 		uint8_t expectedSinglePageHeader[] = {
-			0x43, 0xd9, 0x19, 0x2e, // 0: page type magic number - 0x2e19d943 = bucket data page
+			0xa7, 0x93, 0x5e, 0x1c, // 0: page type magic number - 0x1c5e93a7 = hashed bucket data page
 			0xff, 0xff, 0xff, 0xff, // 4: checksum - 0xffffffff = not implemented
 			0xd9, 0xd8, 0x4a, 0x07,	// 8: page number = 0x074ad8d9
 			0, 0, 0, 0,				// 12: next overflow page number = 0
 			1, 0,					// 16: number of records on the page = 1
 			static_cast<uint8_t>(KEY_INDEX), static_cast<uint8_t>(KEY_INDEX >> 8), // 18: end of free area
-			static_cast<uint8_t>(KEY_INDEX), static_cast<uint8_t>(KEY_INDEX >> 8)  // 20: key/value offset 0
+			static_cast<uint8_t>(KEY_INDEX), static_cast<uint8_t>(KEY_INDEX >> 8), // 20: key/value offset 0
+			static_cast<uint8_t>(keyHash), static_cast<uint8_t>(keyHash >> 8), static_cast<uint8_t>(keyHash >> 16), static_cast<uint8_t>(keyHash >> 24) // 22: key hash 0
 		};
 
 		TS_ASSERT_SAME_DATA(expectedSinglePageHeader, bucketPage.constData(), sizeof(expectedSinglePageHeader));
@@ -212,7 +221,7 @@ namespace {
 		TS_ASSERT_EQUALS(0U, cursor.inlineValue().size());
 
 		// Find the record using the cursor.
-		TS_ASSERT(cursor.find(recordId));
+		TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
 		TS_ASSERT(cursor.isValid());
 		TS_ASSERT(cursor.isInlineValue());
 		TS_ASSERT_EQUALS(3U, cursor.recordIdValue().size());
@@ -260,7 +269,7 @@ void DataPageTest::testAddMultipleSmallRecords()
 
 			RecordId recordId(key, recordNumber);
 			DataPage::AddedValueRef valueRef(value);
-			const size_type addedSize = bucketPage.addSingleRecord(recordId, valueRef);
+			const size_type addedSize = bucketPage.addSingleRecord(recordId, keyHashFor(recordId.key()), valueRef);
 
 			if (addedSize == 0) {
 				break;
@@ -272,7 +281,7 @@ void DataPageTest::testAddMultipleSmallRecords()
 			endOfFreeArea -= 4 + (2 * recordNumber); // len (1) + part num (1) + value size (2) + key + value
 
 			DataPageCursor cursor(&bucketPage);
-			TS_ASSERT(cursor.find(recordId));
+			TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
 			TS_ASSERT(cursor.isValid());
 			TS_ASSERT_EQUALS(key, cursor.key());
 			TS_ASSERT_EQUALS(recordNumber, cursor.partNum());
@@ -284,11 +293,11 @@ void DataPageTest::testAddMultipleSmallRecords()
 		TS_ASSERT_EQUALS(recordsAdded, bucketPage.getNumberOfRecords());
 
 		uint8_t expectedMultiRecordPageHeader[] = {
-			0x43, 0xd9, 0x19, 0x2e, // 0: page type magic number - 0x2e19d943 = bucket data page
+			0xa7, 0x93, 0x5e, 0x1c, // 0: page type magic number - 0x1c5e93a7 = hashed bucket data page
 			0xff, 0xff, 0xff, 0xff, // 4: checksum - 0xffffffff = not implemented
 			0xd9, 0xd8, 0x4a, 0x07,	// 8: page number = 0x074ad8d9
 			0, 0, 0, 0,				// 12: next overflow page number = 0
-			28, 0					// 16: number of records on the page = 28
+			26, 0					// 16: number of records on the page = 26
 		};
 
 		TS_ASSERT_SAME_DATA(expectedMultiRecordPageHeader, bucketPage.constData(), sizeof(expectedMultiRecordPageHeader));
@@ -302,7 +311,7 @@ void DataPageTest::testAddMultipleSmallRecords()
 
 			RecordId recordId(expectedKey, recordNumber);
 			DataPageCursor cursor(&bucketPage);
-			TS_ASSERT(cursor.find(recordId));
+			TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
 			TS_ASSERT(cursor.isValid());
 			TS_ASSERT(cursor.isInlineValue());
 
@@ -332,7 +341,7 @@ namespace {
 
 		RecordId recordId(key, static_cast<partNum_t>(n));
 		DataPage::AddedValueRef valueRef(value);
-		const size_type addedSize = bucketPage.addSingleRecord(recordId, valueRef);
+		const size_type addedSize = bucketPage.addSingleRecord(recordId, keyHashFor(recordId.key()), valueRef);
 		bool success = (addedSize != 0);
 
 		if (success) {
@@ -350,7 +359,7 @@ namespace {
 		RecordId recordId(key, static_cast<partNum_t>(n));
 		DataPageCursor cursor(&bucketPage);
 
-		TS_ASSERT(cursor.find(recordId));
+		TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
 		TS_ASSERT_EQUALS(key, cursor.key());
 		TS_ASSERT_EQUALS(static_cast<partNum_t>(n), cursor.partNum());
 		TS_ASSERT_EQUALS(value, cursor.inlineValue());
@@ -358,7 +367,7 @@ namespace {
 		bucketPage.deleteSingleRecord(cursor);
 
 		cursor.reset();
-		TS_ASSERT(! cursor.find(recordId));
+		TS_ASSERT(! cursor.find(recordId, keyHashFor(recordId.key())));
 	}
 
 	void findAndValidateRecordOfValueSize(BucketDataPage& bucketPage, size_t n)
@@ -369,7 +378,7 @@ namespace {
 		RecordId recordId(key, static_cast<partNum_t>(n));
 		DataPageCursor cursor(&bucketPage);
 
-		TS_ASSERT(cursor.find(recordId));
+		TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
 		TS_ASSERT_EQUALS(key, cursor.key());
 		TS_ASSERT_EQUALS(static_cast<partNum_t>(n), cursor.partNum());
 		TS_ASSERT_EQUALS(value, cursor.inlineValue());
@@ -394,7 +403,7 @@ void DataPageTest::testDeleteLastRecords()
 
 		const RecordId firstRecordId(firstKey, firstPartNum);
 		DataPage::AddedValueRef firstValueRef(firstValue);
-		const size_type firstAddedSize = bucketPage.addSingleRecord(firstRecordId, firstValueRef);
+		const size_type firstAddedSize = bucketPage.addSingleRecord(firstRecordId, keyHashFor(firstRecordId.key()), firstValueRef);
 
 		TS_ASSERT_EQUALS(firstRecordId.recordOverheadSize() + firstValue.size(), firstAddedSize);
 
@@ -428,7 +437,7 @@ void DataPageTest::testDeleteLastRecords()
 		const partNum_t lastPartNum = 0;
 		const RecordId lastRecordId(lastKey, lastPartNum);
 
-		const size_type lastPossibleRecordSize = bucketPage.freeSpace() - sizeof(uint16_t); // free space - record pointer (2)
+		const size_type lastPossibleRecordSize = bucketPage.freeSpace() - 6; // free space - record offset (2) and key hash (4)
 		const size_type lastRecordOverhead = lastRecordId.size() + sizeof(uint16_t);
 		TS_ASSERT_EQUALS(lastRecordOverhead, lastRecordId.recordOverheadSize());
 		TS_ASSERT(lastPossibleRecordSize > lastRecordOverhead);
@@ -438,13 +447,13 @@ void DataPageTest::testDeleteLastRecords()
 		TS_ASSERT_EQUALS(lastPossibleRecordSize, lastRecordOverhead + lastValueSize);
 
 		DataPage::AddedValueRef lastValueRef(lastValue);
-		const size_type lastAddedSize = bucketPage.addSingleRecord(lastRecordId, lastValueRef);
+		const size_type lastAddedSize = bucketPage.addSingleRecord(lastRecordId, keyHashFor(lastRecordId.key()), lastValueRef);
 
 		TS_ASSERT_EQUALS(lastRecordId.recordOverheadSize() + lastValue.size(), lastAddedSize);
 		TS_ASSERT_EQUALS(0U, bucketPage.freeSpace());
 
 		DataPageCursor lastCursor(&bucketPage);
-		TS_ASSERT(lastCursor.find(lastRecordId));
+		TS_ASSERT(lastCursor.find(lastRecordId, keyHashFor(lastRecordId.key())));
 		TS_ASSERT_EQUALS(lastRecordOverhead, lastCursor.recordOverheadSize());
 		TS_ASSERT_EQUALS(lastKey, lastCursor.key());
 		TS_ASSERT_EQUALS(lastPartNum, lastCursor.partNum());
@@ -582,18 +591,18 @@ namespace {
 		const std::string oversizedValue = value + " ";
 
 		const DataPage::AddedValueRef oversizedValueRef(oversizedValue);
-		const size_type addOversizedResult = bucketPage.addSingleRecord(recordId, oversizedValueRef);
+		const size_type addOversizedResult = bucketPage.addSingleRecord(recordId, keyHashFor(recordId.key()), oversizedValueRef);
 		TS_ASSERT_EQUALS(0U, addOversizedResult);
 
 
 		const DataPage::AddedValueRef valueRef(value);
-		const size_type addResult = bucketPage.addSingleRecord(recordId, valueRef);
+		const size_type addResult = bucketPage.addSingleRecord(recordId, keyHashFor(recordId.key()), valueRef);
 		TS_ASSERT_EQUALS(recordId.recordOverheadSize() + value.size(), addResult);
 		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
 
 		DataPageCursor cursor(&bucketPage);
 
-		TS_ASSERT(cursor.find(recordId));
+		TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
 		TS_ASSERT_EQUALS("a", cursor.key());
 		TS_ASSERT_EQUALS(22u, cursor.partNum());
 		TS_ASSERT_EQUALS(value, cursor.inlineValue());
@@ -601,7 +610,7 @@ namespace {
 		bucketPage.deleteSingleRecord(cursor);
 
 		cursor.reset();
-		TS_ASSERT(! cursor.find(recordId));
+		TS_ASSERT(! cursor.find(recordId, keyHashFor(recordId.key())));
 		TS_ASSERT_EQUALS(0, bucketPage.getNumberOfRecords());
 		TS_ASSERT_EQUALS(bucketPage.size(), bucketPage.getEndOfFreeArea());
 		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
@@ -618,6 +627,168 @@ void DataPageTest::testDeleteSingleLargeItem()
 	TS_ASSERT(allocator_->allFreed());
 }
 
+//=============================================================================
+// Testing replacing records in place.
+
+namespace {
+
+	void replaceRecordValue(BucketDataPage& bucketPage, size_t n, const std::string& newValue, bool expectedSuccess)
+	{
+		const std::string key = keyOfSize(n + 1);
+		RecordId recordId(key, static_cast<partNum_t>(n));
+		DataPageCursor cursor(&bucketPage);
+		TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
+
+		const size_type freeSpaceBefore = bucketPage.freeSpace();
+		const size_type oldRecordSize = DataPage::recordInlineSize(cursor);
+		const size_type replacedSize = bucketPage.replaceSingleRecord(cursor, recordId, DataPage::AddedValueRef(newValue));
+
+		if (expectedSuccess) {
+			TS_ASSERT_EQUALS(recordId.recordOverheadSize() + newValue.size(), replacedSize);
+			TS_ASSERT_EQUALS(freeSpaceBefore + oldRecordSize, bucketPage.freeSpace() + replacedSize);
+
+			cursor.reset();
+			TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
+			TS_ASSERT_EQUALS(newValue, cursor.inlineValue());
+		}
+		else {
+			TS_ASSERT_EQUALS(0U, replacedSize);
+			TS_ASSERT_EQUALS(freeSpaceBefore, bucketPage.freeSpace());
+		}
+
+		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
+	}
+
+};
+
+void DataPageTest::testReplaceRecords()
+{
+	{
+		const size_type pageSize = defaultPageSize();
+		BucketDataPage bucketPage(allocator_.get(), pageSize);
+		TS_ASSERT_THROWS_NOTHING(initializeAndValidateBucketPage(bucketPage));
+
+		const unsigned numberOfRecords = 10;
+		for (unsigned recordNumber = 0; recordNumber < numberOfRecords; ++recordNumber) {
+			TS_ASSERT(addRecordOfValueSize(bucketPage, recordNumber));
+		}
+
+		// Same size, smaller and larger value of a record in the middle, the first and the last record.
+		const unsigned replacedRecords[] = { 5, 0, numberOfRecords - 1 };
+
+		for (size_t i = 0; i < sizeof(replacedRecords) / sizeof(replacedRecords[0]); ++i) {
+			const unsigned replaced = replacedRecords[i];
+
+			TS_ASSERT_THROWS_NOTHING(replaceRecordValue(bucketPage, replaced, std::string(replaced, 'S'), true));
+			TS_ASSERT_THROWS_NOTHING(replaceRecordValue(bucketPage, replaced, std::string(), true));
+			TS_ASSERT_THROWS_NOTHING(replaceRecordValue(bucketPage, replaced, std::string(100, 'L'), true));
+
+			// A value larger than the free space is not replaced.
+			TS_ASSERT_THROWS_NOTHING(replaceRecordValue(bucketPage, replaced, std::string(bucketPage.freeSpace() + 101, 'X'), false));
+
+			for (unsigned recordNumber = 0; recordNumber < numberOfRecords; ++recordNumber) {
+				if (recordNumber != replaced) {
+					TS_ASSERT_THROWS_NOTHING(findAndValidateRecordOfValueSize(bucketPage, recordNumber));
+				}
+			}
+
+			TS_ASSERT_THROWS_NOTHING(replaceRecordValue(bucketPage, replaced, valueOfSize(replaced), true));
+		}
+
+		// Records can still be deleted.
+		for (unsigned recordNumber = 0; recordNumber < numberOfRecords; ++recordNumber) {
+			TS_ASSERT_THROWS_NOTHING(deleteRecordOfValueSize(bucketPage, recordNumber));
+		}
+
+		TS_ASSERT_EQUALS(0, bucketPage.getNumberOfRecords());
+		TS_ASSERT_EQUALS(bucketPage.size(), bucketPage.getEndOfFreeArea());
+
+		bucketPage.clearDirtyFlag();
+	}
+
+	TS_ASSERT(allocator_->allFreed());
+}
+
+void DataPageTest::testDeadRecords()
+{
+	{
+		const size_type pageSize = defaultPageSize();
+		BucketDataPage bucketPage(allocator_.get(), pageSize);
+		TS_ASSERT_THROWS_NOTHING(initializeAndValidateBucketPage(bucketPage));
+
+		unsigned numberOfRecords = 0;
+		while (addRecordOfValueSize(bucketPage, numberOfRecords)) {
+			++numberOfRecords;
+		}
+
+		// Marking records dead moves nothing.
+		const size_type freeSpace = bucketPage.freeSpace();
+		const size_type endOfFreeArea = bucketPage.getEndOfFreeArea();
+
+		for (unsigned recordNumber = 0; recordNumber < numberOfRecords; recordNumber += 2) {
+			RecordId recordId(keyOfSize(recordNumber + 1), static_cast<partNum_t>(recordNumber));
+			DataPageCursor cursor(&bucketPage);
+
+			TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
+			TS_ASSERT_EQUALS(recordId.recordOverheadSize() + recordNumber, bucketPage.markRecordDead(cursor));
+		}
+
+		TS_ASSERT(bucketPage.hasDeadRecords());
+		TS_ASSERT_EQUALS(numberOfRecords, bucketPage.getNumberOfRecords());
+		TS_ASSERT_EQUALS(freeSpace, bucketPage.freeSpace());
+		TS_ASSERT_EQUALS(endOfFreeArea, bucketPage.getEndOfFreeArea());
+
+		// Cursors skip dead records.
+		unsigned liveRecords = 0;
+		for (DataPageCursor cursor(&bucketPage); cursor.isValid(); cursor.next()) {
+			TS_ASSERT_EQUALS(1U, cursor.partNum() % 2);
+			++liveRecords;
+		}
+
+		TS_ASSERT_EQUALS(numberOfRecords / 2, liveRecords);
+
+		for (unsigned recordNumber = 0; recordNumber < numberOfRecords; ++recordNumber) {
+			RecordId recordId(keyOfSize(recordNumber + 1), static_cast<partNum_t>(recordNumber));
+			DataPageCursor cursor(&bucketPage);
+			TS_ASSERT_EQUALS(recordNumber % 2 == 1, cursor.find(recordId, keyHashFor(recordId.key())));
+
+			DataPageCursor keyCursor(&bucketPage);
+			TS_ASSERT_EQUALS(recordNumber % 2 == 1, keyCursor.find(recordId.key(), keyHashFor(recordId.key())));
+		}
+
+		// A record which does not fit to the free space compacts the page.
+		const RecordId largeRecordId("large", 0);
+		const std::string largeValue = valueOfSize(freeSpace + 100);
+		TS_ASSERT_DIFFERS(0U, bucketPage.addSingleRecord(largeRecordId, keyHashFor(largeRecordId.key()), DataPage::AddedValueRef(largeValue)));
+		TS_ASSERT(! bucketPage.hasDeadRecords());
+		TS_ASSERT_EQUALS(liveRecords + 1, bucketPage.getNumberOfRecords());
+		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
+
+		for (unsigned recordNumber = 1; recordNumber < numberOfRecords; recordNumber += 2) {
+			TS_ASSERT_THROWS_NOTHING(findAndValidateRecordOfValueSize(bucketPage, recordNumber));
+		}
+
+		DataPageCursor largeCursor(&bucketPage);
+		TS_ASSERT(largeCursor.find(largeRecordId, keyHashFor(largeRecordId.key())));
+		TS_ASSERT_EQUALS(largeValue, largeCursor.inlineValue());
+
+		// Explicit compaction of a page whose records are all dead.
+		for (DataPageCursor cursor(&bucketPage); cursor.isValid(); cursor.next()) {
+			bucketPage.markRecordDead(cursor);
+		}
+
+		TS_ASSERT(! DataPageCursor(&bucketPage).isValid());
+		TS_ASSERT_THROWS_NOTHING(bucketPage.compactRecords());
+		TS_ASSERT_EQUALS(0, bucketPage.getNumberOfRecords());
+		TS_ASSERT_EQUALS(bucketPage.size(), bucketPage.getEndOfFreeArea());
+		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
+
+		bucketPage.clearDirtyFlag();
+	}
+
+	TS_ASSERT(allocator_->allFreed());
+}
+
 //=============================================================================
 // Test OverflowPage.
 
@@ -630,13 +801,13 @@ namespace {
 		overflowPage.setUp(122345689);
 		TS_ASSERT_THROWS_NOTHING(overflowPage.validate());
 
-		const size_type currentMaxValueSize = overflowPage.freeSpace() - sizeof(uint16_t); // free space - record pointer (2)
+		const size_type currentMaxValueSize = overflowPage.freeSpace() - 6; // free space - record offset (2) and key hash (4)
 		const size_type largestPossibleValue = overflowPage.largestPossibleInlineRecordSize();
 		TS_ASSERT_EQUALS(currentMaxValueSize, largestPossibleValue);
-		TS_ASSERT_EQUALS(currentMaxValueSize, (overflowPage.size() - 22));
+		TS_ASSERT_EQUALS(currentMaxValueSize, (overflowPage.size() - 26));
 
 		uint8_t expectedEmptyPageHeader[] = {
-			0x97, 0xf2, 0xe2, 0x35, // 0: page type magic number - 0x35e2f297 = overflow data page
+			0x1f, 0xb6, 0xd2, 0x58, // 0: page type magic number - 0x58d2b61f = hashed overflow data page
 			0xff, 0xff, 0xff, 0xff, // 4: checksum - 0xffffffff = not implemented
 			0xd9, 0xd8, 0x4a, 0x07,	// 8: page number = 0x074ad8d9
 			0, 0, 0, 0,				// 12: next overflow page number = 0
@@ -655,7 +826,7 @@ namespace {
 		const RecordId recordId(key, partNum);
 		const DataPage::AddedValueRef valueRef(value);
 
-		const size_type addResult = overflowPage.addSingleRecord(recordId, valueRef);
+		const size_type addResult = overflowPage.addSingleRecord(recordId, keyHashFor(recordId.key()), valueRef);
 		TS_ASSERT_EQUALS(recordId.recordOverheadSize() + value.size(), addResult);
 
 		const DataPageCursor cursor(&overflowPage);
@@ -698,7 +869,7 @@ namespace {
 		const std::string firstValue = valueOfSize(pageSize / 2);
 		const RecordId firstRecordId(key, 0);
 		DataPage::AddedValueRef firstValueRef(firstValue);
-		const size_type firstAddedSize = bucketPage.addSingleRecord(firstRecordId, firstValueRef);
+		const size_type firstAddedSize = bucketPage.addSingleRecord(firstRecordId, keyHashFor(firstRecordId.key()), firstValueRef);
 		TS_ASSERT(firstAddedSize != 0);
 
 		// Create large value entry.
@@ -706,7 +877,7 @@ namespace {
 		const size_type secondValueSize = pageSize + 13;
 		const PageId& secondValuePage = overflowFilePage(0x2c49e6a3);
 		DataPage::AddedValueRef secondValueRef(secondValueSize, secondValuePage);
-		const size_type secondAddedSize = bucketPage.addSingleRecord(secondRecordId, secondValueRef);
+		const size_type secondAddedSize = bucketPage.addSingleRecord(secondRecordId, keyHashFor(secondRecordId.key()), secondValueRef);
 		TS_ASSERT(secondAddedSize != 0);
 
 		// Validate cursor readings.
@@ -764,13 +935,13 @@ void DataPageTest::testAddInlineRecordData()
 
 		const std::string key = keyOfSize(1);
 		const size_type secondRecordInlineSize = 13; // record id (3) + tag (2) + large value reference (8) = 13
-		const size_type firstRecordInlineSize = originalBucketPage.largestPossibleInlineRecordSize() - secondRecordInlineSize - sizeof(uint16_t);
+		const size_type firstRecordInlineSize = originalBucketPage.largestPossibleInlineRecordSize() - secondRecordInlineSize - 6; // second record slot (6)
 
 		// Create inline entry.
 		const std::string firstValue = valueOfSize(firstRecordInlineSize - 5);
 		const RecordId firstRecordId(key, 0);
 		DataPage::AddedValueRef firstValueRef(firstValue);
-		const size_type firstAddedSize = originalBucketPage.addSingleRecord(firstRecordId, firstValueRef);
+		const size_type firstAddedSize = originalBucketPage.addSingleRecord(firstRecordId, keyHashFor(firstRecordId.key()), firstValueRef);
 		TS_ASSERT_EQUALS(firstRecordInlineSize, firstAddedSize);
 
 		// Create large value entry.
@@ -778,7 +949,7 @@ void DataPageTest::testAddInlineRecordData()
 		const size_type secondValueSize = pageSize + 29;
 		const PageId& secondValuePage = overflowFilePage(0xa7c4ac65);
 		DataPage::AddedValueRef secondValueRef(secondValueSize, secondValuePage);
-		const size_type secondAddedSize = originalBucketPage.addSingleRecord(secondRecordId, secondValueRef);
+		const size_type secondAddedSize = originalBucketPage.addSingleRecord(secondRecordId, keyHashFor(secondRecordId.key()), secondValueRef);
 		TS_ASSERT_EQUALS(secondRecordInlineSize, secondAddedSize);
 		TS_ASSERT_EQUALS(0U, originalBucketPage.freeSpace());
 
@@ -794,8 +965,9 @@ void DataPageTest::testAddInlineRecordData()
 		TS_ASSERT_EQUALS(cursor.recordIdValue().data(), firstRecord.data());
 		TS_ASSERT_EQUALS(firstAddedSize, firstRecord.size());
 
-		const size_type firstCopyAddedSize = copiedBucketPage.addSingleRecord(firstRecord);
+		const size_type firstCopyAddedSize = copiedBucketPage.addSingleRecord(firstRecord, cursor.keyHash());
 		TS_ASSERT_EQUALS(firstRecordInlineSize, firstCopyAddedSize);
+		TS_ASSERT_EQUALS(keyHashFor(key), copiedBucketPage.getKeyHashAt(0));
 
 		cursor.next();
 		TS_ASSERT(cursor.isValid());
@@ -809,7 +981,7 @@ void DataPageTest::testAddInlineRecordData()
 		TS_ASSERT_EQUALS(cursor.recordIdValue().data(), secondRecord.data());
 		TS_ASSERT_EQUALS(secondAddedSize, secondRecord.size());
 
-		const size_type secondCopyAddedSize = copiedBucketPage.addSingleRecord(secondRecord);
+		const size_type secondCopyAddedSize = copiedBucketPage.addSingleRecord(secondRecord, cursor.keyHash());
 		TS_ASSERT_EQUALS(secondRecordInlineSize, secondCopyAddedSize);
 		TS_ASSERT_EQUALS(0U, copiedBucketPage.freeSpace());
 
@@ -843,3 +1015,203 @@ void DataPageTest::testAddInlineRecordData()
 
 	TS_ASSERT(allocator_->allFreed());
 }
+
+//=============================================================================
+// Hash tags.
+
+namespace {
+
+	void doTestFindByHashTag(IPageAllocator* allocator, bool hasKeyHashes)
+	{
+		const size_type pageSize = MIN_PAGE_SIZE;
+
+		// Pages created by the format versions 2 to 4 have hash tags without key hashes.
+		OverflowDataPage overflowPage(allocator, pageSize);
+		if (hasKeyHashes) {
+			overflowPage.setUp(1);
+		}
+		else {
+			overflowPage.setUpTagged(1);
+		}
+
+		TS_ASSERT_EQUALS(! hasKeyHashes, overflowPage.hasHashTags());
+		TS_ASSERT_EQUALS(hasKeyHashes, overflowPage.hasKeyHashes());
+		TS_ASSERT_EQUALS((hasKeyHashes)? 6U : 4U, overflowPage.slotSize());
+
+		// Add enough records to exercise both the vectorized and the scalar part of the slot scan.
+		const partNum_t records = 23;
+		for (partNum_t i = 0; i < records; ++i) {
+			const RecordId recordId(keyFor(i), 0);
+			const uint32_t keyHash = keyHashFor(recordId.key());
+			TS_ASSERT_DIFFERS(0U, overflowPage.addSingleRecord(recordId, keyHash, DataPage::AddedValueRef("v")));
+
+			if (hasKeyHashes) {
+				TS_ASSERT_EQUALS(keyHash, overflowPage.getKeyHashAt(i));
+				TS_ASSERT_THROWS(overflowPage.getHashTagAt(i), InternalErrorException);
+			}
+			else {
+				TS_ASSERT_EQUALS(RecordId::hashTagFor(keyHash), overflowPage.getHashTagAt(i));
+			}
+		}
+
+		TS_ASSERT_THROWS_NOTHING(overflowPage.validate());
+
+		for (partNum_t i = 0; i < records; ++i) {
+			const RecordId recordId(keyFor(i), 0);
+			const uint32_t keyHash = keyHashFor(recordId.key());
+
+			if (hasKeyHashes) {
+				TS_ASSERT_EQUALS(i, overflowPage.findKeyHash(keyHash, 0));
+			}
+			else {
+				TS_ASSERT(overflowPage.findKeyHash(keyHash, 0) <= i);
+			}
+
+			DataPageCursor cursor(&overflowPage);
+			TS_ASSERT(cursor.find(recordId, keyHash));
+			TS_ASSERT_EQUALS(i, cursor.index());
+			TS_ASSERT_EQUALS(hasKeyHashes, cursor.hasKeyHash());
+
+			if (hasKeyHashes) {
+				TS_ASSERT_EQUALS(keyHash, cursor.keyHash());
+			}
+			else {
+				TS_ASSERT_THROWS(cursor.keyHash(), InternalErrorException);
+			}
+
+			DataPageCursor keyCursor(&overflowPage);
+			TS_ASSERT(keyCursor.find(recordId.key(), keyHashFor(recordId.key())));
+			TS_ASSERT_EQUALS(i, keyCursor.index());
+		}
+
+		// Missing record.
+		DataPageCursor cursor(&overflowPage);
+		TS_ASSERT(! cursor.find(RecordId("missing", 0), keyHashFor("missing")));
+		TS_ASSERT(! cursor.isValid());
+
+		// Key hashes are compared whole, a record whose key hash differs only in the lower half is skipped.
+		if (hasKeyHashes) {
+			const uint32_t lastKeyHash = keyHashFor(keyFor(records - 1));
+			TS_ASSERT_EQUALS(records, overflowPage.findKeyHash(lastKeyHash ^ 0x0000ffff, 0));
+			TS_ASSERT_EQUALS(records, overflowPage.findKeyHash(lastKeyHash ^ 0x00010000, 0));
+		}
+
+		// Tags and key hashes are moved together with the record offsets.
+		DataPageCursor deletedCursor(&overflowPage);
+		TS_ASSERT(deletedCursor.find(RecordId(keyFor(3), 0), keyHashFor(keyFor(3))));
+		TS_ASSERT_DIFFERS(0U, overflowPage.deleteSingleRecord(deletedCursor));
+		TS_ASSERT_THROWS_NOTHING(overflowPage.validate());
+
+		// Compaction moves them as well.
+		DataPageCursor deadCursor(&overflowPage);
+		TS_ASSERT(deadCursor.find(RecordId(keyFor(7), 0), keyHashFor(keyFor(7))));
+		overflowPage.markRecordDead(deadCursor);
+		overflowPage.compactRecords();
+		TS_ASSERT_THROWS_NOTHING(overflowPage.validate());
+
+		for (partNum_t i = 0; i < records; ++i) {
+			DataPageCursor cursor(&overflowPage);
+			TS_ASSERT_EQUALS(i != 3 && i != 7, cursor.find(RecordId(keyFor(i), 0), keyHashFor(keyFor(i))));
+
+			if (cursor.isValid() && hasKeyHashes) {
+				TS_ASSERT_EQUALS(keyHashFor(keyFor(i)), cursor.keyHash());
+			}
+		}
+
+		overflowPage.clearDirtyFlag();
+	}
+
+}
+
+void DataPageTest::testFindByHashTag()
+{
+	TS_ASSERT_THROWS_NOTHING(doTestFindByHashTag(allocator_.get(), true));
+	TS_ASSERT_THROWS_NOTHING(doTestFindByHashTag(allocator_.get(), false));
+	TS_ASSERT(allocator_->allFreed());
+}
+
+void DataPageTest::testUntaggedPage()
+{
+	{
+		const size_type pageSize = MIN_PAGE_SIZE;
+
+		// Pages created by the format version 1 do not have hash tags.
+		BucketDataPage bucketPage(allocator_.get(), pageSize);
+		bucketPage.setUpUntagged(122345689);
+		TS_ASSERT_THROWS_NOTHING(bucketPage.validate());
+		TS_ASSERT(! bucketPage.hasHashTags());
+		TS_ASSERT_EQUALS(2U, bucketPage.slotSize());
+		TS_ASSERT_EQUALS(bucketPage.size() - 20, bucketPage.freeSpace());
+
+		const RecordId recordId("a", 127);
+		TS_ASSERT_EQUALS(recordId.recordOverheadSize(), bucketPage.addSingleRecord(recordId, keyHashFor(recordId.key()), DataPage::AddedValueRef("")));
+
+		const size_type RECORD_SIZE = 5; // len (1) + key (1) + part number (1) + value size (2) + value (0)
+		const size_type KEY_INDEX = pageSize - RECORD_SIZE;
+		uint8_t expectedSinglePageHeader[] = {
+			0x43, 0xd9, 0x19, 0x2e, // 0: page type magic number - 0x2e19d943 = bucket data page
+			0xff, 0xff, 0xff, 0xff, // 4: checksum - 0xffffffff = not implemented
+			0xd9, 0xd8, 0x4a, 0x07,	// 8: page number = 0x074ad8d9
+			0, 0, 0, 0,				// 12: next overflow page number = 0
+			1, 0,					// 16: number of records on the page = 1
+			static_cast<uint8_t>(KEY_INDEX), static_cast<uint8_t>(KEY_INDEX >> 8), // 18: end of free area
+			static_cast<uint8_t>(KEY_INDEX), static_cast<uint8_t>(KEY_INDEX >> 8), // 20: key/value offset 0
+			0, 0					// 22: unused
+		};
+
+		TS_ASSERT_SAME_DATA(expectedSinglePageHeader, bucketPage.constData(), sizeof(expectedSinglePageHeader));
+		TS_ASSERT_EQUALS(bucketPage.size() - 20 - RECORD_SIZE - 2, bucketPage.freeSpace()); // record offset (2) without a tag
+
+		// Untagged records are found by comparing the keys.
+		const uint16_t hashTag = RecordId::hashTagFor(keyHashFor(recordId.key()));
+		DataPageCursor cursor(&bucketPage);
+		TS_ASSERT(cursor.find(recordId, keyHashFor(recordId.key())));
+		TS_ASSERT_THROWS(bucketPage.getHashTagAt(0), InternalErrorException);
+		TS_ASSERT_EQUALS(0U, bucketPage.findKeyHash(keyHashFor("b"), 0));
+
+		// Record copied from an untagged page to a tagged page gets the tag.
+		BucketDataPage taggedPage(allocator_.get(), pageSize);
+		taggedPage.setUpTagged(122345689);
+		TS_ASSERT_EQUALS(RECORD_SIZE, taggedPage.addSingleRecord(cursor.inlineRecord(), keyHashFor(cursor.key())));
+		TS_ASSERT_EQUALS(hashTag, taggedPage.getHashTagAt(0));
+
+		DataPageCursor taggedCursor(&taggedPage);
+		TS_ASSERT(taggedCursor.find(recordId, keyHashFor(recordId.key())));
+
+		bucketPage.clearDirtyFlag();
+		taggedPage.clearDirtyFlag();
+	}
+
+	{
+		const size_type pageSize = MIN_PAGE_SIZE;
+
+		// Largest record of a page created by the format versions 2 to 4 does not fit to a slot with the key hash.
+		BucketDataPage taggedPage(allocator_.get(), pageSize);
+		taggedPage.setUpTagged(1);
+
+		const RecordId recordId("a", 0);
+		const std::string value = valueOfSize(taggedPage.freeSpace() - 4 - recordId.recordOverheadSize()); // slot with the hash tag (4)
+		const size_type recordSize = recordId.recordOverheadSize() + static_cast<size_type>(value.size());
+		TS_ASSERT_EQUALS(recordSize, taggedPage.addSingleRecord(recordId, keyHashFor(recordId.key()), DataPage::AddedValueRef(value)));
+		TS_ASSERT(recordSize > taggedPage.largestPossibleInlineRecordSize());
+
+		// Moving the record to an empty page falls back to the tagged format.
+		DataPageCursor cursor(&taggedPage);
+		BucketDataPage movedPage(allocator_.get(), pageSize);
+		movedPage.setUp(2);
+		TS_ASSERT_EQUALS(0U, movedPage.addSingleRecord(cursor.inlineRecord(), keyHashFor(cursor.key())));
+		TS_ASSERT_EQUALS(recordSize, movedPage.addMovedRecordToEmptyPage(cursor.inlineRecord(), keyHashFor(cursor.key())));
+		TS_ASSERT(movedPage.hasHashTags());
+		TS_ASSERT(! movedPage.hasKeyHashes());
+		TS_ASSERT_EQUALS(2U, movedPage.getPageNumber());
+
+		DataPageCursor movedCursor(&movedPage);
+		TS_ASSERT(movedCursor.find(recordId, keyHashFor(recordId.key())));
+		TS_ASSERT_EQUALS(value, movedCursor.inlineValue());
+
+		taggedPage.clearDirtyFlag();
+		movedPage.clearDirtyFlag();
+	}
+
+	TS_ASSERT(allocator_->allFreed());
+}
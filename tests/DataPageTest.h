@@ -45,6 +45,8 @@ public:
 	void testDeleteFirstRecords();
 	void testDeleteMiddleRecords();
 	void testDeleteSingleLargeItem();
+	void testReplaceRecords();
+	void testDeadRecords();
 
 	// Test OverflowPage.
 	void testOverflowPage();
@@ -53,6 +55,10 @@ public:
 	void testCursorGetInlineRecordData();
 	void testAddInlineRecordData();
 
+	// Hash tags.
+	void testFindByHashTag();
+	void testUntaggedPage();
+
 private:
 	boost::scoped_ptr<TestPageAllocator> allocator_;
 };
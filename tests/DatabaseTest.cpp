@@ -25,6 +25,9 @@
  * copyright holder.
  */
 #include "stdafx.h"
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
 #include <kerio/hashdb/HashDB.h>
 #include <kerio/hashdb/Exception.h>
 #include <kerio/hashdb/Constants.h>
@@ -32,6 +35,9 @@
 #include <kerio/hashdbHelpers/StringReadBatch.h>
 #include <kerio/hashdbHelpers/DeleteBatch.h>
 #include "utils/ConfigUtils.h"
+#include "utils/MurmurHash3Adapter.h"
+#include "db/BucketHeaderPage.h"
+#include "db/OverflowHeaderPage.h"
 #include "testUtils/FileUtils.h"
 #include "testUtils/StringUtils.h"
 #include "testUtils/TestPageAllocator.h"
@@ -107,6 +113,15 @@ void DatabaseTest::testOpenInvalid()
 		TS_ASSERT_THROWS(db->open(name, options), InvalidArgumentException);
 		TS_ASSERT_THROWS(db->statistics(), InvalidArgumentException);
 	}
+
+	// Invalid options: mapped files cannot be used with TrueLockManagerType
+	{	
+		Options options = Options::readOnlySingleThreaded();
+		options.lockManagerType_ = Options::TrueLockManagerType;
+		options.pageAllocatorType_ = Options::LockFreePageAllocatorType;
+		TS_ASSERT(options.mapFiles_);
+		TS_ASSERT_THROWS(db->open(name, options), InvalidArgumentException);
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -519,10 +534,10 @@ namespace {
 	{
 		const std::string key("1");
 		const size_type initialRecordSize = static_cast<size_type>(key.size()) + 2 + 2 + 3; // Size of the record is 1 (key len) + 1 (key) + 1 (part num) + 2 (value len) + 3 (value size)
-		const size_type initialNumberOfRecords = std::min((pageSize - 20) / (initialRecordSize + 2), 128U);
+		const size_type initialNumberOfRecords = std::min((pageSize - 20) / (initialRecordSize + 6), 128U);
 
 		const size_type replacementRecordSize = static_cast<size_type>(key.size()) + 2 + 2 + 2;
-		const size_type replacementNumberOfRecords = std::min((pageSize - 20) / (replacementRecordSize + 2), 128U);
+		const size_type replacementNumberOfRecords = std::min((pageSize - 20) / (replacementRecordSize + 6), 128U);
 
 		// Create records.
 		{
@@ -700,7 +715,7 @@ namespace {
 
 	void doTestCreateThreeOverflowPages(Database db, const std::string& name, size_type pageSize)
 	{
-		const size_type largestInlineRecordSize = pageSize - (20 /* HEADER_DATA_END_OFFSET */ + sizeof(uint16_t));
+		const size_type largestInlineRecordSize = pageSize - (20 /* HEADER_DATA_END_OFFSET */ + 6 /* hashed record slot */);
 		const size_type valueSize = largestInlineRecordSize - 5; // key size (1) + key (1) + part number (1) + value size (2) = 5
 
 		const std::string key("6");
@@ -1027,7 +1042,7 @@ namespace {
 
 		const size_type threePageLargeValueSize = 3 * (pageSize - 16 /* HEADER_DATA_END_OFFSET */);
 
-		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + sizeof(uint16_t)) - 13 /* large record size */) / 2;
+		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + 18 /* hashed record slots */) - 13 /* large record size */) / 2;
 		const size_type inlineValueSize = inlineRecordSize - 7; // key size (1) + key (1) + part number (1) + value size (2) + pointer to value = 7
 
 		const partNum_t singleLargeValuePartNumber = 3; // Used in the first part of the test.
@@ -1363,7 +1378,7 @@ namespace {
 			TS_ASSERT_EQUALS(0U, stats.splitsOnOverfill_);
 			TS_ASSERT_EQUALS(pageSize, stats.pageSize_);
 			TS_ASSERT_EQUALS(2U, stats.numberOfBuckets_);
-			TS_ASSERT_EQUALS(7U, stats.overflowFileDataPages_);
+			TS_ASSERT_EQUALS(10U, stats.overflowFileDataPages_); // New values are stored before the old pages are released.
 			TS_ASSERT_EQUALS(1U, stats.overflowFileBitmapPages_);
 			TS_ASSERT_EQUALS(6U, stats.numberOfRecords_);
 			TS_ASSERT_EQUALS(2 * (13U + 2 * (inlineRecordSize - sizeof(uint16_t))), stats.dataInlineSize_); // Inline size did not change.
@@ -1441,7 +1456,7 @@ namespace {
 			TS_ASSERT_EQUALS(0U, stats.splitsOnOverfill_);
 			TS_ASSERT_EQUALS(pageSize, stats.pageSize_);
 			TS_ASSERT_EQUALS(2U, stats.numberOfBuckets_);
-			TS_ASSERT_EQUALS(7U, stats.overflowFileDataPages_);
+			TS_ASSERT_EQUALS(10U, stats.overflowFileDataPages_);
 			TS_ASSERT_EQUALS(1U, stats.overflowFileBitmapPages_);
 			TS_ASSERT_EQUALS(4U, stats.numberOfRecords_);
 			TS_ASSERT_EQUALS(2 * (2 * (inlineRecordSize - sizeof(uint16_t))), stats.dataInlineSize_);
@@ -1469,7 +1484,7 @@ namespace {
 			TS_ASSERT_EQUALS(0U, stats.splitsOnOverfill_);
 			TS_ASSERT_EQUALS(pageSize, stats.pageSize_);
 			TS_ASSERT_EQUALS(2U, stats.numberOfBuckets_);
-			TS_ASSERT_EQUALS(7U, stats.overflowFileDataPages_);
+			TS_ASSERT_EQUALS(10U, stats.overflowFileDataPages_);
 			TS_ASSERT_EQUALS(1U, stats.overflowFileBitmapPages_);
 
 			TS_ASSERT_THROWS_NOTHING(db->close());
@@ -1495,7 +1510,7 @@ namespace {
 			TS_ASSERT_EQUALS(0U, stats.splitsOnOverfill_);
 			TS_ASSERT_EQUALS(pageSize, stats.pageSize_);
 			TS_ASSERT_EQUALS(2U, stats.numberOfBuckets_);
-			TS_ASSERT_EQUALS(7U, stats.overflowFileDataPages_);
+			TS_ASSERT_EQUALS(10U, stats.overflowFileDataPages_);
 			TS_ASSERT_EQUALS(1U, stats.overflowFileBitmapPages_);
 
 			TS_ASSERT_THROWS_NOTHING(db->close());
@@ -1525,7 +1540,7 @@ namespace {
 
 		const size_type threePageLargeValueSize = 3 * (pageSize - 16 /* HEADER_DATA_END_OFFSET */);
 
-		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + sizeof(uint16_t)) - 13 /* large record size */) / 2;
+		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + 18 /* hashed record slots */) - 13 /* large record size */) / 2;
 		const size_type inlineValueSize = inlineRecordSize - 7; // key size (1) + key (1) + part number (1) + value size (2) + pointer to value = 7
 
 		{
@@ -1658,7 +1673,7 @@ namespace {
 
 	void doTestCreatePreallocatedDatabase(Database db, const std::string& name, size_type pageSize)
 	{
-		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + sizeof(uint16_t)));
+		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + 6 /* hashed record slot */));
 		const size_type inlineValueSize = inlineRecordSize - 4; // key size (1) + key (not included) + part number (1) + value size (2) = 4
 		const size_type maxNumberOfRecords = 13;
 
@@ -1797,7 +1812,7 @@ namespace {
 
 	void doTestBucketSplit(Database db, const std::string& name, size_type pageSize, size_type maxNumberOfRecords)
 	{
-		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + sizeof(uint16_t)));
+		const size_type inlineRecordSize = (pageSize - (20 /* HEADER_DATA_END_OFFSET */ + 6 /* hashed record slot */));
 		const size_type inlineValueSize = inlineRecordSize - 4; // key size (1) + key (not included) + part number (1) + value size (2) = 4
 
 		// Create.
@@ -2029,6 +2044,72 @@ void DatabaseTest::testBucketSplitLargeValues()
 
 //-----------------------------------------------------------------------------
 
+namespace {
+
+	void doTestInterruptedSplit(Database db, const std::string& name, size_type pageSize)
+	{
+		const size_type valueSize = pageSize / 8;
+		const std::string crashedName = name + "Crashed";
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		// Store records until a split of a chain with overflow pages writes overflow pages as well. Before each store,
+		// the database files are saved and the bucket file is copied, so that the copy holds the bucket pages as they were
+		// before the split.
+		unsigned numberOfRecords = 0;
+		bool isSplit = false;
+
+		while (! isSplit && numberOfRecords < 1000) {
+			TS_ASSERT_THROWS_NOTHING(db->flush());
+			boost::filesystem::remove(crashedName + ".dbb");
+			boost::filesystem::copy_file(name + ".dbb", crashedName + ".dbb");
+
+			const Statistics statsBefore = db->statistics();
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(numberOfRecords), 0, valueSize, numberOfRecords));
+			++numberOfRecords;
+
+			// The store itself acquires at most one overflow page.
+			const Statistics stats = db->statistics();
+			isSplit = stats.overflowPagesReleased_ > statsBefore.overflowPagesReleased_ && stats.overflowPagesAcquired_ > statsBefore.overflowPagesAcquired_ + 1;
+		}
+
+		TS_ASSERT(isSplit);
+
+		// The split writes its pages to the overflow file directly. Together with the bucket file copy, the overflow file
+		// is left as if the process crashed before the bucket page was overwritten.
+		boost::filesystem::remove(crashedName + ".dbo");
+		boost::filesystem::copy_file(name + ".dbo", crashedName + ".dbo");
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		// Records stored before the split are still readable from the original chain.
+		TS_ASSERT_THROWS_NOTHING(db->open(crashedName, Options::readOnlySingleThreaded()));
+
+		for (unsigned i = 0; i + 1 < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+		TS_ASSERT(db->drop(crashedName));
+	}
+
+};
+
+void DatabaseTest::testInterruptedSplit()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestInterruptedSplit(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestInterruptedSplit(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+
 namespace {
 
 	template<class WriteBatchType, class ReadBatchType, class DeleteBatchType>
@@ -2323,3 +2404,1733 @@ void DatabaseTest::testFetchLimit()
 	TS_ASSERT_THROWS_NOTHING(doTestFetchLimit(db, minPageDatabaseName, MIN_PAGE_SIZE));
 	TS_ASSERT_THROWS_NOTHING(doTestFetchLimit(db, maxPageDatabaseName, MAX_PAGE_SIZE));
 }
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	void doTestPageCache(Database db, const std::string& name, size_type pageSize)
+	{
+		const size_type VALUE_SIZE = 100;
+		const unsigned NUMBER_OF_RECORDS = 8 * pageSize / VALUE_SIZE;
+
+		// Create a database with a cache smaller than the database.
+		{
+			Options options = Options::readWriteSingleThreaded();
+			options.pageSize_ = pageSize;
+			options.pageCacheBytes_ = 4 * pageSize;
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			for (unsigned i = 0; i < NUMBER_OF_RECORDS; ++i) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, VALUE_SIZE, i));
+			}
+
+			Statistics stats = db->statistics();
+			TS_ASSERT_LESS_THAN(0U, stats.pageCacheHits_);
+			TS_ASSERT_LESS_THAN(0U, stats.pageCacheMisses_);
+			TS_ASSERT_LESS_THAN(0U, stats.pageCacheEvictions_);
+
+			// Repeated fetch of the same key is served from the cache.
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(0), 0, VALUE_SIZE, 0));
+			const Statistics statsBefore = db->statistics();
+
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(0), 0, VALUE_SIZE, 0));
+			const Statistics statsAfter = db->statistics();
+
+			TS_ASSERT_EQUALS(statsBefore.pageCacheMisses_, statsAfter.pageCacheMisses_);
+			TS_ASSERT_LESS_THAN(statsBefore.pageCacheHits_, statsAfter.pageCacheHits_);
+
+			// Releasing resources writes back and empties the cache.
+			TS_ASSERT_THROWS_NOTHING(db->releaseSomeResources());
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(1), 0, VALUE_SIZE, 1));
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		// Reopen and check that evicted and flushed pages were written.
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			for (unsigned i = 0; i < NUMBER_OF_RECORDS; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, VALUE_SIZE, i));
+			}
+
+			Statistics stats = db->statistics();
+			TS_ASSERT_EQUALS(NUMBER_OF_RECORDS, stats.numberOfRecords_);
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testPageCache()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestPageCache(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestPageCache(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+namespace {
+
+	void copyDatabaseFiles(const std::string& source, const std::string& target)
+	{
+		const char* suffixes[] = { ".dbb", ".dbo", ".dbl" };
+
+		for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+			boost::filesystem::copy_file(source + suffixes[i], target + suffixes[i]);
+		}
+	}
+
+	void doTestWriteAheadLog(Database db, const std::string& name, size_type pageSize)
+	{
+		const size_type VALUE_SIZE = 100;
+		const unsigned NUMBER_OF_RECORDS = 8 * pageSize / VALUE_SIZE;
+		const std::string crashedName = name + "Crashed";
+
+		// Store records to a database using the log and copy its files as if the process crashed.
+		{
+			Options options = Options::readWriteSingleThreaded();
+			options.pageSize_ = pageSize;
+			options.pageCacheBytes_ = 4 * pageSize;
+			options.writeAheadLog_ = true;
+			options.writeAheadLogGroupSize_ = 4;
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			for (unsigned i = 0; i < NUMBER_OF_RECORDS; ++i) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, VALUE_SIZE, i));
+			}
+
+			TS_ASSERT(boost::filesystem::exists(name + ".dbl"));
+
+			// Pages evicted from the small cache are read back from the log file.
+			for (unsigned i = 0; i < NUMBER_OF_RECORDS; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, VALUE_SIZE, i));
+			}
+
+			TS_ASSERT_THROWS_NOTHING(db->sync());
+			TS_ASSERT_THROWS_NOTHING(copyDatabaseFiles(name, crashedName));
+
+			// Clean close writes all pages to the database files and removes the log.
+			TS_ASSERT_THROWS_NOTHING(db->close());
+			TS_ASSERT(! boost::filesystem::exists(name + ".dbl"));
+		}
+
+		// Incomplete commit at the end of the log is ignored.
+		{
+			std::ofstream log((crashedName + ".dbl").c_str(), std::ios::binary | std::ios::app);
+			log << std::string(pageSize, 'x');
+		}
+
+		// Read-only instance reads committed pages from the log.
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(crashedName, Options::readOnlySingleThreaded()));
+
+			for (unsigned i = 0; i < NUMBER_OF_RECORDS; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, VALUE_SIZE, i));
+			}
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+			TS_ASSERT(boost::filesystem::exists(crashedName + ".dbl"));
+		}
+
+		// Read-write instance writes committed pages to the database files.
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(crashedName, Options::readWriteSingleThreaded()));
+			TS_ASSERT(! boost::filesystem::exists(crashedName + ".dbl"));
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		const std::string* names[] = { &name, &crashedName };
+		for (size_t n = 0; n < 2; ++n) {
+			TS_ASSERT_THROWS_NOTHING(db->open(*names[n], Options::readOnlySingleThreaded()));
+
+			for (unsigned i = 0; i < NUMBER_OF_RECORDS; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, VALUE_SIZE, i));
+			}
+
+			Statistics stats = db->statistics();
+			TS_ASSERT_EQUALS(NUMBER_OF_RECORDS, stats.numberOfRecords_);
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		TS_ASSERT(db->drop(crashedName));
+	}
+
+};
+
+void DatabaseTest::testWriteAheadLog()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestWriteAheadLog(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestWriteAheadLog(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	// Read batch which pulls large values from the stream in small chunks.
+	class ChunkedReadBatch : public StringCopyReadBatch {
+	public:
+		ChunkedReadBatch(size_t chunkSize, size_t bytesToRead)
+			: chunkSize_(chunkSize)
+			, bytesToRead_(bytesToRead)
+			, chunks_(0)
+		{
+
+		}
+
+		size_t chunks() const
+		{
+			return chunks_;
+		}
+
+		virtual bool setLargeValueAt(size_t index, std::istream& valueStream, size_t valueSize)
+		{
+			std::string& value = resultAt(index);
+			value.clear();
+
+			std::vector<char> chunk(chunkSize_);
+			const size_t bytesToRead = std::min(valueSize, bytesToRead_);
+
+			while (value.size() < bytesToRead) {
+				const size_t readSize = std::min(chunkSize_, bytesToRead - value.size());
+				valueStream.read(&chunk[0], readSize);
+
+				if (static_cast<size_t>(valueStream.gcount()) != readSize) {
+					return false;
+				}
+
+				value.append(&chunk[0], readSize);
+				++chunks_;
+			}
+
+			return true;
+		}
+
+	private:
+		const size_t chunkSize_;
+		const size_t bytesToRead_;
+		size_t chunks_;
+	};
+
+	void breakLargeValueChain(const std::string& name, size_type pageSize)
+	{
+		// Terminate the first chained large value page, the value is then shorter than recorded in its record.
+		std::fstream overflowFile((name + ".dbo").c_str(), std::ios::binary | std::ios::in | std::ios::out);
+		std::vector<char> page(pageSize);
+
+		for (size_type pageNumber = 1; overflowFile.seekg(pageNumber * pageSize).read(&page[0], pageSize); ++pageNumber) {
+			const uint32_t magic = *reinterpret_cast<const uint32_t*>(&page[0]);
+			const uint32_t nextPage = *reinterpret_cast<const uint32_t*>(&page[12]);
+
+			if (magic == 0x4dcf7a68 /* LARGE_VALUE_MAGIC */ && nextPage != 0) {
+				const uint32_t noNextPage = 0;
+				overflowFile.seekp(pageNumber * pageSize + 12).write(reinterpret_cast<const char*>(&noNextPage), sizeof(noNextPage));
+				return;
+			}
+		}
+
+		TS_FAIL("no chained large value page found");
+	}
+
+	void doTestStreamLargeValue(Database db, const std::string& name, size_type pageSize)
+	{
+		const std::string key("7");
+		const size_type valueSize = 5 * pageSize + 123;
+
+		{
+			Options options = Options::readWriteSingleThreaded();
+			options.pageSize_ = pageSize;
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, key, 0, valueSize));
+
+			// Value is streamed in chunks crossing the page boundaries.
+			ChunkedReadBatch readBatch(97, valueSize);
+			readBatch.add(key, 0);
+			TS_ASSERT_THROWS_NOTHING(db->fetch(readBatch));
+			TS_ASSERT_EQUALS(valueOfSize(valueSize), readBatch.resultAt(0));
+			TS_ASSERT_EQUALS((valueSize + 96) / 97, readBatch.chunks());
+
+			// Consumer may read just a prefix of the value.
+			ChunkedReadBatch prefixBatch(100, 250);
+			prefixBatch.add(key, 0);
+			TS_ASSERT_THROWS_NOTHING(db->fetch(prefixBatch));
+			TS_ASSERT_EQUALS(valueOfSize(valueSize).substr(0, 250), prefixBatch.resultAt(0));
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		// Errors raised when reading the pages are propagated to the caller.
+		TS_ASSERT_THROWS_NOTHING(breakLargeValueChain(name, pageSize));
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			ChunkedReadBatch readBatch(1000, valueSize);
+			readBatch.add(key, 0);
+			TS_ASSERT_THROWS(db->fetch(readBatch), DatabaseCorruptedException);
+
+			// Prefix on the intact page is still readable.
+			ChunkedReadBatch prefixBatch(100, 250);
+			prefixBatch.add(key, 0);
+			TS_ASSERT_THROWS_NOTHING(db->fetch(prefixBatch));
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testStreamLargeValue()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestStreamLargeValue(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestStreamLargeValue(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+
+void DatabaseTest::testBitmapSummary()
+{
+	Database db = DatabaseFactory();
+	const std::string name = databaseTestPath_ + "/db";
+
+	// Fill more than two bitmap pages, each manages (page size - 16) * 8 pages.
+	const size_type pageSize = MIN_PAGE_SIZE;
+	const size_type managedPages = (pageSize - 16) * 8;
+	const size_type valueSize = 100 * pageSize;
+	const unsigned numberOfValues = static_cast<unsigned>((2 * managedPages) / 100 + 10);
+
+	{
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfValues; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		Statistics stats = db->statistics();
+		TS_ASSERT_EQUALS(3U, stats.overflowFileBitmapPages_);
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+	// Allocation after reopening reads only the bitmap page with free pages.
+	{
+		Options options = Options::readWriteSingleThreaded();
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(numberOfValues), 0, valueSize, numberOfValues));
+		TS_ASSERT_EQUALS(1U, db->statistics().bitmapPagesRead_);
+
+		// Released pages in the first bitmap page are reused.
+		const size_type dataPages = db->statistics().overflowFileDataPages_;
+		TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(0), 0));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(0), 0, valueSize, 0));
+		TS_ASSERT_EQUALS(dataPages, db->statistics().overflowFileDataPages_);
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+	{
+		TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+		for (unsigned i = 0; i <= numberOfValues; ++i) {
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	void moveOverflowFileEnd(IPageAllocator* allocator, const std::string& name, size_type pageSize, uint32_t fullBitmapPages, uint32_t highestPageNumber)
+	{
+		// Pretend that the overflow file ends at the given page and that all its bitmap pages are full.
+		std::fstream overflowFile((name + ".dbo").c_str(), std::ios::binary | std::ios::in | std::ios::out);
+		std::vector<char> buffer(pageSize);
+		TS_ASSERT(overflowFile.read(&buffer[0], pageSize));
+
+		OverflowHeaderPage headerPage(allocator, pageSize);
+		headerPage.putBytes(0, boost::string_ref(&buffer[0], pageSize));
+		headerPage.setHighestPageNumber(highestPageNumber);
+
+		for (uint32_t i = 0; i < fullBitmapPages; ++i) {
+			headerPage.setBitmapPageFull(i, true);
+		}
+
+		headerPage.updateChecksum();
+		TS_ASSERT(overflowFile.seekp(0).write(reinterpret_cast<const char*>(headerPage.constData()), pageSize));
+		overflowFile.close();
+		headerPage.clearDirtyFlag();
+
+		// Extend the file as a sparse file.
+		boost::filesystem::resize_file(name + ".dbo", (static_cast<uint64_t>(highestPageNumber) + 1) * pageSize);
+	}
+
+};
+
+void DatabaseTest::testOverflowFileLargerThan4GB()
+{
+	Database db = DatabaseFactory();
+	const std::string name = databaseTestPath_ + "/db";
+
+	// With the smallest pages, offsets of pages above 4M do not fit to 32 bits.
+	const size_type pageSize = MIN_PAGE_SIZE;
+	const uint64_t fourGigabytes = static_cast<uint64_t>(1) << 32;
+	const uint32_t bitmapPageDistance = (pageSize - 16) * 8 + 1;
+	const uint32_t fullBitmapPages = static_cast<uint32_t>(fourGigabytes / (static_cast<uint64_t>(bitmapPageDistance) * pageSize)) + 1;
+	const uint32_t highestPageNumber = fullBitmapPages * bitmapPageDistance; // Next page is a new bitmap page.
+
+	const std::string smallKey("small");
+	const std::string largeKey("large");
+	const size_type largeValueSize = 3 * pageSize + 17;
+
+	{
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, smallKey, 0, largeValueSize));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+	TS_ASSERT_THROWS_NOTHING(moveOverflowFileEnd(allocator_.get(), name, pageSize, fullBitmapPages, highestPageNumber));
+
+	// Large value is stored to pages beyond 4 GB.
+	{
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, largeKey, 0, largeValueSize, 7));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, largeKey, 0, largeValueSize, 7));
+
+		Statistics stats = db->statistics();
+		TS_ASSERT_EQUALS(fullBitmapPages + 1, stats.overflowFileBitmapPages_);
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+	TS_ASSERT_LESS_THAN(fourGigabytes + 5 * pageSize, boost::filesystem::file_size(name + ".dbo"));
+
+	// Read both with and without the mapping.
+	for (int mapFiles = 0; mapFiles < 2; ++mapFiles) {
+		Options options = Options::readOnlySingleThreaded();
+		options.mapFiles_ = (mapFiles != 0);
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, smallKey, 0, largeValueSize));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, largeKey, 0, largeValueSize, 7));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	uint32_t readSplitPosition(IPageAllocator* allocator, const std::string& name, size_type pageSize)
+	{
+		std::ifstream bucketFile((name + ".dbb").c_str(), std::ios::binary);
+		std::vector<char> buffer(pageSize);
+		TS_ASSERT(bucketFile.read(&buffer[0], pageSize));
+
+		BucketHeaderPage headerPage(allocator, pageSize);
+		headerPage.putBytes(0, boost::string_ref(&buffer[0], pageSize));
+		headerPage.clearDirtyFlag();
+
+		return headerPage.getSplitPosition();
+	}
+
+	void doTestIncrementalSplit(IPageAllocator* allocator, Database db, const std::string& name, size_type pageSize)
+	{
+		const size_type valueSize = pageSize / 8;
+		const unsigned numberOfRecords = 400;
+		const unsigned recordsPerOpen = 25;
+		unsigned closedDuringSplit = 0;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.splitPagesPerStore_ = 1;
+
+		// Each store moves records from a single page of the bucket being split, the split continues after reopening.
+		for (unsigned stored = 0; stored < numberOfRecords; ) {
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			for (unsigned i = 0; i < recordsPerOpen; ++i, ++stored) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(stored), 0, valueSize, stored));
+			}
+
+			// Overwrite and remove some of the records.
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(stored / 2), 0, valueSize + 1, stored / 2));
+			TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(stored / 3), 0));
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(stored / 3), 0, valueSize, stored / 3));
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(stored / 2), 0, valueSize, stored / 2));
+
+			for (unsigned i = 0; i < stored; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+
+			TS_ASSERT_EQUALS(stored, db->statistics().numberOfRecords_);
+			TS_ASSERT_THROWS_NOTHING(db->close());
+
+			if (readSplitPosition(allocator, name, pageSize) != 0) {
+				++closedDuringSplit;
+			}
+		}
+
+		TS_ASSERT_LESS_THAN(0U, closedDuringSplit);
+
+		// Flush finishes the split.
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(numberOfRecords), 0, valueSize, numberOfRecords));
+		TS_ASSERT_THROWS_NOTHING(db->flush());
+		TS_ASSERT_THROWS_NOTHING(db->close());
+		TS_ASSERT_EQUALS(0U, readSplitPosition(allocator, name, pageSize));
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			RecordsIteratedOver records(db);
+			for (unsigned i = 0; i <= numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, valueSize, i));
+			}
+			TS_ASSERT(records.empty());
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testIncrementalSplit()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestIncrementalSplit(allocator_.get(), db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestIncrementalSplit(allocator_.get(), db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+namespace {
+
+	bool isKeyOfNewBucket(const std::string& key)
+	{
+		// The first split moves records whose hash has the lowest bit set from bucket 0 to bucket 1.
+		return (murmur3Hash(key.data(), key.size()) & 1) != 0;
+	}
+
+	class SplitChainReader : boost::noncopyable {
+	public:
+		SplitChainReader(Database db, const std::vector<std::string>& keys, const volatile bool& stop)
+			: db_(db)
+			, keys_(keys)
+			, stop_(stop)
+			, errors_(0)
+		{ }
+
+		// Keys of the new bucket are looked up in both chains of the bucket being split.
+		void operator()()
+		{
+			try {
+				std::string value;
+
+				while (! stop_) {
+					for (std::vector<std::string>::const_iterator ii = keys_.begin(); ii != keys_.end(); ++ii) {
+						db_->fetch(*ii, 0, value);
+					}
+				}
+			} catch (std::exception&) {
+				++errors_;
+			}
+		}
+
+		unsigned errors() const
+		{
+			return errors_;
+		}
+
+	private:
+		Database db_;
+		const std::vector<std::string>& keys_;
+		const volatile bool& stop_;
+		unsigned errors_;
+	};
+
+}
+
+void DatabaseTest::testRemoveDuringSplit()
+{
+	const std::string name = databaseTestPath_ + "/db";
+	const size_type valueSize = 20;
+
+	Database db = DatabaseFactory();
+
+	// The bucket is split when its chain is long, so that readers spend most of the time in the lower chain.
+	Options options = Options::readWriteSingleThreaded();
+	options.pageSize_ = MIN_PAGE_SIZE;
+	options.splitPagesPerStore_ = 1;
+	options.leavePageFreeSpace_ = -16 * static_cast<int32_t>(MIN_PAGE_SIZE);
+
+	// Store records until the first split is left in progress.
+	unsigned numberOfRecords = 0;
+	do {
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(numberOfRecords), 0, valueSize, numberOfRecords));
+		++numberOfRecords;
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	} while (readSplitPosition(allocator_.get(), name, MIN_PAGE_SIZE) == 0 && numberOfRecords < 10000);
+
+	// Each store moves records of the first few pages to the new bucket, the split stays in progress.
+	TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+	for (unsigned i = 0; i < 4; ++i, ++numberOfRecords) {
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(numberOfRecords), 0, valueSize, numberOfRecords));
+	}
+	TS_ASSERT_THROWS_NOTHING(db->close());
+
+	std::vector<std::string> oldBucketKeys;
+	std::vector<std::string> newBucketKeys;
+
+	for (unsigned i = 0; i < numberOfRecords; ++i) {
+		const std::string key = keyFor(i);
+		(isKeyOfNewBucket(key)? newBucketKeys : oldBucketKeys).push_back(key);
+	}
+
+	Options multiThreadedOptions = Options::readWriteMultiThreaded();
+	multiThreadedOptions.pageSize_ = MIN_PAGE_SIZE;
+	multiThreadedOptions.splitPagesPerStore_ = options.splitPagesPerStore_;
+	multiThreadedOptions.leavePageFreeSpace_ = options.leavePageFreeSpace_;
+	multiThreadedOptions.recordCacheBytes_ = 0;
+	TS_ASSERT_THROWS_NOTHING(db->open(name, multiThreadedOptions));
+	TS_ASSERT_EQUALS(2U, db->statistics().numberOfBuckets_);
+
+	// Lookups of the removed keys walk both chains, so the readers mostly hold the lower chain.
+	const size_t removedPairs = std::min(oldBucketKeys.size(), newBucketKeys.size()) / 2;
+	const std::vector<std::string> removedKeys(newBucketKeys.begin(), newBucketKeys.begin() + removedPairs);
+
+	volatile bool stop = false;
+	const unsigned numberOfReaders = 4;
+	boost::scoped_ptr<SplitChainReader> readers[numberOfReaders];
+	boost::thread_group threads;
+
+	for (unsigned i = 0; i < numberOfReaders; ++i) {
+		readers[i].reset(new SplitChainReader(db, removedKeys, stop));
+		threads.create_thread(boost::ref(*readers[i]));
+	}
+
+	// Removals from the higher chain precede removals from the lower chain, so compaction of the dead records
+	// must not lock the chains in the order of removals.
+	for (size_t i = 0; i < removedPairs; ++i) {
+		DeleteBatch deleteBatch;
+		deleteBatch.add(newBucketKeys[i], 0);
+		deleteBatch.add(oldBucketKeys[i], 0);
+		TS_ASSERT_THROWS_NOTHING(db->remove(deleteBatch));
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+
+	stop = true;
+	threads.join_all();
+
+	for (unsigned i = 0; i < numberOfReaders; ++i) {
+		TS_ASSERT_EQUALS(0U, readers[i]->errors());
+	}
+	TS_ASSERT_EQUALS(numberOfRecords - 2 * removedPairs, db->statistics().numberOfRecords_);
+
+	std::string value;
+	for (size_t i = 0; i < newBucketKeys.size(); ++i) {
+		TS_ASSERT_EQUALS(i >= removedPairs, db->fetch(newBucketKeys[i], 0, value));
+	}
+
+	TS_ASSERT_THROWS_NOTHING(db->close());
+	TS_ASSERT_DIFFERS(0U, readSplitPosition(allocator_.get(), name, MIN_PAGE_SIZE));
+}
+
+namespace {
+
+	size_type bulkLoadValueSize(unsigned i, size_type pageSize)
+	{
+		// Every tenth record is a large value.
+		return (i % 10 == 0)? (pageSize + i) : (i % 50 + 1);
+	}
+
+	void doTestBulkLoad(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 3000;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.bulkLoadBufferBytes_ = 16 * 1024;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		{
+			BulkLoader loader;
+			TS_ASSERT_THROWS_NOTHING(loader = db->newBulkLoader(numberOfRecords));
+
+			// Records can't be changed by other means during the bulk load.
+			TS_ASSERT_THROWS(db->store(keyFor(0), 0, "x"), InvalidArgumentException);
+			TS_ASSERT_THROWS(db->remove(keyFor(0)), InvalidArgumentException);
+
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(loader->add(keyFor(i), 0, valueOfSize(i + 1, i)));
+			}
+
+			// The last added value replaces the previous ones.
+			for (unsigned i = 0; i < numberOfRecords; i += 3) {
+				TS_ASSERT_THROWS_NOTHING(loader->add(keyFor(i), 0, valueOfSize(bulkLoadValueSize(i, pageSize), i)));
+				TS_ASSERT_THROWS_NOTHING(loader->add(keyFor(i), 1, valueOfSize(bulkLoadValueSize(i, pageSize), i + 1)));
+			}
+
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				if (i % 3 != 0) {
+					TS_ASSERT_THROWS_NOTHING(loader->add(keyFor(i), 0, valueOfSize(bulkLoadValueSize(i, pageSize), i)));
+				}
+			}
+
+			TS_ASSERT_THROWS(loader->add("", 0, "x"), InvalidArgumentException);
+			TS_ASSERT_THROWS_NOTHING(loader->finish());
+			TS_ASSERT_THROWS(loader->finish(), InvalidArgumentException);
+		}
+
+		const Statistics stats = db->statistics();
+		TS_ASSERT_EQUALS(numberOfRecords + numberOfRecords / 3, stats.numberOfRecords_);
+		TS_ASSERT_LESS_THAN(0U, stats.bucketPagesAcquired_);
+
+		// A loaded database can't be bulk loaded again.
+		TS_ASSERT_THROWS(db->newBulkLoader(1), InvalidArgumentException);
+
+		// Records are stored as usual after the bulk load.
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(numberOfRecords), 0, 10, numberOfRecords));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		TS_ASSERT(! boost::filesystem::exists(name + ".dbr0"));
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			for (unsigned i = 0; i < numberOfRecords; i += 7) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, bulkLoadValueSize(i, pageSize), i));
+			}
+
+			RecordsIteratedOver records(db);
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, bulkLoadValueSize(i, pageSize), i));
+
+				if (i % 3 == 0) {
+					TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 1, bulkLoadValueSize(i, pageSize), i + 1));
+				}
+			}
+			TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(numberOfRecords), 0, 10, numberOfRecords));
+			TS_ASSERT(records.empty());
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+	void doTestAbortedBulkLoad(Database db, const std::string& name, size_type pageSize)
+	{
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.bulkLoadBufferBytes_ = 4 * 1024;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		{
+			BulkLoader loader;
+			TS_ASSERT_THROWS_NOTHING(loader = db->newBulkLoader(0));
+
+			for (unsigned i = 0; i < 500; ++i) {
+				TS_ASSERT_THROWS_NOTHING(loader->add(keyFor(i), 0, valueOfSize(bulkLoadValueSize(i, pageSize), i)));
+			}
+		}
+
+		// Large values of the discarded records are released.
+		const Statistics stats = db->statistics();
+		TS_ASSERT_EQUALS(0U, stats.numberOfRecords_);
+		TS_ASSERT_EQUALS(stats.largeValuePagesAcquired_, stats.largeValuePagesReleased_);
+		TS_ASSERT_THROWS_NOTHING(checkDatabaseIsEmpty(db));
+
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(0), 0, 10, 0));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(0), 0, 10, 0));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+};
+
+void DatabaseTest::testBulkLoad()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+	const std::string abortedDatabaseName = databaseTestPath_ + "/dbAborted";
+
+	TS_ASSERT_THROWS_NOTHING(doTestBulkLoad(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestBulkLoad(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestAbortedBulkLoad(db, abortedDatabaseName, MIN_PAGE_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	size_type compactionValueSize(unsigned i, size_type pageSize)
+	{
+		// Every third record is a large value spanning 3 pages.
+		return (i % 3 == 0)? (2 * pageSize + pageSize / 2) : (pageSize / 10);
+	}
+
+	void doTestCompaction(Database db, const std::string& name, size_type pageSize, bool writeAheadLog)
+	{
+		const unsigned numberOfRecords = 300;
+		const unsigned removedRecords = 200;
+		const unsigned addedRecords = 1000;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.pageCacheBytes_ = 4 * pageSize;
+		options.writeAheadLog_ = writeAheadLog;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, compactionValueSize(i, pageSize), i));
+		}
+
+		// Records stored first leave free pages at the beginning of the overflow file.
+		for (unsigned i = 0; i < removedRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(i), 0));
+		}
+
+		const Statistics statsBefore = db->statistics();
+		unsigned calls = 0;
+		unsigned stored = 0;
+		bool finished = false;
+
+		// Records are stored between steps of the compaction.
+		while (! finished) {
+			TS_ASSERT_THROWS_NOTHING(finished = db->compact(8));
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(addedRecords + stored), 0, compactionValueSize(stored, pageSize), stored));
+			++stored;
+			++calls;
+		}
+
+		TS_ASSERT_LESS_THAN(1U, calls);
+
+		const Statistics statsAfter = db->statistics();
+		TS_ASSERT_LESS_THAN(0U, statsAfter.overflowPagesRelocated_);
+		TS_ASSERT_LESS_THAN(statsAfter.overflowFileDataPages_, statsBefore.overflowFileDataPages_);
+
+		for (unsigned i = removedRecords; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, compactionValueSize(i, pageSize), i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		// The file was truncated, stores after the compaction could only extend it.
+		const uintmax_t fileSize = boost::filesystem::file_size(name + ".dbo");
+		TS_ASSERT_LESS_THAN(fileSize, (1 + statsBefore.overflowFileDataPages_ + statsBefore.overflowFileBitmapPages_) * static_cast<uintmax_t>(pageSize));
+
+		// Compaction of a compact file relocates nothing.
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			TS_ASSERT(db->compact(0));
+			const Statistics stats = db->statistics();
+			TS_ASSERT_EQUALS(0U, stats.overflowPagesRelocated_);
+			TS_ASSERT_EQUALS(fileSize, (1 + stats.overflowFileDataPages_ + stats.overflowFileBitmapPages_) * static_cast<uintmax_t>(pageSize));
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			RecordsIteratedOver records(db);
+			for (unsigned i = removedRecords; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, compactionValueSize(i, pageSize), i));
+			}
+			for (unsigned i = 0; i < stored; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(addedRecords + i), 0, compactionValueSize(i, pageSize), i));
+			}
+			TS_ASSERT(records.empty());
+
+			TS_ASSERT_THROWS(db->compact(0), InvalidArgumentException);
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testCompaction()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+	const std::string loggedDatabaseName = databaseTestPath_ + "/dbLogged";
+
+	TS_ASSERT_THROWS_NOTHING(doTestCompaction(db, minPageDatabaseName, MIN_PAGE_SIZE, false));
+	TS_ASSERT_THROWS_NOTHING(doTestCompaction(db, maxPageDatabaseName, MAX_PAGE_SIZE, false));
+	TS_ASSERT_THROWS_NOTHING(doTestCompaction(db, loggedDatabaseName, MIN_PAGE_SIZE, true));
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	void checkCompactedRecords(Database db, const std::vector<bool>& stored, size_type valueSize)
+	{
+		RecordsIteratedOver records(db);
+
+		for (unsigned i = 0; i < stored.size(); ++i) {
+			if (stored[i]) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, valueSize, i));
+			}
+		}
+
+		TS_ASSERT(records.empty());
+	}
+
+	void doTestCompactionDuringWrites(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 200;
+		const unsigned maxRecords = 1000;
+		const size_type valueSize = 3000;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		std::vector<bool> stored(maxRecords, false);
+		unsigned nextRecord = 0;
+
+		for (; nextRecord < numberOfRecords; ++nextRecord) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(nextRecord), 0, valueSize, nextRecord));
+			stored[nextRecord] = true;
+		}
+
+		for (unsigned i = 0; i < numberOfRecords / 2; i += 2) {
+			TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(i), 0));
+			stored[i] = false;
+		}
+
+		// Stores extend the file behind the end known when the pass started, removes free pages below it.
+		TS_ASSERT(! db->compact(1));
+
+		for (unsigned i = 0; i < 60; ++i, ++nextRecord) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(nextRecord), 0, valueSize, nextRecord));
+			stored[nextRecord] = true;
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->compact(0));
+
+		// Every step of further passes is followed by a store and a remove.
+		unsigned removedRecord = 1;
+
+		for (unsigned pass = 0; pass < 3; ++pass) {
+			bool finished = false;
+
+			while (! finished && nextRecord < maxRecords) {
+				TS_ASSERT_THROWS_NOTHING(finished = db->compact(4));
+
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(nextRecord), 0, valueSize, nextRecord));
+				stored[nextRecord++] = true;
+
+				TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(removedRecord), 0));
+				stored[removedRecord] = false;
+				removedRecord += 3;
+			}
+
+			TS_ASSERT(finished);
+		}
+
+		TS_ASSERT_LESS_THAN(0U, db->statistics().overflowPagesRelocated_);
+		checkCompactedRecords(db, stored, valueSize);
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+		checkCompactedRecords(db, stored, valueSize);
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+};
+
+void DatabaseTest::testCompactionDuringWrites()
+{
+	Database db = DatabaseFactory();
+
+	TS_ASSERT_THROWS_NOTHING(doTestCompactionDuringWrites(db, databaseTestPath_ + "/dbMin", MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestCompactionDuringWrites(db, databaseTestPath_ + "/dbMax", MAX_PAGE_SIZE));
+}
+
+namespace {
+
+	void doTestBucketMerge(Database db, const std::string& name, size_type pageSize, bool writeAheadLog)
+	{
+		const unsigned numberOfRecords = 3000;
+		const unsigned keptRecords = 100;
+		const size_type valueSize = 50;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.writeAheadLog_ = writeAheadLog;
+		options.mergeFillPercent_ = 25;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->flush());
+		const Statistics statsBefore = db->statistics();
+		TS_ASSERT_LESS_THAN(1U, statsBefore.numberOfBuckets_);
+
+		for (unsigned i = keptRecords; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(i), 0));
+		}
+
+		const Statistics statsAfter = db->statistics();
+		TS_ASSERT_LESS_THAN(statsAfter.numberOfBuckets_, statsBefore.numberOfBuckets_);
+		TS_ASSERT_LESS_THAN(0U, statsAfter.bucketPagesReleased_);
+
+		for (unsigned i = 0; i < keptRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		// Pages of the merged buckets are cut from the end of the bucket file.
+		const uintmax_t fileSize = boost::filesystem::file_size(name + ".dbb");
+		TS_ASSERT_EQUALS(fileSize, (1 + statsAfter.numberOfBuckets_) * static_cast<uintmax_t>(pageSize));
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			RecordsIteratedOver records(db);
+			for (unsigned i = 0; i < keptRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, valueSize, i));
+			}
+			TS_ASSERT(records.empty());
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		// Buckets are split again when the database grows.
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			for (unsigned i = keptRecords; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+
+			TS_ASSERT_LESS_THAN(statsAfter.numberOfBuckets_, db->statistics().numberOfBuckets_);
+
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testBucketMerge()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+	const std::string loggedDatabaseName = databaseTestPath_ + "/dbLogged";
+
+	TS_ASSERT_THROWS_NOTHING(doTestBucketMerge(db, minPageDatabaseName, MIN_PAGE_SIZE, false));
+	TS_ASSERT_THROWS_NOTHING(doTestBucketMerge(db, maxPageDatabaseName, MAX_PAGE_SIZE, false));
+	TS_ASSERT_THROWS_NOTHING(doTestBucketMerge(db, loggedDatabaseName, MIN_PAGE_SIZE, true));
+
+	// The low watermark must stay well below the split threshold.
+	Options options = Options::readWriteSingleThreaded();
+	options.mergeFillPercent_ = 51;
+	TS_ASSERT_THROWS(db->open(maxPageDatabaseName, options), InvalidArgumentException);
+}
+
+namespace {
+
+	void doTestKeyFilter(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 2000;
+		const unsigned removedRecords = 500;
+		const unsigned missingKeys = 1000;
+		const size_type valueSize = 20;
+		const std::string filterFileName = name + ".dbf";
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.keyFilterBytes_ = 16 * 1024;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		for (unsigned i = 0; i < removedRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(i), 0));
+		}
+
+		// Most fetches of missing keys are answered by the filter.
+		std::string value;
+		for (unsigned i = 0; i < missingKeys; ++i) {
+			TS_ASSERT(! db->fetch(keyFor(numberOfRecords + i), 0, value));
+		}
+
+		TS_ASSERT_LESS_THAN(missingKeys * 9 / 10, db->statistics().keyFilterRejects_);
+
+		// Removed keys are still in the filter, but they are not found.
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_EQUALS(i >= removedRecords, db->fetch(keyFor(i), 0, value));
+		}
+
+		// Batch fetch leaves out keys rejected by the filter.
+		StringReadBatch readBatch;
+		for (unsigned i = 0; i < 10; ++i) {
+			readBatch.add(keyFor(removedRecords + i), 0);
+			readBatch.add(keyFor(numberOfRecords + i), 0);
+		}
+
+		TS_ASSERT(! db->fetch(readBatch));
+		for (unsigned i = 0; i < 10; ++i) {
+			TS_ASSERT_EQUALS(valueOfSize(valueSize, removedRecords + i), readBatch.resultAt(2 * i));
+		}
+
+		TS_ASSERT(! boost::filesystem::exists(filterFileName));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+		TS_ASSERT(boost::filesystem::exists(filterFileName));
+
+		// The saved filter is used by a read-only instance.
+		{
+			Options readOnlyOptions = Options::readOnlySingleThreaded();
+			readOnlyOptions.keyFilterBytes_ = options.keyFilterBytes_;
+
+			TS_ASSERT_THROWS_NOTHING(db->open(name, readOnlyOptions));
+
+			for (unsigned i = removedRecords; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+			for (unsigned i = 0; i < missingKeys; ++i) {
+				TS_ASSERT(! db->fetch(keyFor(numberOfRecords + i), 0, value));
+			}
+
+			TS_ASSERT_LESS_THAN(missingKeys * 9 / 10, db->statistics().keyFilterRejects_);
+			TS_ASSERT_THROWS_NOTHING(db->close());
+			TS_ASSERT(boost::filesystem::exists(filterFileName));
+		}
+
+		// Changes made without the filter make the saved filter stale.
+		{
+			Options noFilterOptions = options;
+			noFilterOptions.keyFilterBytes_ = 0;
+
+			TS_ASSERT_THROWS_NOTHING(db->open(name, noFilterOptions));
+			TS_ASSERT(! boost::filesystem::exists(filterFileName));
+
+			for (unsigned i = 0; i < removedRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+
+			TS_ASSERT_EQUALS(0U, db->statistics().keyFilterRejects_);
+			TS_ASSERT_THROWS_NOTHING(db->close());
+			TS_ASSERT(! boost::filesystem::exists(filterFileName));
+		}
+
+		// The filter is rebuilt from the stored records. Open reads no pages, fetches scan the buckets one by one
+		// and the filter rejects nothing until all buckets were scanned.
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+			TS_ASSERT_EQUALS(0U, db->statistics().pageCacheMisses_);
+
+			TS_ASSERT(! db->fetch(keyFor(numberOfRecords), 0, value));
+			TS_ASSERT_EQUALS(0U, db->statistics().keyFilterRejects_);
+
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+			for (unsigned i = 0; i < missingKeys; ++i) {
+				TS_ASSERT(! db->fetch(keyFor(numberOfRecords + i), 0, value));
+			}
+
+			TS_ASSERT_LESS_THAN(missingKeys * 9 / 10, db->statistics().keyFilterRejects_);
+			TS_ASSERT_THROWS_NOTHING(db->close());
+			TS_ASSERT(boost::filesystem::exists(filterFileName));
+		}
+
+		// Write requests scan the buckets as well, so the rebuild finishes without any fetch.
+		{
+			Options noFilterOptions = options;
+			noFilterOptions.keyFilterBytes_ = 0;
+
+			TS_ASSERT_THROWS_NOTHING(db->open(name, noFilterOptions));
+			TS_ASSERT_THROWS_NOTHING(db->close());
+			TS_ASSERT(! boost::filesystem::exists(filterFileName));
+
+			TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+			for (unsigned i = 0; i < missingKeys; ++i) {
+				TS_ASSERT(! db->fetch(keyFor(numberOfRecords + i), 0, value));
+			}
+
+			TS_ASSERT_LESS_THAN(missingKeys * 9 / 10, db->statistics().keyFilterRejects_);
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->drop(name));
+		TS_ASSERT(! boost::filesystem::exists(filterFileName));
+	}
+
+};
+
+void DatabaseTest::testKeyFilter()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestKeyFilter(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestKeyFilter(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+namespace {
+
+	void doTestRecordCache(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 500;
+		const unsigned hotRecords = 5;
+		const unsigned hotFetches = 100;
+		const size_type valueSize = 100;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+		options.recordCacheBytes_ = 16 * 1024;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		// Hot records are fetched from the cache after the first fetch.
+		for (unsigned j = 0; j < hotFetches; ++j) {
+			for (unsigned i = 0; i < hotRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+			}
+		}
+
+		Statistics stats = db->statistics();
+		TS_ASSERT_EQUALS((hotFetches - 1) * hotRecords, stats.recordCacheHits_);
+		TS_ASSERT_EQUALS(hotRecords, stats.recordCacheMisses_);
+
+		// Stored and removed values are not returned from the cache.
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(0), 0, valueSize, numberOfRecords));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(0), 0, valueSize, numberOfRecords));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(1), 0, 2 * pageSize, 1));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(1), 0, 2 * pageSize, 1));
+		TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(2), 0));
+		TS_ASSERT_THROWS_NOTHING(db->remove(keyFor(3)));
+
+		std::string value;
+		TS_ASSERT(! db->fetch(keyFor(2), 0, value));
+		TS_ASSERT(! db->fetch(keyFor(3), 0, value));
+
+		// Batch fetch is served from the cache.
+		StringReadBatch readBatch;
+		for (unsigned i = 0; i < 10; ++i) {
+			readBatch.add(keyFor(4), 0);
+		}
+
+		stats = db->statistics();
+		TS_ASSERT(db->fetch(readBatch));
+		TS_ASSERT_EQUALS(stats.recordCacheHits_ + 10, db->statistics().recordCacheHits_);
+
+		for (unsigned i = 0; i < 10; ++i) {
+			TS_ASSERT_EQUALS(valueOfSize(valueSize, 4), readBatch.resultAt(i));
+		}
+
+		// Records which do not fit into the cache evict the least recently used ones.
+		for (unsigned i = hotRecords; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		stats = db->statistics();
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(4), 0, valueSize, 4));
+		TS_ASSERT_EQUALS(stats.recordCacheMisses_ + 1, db->statistics().recordCacheMisses_);
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+};
+
+void DatabaseTest::testRecordCache()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestRecordCache(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestRecordCache(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+namespace {
+
+	size_type replacedValueSize(unsigned i, unsigned round, size_type pageSize)
+	{
+		// Same, smaller and larger inline values, then large values and back.
+		switch (round) {
+		case 0:
+			return 20;
+		case 1:
+			return 10 + (i % 5);
+		case 2:
+			return 30 + (i % 7);
+		case 3:
+			return (i % 10 == 0)? 2 * pageSize : 30 + (i % 7);
+		default:
+			return 20;
+		}
+	}
+
+	void doTestReplaceInPlace(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 1000;
+		const unsigned rounds = 5;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, 20, i));
+		}
+
+		const Statistics statsBefore = db->statistics();
+
+		for (unsigned round = 0; round < rounds; ++round) {
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, replacedValueSize(i, round, pageSize), i + round + 1));
+			}
+
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), 0, replacedValueSize(i, round, pageSize), i + round + 1));
+			}
+
+			const Statistics stats = db->statistics();
+			TS_ASSERT_EQUALS(static_cast<uint64_t>(numberOfRecords), stats.numberOfRecords_);
+
+			// Values of the original size are replaced in place, so no page is acquired.
+			if (round == 0) {
+				TS_ASSERT_EQUALS(statsBefore.dataInlineSize_, stats.dataInlineSize_);
+				TS_ASSERT_EQUALS(statsBefore.numberOfBuckets_, stats.numberOfBuckets_);
+				TS_ASSERT_EQUALS(statsBefore.overflowPagesAcquired_, stats.overflowPagesAcquired_);
+			}
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			RecordsIteratedOver records(db);
+			for (unsigned i = 0; i < numberOfRecords; ++i) {
+				TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, replacedValueSize(i, rounds - 1, pageSize), i + rounds));
+			}
+			TS_ASSERT(records.empty());
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testReplaceInPlace()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestReplaceInPlace(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestReplaceInPlace(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+void DatabaseTest::testReplaceLargeValueFailure()
+{
+	Database db = DatabaseFactory();
+	const std::string name = databaseTestPath_ + "/db";
+
+	const size_type pageSize = MIN_PAGE_SIZE;
+	const size_type largeValuePartSize = pageSize - 16; // HEADER_DATA_END_OFFSET
+	const uint32_t bitmapPageDistance = (pageSize - 16) * 8 + 1;
+	const std::string replacedKey("replaced");
+
+	Options options = Options::readWriteSingleThreaded();
+	options.pageSize_ = pageSize;
+
+	// Store a two page large value and fill the rest of the first bitmap with single page values.
+	{
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, replacedKey, 0, 2 * largeValuePartSize, 7));
+
+		for (unsigned i = 0; db->statistics().overflowFileBitmapPages_ < 2; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, largeValuePartSize, i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+	// Overwrite the second bitmap page, so that any acquisition of a page above the first bitmap fails.
+	{
+		std::fstream overflowFile((name + ".dbo").c_str(), std::ios::binary | std::ios::in | std::ios::out);
+		const std::string garbage(pageSize, 'x');
+		TS_ASSERT(overflowFile.seekp(static_cast<std::streamoff>(bitmapPageDistance + 1) * pageSize).write(garbage.data(), pageSize));
+	}
+
+	// Storing the new value fails, the record still refers to the pages of the old value.
+	{
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+		TS_ASSERT_THROWS(db->store(replacedKey, 0, valueOfSize(3 * largeValuePartSize, 8)), DatabaseCorruptedException);
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, replacedKey, 0, 2 * largeValuePartSize, 7));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+	{
+		TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+		TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, replacedKey, 0, 2 * largeValuePartSize, 7));
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	void doTestRemoveManyParts(Database db, const std::string& name, size_type pageSize)
+	{
+		const std::string partsKey("parts");
+		const unsigned numberOfParts = MAX_PARTNUM + 1;
+		const unsigned valueSize = 10;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		// Parts share pages with other records.
+		for (unsigned i = 0; i < numberOfParts; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, partsKey, static_cast<partNum_t>(i), valueSize, i));
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, valueSize, i));
+		}
+
+		// Even parts and every third other record are removed by a single request.
+		DeleteBatch deleteBatch;
+		unsigned removedRecords = 0;
+
+		for (unsigned i = 0; i < numberOfParts; ++i) {
+			if (i % 2 == 0) {
+				deleteBatch.add(partsKey, static_cast<partNum_t>(i));
+				++removedRecords;
+			}
+
+			if (i % 3 == 0) {
+				deleteBatch.add(keyFor(i), 0);
+				++removedRecords;
+			}
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->remove(deleteBatch));
+		TS_ASSERT_EQUALS(static_cast<uint64_t>(2 * numberOfParts - removedRecords), db->statistics().numberOfRecords_);
+
+		for (unsigned i = 0; i < numberOfParts; ++i) {
+			std::string value;
+
+			if (i % 2 == 0) {
+				TS_ASSERT(! db->fetch(partsKey, static_cast<partNum_t>(i), value));
+			}
+			else {
+				TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, partsKey, static_cast<partNum_t>(i), valueSize, i));
+			}
+		}
+
+		// The remaining parts are removed at once, freed space is reused by new records.
+		TS_ASSERT_THROWS_NOTHING(db->remove(partsKey));
+		TS_ASSERT_EQUALS(0U, db->listParts(partsKey).size());
+
+		for (unsigned i = 0; i < numberOfParts; i += 3) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, 2 * valueSize, i + 1));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+
+		{
+			TS_ASSERT_THROWS_NOTHING(db->open(name, Options::readOnlySingleThreaded()));
+
+			RecordsIteratedOver records(db);
+			for (unsigned i = 0; i < numberOfParts; ++i) {
+				if (i % 3 == 0) {
+					TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, 2 * valueSize, i + 1));
+				}
+				else {
+					TS_ASSERT_THROWS_NOTHING(checkAndRemoveRecordOfSize(records, keyFor(i), 0, valueSize, i));
+				}
+			}
+			TS_ASSERT(records.empty());
+
+			TS_ASSERT_THROWS_NOTHING(db->close());
+		}
+	}
+
+};
+
+void DatabaseTest::testRemoveManyParts()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestRemoveManyParts(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestRemoveManyParts(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	class CollectingValueVisitor : public IValueVisitor {
+	public:
+		CollectingValueVisitor(size_t maxParts = 0)
+			: maxParts_(maxParts)
+			, parts_(0)
+			, valueSize_(0)
+		{ }
+
+		virtual bool visit(const boost::string_ref& valuePart, size_t offset, size_t valueSize)
+		{
+			TS_ASSERT_EQUALS(value_.size(), offset);
+			TS_ASSERT(parts_ == 0 || valueSize_ == valueSize);
+
+			value_.append(valuePart.data(), valuePart.size());
+			valueSize_ = valueSize;
+			++parts_;
+
+			return maxParts_ == 0 || parts_ < maxParts_;
+		}
+
+		const size_t maxParts_;
+		size_t parts_;
+		size_t valueSize_;
+		std::string value_;
+	};
+
+	void doTestFetchVisitor(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 100;
+		const size_type largeValueSize = 3 * pageSize + 10;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, keyFor(i), 0, i, i));
+		}
+
+		TS_ASSERT_THROWS_NOTHING(storeValueOfSize(db, "large", 1, largeValueSize, 1));
+
+		// Values stored on a single page are visited at once.
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			CollectingValueVisitor visitor;
+			TS_ASSERT(db->fetch(keyFor(i), 0, visitor));
+			TS_ASSERT_EQUALS(1U, visitor.parts_);
+			TS_ASSERT_EQUALS(valueOfSize(i, i), visitor.value_);
+			TS_ASSERT_EQUALS(static_cast<size_t>(i), visitor.valueSize_);
+		}
+
+		// Large values are visited in page-sized parts.
+		{
+			CollectingValueVisitor visitor;
+			TS_ASSERT(db->fetch("large", 1, visitor));
+			TS_ASSERT_EQUALS(4U, visitor.parts_);
+			TS_ASSERT_EQUALS(valueOfSize(largeValueSize, 1), visitor.value_);
+			TS_ASSERT_EQUALS(static_cast<size_t>(largeValueSize), visitor.valueSize_);
+		}
+
+		// The visitor can skip the rest of the value.
+		{
+			CollectingValueVisitor visitor(1);
+			TS_ASSERT(db->fetch("large", 1, visitor));
+			TS_ASSERT_EQUALS(1U, visitor.parts_);
+			TS_ASSERT_EQUALS(valueOfSize(largeValueSize, 1).substr(0, visitor.value_.size()), visitor.value_);
+		}
+
+		// Missing records are not visited.
+		{
+			CollectingValueVisitor visitor;
+			TS_ASSERT(! db->fetch("large", 0, visitor));
+			TS_ASSERT(! db->fetch(keyFor(numberOfRecords), 0, visitor));
+			TS_ASSERT_THROWS(db->fetch("", 0, visitor), InvalidArgumentException);
+			TS_ASSERT_EQUALS(0U, visitor.parts_);
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+};
+
+void DatabaseTest::testFetchVisitor()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestFetchVisitor(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestFetchVisitor(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+	void doTestFlatBatch(Database db, const std::string& name, size_type pageSize)
+	{
+		const unsigned numberOfRecords = 1000;
+		const size_type largeValueSize = 2 * pageSize;
+
+		Options options = Options::readWriteSingleThreaded();
+		options.pageSize_ = pageSize;
+
+		TS_ASSERT_THROWS_NOTHING(db->open(name, options));
+
+		// Store.
+		FlatBatch storeBatch;
+		storeBatch.reserve(numberOfRecords);
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			const std::string value = valueOfSize((i % 10 == 0)? largeValueSize : i % 100, i);
+			storeBatch.add(keyFor(i), i % 3, value);
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->store(storeBatch));
+		TS_ASSERT_EQUALS(static_cast<uint64_t>(numberOfRecords), db->statistics().numberOfRecords_);
+
+		for (unsigned i = 0; i < numberOfRecords; i += 7) {
+			TS_ASSERT_THROWS_NOTHING(checkRecordValueOfSize(db, keyFor(i), i % 3, (i % 10 == 0)? largeValueSize : i % 100, i));
+		}
+
+		// Fetch, including a missing record.
+		FlatBatch fetchBatch;
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			fetchBatch.add(keyFor(i), i % 3);
+		}
+
+		TS_ASSERT(db->fetch(fetchBatch));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT(fetchBatch.isFound(i));
+			TS_ASSERT_EQUALS(storeBatch.valueAt(i), fetchBatch.resultAt(i));
+		}
+
+		fetchBatch.add(keyFor(numberOfRecords), 0);
+		TS_ASSERT(! db->fetch(fetchBatch));
+		TS_ASSERT(! fetchBatch.isFound(numberOfRecords));
+		TS_ASSERT(fetchBatch.resultAt(numberOfRecords).empty());
+		TS_ASSERT_EQUALS(storeBatch.valueAt(numberOfRecords - 1), fetchBatch.resultAt(numberOfRecords - 1));
+
+		// Small batches are not reordered.
+		FlatBatch smallBatch;
+		smallBatch.add(keyFor(1), 1);
+		smallBatch.add(keyFor(1), 2);
+		TS_ASSERT(! db->fetch(smallBatch));
+		TS_ASSERT(smallBatch.isFound(0));
+		TS_ASSERT(! smallBatch.isFound(1));
+
+		TS_ASSERT_THROWS_NOTHING(db->remove(smallBatch));
+		TS_ASSERT_EQUALS(static_cast<uint64_t>(numberOfRecords - 1), db->statistics().numberOfRecords_);
+
+		// Remove the first half.
+		FlatBatch removeBatch;
+
+		for (unsigned i = 0; i < numberOfRecords / 2; ++i) {
+			removeBatch.add(keyFor(i), i % 3);
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->remove(removeBatch));
+		TS_ASSERT_EQUALS(static_cast<uint64_t>(numberOfRecords / 2), db->statistics().numberOfRecords_);
+
+		fetchBatch.clear();
+		TS_ASSERT(fetchBatch.empty());
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			fetchBatch.add(keyFor(i), i % 3);
+		}
+
+		TS_ASSERT(! db->fetch(fetchBatch));
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			TS_ASSERT_EQUALS(i >= numberOfRecords / 2, fetchBatch.isFound(i));
+		}
+
+		// Invalid items.
+		FlatBatch invalidBatch;
+		invalidBatch.add("", 0);
+		TS_ASSERT_THROWS(db->fetch(invalidBatch), InvalidArgumentException);
+
+		invalidBatch.clear();
+		invalidBatch.add("key", MAX_PARTNUM + 1, "value");
+		TS_ASSERT_THROWS(db->store(invalidBatch), InvalidArgumentException);
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+	}
+
+};
+
+void DatabaseTest::testFlatBatch()
+{
+	Database db = DatabaseFactory();
+
+	const std::string minPageDatabaseName = databaseTestPath_ + "/dbMin";
+	const std::string maxPageDatabaseName = databaseTestPath_ + "/dbMax";
+
+	TS_ASSERT_THROWS_NOTHING(doTestFlatBatch(db, minPageDatabaseName, MIN_PAGE_SIZE));
+	TS_ASSERT_THROWS_NOTHING(doTestFlatBatch(db, maxPageDatabaseName, MAX_PAGE_SIZE));
+}
@@ -49,6 +49,7 @@ public:
 	void testCreatePreallocatedDatabase();
 	void testBucketSplit();
 	void testBucketSplitLargeValues();
+	void testInterruptedSplit();
 
 	void testReferenceBatchRequests();
 	void testCopyBatchRequests();
@@ -57,6 +58,25 @@ public:
 	void testStoreLimit();
 	void testFetchLimit();
 
+	void testPageCache();
+	void testWriteAheadLog();
+	void testStreamLargeValue();
+	void testBitmapSummary();
+	void testOverflowFileLargerThan4GB();
+	void testIncrementalSplit();
+	void testRemoveDuringSplit();
+	void testBulkLoad();
+	void testCompaction();
+	void testCompactionDuringWrites();
+	void testBucketMerge();
+	void testKeyFilter();
+	void testRecordCache();
+	void testReplaceInPlace();
+	void testReplaceLargeValueFailure();
+	void testRemoveManyParts();
+	void testFetchVisitor();
+	void testFlatBatch();
+
 private:
 	std::string databaseTestPath_;
 	boost::scoped_ptr<kerio::hashdb::IPageAllocator> allocator_;
@@ -167,3 +167,44 @@ void HeaderPageTest::testSetUpAndValidateOverflowPage()
 	overflowPage.clearDirtyFlag();
 	TS_ASSERT_THROWS_NOTHING(overflowPage.validate());
 }
+
+void HeaderPageTest::testBitmapSummary()
+{
+	OverflowHeaderPage overflowPage(allocator_.get(), MIN_PAGE_SIZE);
+	overflowPage.setUp(0);
+
+	const uint32_t summarizedPages = overflowPage.summarizedBitmapPages();
+	TS_ASSERT_EQUALS((MIN_PAGE_SIZE - 56) * 8, summarizedPages);
+
+	// New header has no full bitmap pages.
+	TS_ASSERT(! overflowPage.isBitmapPageFull(0));
+	TS_ASSERT_EQUALS(0U, overflowPage.nextBitmapPageWithFreeSpace(0));
+	TS_ASSERT_EQUALS(summarizedPages - 1, overflowPage.nextBitmapPageWithFreeSpace(summarizedPages - 1));
+
+	// Full pages are skipped.
+	for (uint32_t i = 0; i < 21; ++i) {
+		overflowPage.setBitmapPageFull(i, true);
+	}
+
+	TS_ASSERT(overflowPage.isBitmapPageFull(20));
+	TS_ASSERT(! overflowPage.isBitmapPageFull(21));
+	TS_ASSERT_EQUALS(21U, overflowPage.nextBitmapPageWithFreeSpace(0));
+	TS_ASSERT_EQUALS(21U, overflowPage.nextBitmapPageWithFreeSpace(5));
+
+	overflowPage.setBitmapPageFull(3, false);
+	TS_ASSERT_EQUALS(3U, overflowPage.nextBitmapPageWithFreeSpace(0));
+	TS_ASSERT_EQUALS(21U, overflowPage.nextBitmapPageWithFreeSpace(4));
+
+	overflowPage.setBitmapPageFull(summarizedPages - 1, true);
+	TS_ASSERT_EQUALS(summarizedPages, overflowPage.nextBitmapPageWithFreeSpace(summarizedPages - 1));
+	TS_ASSERT_THROWS(overflowPage.setBitmapPageFull(summarizedPages, true), InternalErrorException);
+
+	// Summary is covered by the header checksum.
+	overflowPage.updateChecksum();
+	TS_ASSERT_THROWS_NOTHING(overflowPage.validate());
+
+	overflowPage.setBitmapPageFull(22, true);
+	TS_ASSERT_THROWS(overflowPage.validate(), DatabaseCorruptedException);
+
+	overflowPage.clearDirtyFlag();
+}
@@ -35,6 +35,7 @@ public:
 	void testEncodePage();
 	void testSetUpAndValidateBucketPage();
 	void testSetUpAndValidateOverflowPage();
+	void testBitmapSummary();
 
 private:
 	boost::scoped_ptr<kerio::hashdb::IPageAllocator> allocator_;
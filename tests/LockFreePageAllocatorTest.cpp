@@ -0,0 +1,156 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+#include "stdafx.h"
+#include <boost/thread/thread.hpp>
+#include <kerio/hashdb/HashDB.h>
+#include <kerio/hashdb/Constants.h>
+#include <kerio/hashdb/Exception.h>
+#include "utils/ConfigUtils.h"
+#include "db/LockFreePageAllocator.h"
+#include "LockFreePageAllocatorTest.h"
+
+using namespace kerio::hashdb;
+
+void LockFreePageAllocatorTest::testInvalidRequest()
+{
+	const size_type pageSize = MIN_PAGE_SIZE;
+	const size_type cacheSize = pageSize * 5;
+
+	boost::scoped_ptr<IPageAllocator> allocator(new LockFreePageAllocator(cacheSize));
+	TS_ASSERT_THROWS(allocator->allocate(0), InternalErrorException);
+	TS_ASSERT_THROWS(allocator->allocate(333), InternalErrorException);
+	TS_ASSERT_THROWS(allocator->deallocate(NULL, NULL), InternalErrorException);
+
+	{
+		IPageAllocator::PageMemoryPtr ptr = allocator->allocate(pageSize); // All subsequent allocations must use pageSize.
+	}
+
+	{
+		TS_ASSERT_THROWS(allocator->allocate(defaultPageSize()), InternalErrorException);
+	}
+
+	TS_ASSERT_EQUALS(1U, allocator->heldPages());
+}
+
+void LockFreePageAllocatorTest::testAllocate()
+{
+	const size_type pageSize = MIN_PAGE_SIZE;
+	const size_type cachePages = LockFreePageAllocator::MAGAZINE_SIZE + 4;
+	const size_type cacheSize = pageSize * cachePages;
+	const size_type testMaxPages = 2 * cachePages;
+
+	boost::scoped_ptr<IPageAllocator> allocator(new LockFreePageAllocator(cacheSize));
+	std::vector<IPageAllocator::PageMemoryPtr> allocatedEntries;
+
+	for (size_type i = 0; i < testMaxPages; ++i) {
+		allocatedEntries.push_back(allocator->allocate(pageSize));
+		TS_ASSERT_EQUALS(0U, allocator->heldPages());
+	}
+
+	// Released pages fill the magazine and then the depot up to the limit.
+	for (size_type i = 0; i < testMaxPages; ++i) {
+		allocatedEntries.pop_back();
+		TS_ASSERT_EQUALS(std::min(i + 1, cachePages), allocator->heldPages());
+	}
+
+	// Held pages are reused.
+	for (size_type i = 0; i < cachePages; ++i) {
+		allocatedEntries.push_back(allocator->allocate(pageSize));
+		TS_ASSERT_EQUALS(cachePages - i - 1, allocator->heldPages());
+	}
+
+	allocatedEntries.clear();
+	TS_ASSERT_EQUALS(cachePages, allocator->heldPages());
+
+	allocator->freeSomeMemory();
+	TS_ASSERT_EQUALS(0U, allocator->heldPages());
+}
+
+namespace {
+
+	class AllocatingThread : boost::noncopyable {
+	public:
+		static const size_type ROUNDS = 2000;
+		static const size_type PAGES_PER_ROUND = 5;
+
+		AllocatingThread(IPageAllocator& allocator, std::vector<IPageAllocator::PageMemoryPtr>& exchange, boost::mutex& exchangeMutex)
+			: allocator_(allocator)
+			, exchange_(exchange)
+			, exchangeMutex_(exchangeMutex)
+		{ }
+
+		// Pages allocated by one thread are often released by another.
+		void operator()()
+		{
+			for (size_type round = 0; round < ROUNDS; ++round) {
+				std::vector<IPageAllocator::PageMemoryPtr> pages;
+
+				for (size_type i = 0; i < PAGES_PER_ROUND; ++i) {
+					pages.push_back(allocator_.allocate(MIN_PAGE_SIZE));
+					pages.back().get()[0] = static_cast<IPageAllocator::value_type>(i);
+				}
+
+				boost::mutex::scoped_lock lock(exchangeMutex_);
+				exchange_.swap(pages);
+			}
+		}
+
+	private:
+		IPageAllocator& allocator_;
+		std::vector<IPageAllocator::PageMemoryPtr>& exchange_;
+		boost::mutex& exchangeMutex_;
+	};
+
+};
+
+void LockFreePageAllocatorTest::testConcurrentAllocate()
+{
+	const size_type cachePages = 20;
+	const size_type numberOfThreads = 4;
+
+	LockFreePageAllocator allocator(cachePages * MIN_PAGE_SIZE);
+
+	std::vector<IPageAllocator::PageMemoryPtr> exchange;
+	boost::mutex exchangeMutex;
+
+	boost::scoped_ptr<AllocatingThread> threads[numberOfThreads];
+	boost::thread_group threadGroup;
+
+	for (size_type i = 0; i < numberOfThreads; ++i) {
+		threads[i].reset(new AllocatingThread(allocator, exchange, exchangeMutex));
+		threadGroup.create_thread(boost::ref(*threads[i]));
+	}
+
+	threadGroup.join_all();
+	exchange.clear();
+
+	TS_ASSERT_LESS_THAN_EQUALS(allocator.heldPages(), cachePages);
+	TS_ASSERT_LESS_THAN(0U, allocator.heldPages());
+
+	allocator.freeSomeMemory();
+	TS_ASSERT_EQUALS(0U, allocator.heldPages());
+}
@@ -136,3 +136,68 @@ void ManagementTest::testDrop()
 	TS_ASSERT(! db->exists(newDb));
 	TS_ASSERT(! db->exists(notADb));
 }
+
+//-----------------------------------------------------------------------------
+// Tests that a database is opened with the built-in hash function which created it.
+
+namespace {
+
+	uint32_t customHash(const char* key, size_t len)
+	{
+		uint32_t hash = 2166136261U;
+
+		for (size_t i = 0; i < len; ++i) {
+			hash = (hash ^ static_cast<uint8_t>(key[i])) * 16777619U;
+		}
+
+		return hash;
+	}
+
+}; // anonymous namespace
+
+void ManagementTest::testHashFunction()
+{
+	const std::string wyHashDb(databaseTestPath_ + "/wyhash");
+	const std::string customDb(databaseTestPath_ + "/custom");
+	const unsigned numberOfKeys = 500;
+
+	TS_ASSERT(Options::builtInHashFunction(Options::CustomHashFunctionType) == NULL);
+	TS_ASSERT_EQUALS(Options::readWriteSingleThreaded().hashFunctionType(), Options::Murmur3HashFunctionType);
+
+	// Create a database with the built-in wyhash function.
+	Options wyHashOptions = Options::readWriteSingleThreaded();
+	wyHashOptions.hashFun_ = Options::builtInHashFunction(Options::WyHashFunctionType);
+	TS_ASSERT_EQUALS(wyHashOptions.hashFunctionType(), Options::WyHashFunctionType);
+
+	Database db = DatabaseFactory();
+	TS_ASSERT_THROWS_NOTHING(db->open(wyHashDb, wyHashOptions));
+
+	for (unsigned i = 0; i < numberOfKeys; ++i) {
+		db->store(keyFor(i), 0, keyFor(i));
+	}
+
+	TS_ASSERT_THROWS_NOTHING(db->close());
+
+	// Default options use MurmurHash3, but the database is opened with wyhash recorded in its header.
+	TS_ASSERT_THROWS_NOTHING(db->open(wyHashDb, Options::readWriteSingleThreaded()));
+
+	std::string value;
+	for (unsigned i = 0; i < numberOfKeys; ++i) {
+		TS_ASSERT(db->fetch(keyFor(i), 0, value));
+		TS_ASSERT_EQUALS(value, keyFor(i));
+	}
+
+	TS_ASSERT_THROWS_NOTHING(db->close());
+
+	// A custom hash function is not recorded, so it is checked by the test hash.
+	Options customOptions = Options::readWriteSingleThreaded();
+	customOptions.hashFun_ = customHash;
+	TS_ASSERT_EQUALS(customOptions.hashFunctionType(), Options::CustomHashFunctionType);
+
+	TS_ASSERT_THROWS_NOTHING(db->open(customDb, customOptions));
+	TS_ASSERT_THROWS_NOTHING(db->close());
+
+	TS_ASSERT_THROWS(db->open(customDb, Options::readWriteSingleThreaded()), InvalidArgumentException);
+	TS_ASSERT_THROWS_NOTHING(db->open(customDb, customOptions));
+	TS_ASSERT_THROWS_NOTHING(db->close());
+}
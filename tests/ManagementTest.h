@@ -37,6 +37,7 @@ public:
 	void testExists();
 	void testRename();
 	void testDrop();
+	void testHashFunction();
 
 private:
 	std::string databaseTestPath_;
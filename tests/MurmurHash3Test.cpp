@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include <kerio/hashdb/HashDB.h>
 #include <kerio/hashdb/Exception.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
 #include "utils/MurmurHash3.h"
 #include "utils/MurmurHash3Adapter.h"
 #include "MurmurHash3Test.h"
@@ -80,3 +82,36 @@ void MurmurHash3Test::testAdapter()
 	const uint32_t result2 = kerio::hashdb::murmur3Hash(testValue2, sizeof(testValue2));
 	TS_ASSERT_EQUALS(0xE7F2C661U, result2);
 }
+
+void MurmurHash3Test::testHashMany()
+{
+	boost::random::mt19937 rng(4321);
+	boost::random::uniform_int_distribution<int> lengthDist(0, 200);
+	boost::random::uniform_int_distribution<int> byteDist(0, 255);
+
+	// Counts which are not a multiple of the lane width leave a scalar remainder.
+	const size_t counts[] = { 0, 1, 3, 4, 5, 8, 11, 16, 37 };
+
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+		std::vector<std::string> values(counts[c]);
+		std::vector<boost::string_ref> keys;
+
+		for (size_t i = 0; i < values.size(); ++i) {
+			values[i].resize(lengthDist(rng));
+			for (size_t j = 0; j < values[i].size(); ++j) {
+				values[i][j] = static_cast<char>(byteDist(rng));
+			}
+
+			keys.push_back(values[i]);
+		}
+
+		std::vector<uint32_t> hashes(keys.size() + 1, 0xdeadbeef);
+		kerio::hashdb::murmur3HashMany(keys.empty()? NULL : &keys[0], keys.size(), &hashes[0]);
+
+		for (size_t i = 0; i < keys.size(); ++i) {
+			TS_ASSERT_EQUALS(kerio::hashdb::murmur3Hash(keys[i].data(), keys[i].size()), hashes[i]);
+		}
+
+		TS_ASSERT_EQUALS(0xdeadbeefU, hashes[keys.size()]);
+	}
+}
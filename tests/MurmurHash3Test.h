@@ -6,4 +6,5 @@ public:
 	void testValidate128bitHash_x86();
 	void testValidate128bitHash_x64();
 	void testAdapter();
+	void testHashMany();
 };
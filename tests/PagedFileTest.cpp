@@ -268,3 +268,110 @@ void PagedFileTest::testReadOnly()
 	TS_ASSERT_THROWS_NOTHING(deleteFile(fileName_));
 	page.clearDirtyFlag();
 }
+
+void PagedFileTest::testMapped()
+{
+	static const unsigned TEST_PAGES = 3;
+	static const size_type VALUE_OFFSET = 16;
+
+	// Mapping is allowed only for read-only files.
+	Options options = Options::readWriteSingleThreaded();
+	options.mapFiles_ = true;
+	TS_ASSERT_THROWS(PagedFile(fileName_, PageId::BucketFileType, options, environment_), InvalidArgumentException);
+
+	// Create a paged file with 3 pages.
+	options.mapFiles_ = false;
+	boost::scoped_ptr<PagedFile> writtenFile;
+	TS_ASSERT_THROWS_NOTHING(writtenFile.reset(new PagedFile(fileName_, PageId::BucketFileType, options, environment_)));
+
+	BucketDataPage page(allocator_.get(), defaultPageSize());
+	for (unsigned i = 0; i < TEST_PAGES; ++i) {
+		page.setUp(i);
+		page.put32(VALUE_OFFSET, 1000 + i);
+		TS_ASSERT_THROWS_NOTHING(writtenFile->write(page));
+	}
+
+	// Open it mapped.
+	Options mappedOptions = Options::readOnlySingleThreaded();
+	TS_ASSERT(mappedOptions.mapFiles_);
+
+	boost::scoped_ptr<PagedFile> file;
+	TS_ASSERT_THROWS_NOTHING(file.reset(new PagedFile(fileName_, PageId::BucketFileType, mappedOptions, environment_)));
+	TS_ASSERT(file->isMapped());
+
+	BucketDataPage readPage(allocator_.get(), defaultPageSize());
+	for (unsigned i = 0; i < TEST_PAGES; ++i) {
+		TS_ASSERT_THROWS_NOTHING(file->read(readPage, bucketFilePage(i)));
+		TS_ASSERT_EQUALS(readPage.getPageNumber(), i);
+		TS_ASSERT_EQUALS(readPage.get32(VALUE_OFFSET), 1000 + i);
+		TS_ASSERT(! readPage.dirty());
+	}
+
+	// Pages beyond the end of file cannot be read.
+	TS_ASSERT_THROWS(file->read(readPage, bucketFilePage(TEST_PAGES)), IoException);
+
+	// Mapping follows the growing file.
+	page.setUp(TEST_PAGES);
+	page.put32(VALUE_OFFSET, 1000 + TEST_PAGES);
+	TS_ASSERT_THROWS_NOTHING(writtenFile->write(page));
+
+	TS_ASSERT_THROWS_NOTHING(file->read(readPage, bucketFilePage(TEST_PAGES)));
+	TS_ASSERT_EQUALS(readPage.get32(VALUE_OFFSET), 1000U + TEST_PAGES);
+
+	// Mapping is private, modifications of page views are not written to the file.
+	BucketDataPage viewPage(file->pageView(bucketFilePage(1)), defaultPageSize());
+	viewPage.setId(bucketFilePage(1));
+	viewPage.put32(VALUE_OFFSET, 0);
+	viewPage.clearDirtyFlag();
+
+	TS_ASSERT_THROWS_NOTHING(writtenFile->read(page, bucketFilePage(1)));
+	TS_ASSERT_EQUALS(page.get32(VALUE_OFFSET), 1001U);
+	TS_ASSERT_THROWS_NOTHING(file->read(readPage, bucketFilePage(1)));
+
+	// Views remain valid after the file is closed.
+	TS_ASSERT_THROWS_NOTHING(file->close());
+	TS_ASSERT_THROWS_NOTHING(file.reset());
+	TS_ASSERT_EQUALS(readPage.getPageNumber(), 1U);
+
+	// Cleanup.
+	TS_ASSERT_THROWS_NOTHING(writtenFile->close());
+	TS_ASSERT_THROWS_NOTHING(writtenFile.reset());
+	TS_ASSERT_THROWS_NOTHING(deleteFile(fileName_));
+}
+
+void PagedFileTest::testPrefetchPages()
+{
+	static const unsigned TEST_PAGES = 8;
+
+	Options options = Options::readWriteSingleThreaded();
+	boost::scoped_ptr<PagedFile> file;
+	TS_ASSERT_THROWS_NOTHING(file.reset(new PagedFile(fileName_, PageId::BucketFileType, options, environment_)));
+
+	BucketDataPage page(allocator_.get(), defaultPageSize());
+	for (unsigned i = 0; i < TEST_PAGES; ++i) {
+		page.setUp(i);
+		TS_ASSERT_THROWS_NOTHING(file->write(page));
+	}
+
+	// Prefetch is only a hint, it never fails.
+	std::vector<uint32_t> pageNumbers;
+	TS_ASSERT_THROWS_NOTHING(file->prefetchPages(pageNumbers));
+
+	pageNumbers.push_back(1);
+	pageNumbers.push_back(2);
+	pageNumbers.push_back(3);
+	pageNumbers.push_back(5);
+	pageNumbers.push_back(7);
+	pageNumbers.push_back(TEST_PAGES + 10);
+	TS_ASSERT_THROWS_NOTHING(file->prefetchPages(pageNumbers));
+
+	for (std::vector<uint32_t>::const_iterator ii = pageNumbers.begin(); *ii < TEST_PAGES; ++ii) {
+		TS_ASSERT_THROWS_NOTHING(file->read(page, bucketFilePage(*ii)));
+		TS_ASSERT_EQUALS(page.getPageNumber(), *ii);
+	}
+
+	// Cleanup.
+	TS_ASSERT_THROWS_NOTHING(file->close());
+	TS_ASSERT_THROWS_NOTHING(file.reset());
+	TS_ASSERT_THROWS_NOTHING(deleteFile(fileName_));
+}
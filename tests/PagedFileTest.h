@@ -39,6 +39,8 @@ public:
 	void testPageSize();
 	void testReadWrite();
 	void testReadOnly();
+	void testMapped();
+	void testPrefetchPages();
 
 private:
 	std::string fileName_;
@@ -0,0 +1,213 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+#include "stdafx.h"
+#include <kerio/hashdb/HashDB.h>
+#include <kerio/hashdb/Constants.h>
+#include <kerio/hashdb/Exception.h>
+#include "db/SharedBufferPool.h"
+#include "testUtils/FileUtils.h"
+#include "testUtils/StringUtils.h"
+#include "SharedBufferPoolTest.h"
+
+using namespace kerio::hashdb;
+
+namespace {
+
+	class TestClient : public IBufferPoolClient {
+	public:
+		TestClient()
+			: cachedPages_(0)
+			, busy_(false)
+		{ }
+
+		virtual size_type releaseColdPages(size_type pages)
+		{
+			size_type releasedPages = 0;
+
+			if (! busy_) {
+				releasedPages = (pages < cachedPages_)? pages : cachedPages_;
+				cachedPages_ -= releasedPages;
+			}
+
+			return releasedPages;
+		}
+
+		bool acquire(SharedBufferPool& pool)
+		{
+			const bool granted = pool.acquireFrame(this, false);
+			if (granted) {
+				++cachedPages_;
+			}
+
+			return granted;
+		}
+
+		size_type cachedPages_;
+		bool busy_;
+	};
+
+};
+
+void SharedBufferPoolTest::testQuotas()
+{
+	const size_type frameSize = MIN_PAGE_SIZE;
+
+	TS_ASSERT_THROWS(BufferPoolFactory(0), InvalidArgumentException);
+	SharedBufferPool pool(10 * frameSize);
+
+	TestClient client;
+	pool.attach(&client, frameSize, 2 * frameSize, 4 * frameSize);
+	TS_ASSERT_THROWS(pool.attach(&client, frameSize, 0, 0), InternalErrorException);
+
+	// Frames are granted up to the hard quota.
+	for (size_type i = 0; i < 4; ++i) {
+		TS_ASSERT(client.acquire(pool));
+	}
+
+	TS_ASSERT(! client.acquire(pool));
+	TS_ASSERT_EQUALS(4U, client.cachedPages_);
+	TS_ASSERT_EQUALS(4 * frameSize, pool.heldBytes());
+
+	// Forced frames are always granted.
+	TS_ASSERT(pool.acquireFrame(&client, true));
+	TS_ASSERT_EQUALS(5 * frameSize, pool.heldBytes());
+
+	pool.releaseFrames(&client, 5);
+	TS_ASSERT_EQUALS(0U, pool.heldBytes());
+	TS_ASSERT_THROWS(pool.releaseFrames(&client, 1), InternalErrorException);
+
+	pool.detach(&client);
+	TS_ASSERT_THROWS(pool.detach(&client), InternalErrorException);
+}
+
+void SharedBufferPoolTest::testReclaim()
+{
+	const size_type frameSize = MIN_PAGE_SIZE;
+	SharedBufferPool pool(8 * frameSize);
+
+	TestClient idleClient;
+	TestClient busyClient;
+	TestClient activeClient;
+
+	pool.attach(&idleClient, frameSize, 2 * frameSize, 0);
+	pool.attach(&busyClient, frameSize, 2 * frameSize, 0);
+	pool.attach(&activeClient, frameSize, 2 * frameSize, 0);
+
+	// Idle client fills the pool first, then the busy client takes the rest.
+	for (size_type i = 0; i < 5; ++i) {
+		TS_ASSERT(idleClient.acquire(pool));
+	}
+
+	for (size_type i = 0; i < 3; ++i) {
+		TS_ASSERT(busyClient.acquire(pool));
+	}
+
+	TS_ASSERT_EQUALS(8 * frameSize, pool.heldBytes());
+
+	// Active client can use its soft quota even if the pool is exhausted.
+	TS_ASSERT(activeClient.acquire(pool));
+	TS_ASSERT(activeClient.acquire(pool));
+	TS_ASSERT_EQUALS(10 * frameSize, pool.heldBytes());
+
+	// Frames above soft quota are taken back from the idle client, but not below its soft quota.
+	busyClient.busy_ = true;
+	TS_ASSERT(activeClient.acquire(pool));
+	TS_ASSERT_EQUALS(2U, idleClient.cachedPages_);
+	TS_ASSERT_EQUALS(3U, busyClient.cachedPages_);
+	TS_ASSERT_EQUALS(3U, activeClient.cachedPages_);
+	TS_ASSERT_EQUALS(8 * frameSize, pool.heldBytes());
+
+	// No other client can give frames back.
+	TS_ASSERT(! activeClient.acquire(pool));
+
+	// The busy client becomes idle.
+	busyClient.busy_ = false;
+	TS_ASSERT(activeClient.acquire(pool));
+	TS_ASSERT_EQUALS(2U, busyClient.cachedPages_);
+
+	pool.detach(&idleClient);
+	pool.detach(&busyClient);
+	pool.detach(&activeClient);
+	TS_ASSERT_EQUALS(0U, pool.heldBytes());
+}
+
+void SharedBufferPoolTest::testDatabasesSharingPool()
+{
+	removeTestDirectory();
+	createTestDirectory();
+
+	const size_type pageSize = MIN_PAGE_SIZE;
+	const unsigned numberOfRecords = 200;
+	const size_type valueSize = 100;
+
+	BufferPool pool = BufferPoolFactory(16 * pageSize);
+
+	Options options = Options::readWriteSingleThreaded();
+	options.pageSize_ = pageSize;
+	options.bufferPool_ = pool;
+	options.bufferPoolSoftQuota_ = 4 * pageSize;
+	options.bufferPoolHardQuota_ = 12 * pageSize;
+
+	Database first = DatabaseFactory();
+	Database second = DatabaseFactory();
+	TS_ASSERT_THROWS_NOTHING(first->open(getTestPath() + "/first", options));
+	TS_ASSERT_THROWS_NOTHING(second->open(getTestPath() + "/second", options));
+
+	for (unsigned i = 0; i < numberOfRecords; ++i) {
+		TS_ASSERT_THROWS_NOTHING(first->store(keyFor(i), 0, valueOfSize(valueSize, i)));
+	}
+
+	TS_ASSERT_LESS_THAN_EQUALS(pool->heldBytes(), 12 * pageSize);
+
+	// Only clean pages of the first database can be reclaimed.
+	TS_ASSERT_THROWS_NOTHING(first->flush());
+	const size_type flushedEvictions = first->statistics().pageCacheEvictions_;
+
+	for (unsigned i = 0; i < numberOfRecords; ++i) {
+		TS_ASSERT_THROWS_NOTHING(second->store(keyFor(i), 0, valueOfSize(valueSize, i + 1)));
+	}
+
+	TS_ASSERT_LESS_THAN_EQUALS(pool->heldBytes(), 16 * pageSize);
+	TS_ASSERT_LESS_THAN(flushedEvictions, first->statistics().pageCacheEvictions_);
+
+	for (unsigned i = 0; i < numberOfRecords; ++i) {
+		std::string value;
+		TS_ASSERT(first->fetch(keyFor(i), 0, value));
+		TS_ASSERT_EQUALS(valueOfSize(valueSize, i), value);
+
+		TS_ASSERT(second->fetch(keyFor(i), 0, value));
+		TS_ASSERT_EQUALS(valueOfSize(valueSize, i + 1), value);
+	}
+
+	TS_ASSERT_LESS_THAN_EQUALS(pool->heldBytes(), 16 * pageSize);
+
+	TS_ASSERT_THROWS_NOTHING(first->close());
+	TS_ASSERT_THROWS_NOTHING(second->close());
+	TS_ASSERT_EQUALS(0U, pool->heldBytes());
+
+	removeTestDirectory();
+}
@@ -0,0 +1,277 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+#include "stdafx.h"
+#include <boost/thread/thread.hpp>
+#include <kerio/hashdb/HashDB.h>
+#include <kerio/hashdb/Constants.h>
+#include <kerio/hashdb/Exception.h>
+#include "db/TrueLockManager.h"
+#include "testUtils/FileUtils.h"
+#include "testUtils/StringUtils.h"
+#include "TrueLockManagerTest.h"
+
+using namespace kerio::hashdb;
+
+namespace {
+
+	class WaitingWriter : boost::noncopyable {
+	public:
+		WaitingWriter(TrueLockManager& lockManager, const PageId& pageId)
+			: lockManager_(lockManager)
+			, pageId_(pageId)
+			, lockSet_(lockManager.newLockSet())
+			, acquired_(false)
+		{ }
+
+		void operator()()
+		{
+			lockManager_.acquireWriteLock(lockSet_, pageId_);
+
+			boost::mutex::scoped_lock lock(mutex_);
+			acquired_ = true;
+		}
+
+		bool acquired()
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			return acquired_;
+		}
+
+		void release()
+		{
+			lockManager_.releaseLockSet(lockSet_);
+		}
+
+	private:
+		TrueLockManager& lockManager_;
+		const PageId pageId_;
+		const ILockManager::lockSet_t lockSet_;
+
+		boost::mutex mutex_;
+		bool acquired_;
+	};
+
+	void waitForOtherThread()
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	}
+
+};
+
+void TrueLockManagerTest::testReadLocksAreShared()
+{
+	TrueLockManager lockManager;
+	const PageId pageId = bucketFilePage(1);
+
+	const ILockManager::lockSet_t first = lockManager.newLockSet();
+	const ILockManager::lockSet_t second = lockManager.newLockSet();
+	TS_ASSERT_DIFFERS(first, second);
+
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireReadLock(first, pageId));
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireReadLock(second, pageId));
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireWriteLock(second, overflowFilePage(1)));
+	TS_ASSERT_EQUALS(2U, lockManager.lockedPages());
+
+	lockManager.releaseLockSet(first);
+	TS_ASSERT_EQUALS(2U, lockManager.lockedPages());
+
+	lockManager.releaseLockSet(second);
+	TS_ASSERT_EQUALS(0U, lockManager.lockedPages());
+
+	TS_ASSERT_THROWS(lockManager.acquireReadLock(0, pageId), InternalErrorException);
+	TS_ASSERT_THROWS(lockManager.acquireReadLock(first, PageId()), InternalErrorException);
+}
+
+void TrueLockManagerTest::testWriteLockIsExclusive()
+{
+	TrueLockManager lockManager;
+	const PageId pageId = bucketFilePage(1);
+
+	// Writer waits until the reader releases the page.
+	const ILockManager::lockSet_t reader = lockManager.newLockSet();
+	lockManager.acquireReadLock(reader, pageId);
+
+	WaitingWriter writer(lockManager, pageId);
+	boost::thread writerThread(boost::ref(writer));
+
+	waitForOtherThread();
+	TS_ASSERT(! writer.acquired());
+
+	lockManager.releaseLockSet(reader);
+	writerThread.join();
+	TS_ASSERT(writer.acquired());
+
+	// Second writer waits until the first one releases the page.
+	WaitingWriter secondWriter(lockManager, pageId);
+	boost::thread secondWriterThread(boost::ref(secondWriter));
+
+	waitForOtherThread();
+	TS_ASSERT(! secondWriter.acquired());
+
+	writer.release();
+	secondWriterThread.join();
+	TS_ASSERT(secondWriter.acquired());
+
+	secondWriter.release();
+	TS_ASSERT_EQUALS(0U, lockManager.lockedPages());
+}
+
+void TrueLockManagerTest::testLockSetReacquire()
+{
+	TrueLockManager lockManager;
+	const PageId readPageId = bucketFilePage(1);
+	const PageId writtenPageId = bucketFilePage(2);
+
+	const ILockManager::lockSet_t lockSet = lockManager.newLockSet();
+	lockManager.acquireReadLock(lockSet, readPageId);
+	lockManager.acquireWriteLock(lockSet, writtenPageId);
+
+	// Locks already held by the set are not acquired again.
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireReadLock(lockSet, readPageId));
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireWriteLock(lockSet, writtenPageId));
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireReadLock(lockSet, writtenPageId));
+	TS_ASSERT_THROWS(lockManager.acquireWriteLock(lockSet, readPageId), InternalErrorException);
+
+	// Released lock set can be used again.
+	lockManager.releaseLockSet(lockSet);
+	TS_ASSERT_EQUALS(0U, lockManager.lockedPages());
+
+	TS_ASSERT_THROWS_NOTHING(lockManager.acquireWriteLock(lockSet, readPageId));
+	TS_ASSERT_EQUALS(1U, lockManager.lockedPages());
+
+	lockManager.releaseLockSet(lockSet);
+	TS_ASSERT_EQUALS(0U, lockManager.lockedPages());
+}
+
+namespace {
+
+	class DatabaseClient : boost::noncopyable {
+	public:
+		static const unsigned RECORDS_PER_CLIENT = 300;
+		static const size_type VALUE_SIZE = 100;
+
+		DatabaseClient(Database db, unsigned clientNumber)
+			: db_(db)
+			, clientNumber_(clientNumber)
+			, errors_(0)
+		{ }
+
+		// Each client writes its own records and reads the records of the other clients.
+		void operator()()
+		{
+			try {
+				for (unsigned i = 0; i < RECORDS_PER_CLIENT; ++i) {
+					const unsigned recordNumber = clientNumber_ * RECORDS_PER_CLIENT + i;
+					db_->store(keyFor(recordNumber), 0, valueOfSize(VALUE_SIZE, recordNumber));
+
+					std::string value;
+					if (! db_->fetch(keyFor(recordNumber), 0, value) || value != valueOfSize(VALUE_SIZE, recordNumber)) {
+						++errors_;
+					}
+
+					const unsigned otherRecordNumber = (recordNumber + RECORDS_PER_CLIENT) % (4 * RECORDS_PER_CLIENT);
+					if (db_->fetch(keyFor(otherRecordNumber), 0, value) && value != valueOfSize(VALUE_SIZE, otherRecordNumber)) {
+						++errors_;
+					}
+				}
+			} catch (std::exception&) {
+				++errors_;
+			}
+		}
+
+		unsigned errors() const
+		{
+			return errors_;
+		}
+
+	private:
+		Database db_;
+		const unsigned clientNumber_;
+		unsigned errors_;
+	};
+
+	void runConcurrentClients(const Options& options)
+	{
+		removeTestDirectory();
+		createTestDirectory();
+
+		const unsigned numberOfClients = 4;
+
+		Database db = DatabaseFactory();
+		TS_ASSERT_THROWS_NOTHING(db->open(getTestPath() + "/multi", options));
+
+		boost::scoped_ptr<DatabaseClient> clients[numberOfClients];
+		boost::thread_group threads;
+
+		for (unsigned i = 0; i < numberOfClients; ++i) {
+			clients[i].reset(new DatabaseClient(db, i));
+			threads.create_thread(boost::ref(*clients[i]));
+		}
+
+		threads.join_all();
+
+		for (unsigned i = 0; i < numberOfClients; ++i) {
+			TS_ASSERT_EQUALS(0U, clients[i]->errors());
+		}
+
+		// All records were stored although buckets were split meanwhile.
+		const unsigned numberOfRecords = numberOfClients * DatabaseClient::RECORDS_PER_CLIENT;
+		TS_ASSERT_EQUALS(numberOfRecords, db->statistics().numberOfRecords_);
+		TS_ASSERT_LESS_THAN(1U, db->statistics().numberOfBuckets_);
+
+		for (unsigned i = 0; i < numberOfRecords; ++i) {
+			std::string value;
+			TS_ASSERT(db->fetch(keyFor(i), 0, value));
+			TS_ASSERT_EQUALS(valueOfSize(DatabaseClient::VALUE_SIZE, i), value);
+		}
+
+		TS_ASSERT_THROWS_NOTHING(db->close());
+		removeTestDirectory();
+	}
+
+};
+
+void TrueLockManagerTest::testConcurrentDatabaseRequests()
+{
+	Options options = Options::readWriteMultiThreaded();
+	options.pageSize_ = MIN_PAGE_SIZE;
+	options.pageCacheBytes_ = 8 * MIN_PAGE_SIZE;
+
+	runConcurrentClients(options);
+}
+
+void TrueLockManagerTest::testConcurrentLoggedDatabaseRequests()
+{
+	// Pages evicted by concurrent requests are appended to the log while other pages are read from the files.
+	Options options = Options::readWriteMultiThreaded();
+	options.pageSize_ = MIN_PAGE_SIZE;
+	options.pageCacheBytes_ = 8 * MIN_PAGE_SIZE;
+	options.writeAheadLog_ = true;
+	options.writeAheadLogCheckpointBytes_ = 64 * MIN_PAGE_SIZE;
+
+	runConcurrentClients(options);
+}
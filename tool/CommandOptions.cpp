@@ -30,7 +30,10 @@
 #include <kerio/hashdbHelpers/StdoutLogger.h>
 #include "utils/CommandLine.h"
 #include "Exception.h"
+#include "CompactCommand.h"
 #include "ListCommand.h"
+#include "LoadCommand.h"
+#include "RehashCommand.h"
 #include "StatsCommand.h"
 #include "CommandOptions.h"
 
@@ -46,15 +49,34 @@ namespace tool {
 		os << "Commands:" << std::endl;
 		os << "  list ......................... list entire database as JSON" << std::endl;
 		os << "  stats ........................ print database statistics" << std::endl;
+		os << "  load ......................... bulk load records of the input database to a new database" << std::endl;
+		os << "  compact ...................... compact and truncate the overflow file of the database" << std::endl;
+		os << "  rehash ....................... rewrite the database with the hash function given by --hash" << std::endl;
 		os << std::endl;
 		os << "Options:" << std::endl;
 		os << "  --db=name .................... database name (default is \"metadata\")" << std::endl;
 		os << "  --dir=directory .............. directory name" << std::endl;
+		os << "  --input=name ................. input database name for the load command" << std::endl;
+		os << "  --hash=name .................. hash function of new databases: murmur3 (default) or wyhash" << std::endl;
 		os << "  --log ........................ enable debug logging to stdout" << std::endl;
 		os << "  --quiet ...................... quiet execution of the command" << std::endl;
 		return os.str();
 	}
 
+	std::string CommandOptions::hashFunctionName(Options::HashFunction_t hashFunction)
+	{
+		switch (hashFunction) {
+		case Options::Murmur3HashFunctionType:
+			return "murmur3";
+
+		case Options::WyHashFunctionType:
+			return "wyhash";
+
+		default:
+			return "custom";
+		}
+	}
+
 	CommandOptions::CommandOptions(int argc, char** argv)
 	{
 		CommandLine arguments(argc, argv);
@@ -71,6 +93,15 @@ namespace tool {
 		else if (arguments.hasOption("stats")) {
 			command_ = newStatsCommand();
 		}
+		else if (arguments.hasOption("load")) {
+			command_ = newLoadCommand();
+		}
+		else if (arguments.hasOption("compact")) {
+			command_ = newCompactCommand();
+		}
+		else if (arguments.hasOption("rehash")) {
+			command_ = newRehashCommand();
+		}
 		else {
 			RAISE_TOOL_EXCEPTION(BadCommandOptionsReturnCode, "operation type not specified");
 		}
@@ -90,6 +121,24 @@ namespace tool {
 			databasePath_ += dir_ / "metadata";
 		}
 
+		// Input database name.
+		const boost::string_ref inputOption = arguments.optionRef("--input");
+		if (! inputOption.empty()) {
+			inputPath_ = dir_ / inputOption.to_string();
+		}
+
+		// Hash function of new databases.
+		const boost::string_ref hashOption = arguments.optionRef("--hash");
+		if (hashOption.empty() || hashOption == "murmur3") {
+			hashFunction_ = Options::Murmur3HashFunctionType;
+		}
+		else if (hashOption == "wyhash") {
+			hashFunction_ = Options::WyHashFunctionType;
+		}
+		else {
+			RAISE_TOOL_EXCEPTION(BadCommandOptionsReturnCode, "unknown hash function \"%s\"", hashOption.to_string());
+		}
+
 		log_ = arguments.hasOption("--log");
 		quiet_ = arguments.hasOption("--quiet");
 
@@ -113,22 +162,64 @@ namespace tool {
 		return db;
 	}
 
+	Database CommandOptions::openInputDatabaseReadOnly() const
+	{
+		Database db = DatabaseFactory();
+
+		if (! db->exists(inputPath_)) {
+			RAISE_TOOL_EXCEPTION(InputDatabaseMissingReturnCode, "input database \"%s\" does not exist", inputPath_.string());
+		}
+
+		Options options = Options::readOnlySingleThreaded();
+
+		if (log_) {
+			options.logger_.reset(new StdoutLogger);
+		}
+
+		db->open(inputPath_, options);
+		return db;
+	}
+
+	Database CommandOptions::openDatabaseReadWrite() const
+	{
+		Database db = DatabaseFactory();
+
+		if (! db->exists(databasePath_)) {
+			RAISE_TOOL_EXCEPTION(InputDatabaseMissingReturnCode, "database \"%s\" does not exist", databasePath_.string());
+		}
+
+		Options options = Options::readWriteSingleThreaded();
+
+		if (log_) {
+			options.logger_.reset(new StdoutLogger);
+		}
+
+		db->open(databasePath_, options);
+		return db;
+	}
+
 	Database CommandOptions::createNewDatabase(size_t preallocatedSize /* = 0 */) const
+	{
+		return createNewDatabase(databasePath_, preallocatedSize);
+	}
+
+	Database CommandOptions::createNewDatabase(const boost::filesystem::path& database, size_t preallocatedSize /* = 0 */) const
 	{
 		Database db = DatabaseFactory();
 
-		if (db->exists(databasePath_)) {
-			RAISE_TOOL_EXCEPTION(OutputDatabaseExistsReturnCode, "output database \"%s\" already exists", databasePath_.string());
+		if (db->exists(database)) {
+			RAISE_TOOL_EXCEPTION(OutputDatabaseExistsReturnCode, "output database \"%s\" already exists", database.string());
 		}
 
 		Options options = Options::readWriteSingleThreaded();
 		options.initialBuckets_ = static_cast<kerio::hashdb::size_type>(preallocatedSize / options.pageSize_  + 1);
+		options.hashFun_ = Options::builtInHashFunction(hashFunction_);
 
 		if (log_) {
 			options.logger_.reset(new StdoutLogger);
 		}
 
-		db->open(databasePath_, options);
+		db->open(database, options);
 		return db;
 	}
 
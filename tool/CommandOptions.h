@@ -34,15 +34,21 @@ namespace tool {
 
 	struct CommandOptions {
 		static std::string usage();
+		static std::string hashFunctionName(Options::HashFunction_t hashFunction);
 
 		CommandOptions(int argc, char** argv);
 		std::string list() const;
 		Database openDatabaseReadOnly() const;
+		Database openInputDatabaseReadOnly() const;
+		Database openDatabaseReadWrite() const;
 		Database createNewDatabase(size_t preallocatedSize = 0) const;
+		Database createNewDatabase(const boost::filesystem::path& database, size_t preallocatedSize = 0) const;
 		Command command_;
 	
 		boost::filesystem::path databasePath_;	// --db=str
 		boost::filesystem::path dir_;			// --dir=directory
+		boost::filesystem::path inputPath_;		// --input=str
+		Options::HashFunction_t hashFunction_;	// --hash=name
 		bool log_;						// --log
 
 		bool quiet_;					// --quiet
@@ -0,0 +1,78 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+#include "stdafx.h"
+#include <iostream>
+#include <kerio/hashdb/HashDB.h>
+#include <kerio/hashdb/Exception.h>
+#include "utils/ExceptionCreator.h"
+#include "CommandOptions.h"
+#include "CompactCommand.h"
+
+namespace kerio {
+namespace hashdb {
+namespace tool {
+
+	class CompactCommand : public ICommand {
+	public:
+		virtual std::string name()
+		{
+			return "compact";
+		}
+
+		virtual bool isReadOnly()
+		{
+			return false;
+		}
+
+		virtual void run(const CommandOptions& options)
+		{
+			Database db = options.openDatabaseReadWrite();
+			const size_type pagesBefore = db->statistics().overflowFileDataPages_;
+
+			// The tool has the database for itself, so a single call compacts it entirely.
+			db->compact(0);
+
+			const Statistics stats = db->statistics();
+			db->close();
+
+			if (! options.quiet_) {
+				std::cout << "Overflow file data pages: " << pagesBefore << " before, " << stats.overflowFileDataPages_ << " after compaction" << std::endl;
+				std::cout << "Overflow pages relocated: " << stats.overflowPagesRelocated_ << std::endl;
+			}
+		}
+	};
+
+
+	Command newCompactCommand()
+	{
+		Command newInstance(new CompactCommand());
+		return newInstance;
+	}
+
+}; // namespace tool
+}; // namespace hashdb
+}; // namespace kerio
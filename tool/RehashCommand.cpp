@@ -0,0 +1,130 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+#include "stdafx.h"
+#include <iostream>
+#include <kerio/hashdb/HashDB.h>
+#include <kerio/hashdb/Exception.h>
+#include "utils/ExceptionCreator.h"
+#include "Exception.h"
+#include "CommandOptions.h"
+#include "RehashCommand.h"
+
+namespace kerio {
+namespace hashdb {
+namespace tool {
+
+	class RehashCommand : public ICommand {
+	public:
+		virtual std::string name()
+		{
+			return "rehash";
+		}
+
+		virtual bool isReadOnly()
+		{
+			return false;
+		}
+
+		virtual void run(const CommandOptions& options)
+		{
+			Database input = options.openDatabaseReadOnly();
+			const uint64_t expectedNumberOfRecords = input->statistics().numberOfRecords_;
+
+			// Records are bulk loaded to a new database created with the requested hash function, which then replaces the original.
+			boost::filesystem::path rehashedPath(options.databasePath_);
+			rehashedPath += ".rehash";
+
+			Database output = options.createNewDatabase(rehashedPath);
+			BulkLoader loader = output->newBulkLoader(expectedNumberOfRecords);
+			uint64_t rehashedRecords = 0;
+
+			for (Iterator iterator = input->newIterator(); iterator->isValid(); iterator->next()) {
+				loader->add(iterator->key(), iterator->partNum(), iterator->value());
+				++rehashedRecords;
+			}
+
+			loader->finish();
+			output->close();
+			input->close();
+
+			// The original is kept under a backup name until the rehashed database is in place.
+			boost::filesystem::path backupPath(options.databasePath_);
+			backupPath += ".original";
+
+			if (! input->rename(options.databasePath_, backupPath)) {
+				RAISE_TOOL_EXCEPTION(GenericErrorReturnCode, "database \"%s\" cannot be renamed to \"%s\"", options.databasePath_.string(), backupPath.string());
+			}
+
+			bool replaced = false;
+
+			try {
+				replaced = input->rename(rehashedPath, options.databasePath_);
+			}
+			catch (std::exception&) {
+				restoreOriginal(input, backupPath, options.databasePath_);
+				throw;
+			}
+
+			if (! replaced) {
+				restoreOriginal(input, backupPath, options.databasePath_);
+				RAISE_TOOL_EXCEPTION(GenericErrorReturnCode, "database \"%s\" cannot be replaced by \"%s\"", options.databasePath_.string(), rehashedPath.string());
+			}
+
+			input->drop(backupPath);
+
+			if (! options.quiet_) {
+				std::cout << "Rehashed " << rehashedRecords << " records with hash function " << CommandOptions::hashFunctionName(options.hashFunction_) << std::endl;
+			}
+		}
+
+	private:
+		static void restoreOriginal(Database& input, const boost::filesystem::path& backupPath, const boost::filesystem::path& databasePath)
+		{
+			// Files of a partially renamed rehashed database would prevent the original from being renamed back.
+			// They are left in place then, and the original stays under the backup name.
+			try {
+				if (input->rename(backupPath, databasePath)) {
+					return;
+				}
+			}
+			catch (std::exception&) {
+			}
+
+			std::cerr << "hashdbTool: original database was left as \"" << backupPath.string() << "\"" << std::endl;
+		}
+	};
+
+
+	Command newRehashCommand()
+	{
+		Command newInstance(new RehashCommand());
+		return newInstance;
+	}
+
+}; // namespace tool
+}; // namespace hashdb
+}; // namespace kerio
@@ -64,5 +64,10 @@ namespace hashdb {
 		return 16 * 1024; // 16 KB.
 	}
 
+	kerio::hashdb::size_type defaultPageCacheBytes()
+	{
+		return 64 * 1024; // 64 KB.
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
@@ -38,6 +38,7 @@ namespace hashdb {
 	bool isValidPageSize(size_type pageSize);
 
 	size_type defaultCacheBytes();
+	size_type defaultPageCacheBytes();
 
 }; // namespace hashdb
 }; // namespace kerio
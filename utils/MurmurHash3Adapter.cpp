@@ -27,9 +27,22 @@
 
 // MurmurHash3Adapter.cpp - allows to pass MurmurHash3 to Options.
 #include "stdafx.h"
+#include <algorithm>
+#include <cstring>
 #include "MurmurHash3.h"
 #include "MurmurHash3Adapter.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HASHDB_AVX2_MURMUR3
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#define HASHDB_SSE2_MURMUR3
+#endif
+
 namespace kerio {
 namespace hashdb {
 
@@ -41,5 +54,163 @@ namespace hashdb {
 		return rv;
 	}
 
+#if defined(HASHDB_AVX2_MURMUR3) || defined(HASHDB_SSE2_MURMUR3)
+
+	namespace {
+
+		const uint32_t C1 = 0xcc9e2d51;
+		const uint32_t C2 = 0x1b873593;
+
+		// Returns the tail bytes of the key mixed the same way as MurmurHash3_x86_32 does.
+		// Zero tail leaves the hash unchanged, so keys without a tail need no special handling.
+		uint32_t tailOf(const boost::string_ref& key)
+		{
+			const uint8_t* tail = reinterpret_cast<const uint8_t*>(key.data()) + (key.size() & ~static_cast<size_t>(3));
+			const size_t tailSize = key.size() & 3;
+			uint32_t k1 = 0;
+
+			if (tailSize >= 3) {
+				k1 ^= tail[2] << 16;
+			}
+
+			if (tailSize >= 2) {
+				k1 ^= tail[1] << 8;
+			}
+
+			if (tailSize >= 1) {
+				k1 ^= tail[0];
+			}
+
+			return k1;
+		}
+
+		uint32_t blockOf(const boost::string_ref& key, size_t blockIndex)
+		{
+			uint32_t block;
+			memcpy(&block, key.data() + blockIndex * 4, sizeof(block));
+			return block;
+		}
+
+#if defined(HASHDB_AVX2_MURMUR3)
+
+		struct Lanes {
+			typedef __m256i vector_t;
+			static const size_t WIDTH = 8;
+
+			static vector_t load(const uint32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+			static void store(uint32_t* p, vector_t v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+			static vector_t set1(uint32_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+			static vector_t mul(vector_t a, vector_t b) { return _mm256_mullo_epi32(a, b); }
+			static vector_t add(vector_t a, vector_t b) { return _mm256_add_epi32(a, b); }
+			static vector_t xor_(vector_t a, vector_t b) { return _mm256_xor_si256(a, b); }
+			static vector_t greater(vector_t a, vector_t b) { return _mm256_cmpgt_epi32(a, b); }
+			static vector_t select(vector_t mask, vector_t a, vector_t b) { return _mm256_blendv_epi8(b, a, mask); }
+			template <int N> static vector_t rotl(vector_t v) { return _mm256_or_si256(_mm256_slli_epi32(v, N), _mm256_srli_epi32(v, 32 - N)); }
+			template <int N> static vector_t shiftRight(vector_t v) { return _mm256_srli_epi32(v, N); }
+		};
+
+#elif defined(HASHDB_SSE2_MURMUR3)
+
+		struct Lanes {
+			typedef __m128i vector_t;
+			static const size_t WIDTH = 4;
+
+			static vector_t load(const uint32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+			static void store(uint32_t* p, vector_t v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+			static vector_t set1(uint32_t x) { return _mm_set1_epi32(static_cast<int>(x)); }
+			static vector_t add(vector_t a, vector_t b) { return _mm_add_epi32(a, b); }
+			static vector_t xor_(vector_t a, vector_t b) { return _mm_xor_si128(a, b); }
+			static vector_t greater(vector_t a, vector_t b) { return _mm_cmpgt_epi32(a, b); }
+			static vector_t select(vector_t mask, vector_t a, vector_t b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+			template <int N> static vector_t rotl(vector_t v) { return _mm_or_si128(_mm_slli_epi32(v, N), _mm_srli_epi32(v, 32 - N)); }
+			template <int N> static vector_t shiftRight(vector_t v) { return _mm_srli_epi32(v, N); }
+
+			static vector_t mul(vector_t a, vector_t b)
+			{
+#if defined(__SSE4_1__)
+				return _mm_mullo_epi32(a, b);
+#else
+				// SSE2 only multiplies the even lanes, so the odd lanes are shifted down and multiplied separately.
+				const __m128i even = _mm_mul_epu32(a, b);
+				const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+				return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+			}
+		};
+
+#endif
+
+		Lanes::vector_t mixBlock(Lanes::vector_t k1)
+		{
+			k1 = Lanes::mul(k1, Lanes::set1(C1));
+			k1 = Lanes::rotl<15>(k1);
+			return Lanes::mul(k1, Lanes::set1(C2));
+		}
+
+		// Hashes Lanes::WIDTH keys, one key per lane. Lanes of shorter keys are masked off once their blocks run out.
+		void hashLanes(const boost::string_ref* keys, uint32_t* hashes)
+		{
+			uint32_t numberOfBlocks[Lanes::WIDTH];
+			uint32_t lengths[Lanes::WIDTH];
+			uint32_t scratch[Lanes::WIDTH];
+			size_t maxBlocks = 0;
+
+			for (size_t j = 0; j < Lanes::WIDTH; ++j) {
+				lengths[j] = static_cast<uint32_t>(keys[j].size());
+				numberOfBlocks[j] = lengths[j] / 4;
+				maxBlocks = std::max(maxBlocks, static_cast<size_t>(numberOfBlocks[j]));
+			}
+
+			const Lanes::vector_t blocks = Lanes::load(numberOfBlocks);
+			Lanes::vector_t h1 = Lanes::set1(0);
+
+			for (size_t i = 0; i < maxBlocks; ++i) {
+				for (size_t j = 0; j < Lanes::WIDTH; ++j) {
+					scratch[j] = (i < numberOfBlocks[j])? blockOf(keys[j], i) : 0;
+				}
+
+				Lanes::vector_t mixed = Lanes::xor_(h1, mixBlock(Lanes::load(scratch)));
+				mixed = Lanes::rotl<13>(mixed);
+				mixed = Lanes::add(Lanes::mul(mixed, Lanes::set1(5)), Lanes::set1(0xe6546b64));
+
+				const Lanes::vector_t active = Lanes::greater(blocks, Lanes::set1(static_cast<uint32_t>(i)));
+				h1 = Lanes::select(active, mixed, h1);
+			}
+
+			for (size_t j = 0; j < Lanes::WIDTH; ++j) {
+				scratch[j] = tailOf(keys[j]);
+			}
+
+			h1 = Lanes::xor_(h1, mixBlock(Lanes::load(scratch)));
+			h1 = Lanes::xor_(h1, Lanes::load(lengths));
+
+			h1 = Lanes::xor_(h1, Lanes::shiftRight<16>(h1));
+			h1 = Lanes::mul(h1, Lanes::set1(0x85ebca6b));
+			h1 = Lanes::xor_(h1, Lanes::shiftRight<13>(h1));
+			h1 = Lanes::mul(h1, Lanes::set1(0xc2b2ae35));
+			h1 = Lanes::xor_(h1, Lanes::shiftRight<16>(h1));
+
+			Lanes::store(hashes, h1);
+		}
+
+	} // anonymous namespace
+
+#endif
+
+	void murmur3HashMany(const boost::string_ref* keys, size_t count, uint32_t* hashes)
+	{
+		size_t i = 0;
+
+#if defined(HASHDB_AVX2_MURMUR3) || defined(HASHDB_SSE2_MURMUR3)
+		for (; i + Lanes::WIDTH <= count; i += Lanes::WIDTH) {
+			hashLanes(keys + i, hashes + i);
+		}
+#endif
+
+		for (; i < count; ++i) {
+			hashes[i] = murmur3Hash(keys[i].data(), keys[i].size());
+		}
+	}
+
 }; // namespace hashdb
 }; // namespace kerio
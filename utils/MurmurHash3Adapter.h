@@ -26,10 +26,17 @@
  */
 
 // MurmurHash3Adapter.h - allows to pass MurmurHash3 to Options.
+#pragma once
+#include <boost/utility/string_ref.hpp>
+
 namespace kerio {
 namespace hashdb {
 
 	uint32_t murmur3Hash(const char* key, size_t len);
 
+	// Hashes several keys at once, several lanes in parallel if the target supports it.
+	// Results are bit-identical to murmur3Hash().
+	void murmur3HashMany(const boost::string_ref* keys, size_t count, uint32_t* hashes);
+
 }; // namespace hashdb
 }; // namespace kerio
@@ -0,0 +1,156 @@
+/* Copyright (c) 2015 Kerio Technologies s.r.o.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR HOLDERS INCLUDED IN THIS NOTICE BE
+ * LIABLE FOR ANY CLAIM, OR ANY SPECIAL INDIRECT OR CONSEQUENTIAL DAMAGES, OR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other
+ * dealings in this Software without prior written authorization of the
+ * copyright holder.
+ */
+
+// WyHash.cpp - wyhash function with the signature of Options::hashFun_t.
+#include "stdafx.h"
+#include <cstring>
+#include "WyHash.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+namespace kerio {
+namespace hashdb {
+
+	namespace {
+
+		const uint64_t SECRET[4] = { 0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL };
+
+		// Computes the 128-bit product of a and b, returns the low half in a and the high half in b.
+		inline void multiply(uint64_t& a, uint64_t& b)
+		{
+#if defined(__SIZEOF_INT128__)
+			const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+			a = static_cast<uint64_t>(product);
+			b = static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+			a = _umul128(a, b, &b);
+#else
+			const uint64_t ha = a >> 32;
+			const uint64_t hb = b >> 32;
+			const uint64_t la = static_cast<uint32_t>(a);
+			const uint64_t lb = static_cast<uint32_t>(b);
+			const uint64_t rh = ha * hb;
+			const uint64_t rm0 = ha * lb;
+			const uint64_t rm1 = hb * la;
+			const uint64_t rl = la * lb;
+			const uint64_t t = rl + (rm0 << 32);
+			uint64_t carry = (t < rl)? 1 : 0;
+			const uint64_t lo = t + (rm1 << 32);
+			carry += (lo < t)? 1 : 0;
+			a = lo;
+			b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+		}
+
+		inline uint64_t mix(uint64_t a, uint64_t b)
+		{
+			multiply(a, b);
+			return a ^ b;
+		}
+
+		inline uint64_t read64(const uint8_t* p)
+		{
+			uint64_t v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		inline uint64_t read32(const uint8_t* p)
+		{
+			uint32_t v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		inline uint64_t read3(const uint8_t* p, size_t len)
+		{
+			return (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+		}
+
+	} // anonymous namespace
+
+	uint32_t wyHash(const char* key, size_t len)
+	{
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(key);
+		uint64_t seed = mix(SECRET[0], SECRET[1]);
+		uint64_t a;
+		uint64_t b;
+
+		if (len <= 16) {
+			if (len >= 4) {
+				a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+				b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+			}
+			else if (len > 0) {
+				a = read3(p, len);
+				b = 0;
+			}
+			else {
+				a = b = 0;
+			}
+		}
+		else {
+			size_t i = len;
+
+			if (i > 48) {
+				uint64_t see1 = seed;
+				uint64_t see2 = seed;
+
+				do {
+					seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+					see1 = mix(read64(p + 16) ^ SECRET[2], read64(p + 24) ^ see1);
+					see2 = mix(read64(p + 32) ^ SECRET[3], read64(p + 40) ^ see2);
+					p += 48;
+					i -= 48;
+				} while (i > 48);
+
+				seed ^= see1 ^ see2;
+			}
+
+			while (i > 16) {
+				seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+				i -= 16;
+				p += 16;
+			}
+
+			a = read64(p + i - 16);
+			b = read64(p + i - 8);
+		}
+
+		a ^= SECRET[1];
+		b ^= seed;
+		multiply(a, b);
+
+		const uint64_t hash = mix(a ^ SECRET[0] ^ len, b ^ SECRET[1]);
+		return static_cast<uint32_t>(hash ^ (hash >> 32));
+	}
+
+}; // namespace hashdb
+}; // namespace kerio